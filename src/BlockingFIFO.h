@@ -0,0 +1,271 @@
+/**
+ * BlockingFIFO.h - this file defines a blocking layer over any of the FIFO
+ *                  queues in DKit. It adds pop_wait() and push_wait(), with
+ *                  an optional timeout, that wait on an empty, or full, queue
+ *                  with the strategy given in the template: spin_wait for the
+ *                  lowest latency at the cost of a core, yield_wait to spin
+ *                  a bit and then give up the CPU, or park_wait to spin a bit
+ *                  and then sleep on a futex until the other side wakes us.
+ *
+ *                  The queue is given to the constructor, and is NOT owned by
+ *                  this class - it has to outlive it. For the waiters to be
+ *                  woken up, ALL the pushes and pops need to go through this
+ *                  class, and not to the queue directly. The thread-safety is
+ *                  that of the queue being wrapped - a BlockingFIFO over an
+ *                  spsc::CircularFIFO is still single-producer, single-consumer.
+ */
+#ifndef __DKIT_BLOCKINGFIFO_H
+#define __DKIT_BLOCKINGFIFO_H
+
+// System Headers
+#include <stdint.h>
+#include <stdexcept>
+#include <utility>
+
+// Third-Party Headers
+
+// Other Headers
+#include "FIFO.h"
+#include "util/timer.h"
+#include "util/waiter.h"
+
+// Forward Declarations
+
+// Public Constants
+
+// Public Datatypes
+
+// Public Data Constants
+
+
+namespace dkit {
+/**
+ * This is the main class definition
+ */
+template <class T, wait_type W = park_wait> class BlockingFIFO :
+	public FIFO<T>
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the only useful constructor - it takes the queue that
+		 * we're going to be waiting on. It's not owned by us, and so it's
+		 * not going to be deleted when we are.
+		 */
+		explicit BlockingFIFO( FIFO<T> *aQueue ) :
+			FIFO<T>(),
+			_queue(aQueue),
+			_notEmpty(),
+			_notFull()
+		{
+			if (_queue == NULL) {
+				throw std::runtime_error("[BlockingFIFO] Unable to wait on a NULL queue!");
+			}
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called.
+		 */
+		virtual ~BlockingFIFO()
+		{
+			// the queue isn't ours, so there's nothing to do
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the queue that we're waiting on.
+		 */
+		FIFO<T> *queue() const
+		{
+			return _queue;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes an item and places it in the queue - waiting
+		 * for room if the queue is full. The timeout is in usec, and if
+		 * it's negative, we'll wait forever. If there's no room by the end
+		 * of the timeout, this returns 'false', otherwise it returns 'true'.
+		 */
+		bool push_wait( const T & anElem, int64_t aTimeout = -1 )
+		{
+			return transfer(false, const_cast<T &>(anElem), aTimeout);
+		}
+
+
+		/**
+		 * This method updates the passed-in reference with the value on the
+		 * top of the queue - waiting for something to arrive if the queue
+		 * is empty. The timeout is in usec, and if it's negative, we'll wait
+		 * forever. If nothing arrives by the end of the timeout, this will
+		 * return 'false' and the value will be untouched.
+		 */
+		bool pop_wait( T & anElem, int64_t aTimeout = -1 )
+		{
+			return transfer(true, anElem, aTimeout);
+		}
+
+
+		/**
+		 * These are the non-blocking methods of the FIFO, and they are
+		 * passed right on to the queue - but a successful push(), or pop(),
+		 * will still wake anyone waiting on the other side.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			if (_queue->push(anElem)) {
+				_notEmpty.wake();
+				return true;
+			}
+			return false;
+		}
+
+
+		virtual bool push( T && anElem )
+		{
+			if (_queue->push(std::move(anElem))) {
+				_notEmpty.wake();
+				return true;
+			}
+			return false;
+		}
+
+
+		virtual bool pop( T & anElem )
+		{
+			if (_queue->pop(anElem)) {
+				_notFull.wake();
+				return true;
+			}
+			return false;
+		}
+
+
+		virtual T pop()
+		{
+			// the queue throws if it's empty, and then there's no one to wake
+			T		v(_queue->pop());
+			_notFull.wake();
+			return v;
+		}
+
+
+		virtual bool peek( T & anElem )
+		{
+			return _queue->peek(anElem);
+		}
+
+
+		virtual T peek()
+		{
+			return _queue->peek();
+		}
+
+
+		virtual void clear()
+		{
+			_queue->clear();
+			_notFull.wake();
+		}
+
+
+		virtual bool empty()
+		{
+			return _queue->empty();
+		}
+
+
+		virtual size_t size() const
+		{
+			return _queue->size();
+		}
+
+
+	private:
+		/**
+		 * There's no sense in copying these - the waiters are tied to the
+		 * threads using this instance, and the queue isn't ours to copy.
+		 */
+		BlockingFIFO( const BlockingFIFO<T, W> & anOther );
+		BlockingFIFO & operator=( const BlockingFIFO<T, W> & anOther );
+
+		/**
+		 * This method tries to pop() into, or push() from, the argument
+		 * once, and if it works, wakes anyone waiting on the other side.
+		 */
+		bool attempt( bool isPop, T & anElem )
+		{
+			return (isPop ? pop(anElem) : push(anElem));
+		}
+
+		/**
+		 * This is the waiting loop for both push_wait() and pop_wait().
+		 * We spin for a bit, and then yield, or park, as the strategy says,
+		 * trying again each time until it works, or the timeout passes.
+		 * The clock is only read once we can't get it right away, so the
+		 * fast path doesn't pay for it.
+		 */
+		bool transfer( bool isPop, T & anElem, int64_t aTimeout )
+		{
+			util::waiter<W>	&me = (isPop ? _notEmpty : _notFull);
+			uint64_t		deadline = 0;
+			uint32_t		spins = 0;
+			while (true) {
+				if (attempt(isPop, anElem)) {
+					return true;
+				}
+				// see if we're out of time - or just getting started
+				if (aTimeout >= 0) {
+					uint64_t	now = util::timer::usecStamp();
+					if (deadline == 0) {
+						deadline = now + aTimeout;
+					}
+					if (now >= deadline) {
+						return false;
+					}
+				}
+				// now wait the way we've been asked to
+				if (!me.spin(spins)) {
+					if (W == park_wait) {
+						int32_t		epoch = me.enlist();
+						bool		done = attempt(isPop, anElem);
+						if (!done) {
+							me.park(epoch, deadline);
+						}
+						me.delist();
+						if (done) {
+							return true;
+						}
+					} else {
+						me.yield();
+					}
+				}
+			}
+		}
+
+		// this is the queue we're waiting on - it's not ours
+		FIFO<T>				*_queue;
+		// the consumers wait on this one, and the producers on the other
+		util::waiter<W>		_notEmpty;
+		util::waiter<W>		_notFull;
+};
+}		// end of namespace dkit
+
+#endif	// __DKIT_BLOCKINGFIFO_H
@@ -9,6 +9,7 @@
 #define __DKIT_FIFO_H
 
 // System Headers
+#include <utility>
 
 // Third-Party Headers
 
@@ -90,11 +91,30 @@ template <class T> class FIFO
 		 * If so, then it will return 'true', otherwise, it'll return 'false'.
 		 */
 		virtual bool push( const T & anElem ) = 0;
+		/**
+		 * This form of push() takes an element that can be moved into the
+		 * queue, rather than copied. For those queues that can't do any
+		 * better, this will just copy it in with the other push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return push(static_cast<const T &>(anElem));
+		}
+		/**
+		 * This method builds a T from the arguments and places it in the
+		 * queue - if it can. The queues that can, build it right in the
+		 * queue, but for the others, this builds one and moves it in.
+		 */
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			return push(T(std::forward<Args>(args)...));
+		}
 		/**
 		 * This method updates the passed-in reference with the value on the
 		 * top of the queue - if it can. If so, it'll return the value and
 		 * 'true', but if it can't, as in the queue is empty, then the method
-		 * will return 'false' and the value will be untouched.
+		 * will return 'false' and the value will be untouched. The value is
+		 * moved out of the queue, and not copied.
 		 */
 		virtual bool pop( T & anElem ) = 0;
 		/**
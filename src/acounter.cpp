@@ -0,0 +1,147 @@
+/**
+ * acounter.cpp - this file implements the atomic, sharded, counter - all
+ *                but the adding, which is inline in the header, as that's
+ *                what's done on the hot path.
+ */
+
+//	System Headers
+#include <string.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "acounter.h"
+
+//	Forward Declarations
+
+//	Private Constants
+
+//	Private Datatypes
+
+//	Private Data Constants
+
+
+/********************************************************
+ *
+ *                Constructors/Destructor
+ *
+ ********************************************************/
+/**
+ * This is the default constructor that sets up the value of
+ * zero (0) in the counter.
+ */
+acounter::acounter()
+{
+	memset(_cells, 0, sizeof(_cells));
+}
+
+
+/**
+ * This constructor takes a traditional int64_t and creates a new
+ * counter starting at this value.
+ */
+acounter::acounter( int64_t aValue )
+{
+	memset(_cells, 0, sizeof(_cells));
+	_cells[0].value = aValue;
+}
+
+
+/**
+ * This is the standard copy constructor and needs to be in every
+ * class to make sure that we don't have too many things running
+ * around.
+ */
+acounter::acounter( const acounter & anOther )
+{
+	memset(_cells, 0, sizeof(_cells));
+	_cells[0].value = anOther.getValue();
+}
+
+
+/**
+ * This is the standard destructor and needs to be virtual to make
+ * sure that if we subclass off this the right destructor will be
+ * called.
+ */
+acounter::~acounter()
+{
+}
+
+
+/**
+ * When we want to process the result of an equality we need to
+ * make sure that we do this right by always having an equals
+ * operator on all classes.
+ */
+acounter & acounter::operator=( const acounter & anOther )
+{
+	if (this != & anOther) {
+		setValue(anOther.getValue());
+	}
+	return *this;
+}
+
+
+acounter & acounter::operator=( int64_t aValue )
+{
+	setValue(aValue);
+	return *this;
+}
+
+
+/********************************************************
+ *
+ *                Accessor Methods
+ *
+ ********************************************************/
+/**
+ * This method returns the total of all the cells at the time of
+ * the call.
+ */
+int64_t acounter::getValue() const
+{
+	int64_t		total = 0;
+	for (uint32_t i = 0; i < eCells; ++i) {
+		total += __atomic_load_n(&_cells[i].value, __ATOMIC_RELAXED);
+	}
+	return total;
+}
+
+
+/**
+ * This method puts the whole value in the first cell, and clears the
+ * rest - so it's only right if no one is adding to it at the time.
+ */
+void acounter::setValue( int64_t aValue )
+{
+	for (uint32_t i = 1; i < eCells; ++i) {
+		__atomic_store_n(&_cells[i].value, 0, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&_cells[0].value, aValue, __ATOMIC_RELAXED);
+}
+
+
+/********************************************************
+ *
+ *             Useful Operator Methods
+ *
+ ********************************************************/
+/**
+ * This casting operator adds up the counter into a simple int64_t.
+ */
+acounter::operator int64_t() const
+{
+	return getValue();
+}
+
+
+/**
+ * For debugging purposes, let's make it easy for the user to stream
+ * out this value.
+ */
+std::ostream & operator<<( std::ostream & aStream, const acounter & aValue )
+{
+	aStream << aValue.getValue();
+	return aStream;
+}
@@ -0,0 +1,195 @@
+/**
+ * acounter.h - this file defines the atomic, sharded, counter - a signed
+ *              64-bit count that many threads can add to at the same time
+ *              without all of them fighting over the one cache line that an
+ *              aint64_t would be on. The count is spread over a number of
+ *              cells, each on its own cache line, and each thread adds to
+ *              the cell it's been given. Reading it adds up all the cells,
+ *              so it's a lot more work than reading an aint64_t - this is
+ *              for counts that are changed all the time, and only looked at
+ *              now and then.
+ */
+#ifndef __DKIT_ACOUNTER_H
+#define __DKIT_ACOUNTER_H
+
+//	System Headers
+#include <stdint.h>
+#include <ostream>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "util/padding.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+/**
+ * This is the main class definition.
+ */
+class acounter
+{
+	public:
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This is the default constructor that sets up the value of
+		 * zero (0) in the counter.
+		 */
+		acounter();
+		/**
+		 * This constructor takes a traditional int64_t and creates a new
+		 * counter starting at this value.
+		 */
+		acounter( int64_t aValue );
+		/**
+		 * This is the standard copy constructor and needs to be in every
+		 * class to make sure that we don't have too many things running
+		 * around. The copy starts at the total of the original.
+		 */
+		acounter( const acounter & anOther );
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called.
+		 */
+		virtual ~acounter();
+
+		/**
+		 * When we want to process the result of an equality we need to
+		 * make sure that we do this right by always having an equals
+		 * operator on all classes.
+		 */
+		acounter & operator=( const acounter & anOther );
+		acounter & operator=( int64_t aValue );
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns the total of all the cells at the time of
+		 * the call. Each cell is read atomically, but not all at once, so
+		 * with threads adding to it, it's a snapshot of a moving target -
+		 * though one that's always been right at some point while it
+		 * was being read, if all the adds are of one sign.
+		 */
+		int64_t getValue() const;
+		/**
+		 * This method sets the total to 'aValue'. It's not atomic with
+		 * respect to the threads that are adding to the counter, so it's
+		 * for setting it up, or resetting it when it's quiet.
+		 */
+		void setValue( int64_t aValue );
+
+		/********************************************************
+		 *
+		 *             Useful Operator Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This casting operator adds up the counter into a simple int64_t
+		 * - with the same cost, and caveats, as getValue().
+		 */
+		operator int64_t() const;
+
+		/**
+		 * This is the heart of the counter - an atomic add to the cell for
+		 * the calling thread. It's inline, and relaxed, as nothing else
+		 * is ordered by it - it's just a count.
+		 */
+		void add( int64_t aDelta )
+		{
+			__atomic_fetch_add(&_cells[shard()].value, aDelta, __ATOMIC_RELAXED);
+		}
+
+		/**
+		 * These are the prefix increment and decrement operators, and the
+		 * compound assignments. There are no postfix versions, as there's
+		 * no one value to return from before the change - that would be
+		 * adding up all the cells on every one.
+		 */
+		acounter & operator++()
+		{
+			add(1);
+			return *this;
+		}
+
+		acounter & operator--()
+		{
+			add(-1);
+			return *this;
+		}
+
+		acounter & operator+=( int64_t aValue )
+		{
+			add(aValue);
+			return *this;
+		}
+
+		acounter & operator-=( int64_t aValue )
+		{
+			add(-aValue);
+			return *this;
+		}
+
+	private:
+		/**
+		 * There are this many cells, and a thread is given the next one
+		 * in turn the first time it adds to any counter - so up to this
+		 * many threads never share one.
+		 */
+		enum {
+			eCells = 16,
+			eCellMask = (eCells - 1)
+		};
+
+		/**
+		 * Each cell is a whole cache line, so that no two threads adding
+		 * to their own cells ever write to the same line.
+		 */
+		struct Cell {
+			int64_t		value;
+			char		pad[dkit::util::cache_line_size - sizeof(int64_t)];
+		};
+
+		/**
+		 * This method returns the cell for the calling thread - handed
+		 * out round-robin, and remembered in a thread-local, so it's
+		 * the same cell in every counter.
+		 */
+		static uint32_t shard()
+		{
+			static uint32_t				__next = 0;
+			static __thread uint32_t	__mine = 0;
+			if (__mine == 0) {
+				__mine = (__sync_fetch_and_add(&__next, 1) & eCellMask) + 1;
+			}
+			return __mine - 1;
+		}
+
+		/**
+		 * The cells start on a line of their own, so that nothing before
+		 * the counter shares a line with the first of them.
+		 */
+		char					_pad0[dkit::util::cache_line_size];
+		Cell					_cells[eCells];
+};
+
+/**
+ * For debugging purposes, let's make it easy for the user to stream
+ * out this value. It's the total of the cells at the time.
+ */
+std::ostream & operator<<( std::ostream & aStream, const acounter & aValue );
+
+#endif		// __DKIT_ACOUNTER_H
@@ -20,6 +20,7 @@
 #include "aint16.h"
 #include "aint32.h"
 #include "aint64.h"
+#include "acounter.h"
 
 //	Forward Declarations
 
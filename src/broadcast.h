@@ -0,0 +1,500 @@
+/**
+ * broadcast.h - this file defines a single-producer broadcast ring in the
+ *               style of the Disruptor. The producer puts each item in the
+ *               ring ONCE, and every registered sink sees every item - each
+ *               on its own thread, with its own cursor into the ring. The
+ *               producer only waits when the ring is full, and then only on
+ *               the slowest of the cursors, so one slow sink no longer holds
+ *               up the rest, and never holds up the producer until it's a
+ *               whole ring behind. It's an adapter - a sink for the sources
+ *               that feed it, and a source for the sinks that listen to it -
+ *               so it can be dropped in between a receiver and its sinks.
+ */
+#ifndef __DKIT_BROADCAST_H
+#define __DKIT_BROADCAST_H
+
+//	System Headers
+#include <stdint.h>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+#include <boost/smart_ptr/detail/spinlock.hpp>
+
+//	Other Headers
+#include "adapter.h"
+#include "util/padding.h"
+#include "util/waiter.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+/**
+ * This is how an item is held in the ring. For a value, the slot is just
+ * a copy of it, and each sink gets it from there. For a pointer - like the
+ * datagrams the receivers send out, and then recycle as soon as send()
+ * returns - the slot holds a copy of what it points to, and each sink gets
+ * a pointer to the slot. Either way, there's one copy into the ring, and
+ * none for each sink. A NULL pointer has nothing to copy, and no slot can
+ * stand for it, so it's turned away before it gets to the ring.
+ */
+template <class T> struct broadcast_item
+{
+	typedef T	value_t;
+
+	static bool missing( const T & anItem )
+	{
+		return false;
+	}
+
+	static void put( value_t & aSlot, const T & anItem )
+	{
+		aSlot = anItem;
+	}
+
+	static T get( value_t & aSlot )
+	{
+		return aSlot;
+	}
+};
+
+template <class U> struct broadcast_item<U *>
+{
+	typedef U	value_t;
+
+	static bool missing( U * const & anItem )
+	{
+		return (anItem == NULL);
+	}
+
+	static void put( value_t & aSlot, U * const & anItem )
+	{
+		aSlot = *anItem;
+	}
+
+	static U *get( value_t & aSlot )
+	{
+		return &aSlot;
+	}
+};
+
+
+/**
+ * This is the main class definition. The ring holds 2^N items, and W is
+ * how the producer waits for room, and the sinks' threads wait for items.
+ */
+template <class T, uint8_t N = 10, wait_type W = yield_wait> class broadcast :
+	public adapter<T, T>
+{
+	public:
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This is the default constructor that makes the ring, with no
+		 * sinks listening to it, and nothing published.
+		 */
+		broadcast() :
+			adapter<T, T>(),
+			_published(0),
+			_next(1),
+			_gate(0),
+			_slots(new value_t[eSize]),
+			_count(0),
+			_subsMutex(),
+			_data(),
+			_space()
+		{
+			for (uint32_t i = 0; i < eMaxSinks; ++i) {
+				_subs[i] = NULL;
+			}
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called. All the sinks' threads are stopped before anything goes -
+		 * even one that removed itself, and is still on its way out.
+		 */
+		virtual ~broadcast()
+		{
+			removeAllListeners();
+			for (uint32_t i = 0; i < eMaxSinks; ++i) {
+				if (_subs[i] != NULL) {
+					while (__atomic_load_n(&_subs[i]->target, __ATOMIC_ACQUIRE) != NULL) {
+						boost::this_thread::yield();
+					}
+					delete _subs[i];
+					_subs[i] = NULL;
+				}
+			}
+			if (_slots != NULL) {
+				delete [] _slots;
+				_slots = NULL;
+			}
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method adds the sink as a listener, just like any source,
+		 * and then starts its thread, with its cursor at the end of the
+		 * ring - it'll see everything published from now on. There's room
+		 * for 'eMaxSinks' of them, and if they're all in use, this returns
+		 * 'false'.
+		 *
+		 * The producer doesn't take the lock, so it may be publishing all
+		 * the while. The cursor is set once, and then again from what's
+		 * published after that's seen - so any gate the producer worked
+		 * out without this cursor is no further on than where it starts.
+		 */
+		virtual bool addToListeners( sink<T> *aSink )
+		{
+			boost::detail::spinlock::scoped_lock	lock(_subsMutex);
+			Subscriber	*sub = NULL;
+			for (uint32_t i = 0; (sub == NULL) && (i < eMaxSinks); ++i) {
+				if (_subs[i] == NULL) {
+					_subs[i] = new Subscriber();
+				}
+				if (__atomic_load_n(&_subs[i]->target, __ATOMIC_ACQUIRE) == NULL) {
+					sub = _subs[i];
+					if (i >= _count) {
+						__atomic_store_n(&_count, i + 1, __ATOMIC_RELEASE);
+					}
+				}
+			}
+			if ((sub == NULL) || !adapter<T, T>::addToListeners(aSink)) {
+				return false;
+			}
+			sub->target = aSink;
+			sub->stop = false;
+			__atomic_store_n(&sub->cursor, __atomic_load_n(&_published, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+			__atomic_store_n(&sub->cursor, __atomic_load_n(&_published, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+			sub->thread = boost::thread(&broadcast<T, N, W>::run, this, sub);
+			return true;
+		}
+
+
+		/**
+		 * This method stops the sink's thread, once it's done with the
+		 * item it's on, and then removes it as a listener. Its cursor no
+		 * longer holds up the producer. A sink can remove itself from its
+		 * own recv() - then it gets no more items after that one, and its
+		 * thread finishes up on its own once recv() returns.
+		 */
+		virtual bool removeFromListeners( sink<T> *aSink )
+		{
+			boost::thread	gone;
+			{
+				boost::detail::spinlock::scoped_lock	lock(_subsMutex);
+				for (uint32_t i = 0; i < _count; ++i) {
+					if ((_subs[i] != NULL) && (_subs[i]->target == aSink)) {
+						halt(_subs[i], gone);
+						break;
+					}
+				}
+			}
+			finish(gone);
+			return adapter<T, T>::removeFromListeners(aSink);
+		}
+
+
+		/**
+		 * This method stops all the sinks' threads, and then removes them
+		 * all as listeners.
+		 */
+		virtual void removeAllListeners()
+		{
+			boost::thread	gone[eMaxSinks];
+			{
+				boost::detail::spinlock::scoped_lock	lock(_subsMutex);
+				for (uint32_t i = 0; i < _count; ++i) {
+					if ((_subs[i] != NULL) && (_subs[i]->target != NULL)) {
+						halt(_subs[i], gone[i]);
+					}
+				}
+			}
+			for (uint32_t i = 0; i < eMaxSinks; ++i) {
+				finish(gone[i]);
+			}
+			adapter<T, T>::removeAllListeners();
+		}
+
+
+		/**
+		 * This method returns the number of items the ring holds, and the
+		 * sequence number of the last one published - the first is 1.
+		 */
+		size_t capacity() const
+		{
+			return eSize;
+		}
+
+
+		uint64_t published() const
+		{
+			return __atomic_load_n(&_published, __ATOMIC_ACQUIRE);
+		}
+
+
+		/********************************************************
+		 *
+		 *              Distribution Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method puts the item in the ring for all the sinks to see.
+		 * If the slowest sink is still a whole ring behind, it waits for
+		 * it - that's the only time the producer waits. There can be ONE
+		 * and ONLY ONE thread calling this - and so recv() and send().
+		 * A NULL pointer isn't published, and this returns 'false'.
+		 */
+		bool publish( const T & anItem )
+		{
+			if (broadcast_item<T>::missing(anItem)) {
+				return false;
+			}
+			if (!adapter<T, T>::isOnline()) {
+				return true;
+			}
+			uint64_t	seq = _next;
+			// the slot is free once every cursor is past its last use
+			if (seq > _gate + eSize) {
+				uint32_t	spins = 0;
+				while (seq > (_gate = slowest(seq)) + eSize) {
+					if (!_space.spin(spins)) {
+						if (W == park_wait) {
+							int32_t		epoch = _space.enlist();
+							if (seq > (_gate = slowest(seq)) + eSize) {
+								_space.park(epoch, 0);
+							}
+							_space.delist();
+						} else {
+							_space.yield();
+						}
+					}
+				}
+			}
+			broadcast_item<T>::put(_slots[seq & eMask], anItem);
+			__atomic_store_n(&_published, seq, __ATOMIC_RELEASE);
+			_next = seq + 1;
+			_data.wake();
+			return true;
+		}
+
+
+		/**
+		 * This is the source<T> facade - sending is publishing, so the
+		 * sinks get the item on their own threads, and not this one.
+		 */
+		virtual bool send( const T anItem )
+		{
+			return publish(anItem);
+		}
+
+
+		/********************************************************
+		 *
+		 *                Processing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This is the sink side - the sources that feed this ring call
+		 * this, and it's published right away.
+		 */
+		virtual bool recv( const T anItem )
+		{
+			return publish(anItem);
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * There are a lot of times that a human-readable version of
+		 * this instance will come in handy. This is that method. It's
+		 * not necessarily meant to be something to process, but most
+		 * likely what a debugging system would want to write out for
+		 * this guy.
+		 */
+		virtual std::string toString() const
+		{
+			std::ostringstream	msg;
+			msg << "[broadcast '" << adapter<T, T>::getName() << "' of " << eSize
+				<< " w/ " << source<T>::getSinks().size() << " sinks, at "
+				<< published() << "]";
+			return msg.str();
+		}
+
+
+	private:
+		/**
+		 * This is a threaded ring - there's no sense in copying it.
+		 */
+		broadcast( const broadcast<T, N, W> & anOther );
+		broadcast & operator=( const broadcast<T, N, W> & anOther );
+
+		/**
+		 * These are the size of the ring, the mask for the slot of a
+		 * sequence number, and the most sinks that can listen at once.
+		 */
+		enum {
+			eSize = (1 << N),
+			eMask = (eSize - 1),
+			eMaxSinks = 32
+		};
+
+		typedef typename broadcast_item<T>::value_t	value_t;
+
+		/**
+		 * Each sink has one of these - the cursor is the sequence number
+		 * of the last item it's done with, and it's on a cache line of its
+		 * own, as its thread writes it, and the producer reads it. When a
+		 * sink is removed, the cursor is set past the end so that it never
+		 * holds up the producer, and the Subscriber is kept for the next
+		 * sink - so the producer never has to worry about it going away.
+		 */
+		struct Subscriber {
+			volatile uint64_t	cursor;
+			char				_pad0[util::cache_line_size - sizeof(uint64_t)];
+			sink<T>				*target;
+			volatile bool		stop;
+			boost::thread		thread;
+
+			Subscriber() : cursor(UINT64_MAX), target(NULL), stop(false), thread() { }
+		};
+
+		/**
+		 * This method returns the lowest cursor of all the sinks - but
+		 * never more than the last one published, 'aSeq - 1'. A sink added
+		 * after this looks starts there, so the gate can't let the producer
+		 * lap it. The fence keeps the scan from being seen before that
+		 * last publish, so a new sink always reads one at least as late.
+		 */
+		uint64_t slowest( uint64_t aSeq ) const
+		{
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			uint64_t	low = aSeq - 1;
+			uint32_t	cnt = __atomic_load_n(&_count, __ATOMIC_ACQUIRE);
+			for (uint32_t i = 0; i < cnt; ++i) {
+				Subscriber	*sub = __atomic_load_n(&_subs[i], __ATOMIC_ACQUIRE);
+				if (sub != NULL) {
+					uint64_t	c = __atomic_load_n(&sub->cursor, __ATOMIC_ACQUIRE);
+					if (c < low) {
+						low = c;
+					}
+				}
+			}
+			return low;
+		}
+
+		/**
+		 * This method tells the sink's thread to stop, wakes it if it's
+		 * parked, and hands its thread back in 'aThread' - to be finished
+		 * once the lock is let go, as the sink may be after the lock from
+		 * its own recv().
+		 */
+		void halt( Subscriber *aSub, boost::thread & aThread )
+		{
+			__atomic_store_n(&aSub->stop, true, __ATOMIC_RELEASE);
+			_data.wake();
+			aThread.swap(aSub->thread);
+		}
+
+		/**
+		 * This method waits for a halted sink's thread to be done - unless
+		 * it's this one, as the sink removed itself, and then it's let go,
+		 * and it'll finish up once it's back in run().
+		 */
+		void finish( boost::thread & aThread )
+		{
+			if (aThread.joinable()) {
+				if (aThread.get_id() == boost::this_thread::get_id()) {
+					aThread.detach();
+				} else {
+					aThread.join();
+				}
+			}
+		}
+
+		/**
+		 * This is the loop for each sink's thread. It takes everything
+		 * that's been published since it last looked - as a batch - hands
+		 * it all to the sink, and only then moves its cursor, so that the
+		 * producer sees one write for the whole batch. When it's stopped,
+		 * the cursor is moved past the end, and then the Subscriber is
+		 * free for the next sink - that's the last this thread touches it.
+		 */
+		void run( Subscriber *aSub )
+		{
+			sink<T>		*target = aSub->target;
+			uint64_t	next = __atomic_load_n(&aSub->cursor, __ATOMIC_ACQUIRE) + 1;
+			uint32_t	spins = 0;
+			while (!__atomic_load_n(&aSub->stop, __ATOMIC_ACQUIRE)) {
+				uint64_t	last = __atomic_load_n(&_published, __ATOMIC_ACQUIRE);
+				if (last >= next) {
+					for (; (next <= last) && !__atomic_load_n(&aSub->stop, __ATOMIC_ACQUIRE); ++next) {
+						target->recv(broadcast_item<T>::get(_slots[next & eMask]));
+					}
+					__atomic_store_n(&aSub->cursor, next - 1, __ATOMIC_RELEASE);
+					_space.wake();
+					spins = 0;
+				} else if (!_data.spin(spins)) {
+					if (W == park_wait) {
+						int32_t		epoch = _data.enlist();
+						if (!__atomic_load_n(&aSub->stop, __ATOMIC_ACQUIRE) && (__atomic_load_n(&_published, __ATOMIC_ACQUIRE) < next)) {
+							_data.park(epoch, 0);
+						}
+						_data.delist();
+					} else {
+						_data.yield();
+					}
+				}
+			}
+			__atomic_store_n(&aSub->cursor, UINT64_MAX, __ATOMIC_RELEASE);
+			_space.wake();
+			__atomic_store_n(&aSub->target, (sink<T> *)NULL, __ATOMIC_RELEASE);
+		}
+
+		/**
+		 * The producer's data - the last sequence number published, that
+		 * the sinks all read, and then on a line of its own, the next one
+		 * to use and the last known slowest cursor, that only it touches.
+		 */
+		volatile uint64_t			_published;
+		char						_pad0[util::cache_line_size - sizeof(uint64_t)];
+		uint64_t					_next;
+		uint64_t					_gate;
+		char						_pad1[util::cache_line_size - 2 * sizeof(uint64_t)];
+		// this is the ring itself
+		value_t						*_slots;
+		// ...and these are the sinks, with the number of entries in use
+		Subscriber					*_subs[eMaxSinks];
+		volatile uint32_t			_count;
+		boost::detail::spinlock		_subsMutex;
+		// these are what the sinks wait on for data, and the producer for room
+		util::waiter<W>				_data;
+		util::waiter<W>				_space;
+};
+}		// end of namespace dkit
+
+#endif		// __DKIT_BROADCAST_H
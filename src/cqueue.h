@@ -9,6 +9,10 @@
  *            into this queue, and only the most recent value will be popped
  *            off when the time comes. This is all done locklessly with the
  *            other components of DKit, and is a very useful tool to have.
+ *
+ *            Like the pool, the queue of keys is picked at compile-time from
+ *            the queue_type, and held by value - unless the dispatch policy,
+ *            D, is virtual_dispatch.
  */
 #ifndef __DKIT_CQUEUE_H
 #define __DKIT_CQUEUE_H
@@ -20,31 +24,13 @@
 
 // Other Headers
 #include "FIFO.h"
-#include "spsc/CircularFIFO.h"
-#include "mpsc/CircularFIFO.h"
-#include "spmc/CircularFIFO.h"
+#include "queue_policy.h"
 #include "trie.h"
 #include "pool.h"
 
 // Forward Declarations
 
 // Public Constants
-/**
- * We need to have a simple enum for the different "types" of queues that
- * we can use for the pool - all based on the complexity of the access. This
- * is meant to allow the user to have complete flexibility in how to ask for,
- * and recycle items from the pool.
- */
-#ifndef __DKIT_QUEUE_TYPE
-#define __DKIT_QUEUE_TYPE
-namespace dkit {
-enum queue_type {
-	sp_sc = 0,
-	mp_sc,
-	sp_mc,
-};
-}		// end of namespace dkit
-#endif	// __DKIT_QUEUE_TYPE
 
 // Public Datatypes
 
@@ -60,7 +46,7 @@ namespace dkit {
  *   KS = the size of the key for the value 'T'
  *   PN = the power of two of pooled keys to have in reserve (default: 2^17)
  */
-template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> class cqueue :
+template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17, class D = static_dispatch> class cqueue :
 	public FIFO<T>
 {
 	private:
@@ -98,26 +84,10 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 */
 		cqueue() :
 			FIFO<T>(),
-			_queue(NULL),
+			_queue(),
+			_pool(),
 			_map()
 		{
-			/**
-			 * We need to look at the 'type' and then create the FIFO
-			 * that makes sense to what he's asking for. The size is the
-			 * power of two (second arg), and will limit how many things
-			 * can be in the pool at once.
-			 */
-			switch (Q) {
-				case sp_sc:
-					_queue = new spsc::CircularFIFO<key_t *, N>();
-					break;
-				case mp_sc:
-					_queue = new mpsc::CircularFIFO<key_t *, N>();
-					break;
-				case sp_mc:
-					_queue = new spmc::CircularFIFO<key_t *, N>();
-					break;
-			}
 		}
 
 
@@ -126,9 +96,10 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 * class to make sure that we control how many copies we have
 		 * floating around in the system.
 		 */
-		cqueue( const cqueue<T, N, Q, KS, PN> & anOther ) :
+		cqueue( const cqueue<T, N, Q, KS, PN, D> & anOther ) :
 			FIFO<T>(),
-			_queue(NULL),
+			_queue(),
+			_pool(),
 			_map()
 		{
 			// let the '=' operator do the heavy lifting...
@@ -148,16 +119,11 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 			 * pointers. If so, then we need to pop every one out and
 			 * then delete each item. It's the only clean way to do it.
 			 */
-			if (_queue != NULL) {
-				// we need to empty the queue of all keys - and delete each
-				key_t	*key = NULL;
-				while (_queue->pop(key)) {
-					if (key != NULL) {
-						delete key;
-					}
+			key_t	*key = NULL;
+			while (_queue.pop(key)) {
+				if (key != NULL) {
+					delete key;
 				}
-				// finally, drop the queue itself
-				delete _queue;
 			}
 		}
 
@@ -167,24 +133,10 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 * that we do this right by always having an equals operator on
 		 * all classes.
 		 */
-		cqueue & operator=( const cqueue<T, N, Q, KS, PN> & anOther )
+		cqueue & operator=( const cqueue<T, N, Q, KS, PN, D> & anOther )
 		{
 			if (this != & anOther) {
-				if (_queue == NULL) {
-					switch (Q) {
-						case sp_sc:
-							_queue = new spsc::CircularFIFO<key_t *, N>(*(anOther._queue));
-							break;
-						case mp_sc:
-							_queue = new mpsc::CircularFIFO<key_t *, N>(*(anOther._queue));
-							break;
-						case sp_mc:
-							_queue = new spmc::CircularFIFO<key_t *, N>(*(anOther._queue));
-							break;
-					}
-				} else {
-					*_queue = *(anOther._queue);
-				}
+				_queue = anOther._queue;
 				_map = anOther._map;
 			}
 			return *this;
@@ -202,10 +154,6 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 */
 		virtual bool push( const T & anElem )
 		{
-			// check on the existance of the queue
-			if (_queue == NULL) {
-				throw std::runtime_error("There is no defined queue for the keys - can't continue");
-			}
 			// see if we need to add the key to the queue
 			if (!_map.upsert(anElem)) {
 				// get an empty key from the pool
@@ -216,7 +164,7 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 				// copy in the value for this element
 				key->set(key_value(anElem));
 				// ...and then save it into the queue in the right place
-				_queue->push(key);
+				_queue.push(key);
 			}
 			return true;
 		}
@@ -231,13 +179,9 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		virtual bool pop( T & anElem )
 		{
 			bool		success = false;
-			// check on the existance of the queue
-			if (_queue == NULL) {
-				throw std::runtime_error("There is no defined queue for the keys - can't continue");
-			}
 			// try to pop a key, and if we can, then extract the value
 			key_t		*key = NULL;
-			if (_queue->pop(key)) {
+			if (_queue.pop(key)) {
 				success = _map.remove(key->bytes, anElem);
 				_pool.recycle(key);
 			}
@@ -271,13 +215,9 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		virtual bool peek( T & anElem )
 		{
 			bool		success = false;
-			// check on the existance of the queue
-			if (_queue == NULL) {
-				throw std::runtime_error("There is no defined queue for the keys - can't continue");
-			}
 			// try to pop a key, and if we can, then copy the value
 			key_t		*key = NULL;
-			if (_queue->peek(key)) {
+			if (_queue.peek(key)) {
 				success = _map.get(key->bytes, anElem);
 			}
 			// return what we got from the trie
@@ -309,11 +249,9 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		virtual void clear()
 		{
 			// we need to empty the queue of all keys - and delete each
-			if (_queue != NULL) {
-				key_t		*key = NULL;
-				while (_queue->pop(key)) {
-					_pool.recycle(key);
-				}
+			key_t		*key = NULL;
+			while (_queue.pop(key)) {
+				_pool.recycle(key);
 			}
 			// ...and also empty the trie
 			_map.clear();
@@ -326,10 +264,7 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 */
 		virtual bool empty()
 		{
-			if (_queue != NULL) {
-				return _queue->empty();
-			}
-			return true;
+			return _queue.empty();
 		}
 
 
@@ -342,10 +277,7 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 */
 		virtual size_t size() const
 		{
-			if (_queue != NULL) {
-				return _queue->size();
-			}
-			return 0;
+			return _queue.size();
 		}
 
 
@@ -377,7 +309,7 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 * contents and not their pointer values. This is how you'd likely
 		 * expect equality to work.
 		 */
-		bool operator==( const cqueue<T, N, Q, KS, PN> & anOther ) const
+		bool operator==( const cqueue<T, N, Q, KS, PN, D> & anOther ) const
 		{
 			// right now, identity is the only equality we know
 			return (this == & anOther);
@@ -389,7 +321,7 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		 * contents and not their pointer values. This is how you'd likely
 		 * expect equality to work.
 		 */
-		bool operator!=( const cqueue<T, N, Q, KS, PN> & anOther ) const
+		bool operator!=( const cqueue<T, N, Q, KS, PN, D> & anOther ) const
 		{
 			return !operator=(anOther);
 		}
@@ -406,19 +338,18 @@ template <class T, uint8_t N, queue_type Q, trie_key_size KS, uint8_t PN = 17> c
 		};
 
 		/**
-		 * The queue of <uint8_t *> "keys" based on the style Q, is going
-		 * to be a pointer we create in the constructor and use here. It's
-		 * the same API no matter what Q is, it's just a cleaner way to
-		 * implement the queue.
+		 * The queue of <uint8_t *> "keys" based on the style Q, and held
+		 * as the dispatch policy D says. By default, it's the ring itself,
+		 * right here in the cqueue, so the calls on it can be inlined.
 		 */
-		FIFO<key_t *>			*_queue;
+		typename D::template queue<key_t *, N, Q>::type		_queue;
 		/**
 		 * This is the pool of keys that we are going to be using for the
 		 * queue. The pool just makes it faster and easier to get them in
 		 * and out, and we've got a simple structure defined to make the
 		 * allocation and clean up clean and easy.
 		 */
-		pool<key_t *, PN, Q>	_pool;
+		pool<key_t *, PN, Q, D>	_pool;
 		/**
 		 * The trie/map to hold the values as they come in. Since this is
 		 * a "map" of sorts, the same keyed value will be placed on top of
@@ -0,0 +1,500 @@
+/**
+ * executor.h - this file defines a fixed-size pool of worker threads that
+ *              run tasks, built on the Chase-Lev work-stealing deque. Each
+ *              worker has its own deque, and the tasks a worker submits go
+ *              on the bottom of it - so the work a task forks stays on the
+ *              thread, and in the cache, that forked it. When a worker runs
+ *              out, it takes from the shared queue that the other threads
+ *              submit to, and then tries to steal from the top of the other
+ *              workers' deques, starting with a random one so that the idle
+ *              workers don't all go after the same victim. If there's still
+ *              nothing, it waits - by spinning, yielding or parking, as the
+ *              wait_type says - until something is submitted.
+ *
+ *              A task_group counts the tasks submitted with it that have yet
+ *              to finish, and wait() on it returns when they're all done.
+ *              If it's called on a worker, the worker runs other tasks while
+ *              it waits, so a task can fork its children and then join on
+ *              them without tying up a thread.
+ */
+#ifndef __DKIT_EXECUTOR_H
+#define __DKIT_EXECUTOR_H
+
+//	System Headers
+#include <stddef.h>
+#include <stdint.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "mpmc/CircularFIFO.h"
+#include "spmc/WorkStealingDeque.h"
+#include "util/padding.h"
+#include "util/waiter.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+template <wait_type W> class executor;
+class task_group;
+
+/**
+ * This is the base class for the work the executor runs - subclass it
+ * and implement run(). The executor doesn't own the task, so it has to
+ * stay alive until it's run - and it's free to delete itself in run(),
+ * as the executor is done with it by then.
+ */
+class task
+{
+	public:
+		task() : _group(NULL) { }
+		virtual ~task() { }
+
+		/**
+		 * This is the work - it's called once, on one of the workers.
+		 */
+		virtual void run() = 0;
+
+	private:
+		// this is the group the task was submitted with, if any
+		task_group		*_group;
+
+		template <wait_type W> friend class executor;
+};
+
+
+/**
+ * This is the count of the tasks submitted with it that have yet to run
+ * to completion. A thread that isn't a worker waits on it by parking, and
+ * the last task to finish wakes it.
+ */
+class task_group
+{
+	public:
+		task_group() : _pending(0), _finishing(0), _done() { }
+		virtual ~task_group() { }
+
+		/**
+		 * This method returns the number of tasks that have yet to finish.
+		 */
+		int64_t pending() const
+		{
+			return __atomic_load_n(&_pending, __ATOMIC_ACQUIRE);
+		}
+
+		/**
+		 * This method returns 'true' when all the tasks are done, and the
+		 * last one has let go of the group - so it's safe to destroy it.
+		 */
+		bool done() const
+		{
+			return ((__atomic_load_n(&_pending, __ATOMIC_SEQ_CST) == 0) &&
+					(__atomic_load_n(&_finishing, __ATOMIC_SEQ_CST) == 0));
+		}
+
+		/**
+		 * This method waits, without running any tasks, until all the
+		 * tasks are done - spinning a bit, and then parking.
+		 */
+		void wait()
+		{
+			uint32_t	spins = 0;
+			while (!done()) {
+				if (!_done.spin(spins)) {
+					if (pending() > 0) {
+						int32_t		epoch = _done.enlist();
+						if (pending() > 0) {
+							_done.park(epoch, 0);
+						}
+						_done.delist();
+					} else {
+						// the last one is just on its way out
+						_done.yield();
+					}
+				}
+			}
+		}
+
+	private:
+		/**
+		 * There's no sense in copying these - the tasks point to this one.
+		 */
+		task_group( const task_group & anOther );
+		task_group & operator=( const task_group & anOther );
+
+		void add( int64_t aCount )
+		{
+			__atomic_add_fetch(&_pending, aCount, __ATOMIC_SEQ_CST);
+		}
+
+		/**
+		 * This is called when each task is done. The '_finishing' count
+		 * keeps the waiter from returning - and destroying the group -
+		 * while the last task is still in the wake().
+		 */
+		void finish()
+		{
+			__atomic_add_fetch(&_finishing, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_sub_fetch(&_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+				_done.wake();
+			}
+			__atomic_sub_fetch(&_finishing, 1, __ATOMIC_SEQ_CST);
+		}
+
+		volatile int64_t			_pending;
+		volatile int32_t			_finishing;
+		util::waiter<park_wait>		_done;
+
+		template <wait_type W> friend class executor;
+};
+
+
+/**
+ * This is the main class definition. The wait_type is how an idle worker
+ * waits for something to do.
+ */
+template <wait_type W = park_wait> class executor
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the constructor that starts 'aThreads' workers - by
+		 * default, one for each CPU on the box.
+		 */
+		executor( uint32_t aThreads = boost::thread::hardware_concurrency() ) :
+			_stop(false),
+			_count(aThreads > 0 ? aThreads : 1),
+			_workers(NULL),
+			_inject(),
+			_idle()
+		{
+			_workers = new Worker[_count];
+			for (uint32_t i = 0; i < _count; ++i) {
+				_workers[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+			}
+			for (uint32_t i = 0; i < _count; ++i) {
+				_workers[i].thread = boost::thread(&executor<W>::run, this, &_workers[i]);
+			}
+		}
+
+
+		/**
+		 * This is the destructor - it runs everything that's been
+		 * submitted, and then stops, and waits for, all the workers.
+		 */
+		virtual ~executor()
+		{
+			__atomic_store_n(&_stop, true, __ATOMIC_RELEASE);
+			_idle.wake();
+			for (uint32_t i = 0; i < _count; ++i) {
+				if (_workers[i].thread.joinable()) {
+					_workers[i].thread.join();
+				}
+			}
+			delete [] _workers;
+			_workers = NULL;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the number of worker threads.
+		 */
+		uint32_t threads() const
+		{
+			return _count;
+		}
+
+
+		/**
+		 * These methods return the number of tasks the workers have run,
+		 * and how many of them were stolen from another worker's deque.
+		 */
+		uint64_t executed() const
+		{
+			uint64_t	retval = 0;
+			for (uint32_t i = 0; i < _count; ++i) {
+				retval += __atomic_load_n(&_workers[i].executed, __ATOMIC_RELAXED);
+			}
+			return retval;
+		}
+
+
+		uint64_t steals() const
+		{
+			uint64_t	retval = 0;
+			for (uint32_t i = 0; i < _count; ++i) {
+				retval += __atomic_load_n(&_workers[i].stolen, __ATOMIC_RELAXED);
+			}
+			return retval;
+		}
+
+
+		/**
+		 * This method returns 'true' if the calling thread is one of this
+		 * executor's workers.
+		 */
+		bool onWorker() const
+		{
+			return (local() != NULL);
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Submit Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method submits the task to be run, and counts it in the
+		 * group, if there is one. From a worker, it goes on the bottom of
+		 * the worker's deque. From any other thread, it goes on the shared
+		 * queue - and if that's full, the calling thread runs it, as it
+		 * has nothing better to do than to wait for room.
+		 */
+		void submit( task *aTask, task_group *aGroup = NULL )
+		{
+			if (aGroup != NULL) {
+				aGroup->add(1);
+			}
+			aTask->_group = aGroup;
+			Worker	*me = local();
+			if (me != NULL) {
+				me->deque.push(aTask);
+			} else if (!_inject.push(aTask)) {
+				execute(NULL, aTask);
+				return;
+			}
+			_idle.wake();
+		}
+
+
+		/**
+		 * This method submits all 'aCount' tasks at once - the group is
+		 * counted up once, a worker makes them all visible to the thieves
+		 * with one store, and the idle workers are woken once.
+		 */
+		void submit( task * const aTasks[], size_t aCount, task_group *aGroup = NULL )
+		{
+			if (aCount == 0) {
+				return;
+			}
+			if (aGroup != NULL) {
+				aGroup->add((int64_t)aCount);
+			}
+			for (size_t i = 0; i < aCount; ++i) {
+				aTasks[i]->_group = aGroup;
+			}
+			Worker	*me = local();
+			if (me != NULL) {
+				me->deque.push(aTasks, aCount);
+			} else {
+				size_t	i = 0;
+				for (; (i < aCount) && _inject.push(aTasks[i]); ++i) {
+				}
+				if (i > 0) {
+					_idle.wake();
+				}
+				// no room for the rest, so this thread has to run them
+				for (; i < aCount; ++i) {
+					execute(NULL, aTasks[i]);
+				}
+				return;
+			}
+			_idle.wake();
+		}
+
+
+		/**
+		 * This method returns when all the tasks in the group are done.
+		 * On a worker, it runs tasks - its own, the shared ones, or ones
+		 * it steals - until they are. On any other thread, it parks.
+		 */
+		void wait( task_group & aGroup )
+		{
+			Worker	*me = local();
+			if (me == NULL) {
+				aGroup.wait();
+				return;
+			}
+			uint32_t	spins = 0;
+			while (!aGroup.done()) {
+				task	*t = NULL;
+				if (find(me, t)) {
+					execute(me, t);
+					spins = 0;
+				} else if (!_idle.spin(spins)) {
+					_idle.yield();
+				}
+			}
+		}
+
+	private:
+		/**
+		 * Each worker has its deque, the state for its choice of victim,
+		 * and the counts of what it's done - on their own cache line, as
+		 * only the worker writes them.
+		 */
+		struct Worker {
+			spmc::WorkStealingDeque<task *, 10>	deque;
+			char								_pad0[util::cache_line_size];
+			uint64_t							seed;
+			volatile uint64_t					executed;
+			volatile uint64_t					stolen;
+			char								_pad1[util::cache_line_size - 3 * sizeof(uint64_t)];
+			boost::thread						thread;
+
+			Worker() : deque(), seed(0), executed(0), stolen(0), thread() { }
+		};
+
+		/**
+		 * This method returns the worker the calling thread is, if it's
+		 * one of ours, and NULL if it's not.
+		 */
+		Worker *local() const
+		{
+			Worker	*me = _me;
+			if ((me != NULL) && ((me < _workers) || (me >= _workers + _count))) {
+				me = NULL;
+			}
+			return me;
+		}
+
+		/**
+		 * This is the xorshift that picks the first victim to steal from.
+		 */
+		static uint64_t random( Worker *aWorker )
+		{
+			uint64_t	x = aWorker->seed;
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			aWorker->seed = x;
+			return x;
+		}
+
+		/**
+		 * This method finds the worker something to do - the bottom of its
+		 * own deque, then the shared queue, then the top of each of the
+		 * others' deques in turn, starting from a random one.
+		 */
+		bool find( Worker *aWorker, task * & aTask )
+		{
+			if (aWorker->deque.pop(aTask) || _inject.pop(aTask)) {
+				return true;
+			}
+			uint32_t	start = (uint32_t)(random(aWorker) % _count);
+			for (uint32_t i = 0; i < _count; ++i) {
+				Worker	*victim = &_workers[(start + i) % _count];
+				if ((victim != aWorker) && victim->deque.steal(aTask)) {
+					__atomic_store_n(&aWorker->stolen, aWorker->stolen + 1, __ATOMIC_RELAXED);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/**
+		 * This method returns 'true' if there's anything at all to do -
+		 * it's the last look before a worker parks.
+		 */
+		bool anyWork()
+		{
+			if (!_inject.empty()) {
+				return true;
+			}
+			for (uint32_t i = 0; i < _count; ++i) {
+				if (!_workers[i].deque.empty()) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/**
+		 * This method runs the task, and then tells its group. The group
+		 * is read first, as the task may delete itself in run().
+		 */
+		void execute( Worker *aWorker, task *aTask )
+		{
+			task_group	*g = aTask->_group;
+			aTask->run();
+			if (aWorker != NULL) {
+				__atomic_store_n(&aWorker->executed, aWorker->executed + 1, __ATOMIC_RELAXED);
+			}
+			if (g != NULL) {
+				g->finish();
+			}
+		}
+
+		/**
+		 * This is the loop for each worker - run whatever it can find, and
+		 * wait when there's nothing. It only stops when it's told to, and
+		 * there's nothing left to run.
+		 */
+		void run( Worker *aWorker )
+		{
+			_me = aWorker;
+			uint32_t	spins = 0;
+			while (true) {
+				task	*t = NULL;
+				if (find(aWorker, t)) {
+					execute(aWorker, t);
+					spins = 0;
+				} else if (__atomic_load_n(&_stop, __ATOMIC_ACQUIRE) && !anyWork()) {
+					break;
+				} else if (!_idle.spin(spins)) {
+					if (W == park_wait) {
+						int32_t		epoch = _idle.enlist();
+						if (!__atomic_load_n(&_stop, __ATOMIC_ACQUIRE) && !anyWork()) {
+							_idle.park(epoch, 0);
+						}
+						_idle.delist();
+					} else {
+						_idle.yield();
+					}
+				}
+			}
+			_me = NULL;
+		}
+
+		/**
+		 * There's no sense in copying these - the threads are ours alone.
+		 */
+		executor( const executor<W> & anOther );
+		executor & operator=( const executor<W> & anOther );
+
+		// this is set when the workers are to finish up and stop
+		volatile bool						_stop;
+		// ...these are the workers
+		uint32_t							_count;
+		Worker								*_workers;
+		// ...this is where the other threads submit tasks
+		mpmc::CircularFIFO<task *, 12>		_inject;
+		// ...and this is where the idle workers wait for them
+		util::waiter<W>						_idle;
+		// this is the worker the current thread is, if it is one
+		static __thread Worker				*_me;
+};
+
+
+template <wait_type W> __thread typename executor<W>::Worker *executor<W>::_me = NULL;
+}		// end of namespace dkit
+
+#endif		// __DKIT_EXECUTOR_H
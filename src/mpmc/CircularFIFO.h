@@ -0,0 +1,614 @@
+/**
+ * CircularFIFO.h - this file defines the template class for a multi-producer,
+ *                  multi-consumer, circular FIFO queue with a size initially
+ *                  specified in the definition of the instance. This queue
+ *                  is completely thread-safe for any number of threads placing
+ *                  elements into this container, and any number of threads
+ *                  removing them. The syntax is very simple - push() will push
+ *                  an element, returning 'true' if there is room, and the
+ *                  value has been placed in the queue.
+ *
+ *                  Each slot in the ring carries a sequence number that says
+ *                  whose turn it is to use the slot - a producer for the lap
+ *                  it's on, or a consumer for that same lap. A thread only
+ *                  claims an index with a CAS when the slot's sequence says
+ *                  it's ready, so neither side ever needs to back out a claim,
+ *                  as the MPSC and SPMC queues do. The value in the slot is
+ *                  only constructed when it's pushed, and destroyed when it's
+ *                  popped.
+ *
+ *                  The peek() of a trivially copyable T copies the slot and
+ *                  then checks that it wasn't popped while it was copied, so
+ *                  it never gets in the way of the other consumers. Any other
+ *                  T can't be copied while another consumer is destroying it,
+ *                  so peek() pins the slot for the copy - and the consumers,
+ *                  and any producer that's lapped the ring to it, wait.
+ *
+ *                  As with the others, S is the instrumentation - and with
+ *                  util::queue_stats, each slot that's timed carries its
+ *                  stamp from the producer that fills it to the consumer
+ *                  that empties it, whichever threads those turn out to be.
+ */
+#ifndef __DKIT_MPMC_CIRCULARFIFO_H
+#define __DKIT_MPMC_CIRCULARFIFO_H
+
+// System Headers
+#include <stdint.h>
+#include <stdexcept>
+#include <type_traits>
+
+// Third-Party Headers
+
+// Other Headers
+#include "FIFO.h"
+#include "util/padding.h"
+#include "util/slot.h"
+#include "util/queue_stats.h"
+
+// Forward Declarations
+
+// Public Constants
+
+// Public Datatypes
+
+// Public Data Constants
+
+
+
+namespace dkit {
+namespace mpmc {
+/**
+ * This is the main class definition
+ */
+template <class T, uint8_t N, class S = util::no_stats> class CircularFIFO :
+	public FIFO<T>
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the default constructor that assumes NOTHING - it just
+		 * makes a simple queue ready to hold things.
+		 */
+		CircularFIFO() :
+			FIFO<T>(),
+			_elements(),
+			_tail(0),
+			_head(0),
+			_stats(eSize, mp_mc)
+		{
+			initSequences();
+		}
+
+
+		/**
+		 * This is the standard copy constructor that needs to be in every
+		 * class to make sure that we control how many copies we have
+		 * floating around in the system.
+		 */
+		CircularFIFO( const CircularFIFO<T, N, S> & anOther ) :
+			FIFO<T>(),
+			_elements(),
+			_tail(0),
+			_head(0),
+			_stats(eSize, mp_mc)
+		{
+			initSequences();
+			// let the '=' operator do the heavy lifting...
+			*this = anOther;
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called.
+		 */
+		virtual ~CircularFIFO()
+		{
+			clear();
+		}
+
+
+		/**
+		 * When we process the result of an equality we need to make sure
+		 * that we do this right by always having an equals operator on
+		 * all classes.
+		 *
+		 * Because of the multi-producer, multi-consumer, nature of
+		 * this class, it is IMPOSSIBLE to have the assignment operator
+		 * be thread-safe without a mutex. This defeats the entire
+		 * purpose, so what we have is a non-thread-safe assignment
+		 * operator that is still useful if care is exercised to make
+		 * sure that no use-case exists where there will be readers or
+		 * writers to this queue while it is being copied in this assignment.
+		 */
+		CircularFIFO & operator=( const CircularFIFO<T, N, S> & anOther )
+		{
+			if (this != & anOther) {
+				// drop what we have, and copy in what's in his queue
+				clear();
+				size_t	head = anOther._head;
+				size_t	tail = anOther._tail;
+				for (size_t i = head; i < (head + eSize); ++i) {
+					Node	&node = _elements[i & eMask];
+					if (i < tail) {
+						node.value.construct(anOther._elements[i & eMask].value.ref());
+						node.seq = i + 1;
+					} else {
+						node.seq = i;
+					}
+				}
+				// now copy the pointers
+				_head = head;
+				_tail = tail;
+			}
+			return *this;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This pair of methods does what you'd expect - it returns the
+		 * length of the queue as it exists at the present time. It's
+		 * got two names because there are so many different kinds of
+		 * implementations that it's often convenient to use one or the
+		 * other to remain consistent.
+		 *
+		 * With producers and consumers all moving at once, this is only
+		 * a snapshot, and the indexes are free-running, so we need to
+		 * make sure that a consumer that's raced ahead of our read of the
+		 * tail doesn't make it look like the queue is enormous.
+		 */
+		virtual size_t size() const
+		{
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			size_t	sz = 0;
+			if (tail > head) {
+				sz = tail - head;
+				if (sz > eSize) {
+					sz = eSize;
+				}
+			}
+			return sz;
+		}
+
+
+		virtual size_t length() const
+		{
+			return size();
+		}
+
+
+		/**
+		 * This method returns the current capacity of the vector and
+		 * is NOT the size per se. The capacity is what this queue
+		 * will hold.
+		 */
+		virtual size_t capacity() const
+		{
+			return eSize;
+		}
+
+
+		/**
+		 * This method returns the instrumentation of the queue - the S
+		 * it was made with. The default, util::no_stats, has nothing in
+		 * it, but util::queue_stats has the high-water mark, the failed
+		 * pushes and pops, and the time the elements sat in the queue.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes an item and places it in the queue - if it can.
+		 * If so, then it will return 'true', otherwise, it'll return 'false'.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			if (std::is_nothrow_copy_constructible<T>::value) {
+				return put(anElem);
+			}
+			return put(util::copy_of(anElem));
+		}
+
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			if (std::is_nothrow_constructible<T, Args &&...>::value) {
+				return put(std::forward<Args>(args)...);
+			}
+			return put(T(std::forward<Args>(args)...));
+		}
+
+
+		/**
+		 * This method updates the passed-in reference with the value on the
+		 * top of the queue - if it can. If so, it'll return the value and
+		 * 'true', but if it can't, as in the queue is empty, then the method
+		 * will return 'false' and the value will be untouched.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			size_t	pos = 0;
+			Node	*node = claim(pos);
+			if (node == NULL) {
+				_stats.pop_empty();
+				return false;
+			}
+
+			// move out the data and hand the slot to the next lap's producers
+			anElem = std::move(node->value.ref());
+			node->value.destroy();
+			_stats.popped(pos & eMask);
+			__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue. This is a slightly different
+		 * form that fits a different use-case, and so it's a handy
+		 * thing to have around at times.
+		 */
+		virtual T pop()
+		{
+			size_t	pos = 0;
+			Node	*node = claim(pos);
+			if (node == NULL) {
+				_stats.pop_empty();
+				throw std::exception();
+			}
+			T		v(std::move(node->value.ref()));
+			node->value.destroy();
+			_stats.popped(pos & eMask);
+			__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+			return v;
+		}
+
+
+		/**
+		 * If there is an item on the queue, this method will return a look
+		 * at that item without updating the queue. The return value will be
+		 * 'true' if there is something, but 'false' if the queue is empty.
+		 * If the slot is popped, and refilled, while we're copying it, the
+		 * sequence will have moved on, and we'll look again.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			if (!std::is_trivially_copyable<T>::value) {
+				size_t	pos = 0;
+				Node	*node = pin(pos);
+				if (node == NULL) {
+					return false;
+				}
+				try {
+					util::copy_assign(anElem, node->value.ref());
+				} catch (...) {
+					unpin(node, pos);
+					throw;
+				}
+				unpin(node, pos);
+				return true;
+			}
+			while (true) {
+				size_t	pos = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+				Node	*node = &_elements[pos & eMask];
+				if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+					return false;
+				}
+				T		v(util::copy_of(node->value.ref()));
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				if (__atomic_load_n(&node->seq, __ATOMIC_RELAXED) == (pos + 1)) {
+					anElem = std::move(v);
+					return true;
+				}
+			}
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			if (!std::is_trivially_copyable<T>::value) {
+				size_t	pos = 0;
+				Node	*node = pin(pos);
+				if (node == NULL) {
+					throw std::exception();
+				}
+				try {
+					T		v(util::copy_of(node->value.ref()));
+					unpin(node, pos);
+					return v;
+				} catch (...) {
+					unpin(node, pos);
+					throw;
+				}
+			}
+			while (true) {
+				size_t	pos = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+				Node	*node = &_elements[pos & eMask];
+				if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+					throw std::exception();
+				}
+				T		v(util::copy_of(node->value.ref()));
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				if (__atomic_load_n(&node->seq, __ATOMIC_RELAXED) == (pos + 1)) {
+					return v;
+				}
+			}
+		}
+
+
+		/**
+		 * This method will clear out the contents of the queue so if
+		 * you're storing pointers, then you need to be careful as this
+		 * could leak.
+		 */
+		virtual void clear()
+		{
+			size_t	pos = 0;
+			Node	*node = NULL;
+			while ((node = claim(pos)) != NULL) {
+				node->value.destroy();
+				__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+			}
+		}
+
+
+		/**
+		 * This method will return 'true' if there are no items in the
+		 * queue. Simple.
+		 */
+		virtual bool empty()
+		{
+			return (size() == 0);
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                         Utility Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are the same. The problem with this is that in a
+		 * multi-producer, multi-consumer system, there's no thread that
+		 * can actually perform this operation in a thread-safe manner.
+		 *
+		 * Moreover, the complexity in doing this is far more than we want to
+		 * take on in this class. It's lightweight, and while it's certainly
+		 * possible to make a good equals operator, it's not worth the cost
+		 * at this time. This method will always return 'false'.
+		 */
+		bool operator==( const CircularFIFO<T,N,S> & anOther ) const
+		{
+			return false;
+		}
+
+
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are NOT the same. The problem with this is that in a
+		 * multi-producer, multi-consumer system, there's no thread that
+		 * can actually perform this operation in a thread-safe manner.
+		 *
+		 * Moreover, the complexity in doing this is far more than we want to
+		 * take on in this class. It's lightweight, and while it's certainly
+		 * possible to make a good not-equals operator, it's not worth the cost
+		 * at this time. This method will always return 'true'.
+		 */
+		bool operator!=( const CircularFIFO<T,N,S> & anOther ) const
+		{
+			return !operator==(anOther);
+		}
+
+
+	private:
+		/**
+		 * A producer only tries to claim the tail when the slot it points
+		 * to is ready for this lap, so a failed CAS just means another
+		 * producer got there first, and we try again at the new tail.
+		 * Once claimed, the element is built in the slot from the arguments
+		 * - copying, moving, or constructing it in place.
+		 * A claimed slot can't be given back, so the element had better
+		 * not throw as it's built - push() and emplace() make a throwing
+		 * element outside the queue first, and then move it in.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			Node	*node = NULL;
+			size_t	pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+			while (true) {
+				node = &_elements[pos & eMask];
+				size_t		seq = __atomic_load_n(&node->seq, __ATOMIC_ACQUIRE);
+				intptr_t	diff = (intptr_t)seq - (intptr_t)pos;
+				if (diff == 0) {
+					// the slot is ours for the taking - if we can claim it
+					if (__atomic_compare_exchange_n(&_tail, &pos, (pos + 1), true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						break;
+					}
+				} else if (diff < 0) {
+					// the consumer of the last lap isn't done - we're full
+					_stats.push_failed();
+					return false;
+				} else {
+					// another producer beat us to it - catch up
+					pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+				}
+			}
+
+			// build the data and hand the slot to the consumers
+			node->value.construct(std::forward<Args>(args)...);
+			if (S::eEnabled) {
+				_stats.pushed(pos & eMask, (pos + 1 - __atomic_load_n(&_head, __ATOMIC_RELAXED)));
+			}
+			__atomic_store_n(&node->seq, (pos + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * Since the size of the queue is in the definition of the
+		 * instance, it's possible to make some very simple enums that
+		 * are the size and the masking bits for the index values, so that
+		 * we know before anything starts up, how big to make things and
+		 * how to "wrap around" when the time comes.
+		 */
+		enum {
+			eMask = ((1 << N) - 1),
+			eSize = (1 << N),
+			ePad = (util::cache_line_size - sizeof(size_t))
+		};
+
+		/**
+		 * Each slot in the ring is a 'node' with the value and a sequence
+		 * number. When the sequence equals the index a producer is at,
+		 * the slot is free for that producer. When it's one more than the
+		 * index a consumer is at, the slot is full for that consumer. The
+		 * consumer then moves it a full lap ahead for the next producer.
+		 * The value is only constructed while the slot is full.
+		 */
+		struct Node {
+			size_t			seq;
+			util::slot<T>	value;
+
+			Node() : seq(0), value() { }
+			~Node() { }
+		};
+
+		/**
+		 * This method sets the sequence of each slot to its own index, so
+		 * that they are all free for the producers on the first lap.
+		 */
+		void initSequences()
+		{
+			for (size_t i = 0; i < eSize; ++i) {
+				_elements[i].seq = i;
+			}
+		}
+
+		/**
+		 * This is the consumer's side of the same dance - it claims the
+		 * head when the slot there is full for this lap, and returns the
+		 * node, with its index in 'aPos'. If the queue is empty, it returns
+		 * NULL. The caller takes the value, and then moves the sequence a
+		 * full lap ahead for the next producer.
+		 */
+		Node *claim( size_t & aPos )
+		{
+			Node	*node = NULL;
+			size_t	pos = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+			while (true) {
+				node = &_elements[pos & eMask];
+				size_t		seq = __atomic_load_n(&node->seq, __ATOMIC_ACQUIRE);
+				intptr_t	diff = (intptr_t)seq - (intptr_t)(pos + 1);
+				if (diff == 0) {
+					// the slot is filled for this lap - if we can claim it
+					if (__atomic_compare_exchange_n(&_head, &pos, (pos + 1), true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						break;
+					}
+				} else if (diff < 0) {
+					// the producer for this slot isn't done - we're empty
+					return NULL;
+				} else {
+					// another consumer beat us to it - catch up
+					pos = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+				}
+			}
+			aPos = pos;
+			return node;
+		}
+
+		/**
+		 * This method pins the slot at the head for a peek() of a T that
+		 * can't be copied while it's being popped. The slot's sequence is
+		 * moved on a lap - to where no one's turn it is yet - so a consumer
+		 * that finds it thinks it's been beaten to the slot, and looks
+		 * again, as does a producer that's lapped the ring. It returns NULL
+		 * if the queue is empty.
+		 */
+		Node *pin( size_t & aPos )
+		{
+			size_t	pos = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			while (true) {
+				Node	*node = &_elements[pos & eMask];
+				size_t	seq = (pos + 1);
+				if (__atomic_compare_exchange_n(&node->seq, &seq, (pos + 1 + eSize), false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+					aPos = pos;
+					return node;
+				}
+				if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+					return NULL;
+				}
+				// popped, or pinned by another peek() - look again
+				pos = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			}
+		}
+
+		/**
+		 * This method hands the pinned slot back to the consumers.
+		 */
+		void unpin( Node *aNode, size_t aPos )
+		{
+			__atomic_store_n(&aNode->seq, (aPos + 1), __ATOMIC_RELEASE);
+		}
+
+		/**
+		 * The ring of nodes, and then the tail and the head - each on
+		 * its own cache line, so that the producers claiming the tail
+		 * don't slow down the consumers claiming the head.
+		 */
+		Node				_elements[eSize];
+		char				_pad0[ePad];
+		size_t				_tail;
+		char				_pad1[ePad];
+		size_t				_head;
+		char				_pad2[ePad];
+		// ...and this is the instrumentation, if there is any
+		S					_stats;
+};
+}		// end of namespace mpmc
+}		// end of namespace dkit
+
+#endif	// __DKIT_MPMC_CIRCULARFIFO_H
@@ -0,0 +1,338 @@
+/**
+ * ByteRing.h - this file defines the template class for a multi-producer,
+ *              single-consumer, ring of variable-length records. It's laid
+ *              out just like the SPSC ByteRing - a 2^N byte buffer of records,
+ *              each an 8-byte header and then its bytes, with a padding record
+ *              where one won't fit before the end of the ring - but here, a
+ *              producer claims its space by moving the tail with a single CAS,
+ *              and the record is published by its header, not the tail.
+ *
+ *              The header is written last, as one 64-bit word, so that until
+ *              it's there, the consumer sees a zero where the record will be,
+ *              and waits. For that to work, everything the consumer releases
+ *              is zeroed before it's handed back to the producers - it's
+ *              memory the consumer has just read, so it's already in cache.
+ *              A producer can reserve more than one record at a time, and
+ *              commit them in any order, but the consumer can't get past one
+ *              that's reserved and not yet committed.
+ */
+#ifndef __DKIT_MPSC_BYTERING_H
+#define __DKIT_MPSC_BYTERING_H
+
+// System Headers
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+// Third-Party Headers
+
+// Other Headers
+#include "util/padding.h"
+
+// Forward Declarations
+
+// Public Constants
+
+// Public Datatypes
+
+// Public Data Constants
+
+
+
+namespace dkit {
+namespace mpsc {
+/**
+ * This is the main class definition
+ */
+template <uint8_t N> class ByteRing
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the default constructor that makes an empty ring - all
+		 * zeros, so that there's no header anywhere in it.
+		 */
+		ByteRing() :
+			_tail(0),
+			_head(0)
+		{
+			memset(_buffer, 0, sizeof(_buffer));
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called.
+		 */
+		virtual ~ByteRing()
+		{
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the number of bytes in the ring that are
+		 * claimed - committed or not - by records, headers, and padding.
+		 */
+		size_t size() const
+		{
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			return (tail > head ? tail - head : 0);
+		}
+
+
+		/**
+		 * This method returns the size of the ring in bytes, and the most
+		 * that a single record can hold.
+		 */
+		size_t capacity() const
+		{
+			return eSize;
+		}
+
+
+		static size_t max_record()
+		{
+			return (eSize / 2 - eHeader);
+		}
+
+
+		/**
+		 * This method returns 'true' if nothing's been claimed in the ring.
+		 */
+		bool empty() const
+		{
+			return (size() == 0);
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Producer Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method claims a place in the ring to write a record of up
+		 * to 'aLength' bytes, and returns it - or NULL if there's no room,
+		 * or it's more than max_record(). If the record won't fit before the
+		 * end of the ring, the rest of it is claimed, too, in the same CAS,
+		 * and made into padding. The header is left with just the length
+		 * that's reserved - and no kind - so the consumer won't go past it.
+		 */
+		void *try_reserve( size_t aLength )
+		{
+			size_t	need = span(aLength);
+			if (need > eSize / 2) {
+				return NULL;
+			}
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+			size_t	pad = 0;
+			while (true) {
+				size_t	toEnd = eSize - (tail & eMask);
+				pad = (need > toEnd ? toEnd : 0);
+				if (tail + pad + need - __atomic_load_n(&_head, __ATOMIC_ACQUIRE) > eSize) {
+					return NULL;
+				}
+				if (__atomic_compare_exchange_n(&_tail, &tail, tail + pad + need, true,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					break;
+				}
+			}
+			if (pad > 0) {
+				publish(tail, ePadding, pad - eHeader);
+				tail += pad;
+			}
+			__atomic_store_n(word(tail), (uint64_t)(need - eHeader), __ATOMIC_RELAXED);
+			return word(tail) + 1;
+		}
+
+
+		/**
+		 * This method publishes the record that try_reserve() returned,
+		 * with the 'aLength' bytes that were written in it. That can be
+		 * less than was reserved - but not more - and what's left over is
+		 * made into padding, before the record itself is published.
+		 */
+		void commit( void *aRecord, size_t aLength )
+		{
+			uint64_t	*hdr = (uint64_t *)aRecord - 1;
+			size_t		pos = (char *)hdr - (char *)_buffer;
+			size_t		used = span(aLength);
+			size_t		have = span((size_t)(__atomic_load_n(hdr, __ATOMIC_RELAXED) & 0xffffffff));
+			if (used < have) {
+				publish(pos + used, ePadding, have - used - eHeader);
+			}
+			publish(pos, eRecord, aLength);
+		}
+
+
+		/**
+		 * This method copies the 'aLength' bytes into the ring as a record,
+		 * and returns 'false' if there's no room for them.
+		 */
+		bool push( const void *aData, size_t aLength )
+		{
+			void	*dest = try_reserve(aLength);
+			if (dest == NULL) {
+				return false;
+			}
+			memcpy(dest, aData, aLength);
+			commit(dest, aLength);
+			return true;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Consumer Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the bytes of the record at the head of the
+		 * ring - right where they sit - and their length in 'aLength', or
+		 * NULL if there's no committed record there. The record stays in
+		 * the ring until the consumer calls release(). Padding is zeroed,
+		 * and skipped over.
+		 */
+		const void *try_front( size_t & aLength )
+		{
+			size_t		head = skip(_head);
+			uint64_t	hdr = __atomic_load_n(word(head), __ATOMIC_ACQUIRE);
+			if ((uint32_t)(hdr >> 32) != eRecord) {
+				// nothing there yet - or not yet committed
+				return NULL;
+			}
+			aLength = (size_t)(hdr & 0xffffffff);
+			return word(head) + 1;
+		}
+
+
+		/**
+		 * This method zeroes the record that try_front() returned - there
+		 * had better be one - and hands its space back to the producers,
+		 * along with any padding that's been committed right after it.
+		 */
+		void release()
+		{
+			size_t	head = _head;
+			skip(retire(head, (size_t)(__atomic_load_n(word(head), __ATOMIC_RELAXED) & 0xffffffff)));
+		}
+
+
+		/**
+		 * This method copies the record at the head of the ring into the
+		 * buffer - if it fits in the 'aCapacity' bytes - and releases it.
+		 * It returns the length of the record, or -1 if there isn't one,
+		 * or it won't fit, in which case it's left in the ring.
+		 */
+		ssize_t pop( void *aBuffer, size_t aCapacity )
+		{
+			size_t		len = 0;
+			const void	*src = try_front(len);
+			if ((src == NULL) || (len > aCapacity)) {
+				return -1;
+			}
+			memcpy(aBuffer, src, len);
+			release();
+			return (ssize_t)len;
+		}
+
+
+	private:
+		/**
+		 * Every record starts with an 8-byte header - the length in the
+		 * low 32 bits, and the kind in the high 32 bits. A kind of zero
+		 * means it's not there yet. Every record is rounded up to eight
+		 * bytes, so the headers are always aligned for the atomic loads.
+		 */
+		enum {
+			eMask = ((1 << N) - 1),
+			eSize = (1 << N),
+			eHeader = sizeof(uint64_t),
+			eRecord = 1,
+			ePadding = 2
+		};
+
+		/**
+		 * This method returns the number of bytes a record of 'aLength'
+		 * takes up in the ring - header and all, rounded up.
+		 */
+		static size_t span( size_t aLength )
+		{
+			return ((eHeader + aLength + 7) & ~((size_t)7));
+		}
+
+		/**
+		 * This method returns the header word at the position in the ring.
+		 */
+		uint64_t *word( size_t aPos )
+		{
+			return &_buffer[(aPos & eMask) / sizeof(uint64_t)];
+		}
+
+		/**
+		 * This method writes the header at the position - last of all, and
+		 * with a release, so that the bytes of the record are seen first.
+		 */
+		void publish( size_t aPos, uint32_t aKind, size_t aLength )
+		{
+			__atomic_store_n(word(aPos), (((uint64_t)aKind << 32) | (uint64_t)aLength), __ATOMIC_RELEASE);
+		}
+
+		/**
+		 * This method zeroes the record of 'aLength' bytes at the head, and
+		 * then moves the head past it, and returns the new head.
+		 */
+		size_t retire( size_t aHead, size_t aLength )
+		{
+			size_t	len = span(aLength);
+			memset(word(aHead), 0, len);
+			__atomic_store_n(&_head, aHead + len, __ATOMIC_RELEASE);
+			return aHead + len;
+		}
+
+		/**
+		 * This method retires all the padding records, in a row, that have
+		 * been committed at the head, and returns the new head.
+		 */
+		size_t skip( size_t aHead )
+		{
+			uint64_t	hdr = __atomic_load_n(word(aHead), __ATOMIC_ACQUIRE);
+			while ((uint32_t)(hdr >> 32) == ePadding) {
+				aHead = retire(aHead, (size_t)(hdr & 0xffffffff));
+				hdr = __atomic_load_n(word(aHead), __ATOMIC_ACQUIRE);
+			}
+			return aHead;
+		}
+
+		/**
+		 * There's no sense in copying these.
+		 */
+		ByteRing( const ByteRing<N> & anOther );
+		ByteRing & operator=( const ByteRing<N> & anOther );
+
+		/**
+		 * The tail is where the producers CAS, and the head is the
+		 * consumer's - each on its own cache line.
+		 */
+		size_t				_tail;
+		char				_pad0[util::cache_line_size - sizeof(size_t)];
+		size_t				_head;
+		char				_pad1[util::cache_line_size - sizeof(size_t)];
+		uint64_t			_buffer[eSize / sizeof(uint64_t)];
+};
+}		// end of namespace mpsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_MPSC_BYTERING_H
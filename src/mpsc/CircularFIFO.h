@@ -14,6 +14,22 @@
  *                  the SINGLE consumer, but the value stays on the queue.
  *                  The pop() will return true if there's something to pop
  *                  off the queue.
+ *
+ *                  Each slot in the ring carries a sequence number that says
+ *                  if it's free for a producer on this lap, or full for the
+ *                  consumer. A producer only claims the tail, with a single
+ *                  CAS, when the slot there is free, so a nearly full ring
+ *                  never has producers moving the tail up and then backing
+ *                  it out again. The value in the slot is only constructed
+ *                  when it's pushed, and destroyed when it's popped.
+ *                  For large records, try_reserve() and commit() let a
+ *                  producer build the element right in its slot, and
+ *                  try_front() and release() let the consumer read it
+ *                  there - with no copies in or out at all.
+ *
+ *                  As with the SPSC queue, S is the instrumentation - see
+ *                  util/queue_stats.h. The producers only touch it with a
+ *                  CAS when the high-water mark goes up, or the ring is full.
  */
 #ifndef __DKIT_MPSC_CIRCULARFIFO_H
 #define __DKIT_MPSC_CIRCULARFIFO_H
@@ -25,6 +41,9 @@
 
 // Other Headers
 #include "FIFO.h"
+#include "util/padding.h"
+#include "util/slot.h"
+#include "util/queue_stats.h"
 
 // Forward Declarations
 
@@ -41,7 +60,7 @@ namespace mpsc {
 /**
  * This is the main class definition
  */
-template <class T, uint8_t N> class CircularFIFO :
+template <class T, uint8_t N, class S = util::no_stats> class CircularFIFO :
 	public FIFO<T>
 {
 	public:
@@ -57,9 +76,11 @@ template <class T, uint8_t N> class CircularFIFO :
 		CircularFIFO() :
 			FIFO<T>(),
 			_elements(),
+			_tail(0),
 			_head(0),
-			_tail(0)
+			_stats(eSize, mp_sc)
 		{
+			initSequences();
 		}
 
 
@@ -68,12 +89,14 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * class to make sure that we control how many copies we have
 		 * floating around in the system.
 		 */
-		CircularFIFO( const CircularFIFO<T, N> & anOther ) :
+		CircularFIFO( const CircularFIFO<T, N, S> & anOther ) :
 			FIFO<T>(),
 			_elements(),
+			_tail(0),
 			_head(0),
-			_tail(0)
+			_stats(eSize, mp_sc)
 		{
+			initSequences();
 			// let the '=' operator do the heavy lifting...
 			*this = anOther;
 		}
@@ -103,16 +126,25 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * sure that no use-case exists where there will be readers or
 		 * writers to this queue while it is being copied in this assignment.
 		 */
-		CircularFIFO & operator=( const CircularFIFO<T, N> & anOther )
+		CircularFIFO & operator=( const CircularFIFO<T, N, S> & anOther )
 		{
 			if (this != & anOther) {
-				// now let's copy in the elements one by one
-				for (size_t i = 0; i < eSize; i++) {
-					_elements[i] = anOther._elements[i];
+				// drop what we have, and copy in what's in his queue
+				clear();
+				size_t	head = anOther._head;
+				size_t	tail = anOther._tail;
+				for (size_t i = head; i < (head + eSize); ++i) {
+					Node	&node = _elements[i & eMask];
+					if (i < tail) {
+						node.value.construct(anOther._elements[i & eMask].value.ref());
+						node.seq = i + 1;
+					} else {
+						node.seq = i;
+					}
 				}
 				// now copy the pointers
-				_head = anOther._head;
-				_tail = anOther._tail;
+				_head = head;
+				_tail = tail;
 			}
 			return *this;
 		}
@@ -132,10 +164,15 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual size_t size() const
 		{
-			size_t		sz = _tail - _head;
-			// see if we wrapped around - and correct the unsigned math
-			if (sz > eSize) {
-				sz = (sz + eSize) & eMask;
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			size_t	sz = 0;
+			// the indexes are free-running, so just make sure they make sense
+			if (tail > head) {
+				sz = tail - head;
+				if (sz > eSize) {
+					sz = eSize;
+				}
 			}
 			return sz;
 		}
@@ -158,6 +195,18 @@ template <class T, uint8_t N> class CircularFIFO :
 		}
 
 
+		/**
+		 * This method returns the instrumentation of the queue - the S
+		 * it was made with. The default, util::no_stats, has nothing in
+		 * it, but util::queue_stats has the high-water mark, the failed
+		 * pushes and pops, and the time the elements sat in the queue.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
 		/********************************************************
 		 *
 		 *                Element Accessing Methods
@@ -169,22 +218,30 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool push( const T & anElem )
 		{
-			bool		error = false;
-
-			// move the tail (insertion point) and get the old value for me
-			size_t	insPt = __sync_fetch_and_add(&_tail, 1) & eMask;
-			// see if we've crashed the queue all the way around...
-			if (_elements[insPt].valid) {
-				// try to back out the damage we've done to the tail
-				__sync_sub_and_fetch(&_tail, 1);
-				error = true;
-			} else {
-				// save the data in the right spot and flag it as valid
-				const_cast<T &>(_elements[insPt].value) = anElem;
-				_elements[insPt].valid = true;
+			if (std::is_nothrow_copy_constructible<T>::value) {
+				return put(anElem);
 			}
+			return put(util::copy_of(anElem));
+		}
 
-			return !error;
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			if (std::is_nothrow_constructible<T, Args &&...>::value) {
+				return put(std::forward<Args>(args)...);
+			}
+			return put(T(std::forward<Args>(args)...));
 		}
 
 
@@ -192,29 +249,26 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * This method updates the passed-in reference with the value on the
 		 * top of the queue - if it can. If so, it'll return the value and
 		 * 'true', but if it can't, as in the queue is empty, then the method
-		 * will return 'false' and the value will be untouched.
+		 * will return 'false' and the value will be untouched. As there's
+		 * only the one consumer, there's no need to CAS the head.
 		 */
 		virtual bool pop( T & anElem )
 		{
-			bool		error = false;
-
-			// see if we have an empty queue...
-			if (!_elements[_head & eMask].valid) {
-				error = true;
-			} else {
-				/**
-				 * We need to get the current _head, and post-fetch increment
-				 * it, and then pull out the value from the head and then
-				 * invalidate the location in the queue. This looks a little
-				 * off until you remember that the fetch is done BEFORE the
-				 * adding of the 1 to _head.
-				 */
-				size_t	grab = __sync_fetch_and_add(&_head, 1) & eMask;
-				anElem = const_cast<T &>(_elements[grab].value);
-				_elements[grab].valid = false;
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & eMask];
+			// see if the producer for this slot has filled it yet
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				_stats.pop_empty();
+				return false;
 			}
 
-			return !error;
+			// move out the data and hand the slot to the next lap's producers
+			anElem = std::move(node->value.ref());
+			node->value.destroy();
+			_stats.popped(pos & eMask);
+			__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+			__atomic_store_n(&_head, (pos + 1), __ATOMIC_RELEASE);
+			return true;
 		}
 
 
@@ -227,10 +281,17 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual T pop()
 		{
-			T		v;
-			if (!pop(v)) {
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & eMask];
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				_stats.pop_empty();
 				throw std::exception();
 			}
+			T		v(std::move(node->value.ref()));
+			node->value.destroy();
+			_stats.popped(pos & eMask);
+			__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+			__atomic_store_n(&_head, (pos + 1), __ATOMIC_RELEASE);
 			return v;
 		}
 
@@ -242,16 +303,15 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool peek( T & anElem )
 		{
-			bool		error = false;
-
-			// see if we have an empty queue...
-			if (!_elements[_head & eMask].valid) {
-				error = true;
-			} else {
-				anElem = const_cast<T &>(_elements[_head & eMask].value);
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & eMask];
+			// see if the producer for this slot has filled it yet
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				return false;
 			}
 
-			return !error;
+			util::copy_assign(anElem, node->value.ref());
+			return true;
 		}
 
 
@@ -263,11 +323,12 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual T peek()
 		{
-			T		v;
-			if (!peek(v)) {
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & eMask];
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
 				throw std::exception();
 			}
-			return v;
+			return util::copy_of(node->value.ref());
 		}
 
 
@@ -278,8 +339,14 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual void clear()
 		{
-			T		v;
-			while (pop(v));
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & eMask];
+			while (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) == (pos + 1)) {
+				node->value.destroy();
+				__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+				node = &_elements[++pos & eMask];
+			}
+			__atomic_store_n(&_head, pos, __ATOMIC_RELEASE);
 		}
 
 
@@ -289,7 +356,83 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool empty()
 		{
-			return (_head == _tail);
+			return (size() == 0);
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                     In-Place Accessing Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method claims the slot at the tail - with a T default-
+		 * initialized in it, which for a plain struct is nothing at all -
+		 * for the calling producer to fill in where it sits. It returns
+		 * NULL if the queue is full. The consumer won't see it, or anything
+		 * pushed after it, until it's handed to commit() - so fill it in
+		 * and commit it quickly. A producer can hold several at once.
+		 */
+		T *try_reserve()
+		{
+			size_t	pos = 0;
+			Node	*node = claim(pos);
+			if (node == NULL) {
+				_stats.push_failed();
+				return NULL;
+			}
+			return node->value.construct_default();
+		}
+
+
+		/**
+		 * This method publishes the element that try_reserve() returned.
+		 * With many producers, there's no 'last' reservation, so this one
+		 * needs to be told which it is. The slot's sequence is still the
+		 * index it was claimed at, as no one else touches it until now.
+		 */
+		void commit( T *anElem )
+		{
+			Node	*node = &_elements[((char *)anElem - (char *)_elements[0].value.raw()) / sizeof(Node)];
+			size_t	pos = __atomic_load_n(&node->seq, __ATOMIC_RELAXED);
+			if (S::eEnabled) {
+				_stats.pushed(pos & eMask, (pos + 1 - __atomic_load_n(&_head, __ATOMIC_RELAXED)));
+			}
+			__atomic_store_n(&node->seq, (pos + 1), __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method returns the element at the head of the queue - right
+		 * where it sits in the ring - or NULL if the queue is empty. It
+		 * stays there, and no producer can reuse the slot, until the
+		 * consumer calls release().
+		 */
+		const T *try_front()
+		{
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & eMask];
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				_stats.pop_empty();
+				return NULL;
+			}
+			return &node->value.ref();
+		}
+
+
+		/**
+		 * This method destroys the element that try_front() returned -
+		 * there had better be one - and hands its slot to the next lap's
+		 * producers, just as pop() would.
+		 */
+		void release()
+		{
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & eMask];
+			node->value.destroy();
+			_stats.popped(pos & eMask);
+			__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+			__atomic_store_n(&_head, (pos + 1), __ATOMIC_RELEASE);
 		}
 
 
@@ -310,7 +453,7 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * possible to make a good equals operator, it's not worth the cost
 		 * at this time. This method will always return 'false'.
 		 */
-		bool operator==( const CircularFIFO<T,N> & anOther ) const
+		bool operator==( const CircularFIFO<T,N,S> & anOther ) const
 		{
 			return false;
 		}
@@ -328,13 +471,43 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * possible to make a good not-equals operator, it's not worth the cost
 		 * at this time. This method will always return 'true'.
 		 */
-		bool operator!=( const CircularFIFO<T,N> & anOther ) const
+		bool operator!=( const CircularFIFO<T,N,S> & anOther ) const
 		{
 			return !operator==(anOther);
 		}
 
 
 	private:
+		/**
+		 * A producer only tries to claim the tail when the slot it points
+		 * to is free on this lap, so a failed CAS just means another
+		 * producer got there first, and we try again at the new tail. If
+		 * the slot isn't free, the queue is full, and the tail is untouched.
+		 * Once claimed, the element is built in the slot from the arguments
+		 * - copying, moving, or constructing it in place.
+		 * A claimed slot can't be given back, so the element had better
+		 * not throw as it's built - push() and emplace() make a throwing
+		 * element outside the queue first, and then move it in.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			size_t	pos = 0;
+			Node	*node = claim(pos);
+			if (node == NULL) {
+				_stats.push_failed();
+				return false;
+			}
+
+			// build the data and hand the slot to the consumer
+			node->value.construct(std::forward<Args>(args)...);
+			if (S::eEnabled) {
+				_stats.pushed(pos & eMask, (pos + 1 - __atomic_load_n(&_head, __ATOMIC_RELAXED)));
+			}
+			__atomic_store_n(&node->seq, (pos + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
 		/**
 		 * Since the size of the queue is in the definition of the
 		 * instance, it's possible to make some very simple enums that
@@ -344,33 +517,83 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		enum {
 			eMask = ((1 << N) - 1),
-			eSize = (1 << N)
+			eSize = (1 << N),
+			ePad = (util::cache_line_size - sizeof(size_t))
 		};
 
 		/**
 		 * In order to simplify the ring buffer access, I'm going to actually
 		 * have the ring a series of 'nodes', and for each, there will be a
-		 * value and a valid 'flag'. If the flag isn't true, then the value
-		 * in the node isn't valid. We'll use this to decouple the push()
-		 * and pop() so that each only needs to know it's own location and
-		 * then interrogate the node for state.
+		 * value and a sequence number. When the sequence equals the index
+		 * a producer is at, the slot is free for that producer. When it's
+		 * one more than the index the consumer is at, the slot is full for
+		 * the consumer, who then moves it a full lap ahead for the next
+		 * producer. This decouples the push() and pop() so that each only
+		 * needs to know it's own location and then interrogate the node.
+		 * The value is only constructed while the slot is full.
 		 */
 		struct Node {
-			T		value;
-			bool	valid;
+			size_t			seq;
+			util::slot<T>	value;
 
-			Node() : value(), valid(false) { }
-			Node( const T & aValue ) : value(aValue), valid(true) { }
+			Node() : seq(0), value() { }
 			~Node() { }
 		};
 
 		/**
-		 * We have a very simple structure - an array of values of a fixed
-		 * size and a simple head and tail.
+		 * This method sets the sequence of each slot to its own index, so
+		 * that they are all free for the producers on the first lap.
+		 */
+		void initSequences()
+		{
+			for (size_t i = 0; i < eSize; ++i) {
+				_elements[i].seq = i;
+			}
+		}
+
+		/**
+		 * This method claims the slot at the tail for the calling producer,
+		 * and returns it - with its index in 'aPos' - or returns NULL if
+		 * the queue is full.
+		 */
+		Node *claim( size_t & aPos )
+		{
+			size_t	pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+			while (true) {
+				Node		*node = &_elements[pos & eMask];
+				size_t		seq = __atomic_load_n(&node->seq, __ATOMIC_ACQUIRE);
+				intptr_t	diff = (intptr_t)seq - (intptr_t)pos;
+				if (diff == 0) {
+					// the slot is ours for the taking - if we can claim it
+					if (__atomic_compare_exchange_n(&_tail, &pos, (pos + 1), true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						aPos = pos;
+						return node;
+					}
+				} else if (diff < 0) {
+					// the consumer hasn't gotten to this slot - we're full
+					return NULL;
+				} else {
+					// another producer beat us to it - catch up
+					pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+				}
+			}
+		}
+
+		/**
+		 * We have a very simple structure - an array of nodes of a fixed
+		 * size and then the tail and the head - each on its own cache line,
+		 * so that the producers claiming the tail don't slow down the
+		 * consumer moving the head.
 		 */
-		volatile Node		_elements[eSize];
-		volatile size_t		_head;
-		volatile size_t		_tail;
+		Node				_elements[eSize];
+		char				_pad0[ePad];
+		size_t				_tail;
+		char				_pad1[ePad];
+		size_t				_head;
+		char				_pad2[ePad];
+		// ...and this is the instrumentation, if there is any
+		S					_stats;
 };
 }		// end of namespace mpsc
 }		// end of namespace dkit
@@ -0,0 +1,527 @@
+/**
+ * DynamicCircularFIFO.h - this file defines the template class for a
+ *                         multi-producer, single-consumer, circular FIFO
+ *                         queue that works just like the mpsc::CircularFIFO,
+ *                         but whose size is given to the constructor at
+ *                         run-time and not in the template. The elements are
+ *                         held in a block of memory mapped out of line -
+ *                         optionally on huge pages - and pre-faulted when
+ *                         the queue is made, so the depth of the queue can
+ *                         come from the configuration of the process, and
+ *                         not a recompile.
+ *
+ *                         S is the instrumentation, just as it is for the
+ *                         mpsc::CircularFIFO - see util/queue_stats.h.
+ */
+#ifndef __DKIT_MPSC_DYNAMICCIRCULARFIFO_H
+#define __DKIT_MPSC_DYNAMICCIRCULARFIFO_H
+
+// System Headers
+#include <stdint.h>
+#include <new>
+#include <stdexcept>
+
+// Third-Party Headers
+
+// Other Headers
+#include "FIFO.h"
+#include "util/padding.h"
+#include "util/slot.h"
+#include "util/ring_storage.h"
+#include "util/queue_stats.h"
+
+// Forward Declarations
+
+// Public Constants
+
+// Public Datatypes
+
+// Public Data Constants
+
+
+
+namespace dkit {
+namespace mpsc {
+/**
+ * This is the main class definition
+ */
+template <class T, class S = util::no_stats> class DynamicCircularFIFO :
+	public FIFO<T>
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This form of the constructor makes a queue with room for at
+		 * least 'aCapacity' slots - rounded up to the next power of two -
+		 * and, if asked, places them on huge pages. There's no T built
+		 * until it's pushed, so T doesn't need a default constructor.
+		 */
+		DynamicCircularFIFO( size_t aCapacity, bool useHugePages = false ) :
+			FIFO<T>(),
+			_capacity(util::ring_storage::powerOfTwo(aCapacity)),
+			_mask(_capacity - 1),
+			_storage(_capacity * sizeof(Node), useHugePages),
+			_elements(NULL),
+			_tail(0),
+			_head(0),
+			_stats(_capacity, mp_sc)
+		{
+			initElements();
+		}
+
+
+		/**
+		 * This is the standard copy constructor that needs to be in every
+		 * class to make sure that we control how many copies we have
+		 * floating around in the system. The copy will have the same
+		 * capacity, and the same use of huge pages, as the original.
+		 */
+		DynamicCircularFIFO( const DynamicCircularFIFO<T, S> & anOther ) :
+			FIFO<T>(),
+			_capacity(anOther._capacity),
+			_mask(anOther._mask),
+			_storage(anOther._capacity * sizeof(Node), anOther._storage.isHuge()),
+			_elements(NULL),
+			_tail(0),
+			_head(0),
+			_stats(_capacity, mp_sc)
+		{
+			initElements();
+			// let the '=' operator do the heavy lifting...
+			*this = anOther;
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called.
+		 */
+		virtual ~DynamicCircularFIFO()
+		{
+			clear();
+			// now destroy the nodes - the storage goes back to the OS
+			for (size_t i = 0; i < _capacity; ++i) {
+				_elements[i].~Node();
+			}
+		}
+
+
+		/**
+		 * When we process the result of an equality we need to make sure
+		 * that we do this right by always having an equals operator on
+		 * all classes.
+		 *
+		 * Because of the multi-producer, single-consumer, nature of
+		 * this class, it is IMPOSSIBLE to have the assignment operator
+		 * be thread-safe without a mutex. This defeats the entire
+		 * purpose, so what we have is a non-thread-safe assignment
+		 * operator that is still useful if care is exercised to make
+		 * sure that no use-case exists where there will be readers or
+		 * writers to this queue while it is being copied in this assignment.
+		 */
+		DynamicCircularFIFO & operator=( const DynamicCircularFIFO<T, S> & anOther )
+		{
+			if (this != & anOther) {
+				if (_capacity != anOther._capacity) {
+					throw std::runtime_error("[DynamicCircularFIFO::operator=] Unable to assign queues of different capacities!");
+				}
+				// drop what we have, and copy in what's in his queue
+				clear();
+				size_t	head = anOther._head;
+				size_t	tail = anOther._tail;
+				for (size_t i = head; i < (head + _capacity); ++i) {
+					Node	&node = _elements[i & _mask];
+					if (i < tail) {
+						node.value.construct(anOther._elements[i & _mask].value.ref());
+						node.seq = i + 1;
+					} else {
+						node.seq = i;
+					}
+				}
+				// now copy the pointers
+				_head = head;
+				_tail = tail;
+			}
+			return *this;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This pair of methods does what you'd expect - it returns the
+		 * length of the queue as it exists at the present time. It's
+		 * got two names because there are so many different kinds of
+		 * implementations that it's often convenient to use one or the
+		 * other to remain consistent.
+		 */
+		virtual size_t size() const
+		{
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			size_t	sz = 0;
+			// the indexes are free-running, so just make sure they make sense
+			if (tail > head) {
+				sz = tail - head;
+				if (sz > _capacity) {
+					sz = _capacity;
+				}
+			}
+			return sz;
+		}
+
+
+		virtual size_t length() const
+		{
+			return size();
+		}
+
+
+		/**
+		 * This method returns the current capacity of the vector and
+		 * is NOT the size per se. The capacity is what this queue
+		 * will hold.
+		 */
+		virtual size_t capacity() const
+		{
+			return _capacity;
+		}
+
+
+		/**
+		 * This method returns 'true' if the storage for the queue ended
+		 * up on huge pages. If they were asked for, but the system has
+		 * none to give, this will be 'false', but the queue still works.
+		 */
+		bool isOnHugePages() const
+		{
+			return _storage.isHuge();
+		}
+
+
+		/**
+		 * This method returns the instrumentation of the queue - the S it
+		 * was made with, which is util::no_stats, and empty, by default.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes an item and places it in the queue - if it can.
+		 * If so, then it will return 'true', otherwise, it'll return 'false'.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			if (std::is_nothrow_copy_constructible<T>::value) {
+				return put(anElem);
+			}
+			return put(util::copy_of(anElem));
+		}
+
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			if (std::is_nothrow_constructible<T, Args &&...>::value) {
+				return put(std::forward<Args>(args)...);
+			}
+			return put(T(std::forward<Args>(args)...));
+		}
+
+
+		/**
+		 * This method updates the passed-in reference with the value on the
+		 * top of the queue - if it can. If so, it'll return the value and
+		 * 'true', but if it can't, as in the queue is empty, then the method
+		 * will return 'false' and the value will be untouched. As there's
+		 * only the one consumer, there's no need to CAS the head.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & _mask];
+			// see if the producer for this slot has filled it yet
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				_stats.pop_empty();
+				return false;
+			}
+
+			// move out the data and hand the slot to the next lap's producers
+			anElem = std::move(node->value.ref());
+			node->value.destroy();
+			_stats.popped(pos & _mask);
+			__atomic_store_n(&node->seq, (pos + _capacity), __ATOMIC_RELEASE);
+			__atomic_store_n(&_head, (pos + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue. This is a slightly different
+		 * form that fits a different use-case, and so it's a handy
+		 * thing to have around at times.
+		 */
+		virtual T pop()
+		{
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & _mask];
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				_stats.pop_empty();
+				throw std::exception();
+			}
+			T		v(std::move(node->value.ref()));
+			node->value.destroy();
+			_stats.popped(pos & _mask);
+			__atomic_store_n(&node->seq, (pos + _capacity), __ATOMIC_RELEASE);
+			__atomic_store_n(&_head, (pos + 1), __ATOMIC_RELEASE);
+			return v;
+		}
+
+
+		/**
+		 * If there is an item on the queue, this method will return a look
+		 * at that item without updating the queue. The return value will be
+		 * 'true' if there is something, but 'false' if the queue is empty.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & _mask];
+			// see if the producer for this slot has filled it yet
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				return false;
+			}
+
+			util::copy_assign(anElem, node->value.ref());
+			return true;
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & _mask];
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				throw std::exception();
+			}
+			return util::copy_of(node->value.ref());
+		}
+
+
+		/**
+		 * This method will clear out the contents of the queue so if
+		 * you're storing pointers, then you need to be careful as this
+		 * could leak.
+		 */
+		virtual void clear()
+		{
+			size_t	pos = _head;
+			Node	*node = &_elements[pos & _mask];
+			while (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) == (pos + 1)) {
+				node->value.destroy();
+				__atomic_store_n(&node->seq, (pos + _capacity), __ATOMIC_RELEASE);
+				node = &_elements[++pos & _mask];
+			}
+			__atomic_store_n(&_head, pos, __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method will return 'true' if there are no items in the
+		 * queue. Simple.
+		 */
+		virtual bool empty()
+		{
+			return (size() == 0);
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                         Utility Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are the same. The problem with this is that in a
+		 * single-producer, single-consumer system, there's no thread that
+		 * can actually perform this operation in a thread-safe manner.
+		 *
+		 * Moreover, the complexity in doing this is far more than we want to
+		 * take on in this class. It's lightweight, and while it's certainly
+		 * possible to make a good equals operator, it's not worth the cost
+		 * at this time. This method will always return 'false'.
+		 */
+		bool operator==( const DynamicCircularFIFO<T, S> & anOther ) const
+		{
+			return false;
+		}
+
+
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are NOT the same. The problem with this is that in a
+		 * single-producer, single-consumer system, there's no thread that
+		 * can actually perform this operation in a thread-safe manner.
+		 *
+		 * Moreover, the complexity in doing this is far more than we want to
+		 * take on in this class. It's lightweight, and while it's certainly
+		 * possible to make a good not-equals operator, it's not worth the cost
+		 * at this time. This method will always return 'true'.
+		 */
+		bool operator!=( const DynamicCircularFIFO<T, S> & anOther ) const
+		{
+			return !operator==(anOther);
+		}
+
+
+	private:
+		/**
+		 * A producer only tries to claim the tail when the slot it points
+		 * to is free on this lap, so a failed CAS just means another
+		 * producer got there first, and we try again at the new tail. If
+		 * the slot isn't free, the queue is full, and the tail is untouched.
+		 * Once claimed, the element is built in the slot from the arguments
+		 * - copying, moving, or constructing it in place.
+		 * A claimed slot can't be given back, so the element had better
+		 * not throw as it's built - push() and emplace() make a throwing
+		 * element outside the queue first, and then move it in.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			Node	*node = NULL;
+			size_t	pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+			while (true) {
+				node = &_elements[pos & _mask];
+				size_t		seq = __atomic_load_n(&node->seq, __ATOMIC_ACQUIRE);
+				intptr_t	diff = (intptr_t)seq - (intptr_t)pos;
+				if (diff == 0) {
+					// the slot is ours for the taking - if we can claim it
+					if (__atomic_compare_exchange_n(&_tail, &pos, (pos + 1), true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						break;
+					}
+				} else if (diff < 0) {
+					// the consumer hasn't gotten to this slot - we're full
+					_stats.push_failed();
+					return false;
+				} else {
+					// another producer beat us to it - catch up
+					pos = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+				}
+			}
+
+			// build the data and hand the slot to the consumer
+			node->value.construct(std::forward<Args>(args)...);
+			if (S::eEnabled) {
+				_stats.pushed(pos & _mask, (pos + 1 - __atomic_load_n(&_head, __ATOMIC_RELAXED)));
+			}
+			__atomic_store_n(&node->seq, (pos + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * Since the size of the queue is given at run-time, we need to
+		 * hold on to the size and the masking bits for the index values,
+		 * so that we know how to "wrap around" when the time comes.
+		 */
+		size_t				_capacity;
+		size_t				_mask;
+
+		/**
+		 * The padding to keep the tail and the head on their own cache
+		 * lines, so that the producers don't slow down the consumer.
+		 */
+		enum {
+			ePad = (util::cache_line_size - sizeof(size_t))
+		};
+
+		/**
+		 * In order to simplify the ring buffer access, I'm going to actually
+		 * have the ring a series of 'nodes', and for each, there will be a
+		 * value and a sequence number. When the sequence equals the index
+		 * a producer is at, the slot is free for that producer. When it's
+		 * one more than the index the consumer is at, the slot is full for
+		 * the consumer, who then moves it a full lap ahead for the next
+		 * producer. This decouples the push() and pop() so that each only
+		 * needs to know it's own location and then interrogate the node.
+		 * The value is only constructed while the slot is full.
+		 */
+		struct Node {
+			size_t			seq;
+			util::slot<T>	value;
+
+			Node() : seq(0), value() { }
+			~Node() { }
+		};
+
+		/**
+		 * This method places a default constructed Node in each of the
+		 * slots of the mapped storage, with the sequence set to its own
+		 * index so that they are all free for the producers on the first
+		 * lap. It's only called from the constructors.
+		 */
+		void initElements()
+		{
+			_elements = (Node *)_storage.data();
+			for (size_t i = 0; i < _capacity; ++i) {
+				new ((void *)&_elements[i]) Node();
+				_elements[i].seq = i;
+			}
+		}
+
+		/**
+		 * We have a very simple structure - an out-of-line block of nodes
+		 * of the run-time size and a simple head and tail.
+		 */
+		util::ring_storage	_storage;
+		Node				*_elements;
+		char				_pad0[ePad];
+		size_t				_tail;
+		char				_pad1[ePad];
+		size_t				_head;
+		char				_pad2[ePad];
+		// ...and this is the instrumentation, if there is any
+		S					_stats;
+};
+}		// end of namespace mpsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_MPSC_DYNAMICCIRCULARFIFO_H
@@ -3,17 +3,24 @@
  *                FIFO queue and is using the compare-and-swap to achieve
  *                the lock-free goal. There can be any number of threads that
  *                call the push() methods, but there can be ONE and ONLY ONE
- *                thread that calls the pop() methods.
+ *                thread that calls the pop() methods. The nodes come from
+ *                a free list, and the consumer retires the ones it's done
+ *                with to the epoch domain, so that a thread walking the list
+ *                - in size(), for instance - never sees one reused.
  */
 #ifndef __DKIT_MPSC_LINKEDFIFO_H
 #define __DKIT_MPSC_LINKEDFIFO_H
 
 // System Headers
+#include <utility>
 
 // Third-Party Headers
 
 // Other Headers
 #include "FIFO.h"
+#include "util/slot.h"
+#include "util/epoch.h"
+#include "util/free_list.h"
 
 // Forward Declarations
 
@@ -48,7 +55,7 @@ template <class T> class LinkedFIFO :
 			_tail(NULL)
 		{
 			// start with my first (empty) node
-			_head = new Node();
+			_head = newNode();
 			_tail = _head;
 		}
 
@@ -63,7 +70,10 @@ template <class T> class LinkedFIFO :
 			_head(NULL),
 			_tail(NULL)
 		{
-			// let the '=' operator do the heavy lifting...
+			// start with my first (empty) node, just like the default
+			_head = newNode();
+			_tail = _head;
+			// ...and let the '=' operator do the heavy lifting...
 			*this = anOther;
 		}
 
@@ -78,7 +88,7 @@ template <class T> class LinkedFIFO :
 			clear();
 			// now clean out the last node (empty) in the list
 			if (_head != NULL) {
-				delete _head;
+				deleteNode(_head);
 				_head = NULL;
 			}
 		}
@@ -106,7 +116,7 @@ template <class T> class LinkedFIFO :
 				 * order so they are appended to us.
 				 */
 				for (Node *n = anOther._head->next; n != NULL; n = n->next) {
-					if (!push(n->value)) {
+					if (!push(n->value.ref())) {
 						break;
 					}
 				}
@@ -126,29 +136,24 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual bool push( const T & anElem )
 		{
-			bool		error = false;
+			return put(anElem);
+		}
 
-			// create a new Node with the provided value
-			Node	*me = new Node(anElem);
-			if (me == NULL) {
-				error = true;
-			} else {
-				/**
-				 * We need to add the new value to the tail and then link it
-				 * back into the list. Not too bad.
-				 */
-				// put in the new tail, and get the old one
-				Node	*oldTail = _tail;
-				while (!__sync_bool_compare_and_swap(&_tail, oldTail, me)) {
-					oldTail = _tail;
-				}
-				// OK, make sure that the list remains intact
-				if (oldTail != NULL) {
-					oldTail->next = me;
-				}
-			}
 
-			return !error;
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * new node from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			return put(std::forward<Args>(args)...);
 		}
 
 
@@ -166,12 +171,13 @@ template <class T> class LinkedFIFO :
 			if (__sync_bool_compare_and_swap(&(_head->next), NULL, NULL)) {
 				error = true;
 			} else {
-				// move the head to the next Node and get the value
+				// move the head to the next Node and move out the value
 				Node	*oldHead = __sync_val_compare_and_swap(&_head, _head, _head->next);
-				anElem = _head->value;
-				// if there is an oldHead (should be), delete it now
+				anElem = std::move(_head->value.ref());
+				_head->value.destroy();
+				// if there is an oldHead (should be), retire it now
 				if (oldHead != NULL) {
-					delete oldHead;
+					retire(oldHead);
 				}
 			}
 
@@ -188,10 +194,17 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual T pop()
 		{
-			T		v;
-			if (!pop(v)) {
+			// if the next guy is NULL, we're empty
+			if (__sync_bool_compare_and_swap(&(_head->next), NULL, NULL)) {
 				throw std::exception();
 			}
+			// move the head to the next Node and move out the value
+			Node	*oldHead = __sync_val_compare_and_swap(&_head, _head, _head->next);
+			T		v(std::move(_head->value.ref()));
+			_head->value.destroy();
+			if (oldHead != NULL) {
+				retire(oldHead);
+			}
 			return v;
 		}
 
@@ -210,7 +223,7 @@ template <class T> class LinkedFIFO :
 				error = true;
 			} else {
 				// look at the next valid node to get the next value
-				anElem = _head->next->value;
+				util::copy_assign(anElem, _head->next->value.ref());
 			}
 
 			return !error;
@@ -225,11 +238,11 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual T peek()
 		{
-			T		v;
-			if (!peek(v)) {
+			// if the next guy is NULL, we're empty
+			if (__sync_bool_compare_and_swap(&(_head->next), NULL, NULL)) {
 				throw std::exception();
 			}
-			return v;
+			return util::copy_of(_head->next->value.ref());
 		}
 
 
@@ -240,9 +253,13 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual void clear()
 		{
-			// pretty simple - just pop everything off the queue
-			T		v;
-			while (pop(v));
+			// pretty simple - just drop everything on the queue
+			while (!__sync_bool_compare_and_swap(&(_head->next), NULL, NULL)) {
+				Node	*oldHead = _head;
+				_head = oldHead->next;
+				_head->value.destroy();
+				retire(oldHead);
+			}
 		}
 
 
@@ -261,10 +278,12 @@ template <class T> class LinkedFIFO :
 		 * queue. Since it's possible that multiple threads are adding
 		 * to this queue at any one point in time, it's really at BEST
 		 * a snapshot of the size, and is only completely accurate
-		 * when the queue is stable.
+		 * when the queue is stable. The guard keeps the nodes we walk
+		 * from being reused while we're on them.
 		 */
 		virtual size_t size() const
 		{
+			util::epoch::guard	g;
 			size_t		retval = 0;
 			for (Node *n = _head->next; n != NULL; n = n->next) {
 				++retval;
@@ -294,10 +313,10 @@ template <class T> class LinkedFIFO :
 
 			// next, check the elements for equality
 			if (equals) {
-				Node	*me = _head;
-				Node	*him = anOther._head;
+				Node	*me = _head->next;
+				Node	*him = anOther._head->next;
 				while (me != NULL) {
-					if ((him == NULL) || (me->value != him->value)) {
+					if ((him == NULL) || (me->value.ref() != him->value.ref())) {
 						equals = false;
 						break;
 					}
@@ -322,19 +341,73 @@ template <class T> class LinkedFIFO :
 
 	private:
 		/**
-		 * My linked list will be made of these nodes, and I'll make them
-		 * with the one-argument constructor that just sets the value and
-		 * nulls out the next pointer. Pretty simple.
+		 * My linked list will be made of these nodes, and the value is
+		 * only constructed when it's pushed. The head of the list is always
+		 * an empty node - the one whose value has been popped - so it's
+		 * the one after the head that has the next value.
 		 */
 		struct Node {
-			T		value;
-			Node	*next;
+			util::slot<T>	value;
+			Node			*next;
 
 			Node() : value(), next(NULL) { }
-			Node( const T & aValue ) : value(aValue), next(NULL) { }
 			~Node() { }
 		};
 
+		/**
+		 * This method builds a new node with the element made from the
+		 * arguments - copying, moving, or constructing it in place - and
+		 * then links it into the list. If the element can't be made, the
+		 * node is dropped, and the exception goes on to the caller.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			Node	*me = newNode();
+			try {
+				me->value.construct(std::forward<Args>(args)...);
+			} catch (...) {
+				deleteNode(me);
+				throw;
+			}
+
+			/**
+			 * We need to add the new value to the tail and then link it
+			 * back into the list. Not too bad.
+			 */
+			// put in the new tail, and get the old one
+			Node	*oldTail = _tail;
+			while (!__sync_bool_compare_and_swap(&_tail, oldTail, me)) {
+				oldTail = _tail;
+			}
+			// OK, make sure that the list remains intact - once the value is there
+			if (oldTail != NULL) {
+				__atomic_store_n(&(oldTail->next), me, __ATOMIC_RELEASE);
+			}
+			return true;
+		}
+
+		/**
+		 * These methods make a node from the free list, and give one back
+		 * - right away, when no other thread can see it, or by retiring it
+		 * to the epoch domain, so it goes back on the free list only when
+		 * no thread can be looking at it.
+		 */
+		static Node *newNode()
+		{
+			return new (util::free_list<Node>::get()) Node();
+		}
+
+		static void deleteNode( Node *aNode )
+		{
+			aNode->~Node();
+			util::free_list<Node>::put(aNode);
+		}
+
+		static void retire( Node *aNode )
+		{
+			util::epoch::retire(aNode, &util::free_list<Node>::put);
+		}
+
 		/**
 		 * We have a very simple structure - a singly-linked list of values
 		 * that I'm just going to be very careful about modifying.
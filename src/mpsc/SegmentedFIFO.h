@@ -0,0 +1,567 @@
+/**
+ * SegmentedFIFO.h - this file defines a multi-producer, single-consumer,
+ *                   unbounded FIFO queue built from a linked list of fixed
+ *                   sized segments of 2^S slots. There can be any number of
+ *                   threads that call the push() methods, but there can be
+ *                   ONE and ONLY ONE thread that calls the pop() methods.
+ *
+ *                   Unlike the LinkedFIFO, there's no new and delete for each
+ *                   element - a producer claims a slot in the tail segment
+ *                   with one fetch-and-add, and a new segment is only needed
+ *                   once every 2^S pushes. When the consumer, and all the
+ *                   producers, are done with a segment, it's put in a small
+ *                   cache so that the next new segment doesn't even need to
+ *                   go to the heap.
+ *
+ *                   The tail is a single word with the address of the tail
+ *                   segment in the high bits, and the count of producers that
+ *                   have claimed a slot in it in the low bits - the segments
+ *                   are aligned so that the low bits of the address are zero.
+ *                   The one fetch-and-add gives a producer the segment and its
+ *                   slot in it, at the same instant, so a producer can never
+ *                   claim a slot in a segment that's been recycled. Those that
+ *                   find the segment full link on the next segment and then
+ *                   swap the tail over to it, and the one that makes the swap
+ *                   knows exactly how many of them there were, so that the
+ *                   last one out can recycle the segment.
+ *
+ *                   The size() and peek() methods, like pop(), are for the
+ *                   consumer's thread only.
+ */
+#ifndef __DKIT_MPSC_SEGMENTEDFIFO_H
+#define __DKIT_MPSC_SEGMENTEDFIFO_H
+
+// System Headers
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Third-Party Headers
+
+// Other Headers
+#include "FIFO.h"
+#include "util/padding.h"
+#include "util/slot.h"
+#include "mpmc/CircularFIFO.h"
+
+// Forward Declarations
+
+// Public Constants
+
+// Public Datatypes
+
+// Public Data Constants
+
+
+namespace dkit {
+namespace mpsc {
+/**
+ * This is the main class definition - the segments hold 2^S elements each.
+ */
+template <class T, uint8_t S = 10> class SegmentedFIFO :
+	public FIFO<T>
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the default constructor that makes an empty queue with
+		 * its first segment ready to be filled.
+		 */
+		SegmentedFIFO() :
+			FIFO<T>(),
+			_tail(0),
+			_head(NULL),
+			_headIdx(0),
+			_cache()
+		{
+			Segment	*seg = allocate();
+			_head = seg;
+			_tail = (uintptr_t)seg;
+		}
+
+
+		/**
+		 * This is the standard copy constructor that needs to be in every
+		 * class to make sure that we control how many copies we have
+		 * floating around in the system.
+		 */
+		SegmentedFIFO( const SegmentedFIFO<T, S> & anOther ) :
+			FIFO<T>(),
+			_tail(0),
+			_head(NULL),
+			_headIdx(0),
+			_cache()
+		{
+			Segment	*seg = allocate();
+			_head = seg;
+			_tail = (uintptr_t)seg;
+			// let the '=' operator do the heavy lifting...
+			*this = anOther;
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called.
+		 */
+		virtual ~SegmentedFIFO()
+		{
+			clear();
+			// there's no one else here, so drop the segments we have left
+			Segment	*seg = _head;
+			while (seg != NULL) {
+				Segment	*next = seg->next;
+				release(seg);
+				seg = next;
+			}
+			while (_cache.pop(seg)) {
+				release(seg);
+			}
+		}
+
+
+		/**
+		 * When we process the result of an equality we need to make sure
+		 * that we do this right by always having an equals operator on
+		 * all classes.
+		 *
+		 * Because of the multi-producer, single-consumer, nature of
+		 * this class, it is IMPOSSIBLE to have the assignment operator
+		 * be thread-safe without a mutex. This defeats the entire
+		 * purpose, so what we have is a non-thread-safe assignment
+		 * operator that is still useful if care is exercised to make
+		 * sure that no use-case exists where there will be readers or
+		 * writers to this queue while it is being copied in this assignment.
+		 */
+		SegmentedFIFO & operator=( const SegmentedFIFO<T, S> & anOther )
+		{
+			if (this != & anOther) {
+				/**
+				 * Clear out what we have, and then push a copy of each of
+				 * his elements, in order, so they are appended to us.
+				 */
+				clear();
+				Segment	*seg = anOther._head;
+				size_t	idx = anOther._headIdx;
+				while (seg != NULL) {
+					if (idx == eSegSize) {
+						seg = seg->next;
+						idx = 0;
+					} else if (seg->slots[idx].ready) {
+						push(seg->slots[idx++].value.ref());
+					} else {
+						break;
+					}
+				}
+			}
+			return *this;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method takes an item and places it in the queue. The queue
+		 * is unbounded, so the only way this will return 'false' is if it
+		 * can't get the memory for a new segment - and then it throws.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			if (std::is_nothrow_copy_constructible<T>::value) {
+				return put(anElem);
+			}
+			return put(util::copy_of(anElem));
+		}
+
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			if (std::is_nothrow_constructible<T, Args &&...>::value) {
+				return put(std::forward<Args>(args)...);
+			}
+			return put(T(std::forward<Args>(args)...));
+		}
+
+
+		/**
+		 * This method updates the passed-in reference with the value on the
+		 * top of the queue - if it can. If so, it'll return the value and
+		 * 'true', but if it can't, as in the queue is empty, then the method
+		 * will return 'false' and the value will be untouched.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			Slot	*slot = front();
+			if (slot == NULL) {
+				return false;
+			}
+			anElem = std::move(slot->value.ref());
+			consume(slot);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue. This is a slightly different
+		 * form that fits a different use-case, and so it's a handy
+		 * thing to have around at times.
+		 */
+		virtual T pop()
+		{
+			Slot	*slot = front();
+			if (slot == NULL) {
+				throw std::exception();
+			}
+			T		v(std::move(slot->value.ref()));
+			consume(slot);
+			return v;
+		}
+
+
+		/**
+		 * If there is an item on the queue, this method will return a look
+		 * at that item without updating the queue. The return value will be
+		 * 'true' if there is something, but 'false' if the queue is empty.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			Slot	*slot = front();
+			if (slot == NULL) {
+				return false;
+			}
+			util::copy_assign(anElem, slot->value.ref());
+			return true;
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			Slot	*slot = front();
+			if (slot == NULL) {
+				throw std::exception();
+			}
+			return util::copy_of(slot->value.ref());
+		}
+
+
+		/**
+		 * This method will clear out the contents of the queue so if
+		 * you're storing pointers, then you need to be careful as this
+		 * could leak.
+		 */
+		virtual void clear()
+		{
+			Slot	*slot = NULL;
+			while ((slot = front()) != NULL) {
+				consume(slot);
+			}
+		}
+
+
+		/**
+		 * This method will return 'true' if there are no items in the
+		 * queue. Simple.
+		 */
+		virtual bool empty()
+		{
+			return (front() == NULL);
+		}
+
+
+		/**
+		 * This method will return the number of items in the queue that
+		 * are ready to be popped. It's a walk of the segments, so it's not
+		 * cheap, and it's only to be called by the consumer.
+		 */
+		virtual size_t size() const
+		{
+			size_t	retval = 0;
+			Segment	*seg = _head;
+			size_t	idx = _headIdx;
+			while (seg != NULL) {
+				if (idx == eSegSize) {
+					seg = __atomic_load_n(&seg->next, __ATOMIC_ACQUIRE);
+					idx = 0;
+				} else if (__atomic_load_n(&seg->slots[idx].ready, __ATOMIC_ACQUIRE)) {
+					++retval;
+					++idx;
+				} else {
+					break;
+				}
+			}
+			return retval;
+		}
+
+
+		/**
+		 * This method returns the number of elements in each segment of
+		 * the queue.
+		 */
+		size_t segmentSize() const
+		{
+			return eSegSize;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                         Utility Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are the same. The problem with this is that in a
+		 * multi-producer, single-consumer system, there's no thread that
+		 * can actually perform this operation in a thread-safe manner.
+		 * This method will always return 'false'.
+		 */
+		bool operator==( const SegmentedFIFO<T, S> & anOther ) const
+		{
+			return false;
+		}
+
+
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are NOT the same. This method will always return
+		 * 'true'.
+		 */
+		bool operator!=( const SegmentedFIFO<T, S> & anOther ) const
+		{
+			return !operator==(anOther);
+		}
+
+	private:
+		/**
+		 * The segments hold 2^S elements, and are aligned on 2^16 bytes, so
+		 * that the low 16 bits of the tail are the count of producers that
+		 * have claimed a slot in the tail segment. That's the 2^S that get
+		 * a slot, and then one for each producer that found it full - and
+		 * there can't be more of those than there are producer threads.
+		 * The cache holds 2^eCachePow segments that are ready for reuse.
+		 */
+		enum {
+			eSegSize = (1 << S),
+			eAlign = (1 << 16),
+			eCountMask = (eAlign - 1),
+			eCachePow = 3
+		};
+		static_assert(S <= 14, "[mpsc::SegmentedFIFO] The segments can hold at most 2^14 elements!");
+
+		/**
+		 * Each slot holds the value, only constructed while it's on the
+		 * queue, and a flag that the producer sets when it's done.
+		 */
+		struct Slot {
+			util::slot<T>	value;
+			bool			ready;
+		};
+
+		/**
+		 * A segment is the slots, the link to the next segment, and the
+		 * count of references that are still out on it. That count starts
+		 * at zero, and the consumer, and each producer that found it full,
+		 * take one off as they are done with it. The producer that swaps
+		 * the tail over to the next segment adds one for each of them.
+		 * The one that takes it to zero recycles the segment.
+		 */
+		struct Segment {
+			Slot			slots[eSegSize];
+			Segment			*next;
+			intptr_t		refs;
+
+			Segment() : next(NULL), refs(0)
+			{
+				for (size_t i = 0; i < eSegSize; ++i) {
+					slots[i].ready = false;
+				}
+			}
+		};
+
+		/**
+		 * A producer does the one fetch-and-add on the tail, and that gives
+		 * it both the segment and its slot. If the slot is in the segment,
+		 * the element is built in it - copying, moving, or constructing it
+		 * in place - and then it's flagged as ready for the consumer. If
+		 * the segment is full, we help move the tail on, and try again.
+		 * A claimed slot can't be given back, so the element had better
+		 * not throw as it's built - push() and emplace() make a throwing
+		 * element outside the queue first, and then move it in.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			while (true) {
+				uintptr_t	tail = __atomic_fetch_add(&_tail, 1, __ATOMIC_ACQUIRE);
+				Segment		*seg = (Segment *)(tail & ~(uintptr_t)eCountMask);
+				size_t		idx = (tail & eCountMask);
+				if (idx < eSegSize) {
+					Slot	&slot = seg->slots[idx];
+					slot.value.construct(std::forward<Args>(args)...);
+					__atomic_store_n(&slot.ready, true, __ATOMIC_RELEASE);
+					return true;
+				}
+				advance(seg);
+			}
+		}
+
+		/**
+		 * This is what a producer does when it finds the tail segment full.
+		 * It makes sure there's a next segment linked on - making one if
+		 * need be - and then tries to swap the tail over to it. If it's the
+		 * one that swaps it, the count in the old tail says how many other
+		 * producers found it full, and so how many references are still
+		 * out. Then it lets go of its own reference.
+		 */
+		void advance( Segment *aSegment )
+		{
+			Segment	*next = __atomic_load_n(&aSegment->next, __ATOMIC_ACQUIRE);
+			if (next == NULL) {
+				Segment	*fresh = allocate();
+				if (__atomic_compare_exchange_n(&aSegment->next, &next, fresh, false,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+					next = fresh;
+				} else {
+					// another producer beat us to it - save ours for later
+					recycle(fresh);
+				}
+			}
+
+			uintptr_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			while ((tail & ~(uintptr_t)eCountMask) == (uintptr_t)aSegment) {
+				if (__atomic_compare_exchange_n(&_tail, &tail, (uintptr_t)next, true,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+					// the full ones, and one more for the consumer
+					intptr_t	out = (intptr_t)(tail & eCountMask) - eSegSize + 1;
+					__atomic_add_fetch(&aSegment->refs, out, __ATOMIC_ACQ_REL);
+					break;
+				}
+			}
+			drop(aSegment);
+		}
+
+		/**
+		 * This method returns the slot at the head of the queue if it's
+		 * ready to be popped, or NULL if it's not. If the head segment has
+		 * been emptied, and there's a next one, we move on to that one, and
+		 * let go of the consumer's reference to the old one.
+		 */
+		Slot *front()
+		{
+			if (_headIdx == eSegSize) {
+				Segment	*next = __atomic_load_n(&_head->next, __ATOMIC_ACQUIRE);
+				if (next == NULL) {
+					return NULL;
+				}
+				Segment	*old = _head;
+				_head = next;
+				_headIdx = 0;
+				drop(old);
+			}
+			Slot	*slot = &_head->slots[_headIdx];
+			if (!__atomic_load_n(&slot->ready, __ATOMIC_ACQUIRE)) {
+				return NULL;
+			}
+			return slot;
+		}
+
+		/**
+		 * This method destroys the value in the head slot - whose value
+		 * has been taken - and moves the head along.
+		 */
+		void consume( Slot *aSlot )
+		{
+			aSlot->value.destroy();
+			aSlot->ready = false;
+			++_headIdx;
+		}
+
+		/**
+		 * This method lets go of one reference to the segment, and if it's
+		 * the last, the segment is recycled.
+		 */
+		void drop( Segment *aSegment )
+		{
+			if (__atomic_sub_fetch(&aSegment->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+				aSegment->next = NULL;
+				recycle(aSegment);
+			}
+		}
+
+		/**
+		 * These methods get a segment from the cache - or the heap, if the
+		 * cache is empty - and give one back to the cache - or the heap, if
+		 * the cache is full. The segments in the cache are all ready to use.
+		 */
+		Segment *allocate()
+		{
+			Segment	*seg = NULL;
+			if (!_cache.pop(seg)) {
+				void	*mem = NULL;
+				if (posix_memalign(&mem, eAlign, sizeof(Segment)) != 0) {
+					throw std::bad_alloc();
+				}
+				seg = new (mem) Segment();
+			}
+			return seg;
+		}
+
+		void recycle( Segment *aSegment )
+		{
+			if (!_cache.push(aSegment)) {
+				release(aSegment);
+			}
+		}
+
+		void release( Segment *aSegment )
+		{
+			aSegment->~Segment();
+			free(aSegment);
+		}
+
+		/**
+		 * The tail is the tagged word the producers all add to, and the
+		 * head is the consumer's alone - each on its own cache line. The
+		 * cache of free segments is shared by all.
+		 */
+		uintptr_t								_tail;
+		char									_pad0[util::cache_line_size - sizeof(uintptr_t)];
+		Segment									*_head;
+		size_t									_headIdx;
+		mpmc::CircularFIFO<Segment *, eCachePow>	_cache;
+};
+}		// end of namespace mpsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_MPSC_SEGMENTEDFIFO_H
@@ -0,0 +1,392 @@
+/**
+ * SharedFIFO.h - this file defines the template class for a multi-producer,
+ *                single-consumer, circular FIFO queue of 2^N elements that
+ *                lives in shared memory, so that the producers can be in any
+ *                number of processes, and the consumer in yet another. It's
+ *                the same ring as the mpsc CircularFIFO - each slot with a
+ *                sequence number that says if it's free for a producer on
+ *                this lap, or full for the consumer, and a producer claims
+ *                the tail with one CAS when the slot there is free - but it's
+ *                laid out in a util::shm_segment with 64-bit indexes and no
+ *                pointers, so it works wherever the segment is mapped.
+ *
+ *                As with the SPSC SharedFIFO, the segment starts with a
+ *                util::shm_header that an attaching process checks, and T
+ *                has to be trivially copyable. One thing to keep in mind: a
+ *                producer that dies between claiming a slot and filling it
+ *                leaves the consumer waiting on that slot for good - just as
+ *                a thread would that was killed there.
+ */
+#ifndef __DKIT_MPSC_SHAREDFIFO_H
+#define __DKIT_MPSC_SHAREDFIFO_H
+
+//	System Headers
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "FIFO.h"
+#include "util/padding.h"
+#include "util/shm_segment.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace mpsc {
+/**
+ * This is the main class definition
+ */
+template <class T, uint8_t N> class SharedFIFO :
+	public FIFO<T>
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "a SharedFIFO can only hold trivially copyable elements");
+
+	public:
+		/**
+		 * This is the 'kind' that goes in the header of the segment - it's
+		 * not the same as the SPSC queue's, as the rings aren't the same.
+		 */
+		enum {
+			eKind = 2
+		};
+
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This constructor gets to the segment named 'aName', as 'aMode'
+		 * says. If it's made here, the queue is set up in it, empty, and if
+		 * it's attached to, the header has to match this queue - or this
+		 * throws a std::runtime_error.
+		 */
+		SharedFIFO( const std::string & aName, util::shm_mode aMode = util::shm_create_or_attach ) :
+			FIFO<T>(),
+			_segment(new util::shm_segment(aName, footprint(), aMode)),
+			_ring(NULL)
+		{
+			try {
+				setup(_segment->data(), _segment->created());
+			} catch (...) {
+				delete _segment;
+				throw;
+			}
+		}
+
+
+		/**
+		 * This constructor puts the queue in a block of shared memory that
+		 * the caller looks after - at least footprint() bytes, and aligned
+		 * to a cache line. If 'aCreate' is 'true', it's set up empty, and if
+		 * not, it has to already hold this queue.
+		 */
+		SharedFIFO( void *aBlock, bool aCreate ) :
+			FIFO<T>(),
+			_segment(NULL),
+			_ring(NULL)
+		{
+			setup(aBlock, aCreate);
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called. Only our mapping of the segment goes - the queue stays
+		 * for the other processes.
+		 */
+		virtual ~SharedFIFO()
+		{
+			if (_segment != NULL) {
+				delete _segment;
+				_segment = NULL;
+			}
+			_ring = NULL;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the number of bytes the queue needs in a
+		 * segment - the header, the head and tail, and the ring of slots.
+		 */
+		static size_t footprint()
+		{
+			return sizeof(Layout);
+		}
+
+
+		/**
+		 * This pair of methods does what you'd expect - it returns the
+		 * length of the queue as it exists at the present time. It's
+		 * got two names because there are so many different kinds of
+		 * implementations that it's often convenient to use one or the
+		 * other to remain consistent.
+		 */
+		virtual size_t size() const
+		{
+			uint64_t	head = __atomic_load_n(&_ring->head, __ATOMIC_ACQUIRE);
+			uint64_t	tail = __atomic_load_n(&_ring->tail, __ATOMIC_ACQUIRE);
+			size_t		sz = 0;
+			// the indexes are free-running, so just make sure they make sense
+			if (tail > head) {
+				sz = (size_t)(tail - head);
+				if (sz > eSize) {
+					sz = eSize;
+				}
+			}
+			return sz;
+		}
+
+
+		virtual size_t length() const
+		{
+			return size();
+		}
+
+
+		/**
+		 * This method returns the current capacity of the queue and
+		 * is NOT the size per se. The capacity is what this queue
+		 * will hold.
+		 */
+		virtual size_t capacity() const
+		{
+			return eSize;
+		}
+
+
+		/**
+		 * This method returns the segment the queue is in - or NULL if it
+		 * was put in a block the caller looks after.
+		 */
+		const util::shm_segment *segment() const
+		{
+			return _segment;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes an item and places it in the queue - if it can.
+		 * If so, then it will return 'true', otherwise, it'll return 'false'.
+		 * A failed CAS on the tail just means another producer - in this
+		 * process, or another - got there first, and we try again.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			uint64_t	pos = __atomic_load_n(&_ring->tail, __ATOMIC_RELAXED);
+			while (true) {
+				Node		*node = &_ring->elements[pos & eMask];
+				uint64_t	seq = __atomic_load_n(&node->seq, __ATOMIC_ACQUIRE);
+				int64_t		diff = (int64_t)(seq - pos);
+				if (diff == 0) {
+					// the slot is ours for the taking - if we can claim it
+					if (__atomic_compare_exchange_n(&_ring->tail, &pos, (pos + 1), true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						node->value = anElem;
+						__atomic_store_n(&node->seq, (pos + 1), __ATOMIC_RELEASE);
+						return true;
+					}
+				} else if (diff < 0) {
+					// the consumer hasn't gotten to this slot - we're full
+					return false;
+				} else {
+					// another producer beat us to it - catch up
+					pos = __atomic_load_n(&_ring->tail, __ATOMIC_RELAXED);
+				}
+			}
+		}
+
+
+		/**
+		 * This method updates the passed-in reference with the value on the
+		 * top of the queue - if it can. If so, it'll return the value and
+		 * 'true', but if it can't, as in the queue is empty, then the method
+		 * will return 'false' and the value will be untouched. As there's
+		 * only the one consumer, there's no need to CAS the head.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			uint64_t	pos = _ring->head;
+			Node		*node = &_ring->elements[pos & eMask];
+			// see if the producer for this slot has filled it yet
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				return false;
+			}
+
+			// copy out the data and hand the slot to the next lap's producers
+			anElem = node->value;
+			__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+			__atomic_store_n(&_ring->head, (pos + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue.
+		 */
+		virtual T pop()
+		{
+			T	v;
+			if (!pop(v)) {
+				throw std::exception();
+			}
+			return v;
+		}
+
+
+		/**
+		 * If there is an item on the queue, this method will return a look
+		 * at that item without updating the queue. The return value will be
+		 * 'true' if there is something, but 'false' if the queue is empty.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			uint64_t	pos = _ring->head;
+			Node		*node = &_ring->elements[pos & eMask];
+			if (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) != (pos + 1)) {
+				return false;
+			}
+			anElem = node->value;
+			return true;
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			T	v;
+			if (!peek(v)) {
+				throw std::exception();
+			}
+			return v;
+		}
+
+
+		/**
+		 * This method will clear out the contents of the queue - all that's
+		 * been published up to now - and has to be called by the consumer.
+		 */
+		virtual void clear()
+		{
+			uint64_t	pos = _ring->head;
+			Node		*node = &_ring->elements[pos & eMask];
+			while (__atomic_load_n(&node->seq, __ATOMIC_ACQUIRE) == (pos + 1)) {
+				__atomic_store_n(&node->seq, (pos + eSize), __ATOMIC_RELEASE);
+				node = &_ring->elements[++pos & eMask];
+			}
+			__atomic_store_n(&_ring->head, pos, __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method will return 'true' if there are no items in the
+		 * queue. Simple.
+		 */
+		virtual bool empty()
+		{
+			return (size() == 0);
+		}
+
+
+	private:
+		/**
+		 * There's no sense in copying one of these - it's a handle on the
+		 * queue in the segment, and each process makes its own.
+		 */
+		SharedFIFO( const SharedFIFO<T, N> & anOther );
+		SharedFIFO & operator=( const SharedFIFO<T, N> & anOther );
+
+		/**
+		 * Since the size of the queue is in the definition of the
+		 * instance, it's possible to make some very simple enums that
+		 * are the size and the masking bits for the index values.
+		 */
+		enum {
+			eMask = ((1 << N) - 1),
+			eSize = (1 << N),
+			eHeaderPad = (util::cache_line_size - sizeof(util::shm_header)),
+			ePad = (util::cache_line_size - sizeof(uint64_t))
+		};
+
+		/**
+		 * Each slot in the ring is the sequence number that hands it back
+		 * and forth between the producers and the consumer, and the value.
+		 */
+		struct Node {
+			uint64_t	seq;
+			T			value;
+		};
+
+		/**
+		 * This is how the queue is laid out in the segment - the header,
+		 * then the tail the producers claim, and the head the consumer
+		 * moves, each on its own cache line, and then the ring.
+		 */
+		struct Layout {
+			util::shm_header	header;
+			char				pad0[eHeaderPad];
+			uint64_t			tail;
+			char				pad1[ePad];
+			uint64_t			head;
+			char				pad2[ePad];
+			Node				elements[eSize];
+		};
+
+		/**
+		 * This method points the handle at the queue in 'aBlock', and if
+		 * 'aCreate' is 'true', sets the sequence of each slot to its own
+		 * index, so they're all free for the first lap, and publishes the
+		 * header. Otherwise, the header has to be for this queue.
+		 */
+		void setup( void *aBlock, bool aCreate )
+		{
+			_ring = (Layout *)aBlock;
+			if (aCreate) {
+				_ring->tail = 0;
+				_ring->head = 0;
+				for (uint64_t i = 0; i < eSize; ++i) {
+					_ring->elements[i].seq = i;
+				}
+				_ring->header.publish(eKind, sizeof(T), eSize);
+			} else {
+				_ring->header.verify(eKind, sizeof(T), eSize);
+			}
+		}
+
+		// this is the segment we made or attached to, and the queue in it
+		util::shm_segment	*_segment;
+		Layout				*_ring;
+};
+}		// end of namespace mpsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_MPSC_SHAREDFIFO_H
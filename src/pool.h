@@ -3,10 +3,15 @@
  *          more efficient way to deal with reuse than the traditional
  *          create/use/destroy scheme that's so common. The storage for the
  *          pool will be somewhat dictated by the usage - in that the client
- *          must give the pool a TYPE of queue to use: SPSC, MPSC, or SPMC.
+ *          must give the pool a TYPE of queue to use: SPSC, MPSC, SPMC or MPMC.
  *          The pool will use this to create the storage it will use and then
  *          it's a simple matter of calling next() to get the next available
  *          item, and then recycle() to recycle it.
+ *
+ *          The queue is picked at compile-time from the type, and held
+ *          right in the pool, so that next() and recycle() are direct calls
+ *          that can be inlined. The optional dispatch policy, D, can be set
+ *          to virtual_dispatch to hold it behind the virtual FIFO<T> instead.
  */
 #ifndef __DKIT_POOL_H
 #define __DKIT_POOL_H
@@ -18,9 +23,7 @@
 
 // Other Headers
 #include "FIFO.h"
-#include "spsc/CircularFIFO.h"
-#include "mpsc/CircularFIFO.h"
-#include "spmc/CircularFIFO.h"
+#include "queue_policy.h"
 
 // Forward Declarations
 /**
@@ -40,22 +43,6 @@ template<typename T> void destroy( T * & t );
 }		// end of namespace dkit
 
 // Public Constants
-/**
- * We need to have a simple enum for the different "types" of queues that
- * we can use for the pool - all based on the complexity of the access. This
- * is meant to allow the user to have complete flexibility in how to ask for,
- * and recycle items from the pool.
- */
-#ifndef __DKIT_QUEUE_TYPE
-#define __DKIT_QUEUE_TYPE
-namespace dkit {
-enum queue_type {
-	sp_sc = 0,
-	mp_sc,
-	sp_mc,
-};
-}		// end of namespace dkit
-#endif	// __DKIT_QUEUE_TYPE
 
 // Public Datatypes
 
@@ -66,7 +53,7 @@ namespace dkit {
 /**
  * This is the main class definition
  */
-template <class T, uint8_t N, queue_type Q> class pool
+template <class T, uint8_t N, queue_type Q, class D = static_dispatch> class pool
 {
 	public:
 		/*******************************************************************
@@ -80,25 +67,8 @@ template <class T, uint8_t N, queue_type Q> class pool
 		 * needed, and store recycled values to a given limit.
 		 */
 		pool() :
-			_queue(NULL)
+			_queue()
 		{
-			/**
-			 * We need to look at the 'type' and then create the FIFO
-			 * that makes sense to what he's asking for. The size is the
-			 * power of two (second arg), and will limit how many things
-			 * can be in the pool at once.
-			 */
-			switch (Q) {
-				case sp_sc:
-					_queue = new spsc::CircularFIFO<T, N>();
-					break;
-				case mp_sc:
-					_queue = new mpsc::CircularFIFO<T, N>();
-					break;
-				case sp_mc:
-					_queue = new spmc::CircularFIFO<T, N>();
-					break;
-			}
 		}
 
 
@@ -107,8 +77,8 @@ template <class T, uint8_t N, queue_type Q> class pool
 		 * class to make sure that we control how many copies we have
 		 * floating around in the system.
 		 */
-		pool( const pool<T, N, Q> & anOther ) :
-			_queue(NULL)
+		pool( const pool<T, N, Q, D> & anOther ) :
+			_queue()
 		{
 			// let the '=' operator do the heavy lifting...
 			*this = anOther;
@@ -127,16 +97,11 @@ template <class T, uint8_t N, queue_type Q> class pool
 			 * pointers. If so, then we need to pop every one out and
 			 * then delete each item. It's the only clean way to do it.
 			 */
-			if (_queue != NULL) {
-				// if it's pointers, then delete each one
-				if (boost::is_pointer<T>::value) {
-					T		val;
-					while (_queue->pop(val)) {
-						pool_util::destroy(val);
-					}
+			if (boost::is_pointer<T>::value) {
+				T		val;
+				while (_queue.pop(val)) {
+					pool_util::destroy(val);
 				}
-				// finally, drop the queue itself
-				delete _queue;
 			}
 		}
 
@@ -146,7 +111,7 @@ template <class T, uint8_t N, queue_type Q> class pool
 		 * that we do this right by always having an equals operator on
 		 * all classes.
 		 */
-		pool & operator=( const pool<T, N, Q> & anOther )
+		pool & operator=( const pool<T, N, Q, D> & anOther )
 		{
 			if (this != & anOther) {
 				/**
@@ -172,9 +137,9 @@ template <class T, uint8_t N, queue_type Q> class pool
 		 */
 		T next()
 		{
-			T		n;
+			T		n = T();
 			// see if we can pop one off the queue. If not, make one
-			if ((_queue == NULL) || !_queue->pop(n)) {
+			if (!_queue.pop(n)) {
 				pool_util::create(n);
 			}
 			// return what we have - new or used
@@ -190,7 +155,7 @@ template <class T, uint8_t N, queue_type Q> class pool
 		 */
 		void recycle( T anItem )
 		{
-			if ((_queue == NULL) || !_queue->push(anItem)) {
+			if (!_queue.push(anItem)) {
 				pool_util::destroy(anItem);
 			}
 		}
@@ -204,11 +169,7 @@ template <class T, uint8_t N, queue_type Q> class pool
 		 */
 		size_t size() const
 		{
-			size_t		sz = 0;
-			if (_queue != NULL) {
-				sz = _queue->size();
-			}
-			return sz;
+			return _queue.size();
 		}
 
 
@@ -220,11 +181,18 @@ template <class T, uint8_t N, queue_type Q> class pool
 		 */
 		bool empty()
 		{
-			bool	ans = true;
-			if ((_queue != NULL) && !_queue->empty()) {
-				ans = false;
-			}
-			return ans;
+			return _queue.empty();
+		}
+
+
+		/**
+		 * This method returns the queue of the pool as the FIFO<T> that
+		 * it is - for those that need the virtual interface. Calls made
+		 * through it can't be inlined, of course.
+		 */
+		FIFO<T> & queue()
+		{
+			return _queue;
 		}
 
 
@@ -257,12 +225,11 @@ template <class T, uint8_t N, queue_type Q> class pool
 
 	private:
 		/**
-		 * The queue of T based on the style Q, is going to be a pointer
-		 * we create in the constructor and use here. It's the same API
-		 * no matter what Q is, it's just a cleaner way to implement the
-		 * queue.
+		 * The queue of T based on the style Q, and held as the dispatch
+		 * policy D says. By default, it's the ring itself - right here in
+		 * the pool - so there's no pointer to chase, and no vtable.
 		 */
-		FIFO<T>		*_queue;
+		typename D::template queue<T, N, Q>::type	_queue;
 };
 
 
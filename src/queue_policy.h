@@ -0,0 +1,259 @@
+/**
+ * queue_policy.h - this file defines how the containers built on one of the
+ *                  CircularFIFO queues - the pool and the cqueue - pick the
+ *                  queue they use. The queue_type, Q, picks the ring at
+ *                  compile-time with circular_fifo<T, N, Q>, and the dispatch
+ *                  policy says how it's held. The default, static_dispatch,
+ *                  embeds that ring by value, so every push() and pop() is a
+ *                  direct call the compiler can inline. If the virtual FIFO<T>
+ *                  is what's wanted - one heap-allocated ring behind a pointer,
+ *                  as it used to be - then virtual_dispatch holds it in a
+ *                  fifo_adapter, and every call goes through the vtable.
+ */
+#ifndef __DKIT_QUEUE_POLICY_H
+#define __DKIT_QUEUE_POLICY_H
+
+//	System Headers
+#include <stdint.h>
+#include <stdexcept>
+#include <utility>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "FIFO.h"
+#include "queue_type.h"
+#include "spsc/CircularFIFO.h"
+#include "mpsc/CircularFIFO.h"
+#include "spmc/CircularFIFO.h"
+#include "mpmc/CircularFIFO.h"
+#include "util/queue_stats.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+/**
+ * This is the compile-time map from a queue_type to the CircularFIFO that
+ * has that kind of access. The 'type' is the ring to use - with the stats
+ * policy S, which is nothing at all unless it's asked for.
+ */
+template <class T, uint8_t N, queue_type Q, class S = util::no_stats> struct circular_fifo;
+
+template <class T, uint8_t N, class S> struct circular_fifo<T, N, sp_sc, S>
+{
+	typedef spsc::CircularFIFO<T, N, S>	type;
+};
+
+template <class T, uint8_t N, class S> struct circular_fifo<T, N, mp_sc, S>
+{
+	typedef mpsc::CircularFIFO<T, N, S>	type;
+};
+
+template <class T, uint8_t N, class S> struct circular_fifo<T, N, sp_mc, S>
+{
+	typedef spmc::CircularFIFO<T, N, S>	type;
+};
+
+template <class T, uint8_t N, class S> struct circular_fifo<T, N, mp_mc, S>
+{
+	typedef mpmc::CircularFIFO<T, N, S>	type;
+};
+
+
+/**
+ * This is the adapter for those that want the virtual FIFO<T> - it makes
+ * the ring for Q on the heap, and passes every call on to it through the
+ * FIFO<T> interface. It's a small object that's cheap to move around, but
+ * none of the calls into the ring can be inlined.
+ */
+template <class T, uint8_t N, queue_type Q> class fifo_adapter :
+	public FIFO<T>
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the default constructor that makes the ring for Q and
+		 * holds on to it as a FIFO<T>.
+		 */
+		fifo_adapter() :
+			FIFO<T>(),
+			_queue(new ring_t())
+		{
+		}
+
+
+		/**
+		 * This is the standard copy constructor that needs to be in every
+		 * class to make sure that we control how many copies we have
+		 * floating around in the system. The ring is copied, too.
+		 */
+		fifo_adapter( const fifo_adapter<T, N, Q> & anOther ) :
+			FIFO<T>(),
+			_queue(new ring_t(anOther.ring()))
+		{
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called.
+		 */
+		virtual ~fifo_adapter()
+		{
+			if (_queue != NULL) {
+				delete _queue;
+				_queue = NULL;
+			}
+		}
+
+
+		/**
+		 * When we process the result of an equality we need to make sure
+		 * that we do this right by always having an equals operator on
+		 * all classes. The ring has the same thread-safety on assignment
+		 * as the ring itself - which is to say, none.
+		 */
+		fifo_adapter & operator=( const fifo_adapter<T, N, Q> & anOther )
+		{
+			if (this != & anOther) {
+				ring() = anOther.ring();
+			}
+			return *this;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the ring as the FIFO<T> it's used as.
+		 */
+		FIFO<T> *queue() const
+		{
+			return _queue;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * These are the methods of the FIFO, and every one is passed on
+		 * to the ring through the FIFO<T> pointer - and the vtable.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			return _queue->push(anElem);
+		}
+
+
+		virtual bool push( T && anElem )
+		{
+			return _queue->push(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			return _queue->emplace(std::forward<Args>(args)...);
+		}
+
+
+		virtual bool pop( T & anElem )
+		{
+			return _queue->pop(anElem);
+		}
+
+
+		virtual T pop()
+		{
+			return _queue->pop();
+		}
+
+
+		virtual bool peek( T & anElem )
+		{
+			return _queue->peek(anElem);
+		}
+
+
+		virtual T peek()
+		{
+			return _queue->peek();
+		}
+
+
+		virtual void clear()
+		{
+			_queue->clear();
+		}
+
+
+		virtual bool empty()
+		{
+			return _queue->empty();
+		}
+
+
+		virtual size_t size() const
+		{
+			return _queue->size();
+		}
+
+
+	private:
+		/**
+		 * The ring for Q, and a way to get at it as what it really is -
+		 * for the copying, and nothing else.
+		 */
+		typedef typename circular_fifo<T, N, Q>::type	ring_t;
+
+		ring_t & ring() const
+		{
+			return *static_cast<ring_t *>(_queue);
+		}
+
+		// this is the ring - made and owned by us, but only seen as a FIFO
+		FIFO<T>		*_queue;
+};
+
+
+/**
+ * These are the dispatch policies for the containers. Each has a 'queue'
+ * template whose 'type' is what the container holds by value for a queue
+ * of 2^N T's with access Q.
+ */
+struct static_dispatch
+{
+	template <class T, uint8_t N, queue_type Q> struct queue
+	{
+		typedef typename circular_fifo<T, N, Q>::type	type;
+	};
+};
+
+struct virtual_dispatch
+{
+	template <class T, uint8_t N, queue_type Q> struct queue
+	{
+		typedef fifo_adapter<T, N, Q>	type;
+	};
+};
+}		// end of namespace dkit
+
+#endif	// __DKIT_QUEUE_POLICY_H
@@ -0,0 +1,39 @@
+/**
+ * queue_type.h - this file defines the kinds of access a queue can have -
+ *                one or many producers, and one or many consumers. It's on
+ *                its own so that the containers that pick a ring by it, and
+ *                the rings' stats, which count more cheaply on a side that
+ *                has only the one thread, all see the very same enum.
+ */
+#ifndef __DKIT_QUEUE_TYPE_H
+#define __DKIT_QUEUE_TYPE_H
+
+//	System Headers
+
+//	Third-Party Headers
+
+//	Other Headers
+
+//	Forward Declarations
+
+//	Public Constants
+/**
+ * We need to have a simple enum for the different "types" of queues that
+ * we can use - all based on the complexity of the access. This is meant to
+ * allow the user to have complete flexibility in how to put things on, and
+ * take them off, the queue.
+ */
+namespace dkit {
+enum queue_type {
+	sp_sc = 0,
+	mp_sc,
+	sp_mc,
+	mp_mc,
+};
+}		// end of namespace dkit
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+#endif	// __DKIT_QUEUE_TYPE_H
@@ -14,6 +14,9 @@
  *                  the SINGLE consumer, but the value stays on the queue.
  *                  The pop() will return true if there's something to pop
  *                  off the queue.
+ *
+ *                  As with the SPSC queue, S is the instrumentation - see
+ *                  util/queue_stats.h - and it's nothing, by default.
  */
 #ifndef __DKIT_SPMC_CIRCULARFIFO_H
 #define __DKIT_SPMC_CIRCULARFIFO_H
@@ -25,6 +28,9 @@
 
 // Other Headers
 #include "FIFO.h"
+#include "acounter.h"
+#include "util/slot.h"
+#include "util/queue_stats.h"
 
 // Forward Declarations
 
@@ -41,7 +47,7 @@ namespace spmc {
 /**
  * This is the main class definition
  */
-template <class T, uint8_t N> class CircularFIFO :
+template <class T, uint8_t N, class S = util::no_stats> class CircularFIFO :
 	public FIFO<T>
 {
 	public:
@@ -59,7 +65,8 @@ template <class T, uint8_t N> class CircularFIFO :
 			_elements(),
 			_head(0),
 			_tail(0),
-			_size(0)
+			_size(0),
+			_stats(eSize, sp_mc)
 		{
 		}
 
@@ -69,12 +76,13 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * class to make sure that we control how many copies we have
 		 * floating around in the system.
 		 */
-		CircularFIFO( const CircularFIFO<T, N> & anOther ) :
+		CircularFIFO( const CircularFIFO<T, N, S> & anOther ) :
 			FIFO<T>(),
 			_elements(),
 			_head(0),
 			_tail(0),
-			_size(0)
+			_size(0),
+			_stats(eSize, sp_mc)
 		{
 			// let the '=' operator do the heavy lifting...
 			*this = anOther;
@@ -105,16 +113,21 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * sure that no use-case exists where there will be readers or
 		 * writers to this queue while it is being copied in this assignment.
 		 */
-		CircularFIFO & operator=( const CircularFIFO<T, N> & anOther )
+		CircularFIFO & operator=( const CircularFIFO<T, N, S> & anOther )
 		{
 			if (this != & anOther) {
 				// now let's copy in the elements one by one
+				clear();
 				for (size_t i = 0; i < eSize; i++) {
-					_elements[i] = anOther._elements[i];
+					if (anOther._elements[i].valid) {
+						_elements[i].value.construct(anOther._elements[i].value.ref());
+						_elements[i].valid = true;
+					}
 				}
 				// now copy the pointers
 				_head = anOther._head;
 				_tail = anOther._tail;
+				_size = anOther._size;
 			}
 			return *this;
 		}
@@ -134,7 +147,14 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual size_t size() const
 		{
-			return __sync_or_and_fetch((volatile size_t *)(&_size), 0x00);
+			// a pop's cell can be read before the push's, so keep it sane
+			int64_t		sz = _size.getValue();
+			if (sz < 0) {
+				sz = 0;
+			} else if (sz > eSize) {
+				sz = eSize;
+			}
+			return (size_t)sz;
 		}
 
 
@@ -155,6 +175,18 @@ template <class T, uint8_t N> class CircularFIFO :
 		}
 
 
+		/**
+		 * This method returns the instrumentation of the queue - the S
+		 * it was made with. The default, util::no_stats, has nothing in
+		 * it, but util::queue_stats has the high-water mark, the failed
+		 * pushes and pops, and the time the elements sat in the queue.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
 		/********************************************************
 		 *
 		 *                Element Accessing Methods
@@ -166,24 +198,30 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool push( const T & anElem )
 		{
-			bool		error = false;
-
-			// move the tail (insertion point) and get the old value for me
-			size_t	insPt = __sync_fetch_and_add(&_tail, 1) & eMask;
-			// see if we've crashed the queue all the way around...
-			if (_elements[insPt].valid) {
-				// try to back out the damage we've done to the tail
-				__sync_sub_and_fetch(&_tail, 1);
-				error = true;
-			} else {
-				// save the data in the right spot and flag it as valid
-				const_cast<T &>(_elements[insPt].value) = anElem;
-				_elements[insPt].valid = true;
-				// update the size by one as we've added something
-				__sync_add_and_fetch(&_size, 1);
+			if (std::is_nothrow_copy_constructible<T>::value) {
+				return put(anElem);
 			}
+			return put(util::copy_of(anElem));
+		}
 
-			return !error;
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			if (std::is_nothrow_constructible<T, Args &&...>::value) {
+				return put(std::forward<Args>(args)...);
+			}
+			return put(T(std::forward<Args>(args)...));
 		}
 
 
@@ -195,23 +233,14 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool pop( T & anElem )
 		{
-			bool		error = false;
-
-			// move the head (extraction point) and get the old value for me
-			size_t	grab = __sync_fetch_and_add(&_head, 1) & eMask;
-			// see if we've emptied the queue all the way around...
-			if (!_elements[grab].valid) {
-				// try to back out the damage we've done to the head
-				__sync_sub_and_fetch(&_head, 1);
-				error = true;
-			} else {
-				anElem = const_cast<T &>(_elements[grab].value);
-				_elements[grab].valid = false;
-				// update the size by one because we've removed something
-				__sync_sub_and_fetch(&_size, 1);
+			Node	*node = claim();
+			if (node == NULL) {
+				_stats.pop_empty();
+				return false;
 			}
-
-			return !error;
+			anElem = std::move(node->value.ref());
+			release(node);
+			return true;
 		}
 
 
@@ -224,10 +253,13 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual T pop()
 		{
-			T		v;
-			if (!pop(v)) {
+			Node	*node = claim();
+			if (node == NULL) {
+				_stats.pop_empty();
 				throw std::exception();
 			}
+			T		v(std::move(node->value.ref()));
+			release(node);
 			return v;
 		}
 
@@ -242,10 +274,11 @@ template <class T, uint8_t N> class CircularFIFO :
 			bool		error = false;
 
 			// see if we have an empty queue...
-			if (!_elements[_head & eMask].valid) {
+			Node	*node = &_elements[_head & eMask];
+			if (!node->valid) {
 				error = true;
 			} else {
-				anElem = const_cast<T &>(_elements[_head & eMask].value);
+				util::copy_assign(anElem, node->value.ref());
 			}
 
 			return !error;
@@ -260,11 +293,11 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual T peek()
 		{
-			T		v;
-			if (!peek(v)) {
+			Node	*node = &_elements[_head & eMask];
+			if (!node->valid) {
 				throw std::exception();
 			}
-			return v;
+			return util::copy_of(node->value.ref());
 		}
 
 
@@ -275,8 +308,10 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual void clear()
 		{
-			T		v;
-			while (pop(v));
+			Node	*node = NULL;
+			while ((node = claim()) != NULL) {
+				release(node);
+			}
 		}
 
 
@@ -286,7 +321,7 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool empty()
 		{
-			return __sync_bool_compare_and_swap(&_size, 0, 0);
+			return (size() == 0);
 		}
 
 
@@ -307,7 +342,7 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * possible to make a good equals operator, it's not worth the cost
 		 * at this time. This method will always return 'false'.
 		 */
-		bool operator==( const CircularFIFO<T,N> & anOther ) const
+		bool operator==( const CircularFIFO<T,N,S> & anOther ) const
 		{
 			return false;
 		}
@@ -325,7 +360,7 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * possible to make a good not-equals operator, it's not worth the cost
 		 * at this time. This method will always return 'true'.
 		 */
-		bool operator!=( const CircularFIFO<T,N> & anOther ) const
+		bool operator!=( const CircularFIFO<T,N,S> & anOther ) const
 		{
 			return !operator==(anOther);
 		}
@@ -350,25 +385,95 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * value and a valid 'flag'. If the flag isn't true, then the value
 		 * in the node isn't valid. We'll use this to decouple the push()
 		 * and pop() so that each only needs to know it's own location and
-		 * then interrogate the node for state.
+		 * then interrogate the node for state. The value is only constructed
+		 * while the flag is set.
 		 */
 		struct Node {
-			T		value;
-			bool	valid;
+			util::slot<T>	value;
+			volatile bool	valid;
 
 			Node() : value(), valid(false) { }
-			Node( const T & aValue ) : value(aValue), valid(true) { }
 			~Node() { }
 		};
 
+		/**
+		 * The producer moves the tail and gets the old value for itself,
+		 * and if that node is still full, we've crashed the queue all the
+		 * way around, and we back out the damage we've done to the tail.
+		 * Otherwise, the element is built in the node from the arguments
+		 * - copying, moving, or constructing it in place - and then it's
+		 * flagged as valid.
+		 * A claimed slot can't be given back, so the element had better
+		 * not throw as it's built - push() and emplace() make a throwing
+		 * element outside the queue first, and then move it in.
+		 * The depth handed to the stats is from the tail and the head, and
+		 * not size(), which would add up every cell of the counter.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			size_t	pos = __sync_fetch_and_add(&_tail, 1);
+			Node	*node = &_elements[pos & eMask];
+			if (node->valid) {
+				__sync_sub_and_fetch(&_tail, 1);
+				_stats.push_failed();
+				return false;
+			}
+			node->value.construct(std::forward<Args>(args)...);
+			if (S::eEnabled) {
+				// a consumer that found it empty may not have backed out the head yet
+				size_t	head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+				_stats.pushed(pos & eMask, (head < pos + 1 ? pos + 1 - head : 1));
+			}
+			__sync_synchronize();
+			node->valid = true;
+			// update the size by one as we've added something
+			++_size;
+			return true;
+		}
+
+		/**
+		 * A consumer moves the head and gets the old value for itself,
+		 * and if that node isn't valid, we've emptied the queue and back
+		 * out the damage we've done to the head, returning NULL. Otherwise,
+		 * the node is ours to take the value from, and then release().
+		 */
+		Node *claim()
+		{
+			Node	*node = &_elements[__sync_fetch_and_add(&_head, 1) & eMask];
+			if (!node->valid) {
+				__sync_sub_and_fetch(&_head, 1);
+				return NULL;
+			}
+			return node;
+		}
+
+		/**
+		 * This method destroys the value in a node a consumer has claimed,
+		 * and gives the node back to the producer.
+		 */
+		void release( Node *aNode )
+		{
+			aNode->value.destroy();
+			_stats.popped(aNode - _elements);
+			__sync_synchronize();
+			aNode->valid = false;
+			// update the size by one because we've removed something
+			--_size;
+		}
+
 		/**
 		 * We have a very simple structure - an array of values of a fixed
-		 * size and a simple head and tail.
+		 * size and a simple head and tail. The head and tail can be moved
+		 * past the elements and backed out again, so the size is counted
+		 * on its own - in a sharded counter, so the producer and all the
+		 * consumers aren't fighting over one word just to keep it.
 		 */
-		volatile Node		_elements[eSize];
+		Node				_elements[eSize];
 		volatile size_t		_head;
 		volatile size_t		_tail;
-		volatile size_t		_size;
+		acounter			_size;
+		// ...and this is the instrumentation, if there is any
+		S					_stats;
 };
 }		// end of namespace spmc
 }		// end of namespace dkit
@@ -0,0 +1,515 @@
+/**
+ * DynamicCircularFIFO.h - this file defines the template class for a
+ *                         single-producer, multi-consumer, circular FIFO
+ *                         queue that works just like the spmc::CircularFIFO,
+ *                         but whose size is given to the constructor at
+ *                         run-time and not in the template. The elements are
+ *                         held in a block of memory mapped out of line -
+ *                         optionally on huge pages - and pre-faulted when
+ *                         the queue is made, so the depth of the queue can
+ *                         come from the configuration of the process, and
+ *                         not a recompile.
+ *
+ *                         Like the spmc::CircularFIFO, S can be one of the
+ *                         util/queue_stats.h classes, and is nothing unless
+ *                         it's asked for.
+ */
+#ifndef __DKIT_SPMC_DYNAMICCIRCULARFIFO_H
+#define __DKIT_SPMC_DYNAMICCIRCULARFIFO_H
+
+// System Headers
+#include <stdint.h>
+#include <new>
+#include <stdexcept>
+
+// Third-Party Headers
+
+// Other Headers
+#include "FIFO.h"
+#include "acounter.h"
+#include "util/ring_storage.h"
+#include "util/slot.h"
+#include "util/queue_stats.h"
+
+// Forward Declarations
+
+// Public Constants
+
+// Public Datatypes
+
+// Public Data Constants
+
+
+
+namespace dkit {
+namespace spmc {
+/**
+ * This is the main class definition
+ */
+template <class T, class S = util::no_stats> class DynamicCircularFIFO :
+	public FIFO<T>
+{
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This form of the constructor makes a queue with room for at
+		 * least 'aCapacity' slots - rounded up to the next power of two -
+		 * and, if asked, places them on huge pages. There's no T built
+		 * until it's pushed, so T doesn't need a default constructor.
+		 */
+		DynamicCircularFIFO( size_t aCapacity, bool useHugePages = false ) :
+			FIFO<T>(),
+			_capacity(util::ring_storage::powerOfTwo(aCapacity)),
+			_mask(_capacity - 1),
+			_storage(_capacity * sizeof(Node), useHugePages),
+			_elements(NULL),
+			_head(0),
+			_tail(0),
+			_size(0),
+			_stats(_capacity, sp_mc)
+		{
+			initElements();
+		}
+
+
+		/**
+		 * This is the standard copy constructor that needs to be in every
+		 * class to make sure that we control how many copies we have
+		 * floating around in the system. The copy will have the same
+		 * capacity, and the same use of huge pages, as the original.
+		 */
+		DynamicCircularFIFO( const DynamicCircularFIFO<T, S> & anOther ) :
+			FIFO<T>(),
+			_capacity(anOther._capacity),
+			_mask(anOther._mask),
+			_storage(anOther._capacity * sizeof(Node), anOther._storage.isHuge()),
+			_elements(NULL),
+			_head(0),
+			_tail(0),
+			_size(0),
+			_stats(_capacity, sp_mc)
+		{
+			initElements();
+			// let the '=' operator do the heavy lifting...
+			*this = anOther;
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called.
+		 */
+		virtual ~DynamicCircularFIFO()
+		{
+			clear();
+			// now destroy the nodes - the storage goes back to the OS
+			for (size_t i = 0; i < _capacity; ++i) {
+				_elements[i].~Node();
+			}
+		}
+
+
+		/**
+		 * When we process the result of an equality we need to make sure
+		 * that we do this right by always having an equals operator on
+		 * all classes.
+		 *
+		 * Because of the single-producer, multi-consumer, nature of
+		 * this class, it is IMPOSSIBLE to have the assignment operator
+		 * be thread-safe without a mutex. This defeats the entire
+		 * purpose, so what we have is a non-thread-safe assignment
+		 * operator that is still useful if care is exercised to make
+		 * sure that no use-case exists where there will be readers or
+		 * writers to this queue while it is being copied in this assignment.
+		 */
+		DynamicCircularFIFO & operator=( const DynamicCircularFIFO<T, S> & anOther )
+		{
+			if (this != & anOther) {
+				if (_capacity != anOther._capacity) {
+					throw std::runtime_error("[DynamicCircularFIFO::operator=] Unable to assign queues of different capacities!");
+				}
+				// now let's copy in the elements one by one
+				clear();
+				for (size_t i = 0; i < _capacity; i++) {
+					if (anOther._elements[i].valid) {
+						_elements[i].value.construct(anOther._elements[i].value.ref());
+						_elements[i].valid = true;
+					}
+				}
+				// now copy the pointers
+				_head = anOther._head;
+				_tail = anOther._tail;
+				_size = anOther._size;
+			}
+			return *this;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This pair of methods does what you'd expect - it returns the
+		 * length of the queue as it exists at the present time. It's
+		 * got two names because there are so many different kinds of
+		 * implementations that it's often convenient to use one or the
+		 * other to remain consistent.
+		 */
+		virtual size_t size() const
+		{
+			// a pop's cell can be read before the push's, so keep it sane
+			int64_t		sz = _size.getValue();
+			if (sz < 0) {
+				sz = 0;
+			} else if ((size_t)sz > _capacity) {
+				sz = _capacity;
+			}
+			return (size_t)sz;
+		}
+
+
+		virtual size_t length() const
+		{
+			return size();
+		}
+
+
+		/**
+		 * This method returns the current capacity of the vector and
+		 * is NOT the size per se. The capacity is what this queue
+		 * will hold.
+		 */
+		virtual size_t capacity() const
+		{
+			return _capacity;
+		}
+
+
+		/**
+		 * This method returns 'true' if the storage for the queue ended
+		 * up on huge pages. If they were asked for, but the system has
+		 * none to give, this will be 'false', but the queue still works.
+		 */
+		bool isOnHugePages() const
+		{
+			return _storage.isHuge();
+		}
+
+
+		/**
+		 * This method returns the instrumentation of the queue, which is
+		 * the empty util::no_stats unless another S was asked for.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes an item and places it in the queue - if it can.
+		 * If so, then it will return 'true', otherwise, it'll return 'false'.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			if (std::is_nothrow_copy_constructible<T>::value) {
+				return put(anElem);
+			}
+			return put(util::copy_of(anElem));
+		}
+
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			if (std::is_nothrow_constructible<T, Args &&...>::value) {
+				return put(std::forward<Args>(args)...);
+			}
+			return put(T(std::forward<Args>(args)...));
+		}
+
+
+		/**
+		 * This method updates the passed-in reference with the value on the
+		 * top of the queue - if it can. If so, it'll return the value and
+		 * 'true', but if it can't, as in the queue is empty, then the method
+		 * will return 'false' and the value will be untouched.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			Node	*node = claim();
+			if (node == NULL) {
+				_stats.pop_empty();
+				return false;
+			}
+			anElem = std::move(node->value.ref());
+			release(node);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue. This is a slightly different
+		 * form that fits a different use-case, and so it's a handy
+		 * thing to have around at times.
+		 */
+		virtual T pop()
+		{
+			Node	*node = claim();
+			if (node == NULL) {
+				_stats.pop_empty();
+				throw std::exception();
+			}
+			T		v(std::move(node->value.ref()));
+			release(node);
+			return v;
+		}
+
+
+		/**
+		 * If there is an item on the queue, this method will return a look
+		 * at that item without updating the queue. The return value will be
+		 * 'true' if there is something, but 'false' if the queue is empty.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			bool		error = false;
+
+			// see if we have an empty queue...
+			Node	*node = &_elements[_head & _mask];
+			if (!node->valid) {
+				error = true;
+			} else {
+				util::copy_assign(anElem, node->value.ref());
+			}
+
+			return !error;
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			Node	*node = &_elements[_head & _mask];
+			if (!node->valid) {
+				throw std::exception();
+			}
+			return util::copy_of(node->value.ref());
+		}
+
+
+		/**
+		 * This method will clear out the contents of the queue so if
+		 * you're storing pointers, then you need to be careful as this
+		 * could leak.
+		 */
+		virtual void clear()
+		{
+			Node	*node = NULL;
+			while ((node = claim()) != NULL) {
+				release(node);
+			}
+		}
+
+
+		/**
+		 * This method will return 'true' if there are no items in the
+		 * queue. Simple.
+		 */
+		virtual bool empty()
+		{
+			return (size() == 0);
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                         Utility Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are the same. The problem with this is that in a
+		 * single-producer, single-consumer system, there's no thread that
+		 * can actually perform this operation in a thread-safe manner.
+		 *
+		 * Moreover, the complexity in doing this is far more than we want to
+		 * take on in this class. It's lightweight, and while it's certainly
+		 * possible to make a good equals operator, it's not worth the cost
+		 * at this time. This method will always return 'false'.
+		 */
+		bool operator==( const DynamicCircularFIFO<T, S> & anOther ) const
+		{
+			return false;
+		}
+
+
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are NOT the same. The problem with this is that in a
+		 * single-producer, single-consumer system, there's no thread that
+		 * can actually perform this operation in a thread-safe manner.
+		 *
+		 * Moreover, the complexity in doing this is far more than we want to
+		 * take on in this class. It's lightweight, and while it's certainly
+		 * possible to make a good not-equals operator, it's not worth the cost
+		 * at this time. This method will always return 'true'.
+		 */
+		bool operator!=( const DynamicCircularFIFO<T, S> & anOther ) const
+		{
+			return !operator==(anOther);
+		}
+
+
+	private:
+		/**
+		 * Since the size of the queue is given at run-time, we need to
+		 * hold on to the size and the masking bits for the index values,
+		 * so that we know how to "wrap around" when the time comes.
+		 */
+		size_t				_capacity;
+		size_t				_mask;
+
+		/**
+		 * In order to simplify the ring buffer access, I'm going to actually
+		 * have the ring a series of 'nodes', and for each, there will be a
+		 * value and a valid 'flag'. If the flag isn't true, then the value
+		 * in the node isn't valid. We'll use this to decouple the push()
+		 * and pop() so that each only needs to know it's own location and
+		 * then interrogate the node for state. The value is only constructed
+		 * while the flag is set.
+		 */
+		struct Node {
+			util::slot<T>	value;
+			volatile bool	valid;
+
+			Node() : value(), valid(false) { }
+			~Node() { }
+		};
+
+		/**
+		 * The producer moves the tail and gets the old value for itself,
+		 * and if that node is still full, we've crashed the queue all the
+		 * way around, and we back out the damage we've done to the tail.
+		 * Otherwise, the element is built in the node from the arguments
+		 * - copying, moving, or constructing it in place - and then it's
+		 * flagged as valid.
+		 * A claimed slot can't be given back, so the element had better
+		 * not throw as it's built - push() and emplace() make a throwing
+		 * element outside the queue first, and then move it in.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			size_t	pos = __sync_fetch_and_add(&_tail, 1);
+			Node	*node = &_elements[pos & _mask];
+			if (node->valid) {
+				__sync_sub_and_fetch(&_tail, 1);
+				_stats.push_failed();
+				return false;
+			}
+			node->value.construct(std::forward<Args>(args)...);
+			if (S::eEnabled) {
+				// the head can be a claim ahead of itself for a moment
+				size_t	head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+				_stats.pushed(pos & _mask, (head < pos + 1 ? pos + 1 - head : 1));
+			}
+			__sync_synchronize();
+			node->valid = true;
+			// update the size by one as we've added something
+			++_size;
+			return true;
+		}
+
+		/**
+		 * A consumer moves the head and gets the old value for itself,
+		 * and if that node isn't valid, we've emptied the queue and back
+		 * out the damage we've done to the head, returning NULL. Otherwise,
+		 * the node is ours to take the value from, and then release().
+		 */
+		Node *claim()
+		{
+			Node	*node = &_elements[__sync_fetch_and_add(&_head, 1) & _mask];
+			if (!node->valid) {
+				__sync_sub_and_fetch(&_head, 1);
+				return NULL;
+			}
+			return node;
+		}
+
+		/**
+		 * This method destroys the value in a node a consumer has claimed,
+		 * and gives the node back to the producer.
+		 */
+		void release( Node *aNode )
+		{
+			aNode->value.destroy();
+			_stats.popped(aNode - _elements);
+			__sync_synchronize();
+			aNode->valid = false;
+			// update the size by one because we've removed something
+			--_size;
+		}
+
+		/**
+		 * This method places a default constructed Node in each of the
+		 * slots of the mapped storage. It's only called from the
+		 * constructors.
+		 */
+		void initElements()
+		{
+			_elements = (Node *)_storage.data();
+			for (size_t i = 0; i < _capacity; ++i) {
+				new ((void *)&_elements[i]) Node();
+			}
+		}
+
+		/**
+		 * We have a very simple structure - an out-of-line block of nodes
+		 * of the run-time size and a simple head and tail. As with the
+		 * spmc::CircularFIFO, the head and tail are backed out at times, so
+		 * the size is kept apart, in a sharded counter that the consumers
+		 * each add to on their own cache line.
+		 */
+		util::ring_storage	_storage;
+		Node				*_elements;
+		volatile size_t		_head;
+		volatile size_t		_tail;
+		acounter			_size;
+		// ...and this is the instrumentation, if there is any
+		S					_stats;
+};
+}		// end of namespace spmc
+}		// end of namespace dkit
+
+#endif	// __DKIT_SPMC_DYNAMICCIRCULARFIFO_H
@@ -3,17 +3,25 @@
  *                FIFO queue and is using the compare-and-swap to achieve
  *                the lock-free goal. There can be any number of threads that
  *                call the pop() methods, but there can be ONE and ONLY ONE
- *                thread that calls the push() method.
+ *                thread that calls the push() method. A consumer can't
+ *                know that another one isn't still looking at the node it
+ *                just took off the list, so the nodes are retired to the
+ *                epoch domain, and only go back on the free list when no
+ *                consumer can be looking at them.
  */
 #ifndef __DKIT_SPMC_LINKEDFIFO_H
 #define __DKIT_SPMC_LINKEDFIFO_H
 
 // System Headers
+#include <utility>
 
 // Third-Party Headers
 
 // Other Headers
 #include "FIFO.h"
+#include "util/slot.h"
+#include "util/epoch.h"
+#include "util/free_list.h"
 
 // Forward Declarations
 
@@ -47,7 +55,9 @@ template <class T> class LinkedFIFO :
 			_head(NULL),
 			_tail(NULL)
 		{
-			// start with NOTHING in the list - not one single thing
+			// start with my first (empty) node
+			_head = newNode();
+			_tail = _head;
 		}
 
 
@@ -61,7 +71,10 @@ template <class T> class LinkedFIFO :
 			_head(NULL),
 			_tail(NULL)
 		{
-			// let the '=' operator do the heavy lifting...
+			// start with my first (empty) node, just like the default
+			_head = newNode();
+			_tail = _head;
+			// ...and let the '=' operator do the heavy lifting...
 			*this = anOther;
 		}
 
@@ -73,8 +86,12 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual ~LinkedFIFO()
 		{
-			// simply clear out the queue and we're all cleaned up
 			clear();
+			// now clean out the last node (empty) in the list
+			if (_head != NULL) {
+				deleteNode(_head);
+				_head = NULL;
+			}
 		}
 
 
@@ -99,8 +116,8 @@ template <class T> class LinkedFIFO :
 				 * to walk it, pushing on the values from it in the right
 				 * order so they are appended to us.
 				 */
-				for (Node *n = anOther._head; n != NULL; n = n->next) {
-					if (!push(n->value)) {
+				for (Node *n = anOther._head->next; n != NULL; n = n->next) {
+					if (!push(n->value.ref())) {
 						break;
 					}
 				}
@@ -120,37 +137,24 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual bool push( const T & anElem )
 		{
-			bool		error = false;
+			return put(anElem);
+		}
 
-			// create a new Node with the provided value
-			Node	*me = new Node(anElem);
-			if (me == NULL) {
-				error = true;
-			} else {
-				/**
-				 * We need to add the new value to the tail and then link it
-				 * back into the list. The logic for doing this is interesting
-				 * in that we need to make sure that we handle the TWO cases
-				 * of linking back into the list properly. The first is if
-				 * there is NO LIST, and in that case, we need to make this
-				 * the new head, and update the tail. If it's not empty, then
-				 * we need to make sure that the mode we're about to link
-				 * really exists. We do this by looking at the 'next' pointer.
-				 * If it's NULL, then we know it's not about to be deleted,
-				 * and we can set it. These atomic operations are really
-				 * quite handy.
-				 */
-				if (!__sync_bool_compare_and_swap(&_head, NULL, me)) {
-					// only set the link on the last node that exists
-					__sync_bool_compare_and_swap(&(_tail->next), NULL, me);
-				}
-				Node	*oldTail = _tail;
-				while (!__sync_bool_compare_and_swap(&_tail, oldTail, me)) {
-					oldTail = _tail;
-				}
-			}
 
-			return !error;
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * new node from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			return put(std::forward<Args>(args)...);
 		}
 
 
@@ -162,34 +166,18 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual bool pop( T & anElem )
 		{
-			bool		error = false;
-
+			util::epoch::guard	g;
 			Node	*oldHead = NULL;
-			// if there's no head, then the queue is empty - bad news
-			while ((oldHead = _head) != NULL) {
-				if (__sync_bool_compare_and_swap(&_head, oldHead, oldHead->next)) {
-					break;
-				}
-			}
-			// if we got something, then extract the value and drop the Node
-			if (oldHead != NULL) {
-				// extract the value from the node we've removed
-				anElem = oldHead->value;
-				/**
-				 * If this node is the last in the list - characterized by
-				 * the 'next' being NULL, then we need to update it's
-				 * 'next' before we delete it. Why? So that the push()
-				 * method understands that this node is about to go out of
-				 * scope, and we don't want to update it.
-				 */
-				__sync_bool_compare_and_swap(&(oldHead->next), NULL, (Node *)0x01L);
-				delete oldHead;
-			} else {
+			Node	*first = claim(oldHead);
+			if (first == NULL) {
 				// nothing to get, so return an error and no value change
-				error = true;
+				return false;
 			}
-
-			return !error;
+			// extract the value from the node that's now the head
+			anElem = std::move(first->value.ref());
+			first->value.destroy();
+			retire(oldHead);
+			return true;
 		}
 
 
@@ -202,10 +190,15 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual T pop()
 		{
-			T		v;
-			if (!pop(v)) {
+			util::epoch::guard	g;
+			Node	*oldHead = NULL;
+			Node	*first = claim(oldHead);
+			if (first == NULL) {
 				throw std::exception();
 			}
+			T		v(std::move(first->value.ref()));
+			first->value.destroy();
+			retire(oldHead);
 			return v;
 		}
 
@@ -227,11 +220,13 @@ template <class T> class LinkedFIFO :
 			bool		error = false;
 
 			// if the next guy is NULL, we're empty
-			if (__sync_bool_compare_and_swap(&_head, NULL, NULL)) {
+			util::epoch::guard	g;
+			Node	*first = _head->next;
+			if (first == NULL) {
 				error = true;
 			} else {
 				// look at the next valid node to get the next value
-				anElem = _head->value;
+				util::copy_assign(anElem, first->value.ref());
 			}
 
 			return !error;
@@ -253,11 +248,13 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual T peek()
 		{
-			T		v;
-			if (!peek(v)) {
+			// if the next guy is NULL, we're empty
+			util::epoch::guard	g;
+			Node	*first = _head->next;
+			if (first == NULL) {
 				throw std::exception();
 			}
-			return v;
+			return util::copy_of(first->value.ref());
 		}
 
 
@@ -268,9 +265,14 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual void clear()
 		{
-			// pretty simple - just pop everything off the queue
-			T		v;
-			while (pop(v));
+			// pretty simple - just drop everything on the queue
+			util::epoch::guard	g;
+			Node	*oldHead = NULL;
+			Node	*first = NULL;
+			while ((first = claim(oldHead)) != NULL) {
+				first->value.destroy();
+				retire(oldHead);
+			}
 		}
 
 
@@ -280,7 +282,8 @@ template <class T> class LinkedFIFO :
 		 */
 		virtual bool empty()
 		{
-			return (__sync_bool_compare_and_swap(&_head, NULL, NULL));
+			util::epoch::guard	g;
+			return (__atomic_load_n(&_head->next, __ATOMIC_ACQUIRE) == NULL);
 		}
 
 
@@ -289,12 +292,14 @@ template <class T> class LinkedFIFO :
 		 * queue. Since it's possible that multiple threads are adding
 		 * to this queue at any one point in time, it's really at BEST
 		 * a snapshot of the size, and is only completely accurate
-		 * when the queue is stable.
+		 * when the queue is stable. The guard keeps the nodes we walk
+		 * from being reused while we're on them.
 		 */
 		virtual size_t size() const
 		{
+			util::epoch::guard	g;
 			size_t		retval = 0;
-			for (Node *n = _head; n != NULL; n = n->next) {
+			for (Node *n = _head->next; n != NULL; n = n->next) {
 				++retval;
 			}
 			return retval;
@@ -322,10 +327,10 @@ template <class T> class LinkedFIFO :
 
 			// next, check the elements for equality
 			if (equals) {
-				Node	*me = _head;
-				Node	*him = anOther._head;
+				Node	*me = _head->next;
+				Node	*him = anOther._head->next;
 				while (me != NULL) {
-					if ((him == NULL) || (me->value != him->value)) {
+					if ((him == NULL) || (me->value.ref() != him->value.ref())) {
 						equals = false;
 						break;
 					}
@@ -350,19 +355,93 @@ template <class T> class LinkedFIFO :
 
 	private:
 		/**
-		 * My linked list will be made of these nodes, and I'll make them
-		 * with the one-argument constructor that just sets the value and
-		 * nulls out the next pointer. Pretty simple.
+		 * My linked list will be made of these nodes, and the value is
+		 * only constructed when it's pushed. The head of the list is always
+		 * an empty node - the one whose value has been popped - so it's
+		 * the one after the head that has the next value.
 		 */
 		struct Node {
-			T		value;
-			Node	*next;
+			util::slot<T>	value;
+			Node			*volatile next;
 
 			Node() : value(), next(NULL) { }
-			Node( const T & aValue ) : value(aValue), next(NULL) { }
 			~Node() { }
 		};
 
+		/**
+		 * This method builds a new node with the element made from the
+		 * arguments - copying, moving, or constructing it in place - and
+		 * then links it into the list. If the element can't be made, the
+		 * node is dropped, and the exception goes on to the caller.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			Node	*me = newNode();
+			try {
+				me->value.construct(std::forward<Args>(args)...);
+			} catch (...) {
+				deleteNode(me);
+				throw;
+			}
+
+			/**
+			 * With only the one producer, and an empty node always at the
+			 * head, the tail is ours alone - no consumer takes it off the
+			 * list until there's a node after it. So we just link the new
+			 * node on - once the value in it is there for the consumers
+			 * to see - and it's the new tail.
+			 */
+			__atomic_store_n(&(_tail->next), me, __ATOMIC_RELEASE);
+			_tail = me;
+			return true;
+		}
+
+		/**
+		 * This method moves the head on to the node after it for a
+		 * consumer, and returns that node - whose value is now the
+		 * caller's to take - or NULL if the queue is empty. The old head
+		 * is passed back to be retired once the value's been taken. This
+		 * has to be called in an epoch guard, as another consumer may take
+		 * the head we're looking at, and retire it, at any time.
+		 */
+		Node *claim( Node * & anOldHead )
+		{
+			Node	*head = NULL;
+			Node	*first = NULL;
+			do {
+				head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+				first = __atomic_load_n(&(head->next), __ATOMIC_ACQUIRE);
+				if (first == NULL) {
+					// the queue is empty - bad news
+					return NULL;
+				}
+			} while (!__sync_bool_compare_and_swap(&_head, head, first));
+			anOldHead = head;
+			return first;
+		}
+
+		/**
+		 * These methods make a node from the free list, and give one back
+		 * - right away, when no other thread can see it, or by retiring it
+		 * to the epoch domain, so it goes back on the free list only when
+		 * no consumer can be looking at it.
+		 */
+		static Node *newNode()
+		{
+			return new (util::free_list<Node>::get()) Node();
+		}
+
+		static void deleteNode( Node *aNode )
+		{
+			aNode->~Node();
+			util::free_list<Node>::put(aNode);
+		}
+
+		static void retire( Node *aNode )
+		{
+			util::epoch::retire(aNode, &util::free_list<Node>::put);
+		}
+
 		/**
 		 * We have a very simple structure - a singly-linked list of values
 		 * that I'm just going to be very careful about modifying.
@@ -0,0 +1,310 @@
+/**
+ * WorkStealingDeque.h - this file defines the template class for the
+ *                       Chase-Lev work-stealing deque. There's ONE owner
+ *                       that push()-es and pop()-s at the bottom - like a
+ *                       stack, so it works on what it made most recently,
+ *                       and is still warm in its cache - and as many thieves
+ *                       as necessary that steal() from the top, taking the
+ *                       oldest, and usually the largest, piece of work. The
+ *                       owner only ever contends with a thief over the very
+ *                       last element, so almost all of its operations are
+ *                       plain loads and stores.
+ *
+ *                       The ring starts at 2^N elements, and the owner
+ *                       doubles it when it's full. A thief may still be
+ *                       reading the old ring, so it's kept until the deque
+ *                       is destroyed - all of them together are never more
+ *                       than twice the size of the largest one.
+ *
+ *                       Because a thief reads the element before it knows
+ *                       it's won the race for it, the elements need to be
+ *                       something that can be read atomically - a pointer,
+ *                       or an integer no wider than one.
+ */
+#ifndef __DKIT_SPMC_WORKSTEALINGDEQUE_H
+#define __DKIT_SPMC_WORKSTEALINGDEQUE_H
+
+// System Headers
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <type_traits>
+
+// Third-Party Headers
+
+// Other Headers
+#include "util/padding.h"
+
+// Forward Declarations
+
+// Public Constants
+
+// Public Datatypes
+
+// Public Data Constants
+
+
+
+namespace dkit {
+namespace spmc {
+/**
+ * This is the main class definition
+ */
+template <class T, uint8_t N = 8> class WorkStealingDeque
+{
+	static_assert(std::is_trivially_copyable<T>::value && (sizeof(T) <= sizeof(void *)),
+				  "the elements of a WorkStealingDeque have to be read atomically");
+
+	public:
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the default constructor that makes an empty deque with
+		 * a ring of 2^N elements.
+		 */
+		WorkStealingDeque() :
+			_top(0),
+			_bottom(0),
+			_ring(Ring::create(1 << N, NULL))
+		{
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called. It lets go of the ring, and all the ones it's outgrown.
+		 */
+		virtual ~WorkStealingDeque()
+		{
+			Ring	*r = _ring;
+			while (r != NULL) {
+				Ring	*prev = r->prev;
+				free(r);
+				r = prev;
+			}
+			_ring = NULL;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the number of elements in the deque right
+		 * now - though with thieves about, it's only a snapshot.
+		 */
+		size_t size() const
+		{
+			int64_t		t = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+			int64_t		b = __atomic_load_n(&_bottom, __ATOMIC_ACQUIRE);
+			return (b > t ? (size_t)(b - t) : 0);
+		}
+
+
+		/**
+		 * This method returns 'true' if there's nothing to pop, or steal,
+		 * at the moment.
+		 */
+		bool empty() const
+		{
+			return (size() == 0);
+		}
+
+
+		/**
+		 * This method returns the number of elements the ring can hold
+		 * before the owner has to grow it.
+		 */
+		size_t capacity() const
+		{
+			return (size_t)(__atomic_load_n(&_ring, __ATOMIC_ACQUIRE)->mask + 1);
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                      Owner Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method puts the element on the bottom of the deque, growing
+		 * the ring if it's full - so it always succeeds, unless there's no
+		 * memory for the bigger ring, and then it throws a runtime_error,
+		 * with the deque as it was. It's ONLY to be called by the owner.
+		 */
+		void push( const T & anElem )
+		{
+			int64_t		b = __atomic_load_n(&_bottom, __ATOMIC_RELAXED);
+			int64_t		t = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+			Ring		*r = _ring;
+			if (b - t > r->mask) {
+				r = grow(r, t, b);
+			}
+			r->put(b, anElem);
+			__atomic_store_n(&_bottom, b + 1, __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method puts all 'aCount' elements on the bottom of the
+		 * deque, and only then lets the thieves see them - one store for
+		 * the whole lot. The last one in the array is the first one the
+		 * owner will pop().
+		 */
+		void push( const T anElems[], size_t aCount )
+		{
+			int64_t		b = __atomic_load_n(&_bottom, __ATOMIC_RELAXED);
+			int64_t		t = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+			Ring		*r = _ring;
+			while (b - t + (int64_t)aCount > r->mask + 1) {
+				r = grow(r, t, b);
+			}
+			for (size_t i = 0; i < aCount; ++i) {
+				r->put(b + i, anElems[i]);
+			}
+			__atomic_store_n(&_bottom, b + (int64_t)aCount, __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method takes the element on the bottom of the deque - the
+		 * one most recently pushed - and returns 'true' if there was one.
+		 * It's ONLY to be called by the owner. The bottom is moved up
+		 * first, so that a thief can't take it, and only if the thieves
+		 * have got to the same element does the owner have to race them
+		 * for it with a CAS on the top.
+		 */
+		bool pop( T & anElem )
+		{
+			bool		retval = false;
+			int64_t		b = __atomic_load_n(&_bottom, __ATOMIC_RELAXED) - 1;
+			Ring		*r = _ring;
+			__atomic_store_n(&_bottom, b, __ATOMIC_SEQ_CST);
+			int64_t		t = __atomic_load_n(&_top, __ATOMIC_SEQ_CST);
+			if (t <= b) {
+				T	v = r->get(b);
+				retval = true;
+				if (t == b) {
+					// it's the last one - and a thief may be after it, too
+					if (!__atomic_compare_exchange_n(&_top, &t, t + 1, false,
+													 __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+						retval = false;
+					}
+					__atomic_store_n(&_bottom, b + 1, __ATOMIC_RELAXED);
+				}
+				if (retval) {
+					anElem = v;
+				}
+			} else {
+				// it was empty, so put the bottom back where it was
+				__atomic_store_n(&_bottom, b + 1, __ATOMIC_RELAXED);
+			}
+			return retval;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                      Thief Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method takes the element on the top of the deque - the
+		 * oldest one - and returns 'true' if it got it. Any thread can
+		 * call this. It returns 'false' if the deque is empty, or if it
+		 * lost the race for the element to another thief, or the owner.
+		 * Either way, the caller is best off trying another deque.
+		 */
+		bool steal( T & anElem )
+		{
+			int64_t		t = __atomic_load_n(&_top, __ATOMIC_SEQ_CST);
+			int64_t		b = __atomic_load_n(&_bottom, __ATOMIC_SEQ_CST);
+			if (t < b) {
+				Ring	*r = __atomic_load_n(&_ring, __ATOMIC_ACQUIRE);
+				T		v = r->get(t);
+				if (__atomic_compare_exchange_n(&_top, &t, t + 1, false,
+												__ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+					anElem = v;
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+		/**
+		 * This is the ring of elements - allocated in one block with the
+		 * elements right after the header. The 'prev' is the ring this one
+		 * replaced, kept for the thieves that might still be in it.
+		 */
+		struct Ring {
+			int64_t		mask;
+			Ring		*prev;
+			T			elems[1];
+
+			static Ring *create( int64_t aSize, Ring *aPrev )
+			{
+				Ring	*r = (Ring *)malloc(sizeof(Ring) + (aSize - 1) * sizeof(T));
+				if (r == NULL) {
+					throw std::runtime_error("[WorkStealingDeque::Ring::create] Unable to allocate the ring for the deque!");
+				}
+				r->mask = aSize - 1;
+				r->prev = aPrev;
+				return r;
+			}
+
+			void put( int64_t anIndex, const T & anElem )
+			{
+				__atomic_store(&elems[anIndex & mask], &anElem, __ATOMIC_RELAXED);
+			}
+
+			T get( int64_t anIndex ) const
+			{
+				T	v;
+				__atomic_load(&elems[anIndex & mask], &v, __ATOMIC_RELAXED);
+				return v;
+			}
+		};
+
+		/**
+		 * This method makes a ring twice the size of the one that's full,
+		 * copies in what's between the top and the bottom - each element
+		 * to the same index it had, so the thieves' view doesn't change -
+		 * and publishes it.
+		 */
+		Ring *grow( Ring *aRing, int64_t aTop, int64_t aBottom )
+		{
+			Ring	*r = Ring::create(2 * (aRing->mask + 1), aRing);
+			for (int64_t i = aTop; i < aBottom; ++i) {
+				r->put(i, aRing->get(i));
+			}
+			__atomic_store_n(&_ring, r, __ATOMIC_RELEASE);
+			return r;
+		}
+
+		/**
+		 * There's no sense in copying these - the owner is one thread.
+		 */
+		WorkStealingDeque( const WorkStealingDeque<T, N> & anOther );
+		WorkStealingDeque & operator=( const WorkStealingDeque<T, N> & anOther );
+
+		/**
+		 * The top is where the thieves CAS, so it's on its own cache line,
+		 * away from the bottom and the ring that the owner works with.
+		 */
+		volatile int64_t	_top;
+		char				_pad0[util::cache_line_size - sizeof(int64_t)];
+		volatile int64_t	_bottom;
+		Ring *volatile		_ring;
+};
+}		// end of namespace spmc
+}		// end of namespace dkit
+
+#endif	// __DKIT_SPMC_WORKSTEALINGDEQUE_H
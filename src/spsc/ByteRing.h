@@ -0,0 +1,298 @@
+/**
+ * ByteRing.h - this file defines the template class for a single-producer,
+ *              single-consumer, ring of variable-length records - a 2^N byte
+ *              buffer where each record is an 8-byte header, with its length,
+ *              followed right away by its bytes. There's no pointer to chase,
+ *              and the next record is right after this one, so a consumer
+ *              streams through memory in order - unlike a FIFO of pointers
+ *              to buffers that are scattered all over the heap.
+ *
+ *              The producer calls try_reserve() with the most it could need,
+ *              writes right into the ring - a recvfrom() into the pointer it
+ *              gets, for instance - and then commit()s what it actually used.
+ *              The consumer calls try_front() to see the next record where
+ *              it sits, and release() when it's done with it. A record never
+ *              wraps around the end of the ring: if it won't fit in what's
+ *              left, the rest is filled with a padding record that the
+ *              consumer skips, and the record goes at the start. Because of
+ *              that, the most a record can hold is half the ring.
+ */
+#ifndef __DKIT_SPSC_BYTERING_H
+#define __DKIT_SPSC_BYTERING_H
+
+//	System Headers
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "util/padding.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace spsc {
+/**
+ * This is the main template definition for the 2^N byte ring
+ */
+template <uint8_t N> class ByteRing
+{
+	public :
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This is the default constructor that makes an empty ring.
+		 */
+		ByteRing() :
+			_head(0),
+			_tail(0),
+			_reserved(0)
+		{
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called.
+		 */
+		virtual ~ByteRing()
+		{
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns the number of bytes in the ring that are in
+		 * use - the records, their headers, and any padding.
+		 */
+		size_t size() const
+		{
+			return (__atomic_load_n(&_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&_head, __ATOMIC_ACQUIRE));
+		}
+
+
+		/**
+		 * This method returns the size of the ring in bytes, and the most
+		 * that a single record can hold.
+		 */
+		size_t capacity() const
+		{
+			return eSize;
+		}
+
+
+		static size_t max_record()
+		{
+			return (eSize / 2 - eHeader);
+		}
+
+
+		/**
+		 * This method returns 'true' if there are no records in the ring.
+		 */
+		bool empty() const
+		{
+			return (size() == 0);
+		}
+
+
+		/********************************************************
+		 *
+		 *                Producer Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns a place in the ring to write a record of up
+		 * to 'aLength' bytes, or NULL if there's no room - or it's more
+		 * than max_record(). Nothing is seen by the consumer until it's
+		 * commit()-ed. Calling this again, without a commit(), just gives
+		 * back the same place.
+		 */
+		void *try_reserve( size_t aLength )
+		{
+			size_t	need = span(aLength);
+			if (need > eSize / 2) {
+				return NULL;
+			}
+			size_t	tail = _tail;
+			size_t	toEnd = eSize - (tail & eMask);
+			size_t	pad = (need > toEnd ? toEnd : 0);
+			if (tail + pad + need - __atomic_load_n(&_head, __ATOMIC_ACQUIRE) > eSize) {
+				return NULL;
+			}
+			if (pad > 0) {
+				// the consumer won't look at this until the commit()
+				header(tail)->length = (uint32_t)(pad - eHeader);
+				header(tail)->kind = ePadding;
+				tail += pad;
+			}
+			_reserved = tail;
+			return header(tail) + 1;
+		}
+
+
+		/**
+		 * This method publishes the record that try_reserve() handed out
+		 * - there had better be one - with the 'aLength' bytes that were
+		 * written in it. That can be less than was reserved, but not more.
+		 */
+		void commit( size_t aLength )
+		{
+			header(_reserved)->length = (uint32_t)aLength;
+			header(_reserved)->kind = eRecord;
+			__atomic_store_n(&_tail, _reserved + span(aLength), __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method copies the 'aLength' bytes into the ring as a record,
+		 * and returns 'false' if there's no room for them.
+		 */
+		bool push( const void *aData, size_t aLength )
+		{
+			void	*dest = try_reserve(aLength);
+			if (dest == NULL) {
+				return false;
+			}
+			memcpy(dest, aData, aLength);
+			commit(aLength);
+			return true;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Consumer Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns the bytes of the record at the head of the
+		 * ring - right where they sit - and their length in 'aLength', or
+		 * NULL if the ring is empty. The record stays in the ring until
+		 * the consumer calls release(). Padding is skipped over.
+		 */
+		const void *try_front( size_t & aLength )
+		{
+			size_t	head = _head;
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			while (head != tail) {
+				Header	*hdr = header(head);
+				if (hdr->kind == eRecord) {
+					aLength = hdr->length;
+					return hdr + 1;
+				}
+				// it's padding to the end of the ring, so skip it
+				head += span(hdr->length);
+				__atomic_store_n(&_head, head, __ATOMIC_RELEASE);
+			}
+			return NULL;
+		}
+
+
+		/**
+		 * This method hands the space of the record that try_front()
+		 * returned back to the producer. There had better be one.
+		 */
+		void release()
+		{
+			size_t	head = _head;
+			__atomic_store_n(&_head, head + span(header(head)->length), __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method copies the record at the head of the ring into the
+		 * buffer - if it fits in the 'aCapacity' bytes - and releases it.
+		 * It returns the length of the record, or -1 if the ring is empty,
+		 * or the record won't fit, in which case it's left in the ring.
+		 */
+		ssize_t pop( void *aBuffer, size_t aCapacity )
+		{
+			size_t		len = 0;
+			const void	*src = try_front(len);
+			if ((src == NULL) || (len > aCapacity)) {
+				return -1;
+			}
+			memcpy(aBuffer, src, len);
+			release();
+			return (ssize_t)len;
+		}
+
+
+	private:
+		/**
+		 * Every record starts with one of these - the length of what's in
+		 * it, and if it's a record, or padding to the end of the ring. It's
+		 * eight bytes, and every record is rounded up to eight bytes, so
+		 * the headers are always aligned.
+		 */
+		struct Header {
+			uint32_t	length;
+			uint32_t	kind;
+		};
+
+		enum {
+			eMask = ((1 << N) - 1),
+			eSize = (1 << N),
+			eHeader = sizeof(Header),
+			eRecord = 1,
+			ePadding = 2
+		};
+
+		/**
+		 * This method returns the number of bytes a record of 'aLength'
+		 * takes up in the ring - header and all, rounded up.
+		 */
+		static size_t span( size_t aLength )
+		{
+			return ((eHeader + aLength + 7) & ~((size_t)7));
+		}
+
+		/**
+		 * This method returns the header at the position in the ring.
+		 */
+		Header *header( size_t aPos )
+		{
+			return (Header *)((char *)_buffer + (aPos & eMask));
+		}
+
+		/**
+		 * There's no sense in copying these.
+		 */
+		ByteRing( const ByteRing<N> & anOther );
+		ByteRing & operator=( const ByteRing<N> & anOther );
+
+		/**
+		 * The head and the tail are free-running byte positions - each on
+		 * its own cache line - and the ring is after them, so that it's
+		 * aligned for the headers. The '_reserved' is the producer's own.
+		 */
+		volatile size_t		_head;
+		char				_pad0[util::cache_line_size - sizeof(size_t)];
+		volatile size_t		_tail;
+		size_t				_reserved;
+		char				_pad1[util::cache_line_size - 2 * sizeof(size_t)];
+		uint64_t			_buffer[eSize / sizeof(uint64_t)];
+};
+}		// end of namespace spsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_SPSC_BYTERING_H
@@ -0,0 +1,450 @@
+/**
+ * CachedCircularFIFO.h - this file defines the template class for a single-
+ *                        producer, single-consumer, circular FIFO queue that
+ *                        is very much like the spsc::CircularFIFO, but has
+ *                        been laid out so that the producer and consumer do
+ *                        not share cache lines. The 'head' and 'tail' are
+ *                        each on their own cache line, and each side keeps
+ *                        a private, cached, copy of the other side's index
+ *                        so that it only needs to re-read the remote index
+ *                        when the cached value says the queue is full (for
+ *                        the producer) or empty (for the consumer). The
+ *                        indexes are published with release stores and
+ *                        read with acquire loads, and not just 'volatile'.
+ *
+ *                        Like the spsc::CircularFIFO, this is only safe with
+ *                        ONE and ONLY ONE thread calling push(), and ONE and
+ *                        ONLY ONE thread calling pop(), peek() and clear().
+ *                        And like it, the slots are only constructed when
+ *                        an element is pushed, and destroyed when popped.
+ *                        S is the instrumentation, as it is for the ring
+ *                        there, and util::no_stats keeps it out entirely.
+ */
+#ifndef __DKIT_SPSC_CACHEDCIRCULARFIFO_H
+#define __DKIT_SPSC_CACHEDCIRCULARFIFO_H
+
+//	System Headers
+#include <stdint.h>
+#include <stdexcept>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "FIFO.h"
+#include "util/padding.h"
+#include "util/slot.h"
+#include "util/queue_stats.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace spsc {
+/**
+ * This is the main template definition for the 2^N sized FIFO queue
+ */
+template <class T, uint8_t N, class S = util::no_stats> class CachedCircularFIFO :
+	public FIFO<T>
+{
+	public :
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This form of the constructor initializes the queue to a series
+		 * of 2^N empty slots. There's no T constructed until it's pushed,
+		 * so T doesn't need a default constructor. To pop() into a T, it
+		 * needs to be move-assignable, and to push() a copy, or copy the
+		 * queue, T needs to be copyable - otherwise those will throw.
+		 */
+		CachedCircularFIFO() :
+			FIFO<T>(),
+			_elements(),
+			_tail(0),
+			_cachedHead(0),
+			_head(0),
+			_cachedTail(0),
+			_stats(eSize, sp_sc)
+		{
+		}
+
+
+		/**
+		 * This is the standard copy constructor and needs to be in every
+		 * class to make sure that we don't have too many things running
+		 * around.
+		 */
+		CachedCircularFIFO( const CachedCircularFIFO<T,N,S> & anOther ) :
+			FIFO<T>(),
+			_elements(),
+			_tail(0),
+			_cachedHead(0),
+			_head(0),
+			_cachedTail(0),
+			_stats(eSize, sp_sc)
+		{
+			// let the '=' operator do it
+			*this = anOther;
+		}
+
+
+		/**
+		 * This is the destructor for the queue and makes sure that
+		 * everything is cleaned up before leaving.
+		 */
+		virtual ~CachedCircularFIFO()
+		{
+			// destroy anything that's still in the queue
+			clear();
+		}
+
+
+		/**
+		 * When we want to process the result of an equality we need to
+		 * make sure that we do this right by always having an equals
+		 * operator on all classes.
+		 *
+		 * Because of the single-producer, single-consumer, nature of
+		 * this class, it is IMPOSSIBLE to have the assignment operator
+		 * be thread-safe without a mutex. This defeats the entire
+		 * purpose, so what we have is a non-thread-safe assignment
+		 * operator that is still useful if care is exercised to make
+		 * sure that no use-case exists where there will be readers or
+		 * writers to this queue while it is being copied in this assignment.
+		 */
+		CachedCircularFIFO<T,N,S> & operator=( const CachedCircularFIFO<T,N,S> & anOther )
+		{
+			// make sure that we don't do this to ourselves
+			if (this != & anOther) {
+				// drop what we have, and copy in what's in his queue
+				clear();
+				for (size_t i = anOther._head; i != anOther._tail; ++i) {
+					_elements[i & eMask].construct(anOther._elements[i & eMask].ref());
+				}
+				// now copy the indexes - and reset the cached copies
+				_head = anOther._head;
+				_tail = anOther._tail;
+				_cachedHead = _head;
+				_cachedTail = _tail;
+			}
+
+			return *this;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This pair of methods does what you'd expect - it returns the
+		 * length of the queue as it exists at the present time. It's
+		 * got two names because there are so many different kinds of
+		 * implementations that it's often convenient to use one or the
+		 * other to remain consistent.
+		 *
+		 * Because the indexes are free-running, and not masked, the
+		 * difference is always the number of elements in the queue.
+		 */
+		virtual size_t size() const
+		{
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			return (tail - head);
+		}
+
+
+		virtual size_t length() const
+		{
+			return size();
+		}
+
+
+		/**
+		 * This method returns the current capacity of the vector and
+		 * is NOT the size per se. The capacity is what this queue
+		 * will hold.
+		 */
+		virtual size_t capacity() const
+		{
+			return eSize;
+		}
+
+
+		/**
+		 * This method returns the instrumentation of the queue - the S
+		 * it was made with, and util::no_stats, with nothing in it, if
+		 * nothing else was given.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method pushes the provided element onto the queue, and
+		 * because it's FIFO, it's going to be the placed at the 'tail'
+		 * of the queue, and the pop() will take elements off the 'head'.
+		 * The producer only looks at the real 'head' when its cached copy
+		 * says there's no room - and then only to refresh that copy. If
+		 * there's still no room, this returns 'false'.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			return put(anElem);
+		}
+
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			return put(std::forward<Args>(args)...);
+		}
+
+
+		/**
+		 * This form of the pop() method takes an element reference as
+		 * an argument where the top of the queue will be placed - assuming
+		 * there's something there to get. If so, then the value will be
+		 * replaced, and a 'true' will be returned. Otherwise, a 'false'
+		 * will be returned, as there's nothing to return. Like push(),
+		 * the real 'tail' is only read when the cached copy says empty.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			size_t	head = _head;
+			if (!available(head)) {
+				_stats.pop_empty();
+				return false;
+			}
+
+			// OK, move out the head of the queue, and move up one
+			anElem = std::move(_elements[head & eMask].ref());
+			_elements[head & eMask].destroy();
+			_stats.popped(head & eMask);
+			__atomic_store_n(&_head, (head + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue. This is a slightly different
+		 * form that fits a different use-case, and so it's a handy
+		 * thing to have around at times.
+		 */
+		virtual T pop()
+		{
+			size_t	head = _head;
+			if (!available(head)) {
+				_stats.pop_empty();
+				throw std::exception();
+			}
+			T		v(std::move(_elements[head & eMask].ref()));
+			_elements[head & eMask].destroy();
+			_stats.popped(head & eMask);
+			__atomic_store_n(&_head, (head + 1), __ATOMIC_RELEASE);
+			return v;
+		}
+
+
+		/**
+		 * This method looks at the first element on the top of the queue
+		 * and returns it in the provided reference argument. If there's
+		 * nothing there, the return value will be 'false', and the reference
+		 * will be untouched. If there's something there, the return value
+		 * will be 'true'. This HAS to be called from the consumer thread.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			size_t	head = _head;
+			if (!available(head)) {
+				return false;
+			}
+
+			// OK, copy the head of the queue, but DO NOT move up one
+			util::copy_assign(anElem, _elements[head & eMask].ref());
+			return true;
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			size_t	head = _head;
+			if (!available(head)) {
+				throw std::exception();
+			}
+			return util::copy_of(_elements[head & eMask].ref());
+		}
+
+
+		/**
+		 * This method will remove all the elements from the queue by
+		 * simply destroying them one by one until they are all removed.
+		 * In order for this to be thread-safe, this action can only be
+		 * called by the CONSUMER thread, as that's the same activity as
+		 * is happening in this method.
+		 */
+		virtual void clear()
+		{
+			size_t	head = _head;
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail; ++head) {
+				_elements[head & eMask].destroy();
+			}
+			_cachedTail = tail;
+			__atomic_store_n(&_head, head, __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method returns 'true' if there are no elements in the queue.
+		 */
+		virtual bool empty()
+		{
+			return (__atomic_load_n(&_head, __ATOMIC_ACQUIRE) ==
+					__atomic_load_n(&_tail, __ATOMIC_ACQUIRE));
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are the same. As with the spsc::CircularFIFO, there's
+		 * no thread that can actually perform this operation in a
+		 * thread-safe manner, so this method will always return 'false'.
+		 */
+		bool operator==( const CachedCircularFIFO<T,N,S> & anOther ) const
+		{
+			return false;
+		}
+
+
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are NOT the same. As with the operator==(), this
+		 * method will always return 'true'.
+		 */
+		bool operator!=( const CachedCircularFIFO<T,N,S> & anOther ) const
+		{
+			return !operator==(anOther);
+		}
+
+
+	private:
+		/**
+		 * This method builds the element at the 'tail' from the arguments
+		 * - copying, moving, or constructing it in place. The producer only
+		 * looks at the real 'head' when its cached copy says there's no
+		 * room - and then only to refresh that copy. If there's still no
+		 * room, this returns 'false'.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			size_t	tail = _tail;
+			// see if we're full based on what we last knew of the head
+			if ((tail - _cachedHead) == eSize) {
+				_cachedHead = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+				if ((tail - _cachedHead) == eSize) {
+					// the queue had no more space - push back!
+					_stats.push_failed();
+					return false;
+				}
+			}
+
+			// build it in the spot and then publish the new tail
+			_elements[tail & eMask].construct(std::forward<Args>(args)...);
+			if (S::eEnabled) {
+				// the cached head may be stale, so the depth is from the real one
+				_stats.pushed(tail & eMask, (tail + 1 - __atomic_load_n(&_head, __ATOMIC_RELAXED)));
+			}
+			__atomic_store_n(&_tail, (tail + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+		/**
+		 * This method returns 'true' if there's an element at 'aHead' for
+		 * the consumer. The real 'tail' is only read when the cached copy
+		 * says the queue is empty.
+		 */
+		bool available( size_t aHead )
+		{
+			if (aHead == _cachedTail) {
+				_cachedTail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+				if (aHead == _cachedTail) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/**
+		 * Since the size of the queue is in the definition of the
+		 * instance, it's possible to make some very simple enums that
+		 * are the size and the masking bits for the index values, so that
+		 * we know before anything starts up, how big to make things and
+		 * how to "wrap around" when the time comes.
+		 */
+		enum {
+			eMask = ((1 << N) - 1),
+			eSize = (1 << N)
+		};
+
+		/**
+		 * The slots come first, then the producer's cache line - with
+		 * the 'tail' it owns and its copy of the 'head', and then the
+		 * consumer's cache line - with the 'head' it owns and its copy of
+		 * the 'tail'. Each pair starts a cache line of its own - as does
+		 * the instrumentation - so the two sides never write to the same
+		 * line, whatever the size of the slots.
+		 */
+		util::slot<T>	_elements[eSize];
+		alignas(util::cache_line_size) size_t	_tail;
+		size_t			_cachedHead;
+		alignas(util::cache_line_size) size_t	_head;
+		size_t			_cachedTail;
+		// ...and this is the instrumentation, if there is any
+		alignas(util::cache_line_size) S		_stats;
+};
+}		// end of namespace spsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_SPSC_CACHEDCIRCULARFIFO_H
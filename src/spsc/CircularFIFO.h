@@ -11,7 +11,25 @@
  *                  the top of the queue, and it HAS to be the same thread as
  *                  the SINGLE consumer, but the value stays on the queue.
  *                  The pop() will return true if there's something to pop
- *                  off the queue.
+ *                  off the queue. For bursts of data, push_n(), pop_n()
+ *                  and consume_all() move a whole run of elements with a
+ *                  single update of the 'tail' or 'head' for the batch.
+ *                  For large records, try_reserve() and commit() let the
+ *                  producer build the element right in the ring - or
+ *                  cancel() it - and try_front() and release() let the
+ *                  consumer read it
+ *                  there - with no copies in or out at all.
+ *
+ *                  The slots hold uninitialized storage, and each element is
+ *                  only constructed when it's pushed - moved in, or built in
+ *                  place with emplace() - and destroyed when it's popped, so
+ *                  T doesn't need a default constructor, and can be move-only.
+ *
+ *                  The last template parameter, S, is the instrumentation
+ *                  - util::no_stats, and nothing at all, by default. With
+ *                  util::queue_stats, stats() has the high-water mark, the
+ *                  pushes that found it full, the pops that found it empty,
+ *                  and how long a sample of the elements sat in the queue.
  */
 #ifndef __DKIT_SPSC_CIRCULARFIFO_H
 #define __DKIT_SPSC_CIRCULARFIFO_H
@@ -23,6 +41,8 @@
 
 //	Other Headers
 #include "FIFO.h"
+#include "util/slot.h"
+#include "util/queue_stats.h"
 
 //	Forward Declarations
 
@@ -38,7 +58,7 @@ namespace spsc {
 /**
  * This is the main template definition for the 2^N sized FIFO queue
  */
-template <class T, uint8_t N> class CircularFIFO :
+template <class T, uint8_t N, class S = util::no_stats> class CircularFIFO :
 	public FIFO<T>
 {
 	public :
@@ -49,16 +69,18 @@ template <class T, uint8_t N> class CircularFIFO :
 		 ********************************************************/
 		/**
 		 * This form of the constructor initializes the queue to a series
-		 * of 2^N empty T instances. If there is no default constructor
-		 * for T, this will not compile. Please make sure there's AT
-		 * LEAST a default constructor and copy construstor as well as
-		 * an assignment operator for T - it's all going to be needed.
+		 * of 2^N empty slots. There's no T constructed until it's pushed,
+		 * so T doesn't need a default constructor. To pop() into a T, it
+		 * needs to be move-assignable, and to push() a copy, or copy the
+		 * queue, T needs to be copyable - otherwise those will throw.
 		 */
 		CircularFIFO() :
 			FIFO<T>(),
 			_elements(),
 			_head(0),
-			_tail(0)
+			_tail(0),
+			_reserved(false),
+			_stats(eSize, sp_sc)
 		{
 		}
 
@@ -68,11 +90,13 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * class to make sure that we don't have too many things running
 		 * around.
 		 */
-		CircularFIFO( const CircularFIFO<T,N> & anOther ) :
+		CircularFIFO( const CircularFIFO<T,N,S> & anOther ) :
 			FIFO<T>(),
 			_elements(),
 			_head(0),
-			_tail(0)
+			_tail(0),
+			_reserved(false),
+			_stats(eSize, sp_sc)
 		{
 			// let the '=' operator do it
 			*this = anOther;
@@ -85,7 +109,9 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual ~CircularFIFO()
 		{
-			// there's not a lot to do at this point - yet
+			// destroy anything that's still in the queue, or reserved
+			cancel();
+			clear();
 		}
 
 
@@ -102,13 +128,15 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * sure that no use-case exists where there will be readers or
 		 * writers to this queue while it is being copied in this assignment.
 		 */
-		CircularFIFO<T,N> & operator=( const CircularFIFO<T,N> & anOther )
+		CircularFIFO<T,N,S> & operator=( const CircularFIFO<T,N,S> & anOther )
 		{
 			// make sure that we don't do this to ourselves
 			if (this != & anOther) {
-				// now let's copy in the elements one by one
-				for (size_t i = 0; i < eSize; i++) {
-					_elements[i] = anOther._elements[i];
+				// drop what we have, and copy in what's in his queue
+				cancel();
+				clear();
+				for (size_t i = anOther._head; i != anOther._tail; i = (i + 1) & eMask) {
+					_elements[i].construct(anOther._elements[i].ref());
 				}
 				// now copy the pointers
 				_head = anOther._head;
@@ -159,6 +187,18 @@ template <class T, uint8_t N> class CircularFIFO :
 		}
 
 
+		/**
+		 * This method returns the instrumentation of the queue - the S
+		 * it was made with. The default, util::no_stats, has nothing in
+		 * it, but util::queue_stats has the high-water mark, the failed
+		 * pushes and pops, and the time the elements sat in the queue.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
 		/********************************************************
 		 *
 		 *                Element Accessing Methods
@@ -175,16 +215,24 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool push( const T & anElem )
 		{
-			size_t	newTail = (_tail + 1) & eMask;
-			// if we have room, then let's save it in the spot
-			if (newTail != _head) {
-				_elements[_tail] = anElem;
-				_tail = newTail;
-				return true;
-			}
+			return put(anElem);
+		}
 
-			// the queue had no more space - push back!
-			return false;
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			return put(std::forward<Args>(args)...);
 		}
 
 
@@ -197,14 +245,18 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool pop( T & anElem )
 		{
+			size_t	head = _head;
 			// see if we have anything in the queue to pull out
-			if (_head == _tail) {
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
+				_stats.pop_empty();
 				return false;
 			}
 
-			// OK, grab the head of the queue, and move up one
-			anElem = _elements[_head];
-			_head = (_head + 1) & eMask;
+			// OK, move out the head of the queue, and move up one
+			anElem = std::move(_elements[head].ref());
+			_elements[head].destroy();
+			_stats.popped(head);
+			__atomic_store_n(&_head, ((head + 1) & eMask), __ATOMIC_RELEASE);
 			return true;
 		}
 
@@ -218,10 +270,15 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual T pop()
 		{
-			T		v;
-			if (!pop(v)) {
+			size_t	head = _head;
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
+				_stats.pop_empty();
 				throw std::exception();
 			}
+			T		v(std::move(_elements[head].ref()));
+			_elements[head].destroy();
+			_stats.popped(head);
+			__atomic_store_n(&_head, ((head + 1) & eMask), __ATOMIC_RELEASE);
 			return v;
 		}
 
@@ -237,13 +294,14 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual bool peek( T & anElem )
 		{
+			size_t	head = _head;
 			// see if we have anything in the queue to pull out
-			if (_head == _tail) {
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
 				return false;
 			}
 
-			// OK, grab the head of the queue, but DO NOT move up one
-			anElem = _elements[_head & eMask];
+			// OK, copy the head of the queue, but DO NOT move up one
+			util::copy_assign(anElem, _elements[head].ref());
 			return true;
 		}
 
@@ -256,25 +314,245 @@ template <class T, uint8_t N> class CircularFIFO :
 		 */
 		virtual T peek()
 		{
-			T		v;
-			if (!peek(v)) {
+			size_t	head = _head;
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
 				throw std::exception();
 			}
-			return v;
+			return util::copy_of(_elements[head].ref());
+		}
+
+
+		/********************************************************
+		 *
+		 *                In-Place Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns the slot at the 'tail' - with a T default-
+		 * initialized in it, which for a plain struct is nothing at all -
+		 * for the producer to fill in where it sits. It returns NULL if
+		 * there's no room. Nothing is seen by the consumer until commit()
+		 * is called, and there's only one reservation at a time - asking
+		 * again before the commit() returns the same slot, as it is.
+		 */
+		T *try_reserve()
+		{
+			size_t	tail = _tail;
+			if (_reserved) {
+				return &_elements[tail].ref();
+			}
+			if (((tail + 1) & eMask) == __atomic_load_n(&_head, __ATOMIC_ACQUIRE)) {
+				_stats.push_failed();
+				return NULL;
+			}
+			_reserved = true;
+			return _elements[tail].construct_default();
+		}
+
+
+		/**
+		 * This method publishes the element the last try_reserve() handed
+		 * out - there had better be one - just as push() would.
+		 */
+		void commit()
+		{
+			size_t	tail = _tail;
+			_reserved = false;
+			if (S::eEnabled) {
+				_stats.pushed(tail, ((tail + 1 - __atomic_load_n(&_head, __ATOMIC_RELAXED)) & eMask));
+			}
+			__atomic_store_n(&_tail, ((tail + 1) & eMask), __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method drops the element the last try_reserve() handed out,
+		 * if it's not been committed, and gives the slot back - the consumer
+		 * never knew it was there. Without a reservation, it does nothing.
+		 */
+		void cancel()
+		{
+			if (_reserved) {
+				_elements[_tail].destroy();
+				_reserved = false;
+			}
+		}
+
+
+		/**
+		 * This method returns the element at the 'head' of the queue -
+		 * right where it sits in the ring - or NULL if the queue is empty.
+		 * It stays there, and the producer can't reuse the slot, until the
+		 * consumer calls release().
+		 */
+		const T *try_front()
+		{
+			size_t	head = _head;
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
+				_stats.pop_empty();
+				return NULL;
+			}
+			return &_elements[head].ref();
+		}
+
+
+		/**
+		 * This method destroys the element that try_front() returned -
+		 * there had better be one - and hands its slot back to the
+		 * producer, just as pop() would.
+		 */
+		void release()
+		{
+			size_t	head = _head;
+			_elements[head].destroy();
+			_stats.popped(head);
+			__atomic_store_n(&_head, ((head + 1) & eMask), __ATOMIC_RELEASE);
+		}
+
+
+		/********************************************************
+		 *
+		 *                Batch Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method pushes as many of the 'aCount' elements in the
+		 * provided array onto the queue as there is room for, and returns
+		 * the number that were actually placed. The elements are copied
+		 * in, at most, two contiguous spans - the run up to the end of
+		 * the ring, and then the wrap back to the start - and the 'tail'
+		 * is published only ONCE for the entire batch. This means the
+		 * consumer sees one cache-line update per batch, and not one per
+		 * element, which is the whole point of the batch.
+		 */
+		size_t push_n( const T anElems[], size_t aCount )
+		{
+			size_t	tail = _tail;
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			// we always keep one slot open to tell 'full' from 'empty'
+			size_t	cnt = (head - tail - 1) & eMask;
+			size_t	sz = (tail - head) & eMask;
+			if (aCount < cnt) {
+				cnt = aCount;
+			} else if (aCount > cnt) {
+				_stats.push_failed();
+			}
+			// if we have room, copy in the two spans and publish the tail
+			if (cnt > 0) {
+				size_t	first = eSize - tail;
+				if (first > cnt) {
+					first = cnt;
+				}
+				for (size_t i = 0; i < first; ++i) {
+					_elements[tail + i].construct(anElems[i]);
+					_stats.pushed(tail + i, sz + i + 1);
+				}
+				for (size_t i = first; i < cnt; ++i) {
+					_elements[i - first].construct(anElems[i]);
+					_stats.pushed(i - first, sz + i + 1);
+				}
+				__atomic_store_n(&_tail, ((tail + cnt) & eMask), __ATOMIC_RELEASE);
+			}
+			return cnt;
+		}
+
+
+		/**
+		 * This method pops up to 'aCount' elements off the queue and
+		 * places them, in order, into the provided array. The return
+		 * value is the number of elements actually popped, which will be
+		 * zero if the queue is empty. Like push_n(), the elements are
+		 * moved out in, at most, two spans and the 'head' is published
+		 * only once for the entire batch.
+		 */
+		size_t pop_n( T anElems[], size_t aCount )
+		{
+			size_t	head = _head;
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			size_t	cnt = (tail - head) & eMask;
+			if (aCount < cnt) {
+				cnt = aCount;
+			}
+			// if we have anything, copy out the two spans and publish
+			if (cnt > 0) {
+				size_t	first = eSize - head;
+				if (first > cnt) {
+					first = cnt;
+				}
+				for (size_t i = 0; i < first; ++i) {
+					anElems[i] = std::move(_elements[head + i].ref());
+					_elements[head + i].destroy();
+					_stats.popped(head + i);
+				}
+				for (size_t i = first; i < cnt; ++i) {
+					anElems[i] = std::move(_elements[i - first].ref());
+					_elements[i - first].destroy();
+					_stats.popped(i - first);
+				}
+				__atomic_store_n(&_head, ((head + cnt) & eMask), __ATOMIC_RELEASE);
+			} else {
+				_stats.pop_empty();
+			}
+			return cnt;
+		}
+
+
+		/**
+		 * This method hands every element currently in the queue to the
+		 * provided functor - in order, and by const reference, right out
+		 * of the ring - and then publishes the new 'head' once at the end.
+		 * The functor just needs to have:
+		 *
+		 *   void operator()( const T & anElem );
+		 *
+		 * and it's called on the consumer thread, so it needs to be quick,
+		 * as the producer can't reuse any of these slots until it returns.
+		 * The return value is the number of elements consumed.
+		 */
+		template <class F> size_t consume_all( F & aFunctor )
+		{
+			size_t	head = _head;
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			size_t	cnt = (tail - head) & eMask;
+			// if we have anything, walk the two spans and then publish
+			if (cnt > 0) {
+				size_t	first = eSize - head;
+				if (first > cnt) {
+					first = cnt;
+				}
+				for (size_t i = 0; i < first; ++i) {
+					aFunctor(const_cast<const T &>(_elements[head + i].ref()));
+					_elements[head + i].destroy();
+					_stats.popped(head + i);
+				}
+				for (size_t i = 0; i < (cnt - first); ++i) {
+					aFunctor(const_cast<const T &>(_elements[i].ref()));
+					_elements[i].destroy();
+					_stats.popped(i);
+				}
+				__atomic_store_n(&_head, ((head + cnt) & eMask), __ATOMIC_RELEASE);
+			} else {
+				_stats.pop_empty();
+			}
+			return cnt;
 		}
 
 
 		/**
 		 * This method will remove all the elements from the queue by
-		 * simply popping them off one by one until they are all removed.
+		 * simply destroying them one by one until they are all removed.
 		 * In order for this to be thread-safe, this action can only be
 		 * called by the CONSUMER thread, as that's the same activity as
 		 * is happening in this method.
 		 */
 		virtual void clear()
 		{
-			T		v;
-			while (pop(v));
+			size_t	head = _head;
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head = (head + 1) & eMask) {
+				_elements[head].destroy();
+			}
+			__atomic_store_n(&_head, head, __ATOMIC_RELEASE);
 		}
 
 
@@ -304,7 +582,7 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * possible to make a good equals operator, it's not worth the cost
 		 * at this time. This method will always return 'false'.
 		 */
-		bool operator==( const CircularFIFO<T,N> & anOther ) const
+		bool operator==( const CircularFIFO<T,N,S> & anOther ) const
 		{
 			return false;
 		}
@@ -322,13 +600,37 @@ template <class T, uint8_t N> class CircularFIFO :
 		 * possible to make a good not-equals operator, it's not worth the cost
 		 * at this time. This method will always return 'true'.
 		 */
-		bool operator!=( const CircularFIFO<T,N> & anOther ) const
+		bool operator!=( const CircularFIFO<T,N,S> & anOther ) const
 		{
 			return !operator==(anOther);
 		}
 
 
 	private:
+		/**
+		 * This method builds the element at the 'tail' from the arguments
+		 * - copying, moving, or constructing it in place - if there's room,
+		 * and then publishes the new 'tail'. It returns 'false' if there's
+		 * no room in the queue.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			size_t	tail = _tail;
+			size_t	newTail = (tail + 1) & eMask;
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			// if we have room, then let's build it in the spot
+			if (newTail != head) {
+				_elements[tail].construct(std::forward<Args>(args)...);
+				_stats.pushed(tail, ((newTail - head) & eMask));
+				__atomic_store_n(&_tail, newTail, __ATOMIC_RELEASE);
+				return true;
+			}
+
+			// the queue had no more space - push back!
+			_stats.push_failed();
+			return false;
+		}
+
 		/**
 		 * Since the size of the queue is in the definition of the
 		 * instance, it's possible to make some very simple enums that
@@ -342,15 +644,20 @@ template <class T, uint8_t N> class CircularFIFO :
 		};
 
 		/**
-		 * We need to have a linear array of the elements as well as the
+		 * We need to have a linear array of the slots as well as the
 		 * head and tail of the queue. Since all these are going to be
-		 * messed with by one producer and one consumer thread, making the
-		 * ivars volatile is sufficient to ensure the thread-safety of
-		 * the container.
+		 * messed with by one producer and one consumer thread, the
+		 * indexes are published with release stores, and read with
+		 * acquire loads, so the slots are always seen fully built. The
+		 * '_reserved' flag is the producer's own, and says the slot at
+		 * the 'tail' has been handed out by try_reserve().
 		 */
-		volatile T			_elements[eSize];
+		util::slot<T>		_elements[eSize];
 		volatile size_t		_head;
 		volatile size_t		_tail;
+		bool				_reserved;
+		// ...and this is the instrumentation, if there is any
+		S					_stats;
 };
 }		// end of namespace spsc
 }		// end of namespace dkit
@@ -0,0 +1,445 @@
+/**
+ * DynamicCircularFIFO.h - this file defines the template class for a single-
+ *                         producer, single-consumer, circular FIFO queue
+ *                         that works just like the spsc::CircularFIFO, but
+ *                         whose size is given to the constructor at run-time
+ *                         and not in the template. The elements are held in
+ *                         a block of memory mapped out of line - optionally
+ *                         on huge pages - and pre-faulted when the queue is
+ *                         made, so the depth of the queue can come from the
+ *                         configuration of the process, and not a recompile.
+ *
+ *                         This queue is completely thread-safe so long as
+ *                         there is ONE and ONLY ONE thread placing elements
+ *                         into this container, and ONE and ONLY ONE thread
+ *                         removing them. Like the spsc::CircularFIFO, the
+ *                         slots are only constructed when an element is
+ *                         pushed, and destroyed when it's popped.
+ *
+ *                         As with the fixed ring, the last template
+ *                         parameter, S, is the instrumentation, and it's
+ *                         sized from the capacity the queue is made with.
+ */
+#ifndef __DKIT_SPSC_DYNAMICCIRCULARFIFO_H
+#define __DKIT_SPSC_DYNAMICCIRCULARFIFO_H
+
+//	System Headers
+#include <stdint.h>
+#include <new>
+#include <stdexcept>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "FIFO.h"
+#include "util/ring_storage.h"
+#include "util/slot.h"
+#include "util/queue_stats.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace spsc {
+/**
+ * This is the main template definition for the run-time sized FIFO queue
+ */
+template <class T, class S = util::no_stats> class DynamicCircularFIFO :
+	public FIFO<T>
+{
+	public :
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This form of the constructor makes a queue with room for at
+		 * least 'aCapacity' slots - rounded up to the next power of two -
+		 * and, if asked, places them on huge pages. There's no T built
+		 * until it's pushed, so T doesn't need a default constructor.
+		 */
+		DynamicCircularFIFO( size_t aCapacity, bool useHugePages = false ) :
+			FIFO<T>(),
+			_capacity(util::ring_storage::powerOfTwo(aCapacity)),
+			_mask(_capacity - 1),
+			_storage(_capacity * sizeof(util::slot<T>), useHugePages),
+			_elements(NULL),
+			_head(0),
+			_tail(0),
+			_stats(_capacity, sp_sc)
+		{
+			initElements();
+		}
+
+
+		/**
+		 * This is the standard copy constructor and needs to be in every
+		 * class to make sure that we don't have too many things running
+		 * around. The copy will have the same capacity, and the same use
+		 * of huge pages, as the original.
+		 */
+		DynamicCircularFIFO( const DynamicCircularFIFO<T, S> & anOther ) :
+			FIFO<T>(),
+			_capacity(anOther._capacity),
+			_mask(anOther._mask),
+			_storage(anOther._capacity * sizeof(util::slot<T>), anOther._storage.isHuge()),
+			_elements(NULL),
+			_head(0),
+			_tail(0),
+			_stats(_capacity, sp_sc)
+		{
+			initElements();
+			// let the '=' operator do it
+			*this = anOther;
+		}
+
+
+		/**
+		 * This is the destructor for the queue and makes sure that
+		 * everything is cleaned up before leaving - the elements still in
+		 * the queue are destroyed, and the storage goes back to the OS.
+		 */
+		virtual ~DynamicCircularFIFO()
+		{
+			clear();
+		}
+
+
+		/**
+		 * When we want to process the result of an equality we need to
+		 * make sure that we do this right by always having an equals
+		 * operator on all classes.
+		 *
+		 * Because of the single-producer, single-consumer, nature of
+		 * this class, it is IMPOSSIBLE to have the assignment operator
+		 * be thread-safe without a mutex. This defeats the entire
+		 * purpose, so what we have is a non-thread-safe assignment
+		 * operator that is still useful if care is exercised to make
+		 * sure that no use-case exists where there will be readers or
+		 * writers to this queue while it is being copied in this assignment.
+		 *
+		 * Since the size isn't part of the type, it's possible to try
+		 * and assign queues of different capacities, and that's just not
+		 * something we can do without moving the storage.
+		 */
+		DynamicCircularFIFO<T, S> & operator=( const DynamicCircularFIFO<T, S> & anOther )
+		{
+			// make sure that we don't do this to ourselves
+			if (this != & anOther) {
+				if (_capacity != anOther._capacity) {
+					throw std::runtime_error("[DynamicCircularFIFO::operator=] Unable to assign queues of different capacities!");
+				}
+				// drop what we have, and copy in what's in his queue
+				clear();
+				for (size_t i = anOther._head; i != anOther._tail; i = (i + 1) & _mask) {
+					_elements[i].construct(anOther._elements[i].ref());
+				}
+				// now copy the pointers
+				_head = anOther._head;
+				_tail = anOther._tail;
+			}
+
+			return *this;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This pair of methods does what you'd expect - it returns the
+		 * length of the queue as it exists at the present time. It's
+		 * got two names because there are so many different kinds of
+		 * implementations that it's often convenient to use one or the
+		 * other to remain consistent.
+		 */
+		virtual size_t size() const
+		{
+			return ((_tail - _head) & _mask);
+		}
+
+
+		virtual size_t length() const
+		{
+			return size();
+		}
+
+
+		/**
+		 * This method returns the current capacity of the vector and
+		 * is NOT the size per se. The capacity is what this queue
+		 * will hold.
+		 */
+		virtual size_t capacity() const
+		{
+			return _capacity;
+		}
+
+
+		/**
+		 * This method returns 'true' if the storage for the queue ended
+		 * up on huge pages. If they were asked for, but the system has
+		 * none to give, this will be 'false', but the queue still works.
+		 */
+		bool isOnHugePages() const
+		{
+			return _storage.isHuge();
+		}
+
+
+		/**
+		 * This method returns the instrumentation of the queue. With the
+		 * default, util::no_stats, there's nothing in it at all.
+		 */
+		const S & stats() const
+		{
+			return _stats;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method pushes the provided element onto the queue, and
+		 * because it's FIFO, it's going to be the placed at the 'tail'
+		 * of the queue, and the pop() will take elements off the 'head'.
+		 * This method will make sure that there is a place to put the
+		 * element BEFORE placing it in the queue, and will return 'false'
+		 * if there is no available space. Otherwise, it will place the
+		 * element, and then return 'true'.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			return put(anElem);
+		}
+
+
+		/**
+		 * This form of push() moves the element into the queue, rather
+		 * than copying it, and emplace() builds the element right in the
+		 * slot from the arguments. Otherwise, they are just like push().
+		 */
+		virtual bool push( T && anElem )
+		{
+			return put(std::move(anElem));
+		}
+
+
+		template <class... Args> bool emplace( Args &&... args )
+		{
+			return put(std::forward<Args>(args)...);
+		}
+
+
+		/**
+		 * This form of the pop() method takes an element reference as
+		 * an argument where the top of the queue will be placed - assuming
+		 * there's something there to get. If so, then the value will be
+		 * replaced, and a 'true' will be returned. Otherwise, a 'false'
+		 * will be returned, as there's nothing to return.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			size_t	head = _head;
+			// see if we have anything in the queue to pull out
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
+				_stats.pop_empty();
+				return false;
+			}
+
+			// OK, move out the head of the queue, and move up one
+			anElem = std::move(_elements[head].ref());
+			_elements[head].destroy();
+			_stats.popped(head);
+			__atomic_store_n(&_head, ((head + 1) & _mask), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue. This is a slightly different
+		 * form that fits a different use-case, and so it's a handy
+		 * thing to have around at times.
+		 */
+		virtual T pop()
+		{
+			size_t	head = _head;
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
+				_stats.pop_empty();
+				throw std::exception();
+			}
+			T		v(std::move(_elements[head].ref()));
+			_elements[head].destroy();
+			_stats.popped(head);
+			__atomic_store_n(&_head, ((head + 1) & _mask), __ATOMIC_RELEASE);
+			return v;
+		}
+
+
+		/**
+		 * This method looks at the first element on the top of the queue
+		 * and returns it in the provided reference argument. If there's
+		 * nothing there, the return value will be 'false', and the reference
+		 * will be untouched. If there's something there, the return value
+		 * will be 'true'.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			size_t	head = _head;
+			// see if we have anything in the queue to pull out
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
+				return false;
+			}
+
+			// OK, copy the head of the queue, but DO NOT move up one
+			util::copy_assign(anElem, _elements[head].ref());
+			return true;
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			size_t	head = _head;
+			if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE)) {
+				throw std::exception();
+			}
+			return util::copy_of(_elements[head].ref());
+		}
+
+
+		/**
+		 * This method will remove all the elements from the queue by
+		 * simply destroying them one by one until they are all removed.
+		 * In order for this to be thread-safe, this action can only be
+		 * called by the CONSUMER thread, as that's the same activity as
+		 * is happening in this method.
+		 */
+		virtual void clear()
+		{
+			size_t	head = _head;
+			size_t	tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head = (head + 1) & _mask) {
+				_elements[head].destroy();
+			}
+			__atomic_store_n(&_head, head, __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method returns 'true' if there are no elements in the queue.
+		 */
+		virtual bool empty()
+		{
+			return (_head == _tail);
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are the same. As with the spsc::CircularFIFO, there's
+		 * no thread that can actually perform this operation in a
+		 * thread-safe manner, so this method will always return 'false'.
+		 */
+		bool operator==( const DynamicCircularFIFO<T, S> & anOther ) const
+		{
+			return false;
+		}
+
+
+		/**
+		 * Traditionally, this operator would look at the elements in this
+		 * queue, compare them to the elements in the argument queue, and
+		 * see if they are NOT the same. As with the operator==(), this
+		 * method will always return 'true'.
+		 */
+		bool operator!=( const DynamicCircularFIFO<T, S> & anOther ) const
+		{
+			return !operator==(anOther);
+		}
+
+
+	private:
+		/**
+		 * This method points the slots at the mapped storage. There's no
+		 * T built until it's pushed. It's only called from the constructors.
+		 */
+		void initElements()
+		{
+			_elements = (util::slot<T> *)_storage.data();
+		}
+
+		/**
+		 * This method builds the element at the 'tail' from the arguments
+		 * - copying, moving, or constructing it in place - if there's room,
+		 * and then publishes the new 'tail'. It returns 'false' if there's
+		 * no room in the queue.
+		 */
+		template <class... Args> bool put( Args &&... args )
+		{
+			size_t	tail = _tail;
+			size_t	newTail = (tail + 1) & _mask;
+			size_t	head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+			// if we have room, then let's build it in the spot
+			if (newTail != head) {
+				_elements[tail].construct(std::forward<Args>(args)...);
+				_stats.pushed(tail, ((newTail - head) & _mask));
+				__atomic_store_n(&_tail, newTail, __ATOMIC_RELEASE);
+				return true;
+			}
+
+			// the queue had no more space - push back!
+			_stats.push_failed();
+			return false;
+		}
+
+		/**
+		 * Since the size of the queue is given at run-time, we need to
+		 * hold on to the size and the masking bits for the index values,
+		 * so that we know how to "wrap around" when the time comes.
+		 */
+		size_t				_capacity;
+		size_t				_mask;
+
+		/**
+		 * We need to have the out-of-line block of slots as well as the
+		 * head and tail of the queue. Since all these are going to be
+		 * messed with by one producer and one consumer thread, the indexes
+		 * are published with release stores, and read with acquire loads.
+		 */
+		util::ring_storage	_storage;
+		util::slot<T>		*_elements;
+		volatile size_t		_head;
+		volatile size_t		_tail;
+		// ...and this is the instrumentation, if there is any
+		S					_stats;
+};
+}		// end of namespace spsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_SPSC_DYNAMICCIRCULARFIFO_H
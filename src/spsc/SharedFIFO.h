@@ -0,0 +1,385 @@
+/**
+ * SharedFIFO.h - this file defines the template class for a single-producer,
+ *                single-consumer, circular FIFO queue of 2^N elements that
+ *                lives in shared memory, so that the producer and consumer
+ *                can be in different processes. It's the same lock-free ring
+ *                as the CircularFIFO - a head and a tail on their own cache
+ *                lines, each written by only one side - but it's all laid out
+ *                in a util::shm_segment as indexes, and never as pointers, so
+ *                it works wherever each process has the segment mapped.
+ *
+ *                The segment starts with a util::shm_header that says what's
+ *                in it - the kind of queue, the size of the elements and how
+ *                many there are - and the process that attaches to it checks
+ *                that against what it was built with. The elements are just
+ *                copied in and out, byte for byte, so T has to be trivially
+ *                copyable - no pointers, and nothing with a destructor.
+ *
+ *                This object itself is just a handle on the segment, in the
+ *                memory of the process that made it. Along with the mapping,
+ *                it keeps the producer's last look at the head, and the
+ *                consumer's last look at the tail, so that neither goes to
+ *                the other's cache line until it has to.
+ */
+#ifndef __DKIT_SPSC_SHAREDFIFO_H
+#define __DKIT_SPSC_SHAREDFIFO_H
+
+//	System Headers
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "FIFO.h"
+#include "util/padding.h"
+#include "util/shm_segment.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace spsc {
+/**
+ * This is the main class definition
+ */
+template <class T, uint8_t N> class SharedFIFO :
+	public FIFO<T>
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+				  "a SharedFIFO can only hold trivially copyable elements");
+
+	public:
+		/**
+		 * This is the 'kind' that goes in the header of the segment, so
+		 * that nothing else attaches to it by mistake.
+		 */
+		enum {
+			eKind = 1
+		};
+
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This constructor gets to the segment named 'aName', as 'aMode'
+		 * says. If it's made here, the queue is set up in it, empty, and if
+		 * it's attached to, the header has to match this queue - or this
+		 * throws a std::runtime_error.
+		 */
+		SharedFIFO( const std::string & aName, util::shm_mode aMode = util::shm_create_or_attach ) :
+			FIFO<T>(),
+			_segment(new util::shm_segment(aName, footprint(), aMode)),
+			_ring(NULL),
+			_headCache(0),
+			_tailCache(0)
+		{
+			try {
+				setup(_segment->data(), _segment->created());
+			} catch (...) {
+				delete _segment;
+				throw;
+			}
+		}
+
+
+		/**
+		 * This constructor puts the queue in a block of shared memory that
+		 * the caller looks after - at least footprint() bytes, and aligned
+		 * to a cache line - so that more than one queue can be in the same
+		 * segment. If 'aCreate' is 'true', it's set up empty, and if not,
+		 * it has to already hold this queue.
+		 */
+		SharedFIFO( void *aBlock, bool aCreate ) :
+			FIFO<T>(),
+			_segment(NULL),
+			_ring(NULL),
+			_headCache(0),
+			_tailCache(0)
+		{
+			setup(aBlock, aCreate);
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this, the right destructor will be
+		 * called. The elements are in the segment, and stay there for the
+		 * other process - all we drop is our mapping of it.
+		 */
+		virtual ~SharedFIFO()
+		{
+			if (_segment != NULL) {
+				delete _segment;
+				_segment = NULL;
+			}
+			_ring = NULL;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the number of bytes the queue needs in a
+		 * segment - the header, the head and tail, and the ring itself.
+		 */
+		static size_t footprint()
+		{
+			return sizeof(Layout);
+		}
+
+
+		/**
+		 * This pair of methods does what you'd expect - it returns the
+		 * length of the queue as it exists at the present time. It's
+		 * got two names because there are so many different kinds of
+		 * implementations that it's often convenient to use one or the
+		 * other to remain consistent.
+		 */
+		virtual size_t size() const
+		{
+			uint64_t	head = __atomic_load_n(&_ring->head, __ATOMIC_ACQUIRE);
+			uint64_t	tail = __atomic_load_n(&_ring->tail, __ATOMIC_ACQUIRE);
+			// the indexes are free-running, so just make sure they make sense
+			return (tail > head ? (size_t)(tail - head) : 0);
+		}
+
+
+		virtual size_t length() const
+		{
+			return size();
+		}
+
+
+		/**
+		 * This method returns the capacity of the queue - all 2^N slots
+		 * can be used, as the indexes run free and never wrap.
+		 */
+		virtual size_t capacity() const
+		{
+			return eSize;
+		}
+
+
+		/**
+		 * This method returns the segment the queue is in - or NULL if it
+		 * was put in a block the caller looks after.
+		 */
+		const util::shm_segment *segment() const
+		{
+			return _segment;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Element Accessing Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes an item and places it in the queue - if it can.
+		 * If so, then it will return 'true', otherwise, it'll return 'false'.
+		 * The head is only read from the segment when the cached one says
+		 * that the queue might be full.
+		 */
+		virtual bool push( const T & anElem )
+		{
+			uint64_t	tail = _ring->tail;
+			if ((tail - _headCache) >= eSize) {
+				_headCache = __atomic_load_n(&_ring->head, __ATOMIC_ACQUIRE);
+				if ((tail - _headCache) >= eSize) {
+					return false;
+				}
+			}
+			_ring->elements[tail & eMask] = anElem;
+			__atomic_store_n(&_ring->tail, (tail + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * This method updates the passed-in reference with the value on the
+		 * top of the queue - if it can. If so, it'll return the value and
+		 * 'true', but if it can't, as in the queue is empty, then the method
+		 * will return 'false' and the value will be untouched.
+		 */
+		virtual bool pop( T & anElem )
+		{
+			uint64_t	head = _ring->head;
+			if (!ready(head)) {
+				return false;
+			}
+			anElem = _ring->elements[head & eMask];
+			__atomic_store_n(&_ring->head, (head + 1), __ATOMIC_RELEASE);
+			return true;
+		}
+
+
+		/**
+		 * This form of the pop() method will throw a std::exception
+		 * if there is nothing to pop, but otherwise, will return the
+		 * the first element on the queue.
+		 */
+		virtual T pop()
+		{
+			T	v;
+			if (!pop(v)) {
+				throw std::exception();
+			}
+			return v;
+		}
+
+
+		/**
+		 * If there is an item on the queue, this method will return a look
+		 * at that item without updating the queue. The return value will be
+		 * 'true' if there is something, but 'false' if the queue is empty.
+		 */
+		virtual bool peek( T & anElem )
+		{
+			uint64_t	head = _ring->head;
+			if (!ready(head)) {
+				return false;
+			}
+			anElem = _ring->elements[head & eMask];
+			return true;
+		}
+
+
+		/**
+		 * This form of the peek() method is very much like the non-argument
+		 * version of the pop() method. If there is something on the top of
+		 * the queue, this method will return a COPY of it. If not, it will
+		 * throw a std::exception, that needs to be caught.
+		 */
+		virtual T peek()
+		{
+			T	v;
+			if (!peek(v)) {
+				throw std::exception();
+			}
+			return v;
+		}
+
+
+		/**
+		 * This method will clear out the contents of the queue - and like
+		 * pop(), it has to be called by the consumer.
+		 */
+		virtual void clear()
+		{
+			_tailCache = __atomic_load_n(&_ring->tail, __ATOMIC_ACQUIRE);
+			__atomic_store_n(&_ring->head, _tailCache, __ATOMIC_RELEASE);
+		}
+
+
+		/**
+		 * This method will return 'true' if there are no items in the
+		 * queue. Simple.
+		 */
+		virtual bool empty()
+		{
+			return (size() == 0);
+		}
+
+
+	private:
+		/**
+		 * There's no sense in copying one of these - it's a handle on the
+		 * queue in the segment, and each process makes its own.
+		 */
+		SharedFIFO( const SharedFIFO<T, N> & anOther );
+		SharedFIFO & operator=( const SharedFIFO<T, N> & anOther );
+
+		/**
+		 * Since the size of the queue is in the definition of the
+		 * instance, it's possible to make some very simple enums that
+		 * are the size and the masking bits for the index values.
+		 */
+		enum {
+			eMask = ((1 << N) - 1),
+			eSize = (1 << N),
+			eHeaderPad = (util::cache_line_size - sizeof(util::shm_header)),
+			ePad = (util::cache_line_size - sizeof(uint64_t))
+		};
+
+		/**
+		 * This is how the queue is laid out in the segment - the header,
+		 * then the tail and the head, each on its own cache line, and then
+		 * the ring. The indexes are 64-bit and free-running, so they mean
+		 * the same thing to a process built 32-bit as to one built 64-bit.
+		 */
+		struct Layout {
+			util::shm_header	header;
+			char				pad0[eHeaderPad];
+			uint64_t			tail;
+			char				pad1[ePad];
+			uint64_t			head;
+			char				pad2[ePad];
+			T					elements[eSize];
+		};
+
+		/**
+		 * This method points the handle at the queue in 'aBlock', and if
+		 * 'aCreate' is 'true', makes it empty and publishes the header.
+		 * Otherwise, the header has to be for this queue.
+		 */
+		void setup( void *aBlock, bool aCreate )
+		{
+			_ring = (Layout *)aBlock;
+			if (aCreate) {
+				_ring->tail = 0;
+				_ring->head = 0;
+				_ring->header.publish(eKind, sizeof(T), eSize);
+			} else {
+				_ring->header.verify(eKind, sizeof(T), eSize);
+			}
+			_headCache = __atomic_load_n(&_ring->head, __ATOMIC_ACQUIRE);
+			_tailCache = __atomic_load_n(&_ring->tail, __ATOMIC_ACQUIRE);
+		}
+
+		/**
+		 * This method returns 'true' if there's an element at 'aHead' for
+		 * the consumer - looking at the tail in the segment only when the
+		 * cached one says there isn't.
+		 */
+		bool ready( uint64_t aHead )
+		{
+			if (aHead == _tailCache) {
+				_tailCache = __atomic_load_n(&_ring->tail, __ATOMIC_ACQUIRE);
+				if (aHead == _tailCache) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/**
+		 * This is the segment we made or attached to - if we did - and the
+		 * queue in it, and then the producer's cached head, and the
+		 * consumer's cached tail, on their own cache lines.
+		 */
+		util::shm_segment	*_segment;
+		Layout				*_ring;
+		char				_pad0[util::cache_line_size];
+		uint64_t			_headCache;
+		char				_pad1[ePad];
+		uint64_t			_tailCache;
+		char				_pad2[ePad];
+};
+}		// end of namespace spsc
+}		// end of namespace dkit
+
+#endif	// __DKIT_SPSC_SHAREDFIFO_H
@@ -12,16 +12,30 @@
  *            uint64_t key_value( const T & t );
  *
  *          and just needs to be defined for the 'T' that you are using.
+ *
+ *          That's the dense_trie, and it's the default. For sparse keys,
+ *          the adaptive_trie has the same API, but each level is the
+ *          smallest of four kinds of node - with room for 4, 16, 48 or
+ *          all 256 children - that holds what's there. A node is copied
+ *          into a bigger, or smaller, one as children come and go, and
+ *          the values are each in a Node of their own. The readers take
+ *          no locks, and the writers lock just the node they change.
  */
 #ifndef __DKIT_TRIE_H
 #define __DKIT_TRIE_H
 
 //	System Headers
 #include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <string.h>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 //	Third-Party Headers
 #include <boost/smart_ptr/detail/spinlock.hpp>
@@ -29,6 +43,10 @@
 
 //	Other Headers
 #include "abool.h"
+#include "executor.h"
+#include "util/epoch.h"
+#include "util/mapped_file.h"
+#include "util/waiter.h"
 
 //	Forward Declarations
 /**
@@ -48,6 +66,126 @@ template<typename T> void destroy( T * & t );
 //	Public Constants
 
 //	Public Datatypes
+/**
+ * A Node holding anything but a pointer guards its value with a seqlock -
+ * a writer makes the sequence odd, writes the value, and makes it even
+ * again, and a reader copies the value out between two reads of the same
+ * even sequence, or tries again. The reader never stores a thing, so any
+ * number of them can read a hot value without bouncing its cache line
+ * between them. The sequence is the writers' lock as well. A pointer is
+ * just CAS-ed in and out, and needs none of this, so it's an empty base.
+ */
+namespace dkit {
+namespace trie_util {
+template <bool S> struct sequence
+{
+};
+
+template <> struct sequence<true>
+{
+	volatile uint32_t		seq;
+
+	sequence() : seq(0) { }
+
+	/**
+	 * A writer makes the sequence odd - if it's already odd, another
+	 * writer is in there, and we wait on it. The CAS is a full barrier,
+	 * so none of the writes of the value can move up before it.
+	 */
+	void lockForWrite()
+	{
+		uint32_t	s = seq;
+		while ((s & 0x01) || !__sync_bool_compare_and_swap(&seq, s, s + 1)) {
+			util::waiter<spin_wait>::pause();
+			s = seq;
+		}
+	}
+
+	void unlockForWrite()
+	{
+		__atomic_store_n(&seq, seq + 1, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * A reader gets an even sequence to start, and after it's copied
+	 * out the value, the copy is good only if the sequence is the same.
+	 */
+	uint32_t beginRead() const
+	{
+		uint32_t	s = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+		while (s & 0x01) {
+			util::waiter<spin_wait>::pause();
+			s = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+		}
+		return s;
+	}
+
+	bool endRead( uint32_t aSeq ) const
+	{
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		return (__atomic_load_n(&seq, __ATOMIC_RELAXED) == aSeq);
+	}
+};
+
+
+/**
+ * This is the header at the start of a saved image of a trie. The rest
+ * of the image is blocks, one for each Branch and Leaf that has a value
+ * under it, addressed by their offsets from the start of the image, so
+ * it can be mapped anywhere. A block has what's there for each byte of
+ * the key - the offsets of the blocks below, or in the last level, the
+ * values - in order. If all 256 are there, that's all there is to the
+ * block, and the offset to it has its low bit set. If not, it starts with
+ * a byte for each of the 256 that's the place of its entry, plus one, or
+ * zero if it's not there, and only the entries that are there follow. The
+ * root is written last, as the blocks below each one have to be written
+ * before it knows where they are. It's all in the byte order of the box
+ * that wrote it.
+ */
+struct image_header {
+	enum {
+		eMagic = 0x444b5449,		// 'DKTI'
+		eVersion = 1
+	};
+
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	keyBytes;
+	uint32_t	order;
+	uint32_t	valueSize;
+	uint32_t	valueAlign;
+	uint64_t	count;
+	uint64_t	root;
+	uint64_t	length;
+
+	/**
+	 * This method checks that the image is for the trie the caller has
+	 * in mind, and all there, and throws a std::runtime_error that says
+	 * what's wrong if it isn't.
+	 */
+	void verify( uint32_t aKeyBytes, uint32_t anOrder, uint32_t aValueSize,
+				 uint32_t aValueAlign, uint64_t aLength ) const
+	{
+		if (magic != (uint32_t)eMagic) {
+			throw std::runtime_error("[image_header] The file doesn't hold a trie image!");
+		}
+		if (version != eVersion) {
+			throw std::runtime_error("[image_header] The trie image is another version!");
+		}
+		if ((keyBytes != aKeyBytes) || (order != anOrder)) {
+			throw std::runtime_error("[image_header] The trie image has another kind of key!");
+		}
+		if ((valueSize != aValueSize) || (valueAlign != aValueAlign)) {
+			throw std::runtime_error("[image_header] The trie image has another kind of value!");
+		}
+		uint64_t	at = (root & ~((uint64_t)0x01));
+		if ((length != aLength) || (at < sizeof(image_header)) || (at >= length)) {
+			throw std::runtime_error("[image_header] The trie image isn't all there!");
+		}
+	}
+};
+}		// end of namespace trie_util
+}		// end of namespace dkit
 
 //	Public Data Constants
 /**
@@ -63,6 +201,25 @@ enum trie_key_size {
 	uint64_key = 8,
 	uint128_key = 16,
 };
+
+/**
+ * This is the layout of the levels of the trie - every one a full 256-way
+ * branch, or each one only as big as it needs to be.
+ */
+enum trie_mode {
+	dense_trie = 0,
+	adaptive_trie,
+};
+
+/**
+ * This is the order the bytes of a key are walked in - as they are in
+ * memory, or most significant first, so that walking the tree in byte
+ * order is walking the keys in numeric order.
+ */
+enum trie_key_order {
+	native_order = 0,
+	ordered_keys,
+};
 }		// end of namespace dkit
 
 
@@ -70,8 +227,11 @@ enum trie_key_size {
  * Main class definition
  */
 namespace dkit {
-template <class T, trie_key_size N> class trie
+template <class T, trie_key_size N, trie_mode M = dense_trie,
+		  trie_key_order O = native_order> class trie
 {
+	static_assert(M == dense_trie, "an adaptive_trie only has native_order keys");
+
 	public:
 		/********************************************************
 		 *
@@ -84,30 +244,48 @@ template <class T, trie_key_size N> class trie
 		 * all the storage and clean-up of the data in the Nodes, and the
 		 * tree in the trie handles all the branches. It's protected as some
 		 * subclasses may wish to use it.
+		 *
+		 * A pointer value is CAS-ed in, and read out with a plain load,
+		 * and the one it replaces is retired to the epoch - not deleted -
+		 * as a reader may still have it. Anything else has to be
+		 * trivially copyable, and it's copied in and out under the Node's
+		 * seqlock. Either way, readers never write to the Node at all.
 		 */
-		struct Node {
+		struct Node : public trie_util::sequence<!boost::is_pointer<T>::value> {
+			static_assert(boost::is_pointer<T>::value || std::is_trivially_copyable<T>::value,
+						  "a trie of non-pointers needs trivially copyable values");
+
 			volatile T							value;
 			abool								valid;
-			mutable boost::detail::spinlock		mutex;
 
 			/**
 			 * These are the constructors and destructor for the Node
 			 */
-			Node() : value(), valid(false), mutex() { }
-			Node( const T aValue ) : value(aValue), valid(true), mutex() { }
-			~Node() { clear(); }
+			Node() : value(), valid(false) { }
+			Node( const T aValue ) : value(aValue), valid(true) { }
+
+			/**
+			 * When the Node goes, so does the trie it's in, and no one can
+			 * be reading it, so the value is cleaned up right now.
+			 */
+			~Node()
+			{
+				if (boost::is_pointer<T>::value) {
+					T	old = exchange(T(), boost::is_pointer<T>());
+					trie_util::destroy(old);
+				}
+			}
 
 			// this method is the simple clearing out of the value
 			void clear()
 			{
 				if (boost::is_pointer<T>::value) {
 					// we have to CAS in a NULL to the value
-					T	old = value;
-					while (!__sync_bool_compare_and_swap(&value, old, NULL)) {
-						old = value;
+					T	old = exchange(T(), boost::is_pointer<T>());
+					// ...and then retire what we took out
+					if (valid) {
+						retire(old, boost::is_pointer<T>());
 					}
-					// ...and then clean up what we took out
-					trie_util::destroy(old);
 				}
 				valid = false;
 			}
@@ -115,24 +293,19 @@ template <class T, trie_key_size N> class trie
 			/**
 			 * This takes care of placing a value into the Node in as
 			 * efficient a way as possible. For pointers, it's CAS, but
-			 * for non-pointers, it's a spinlock to protect the assignment.
+			 * for non-pointers, it's a write under the seqlock.
 			 */
 			void assign( const T & t )
 			{
 				if (boost::is_pointer<T>::value) {
 					// do a CAS on the old to new value of this node
-					T	old = value;
-					while (!__sync_bool_compare_and_swap(&value, old, t)) {
-						old = value;
-					}
-					// if we have a valid old pointer, then delete it
+					T	old = exchange(t, boost::is_pointer<T>());
+					// if we have a valid old pointer, then retire it
 					if (valid) {
-						trie_util::destroy(old);
+						retire(old, boost::is_pointer<T>());
 					}
 				} else {
-					// lock up this guy for the assignment...
-					boost::detail::spinlock::scoped_lock	lock(mutex);
-					value = t;
+					write(t, boost::is_pointer<T>());
 				}
 				// make sure that we are considering this node valid
 				valid = true;
@@ -141,22 +314,17 @@ template <class T, trie_key_size N> class trie
 			/**
 			 * This takes care of pulling a value out of the Node in as
 			 * efficient a way as possible. For pointers, it's CAS, but
-			 * for non-pointers, it's a spinlock to protect the assignment.
+			 * for non-pointers, it's a read under the seqlock - retried
+			 * if a writer got in the way.
 			 * If there's a value to get, it's copied and 'true' is returned.
 			 * If not, then the arg is left untouched, and 'false' is
 			 * returned.
 			 */
-			bool copy( T & t )
+			bool copy( T & t ) const
 			{
 				bool		success = false;
-				if ((bool)valid) {
-					if (boost::is_pointer<T>::value) {
-						// CAS out the value after a no-op or-ing.
-						t = __sync_or_and_fetch(&value, 0x0);
-					} else {
-						boost::detail::spinlock::scoped_lock	lock(mutex);
-						t = value;
-					}
+				if ((bool)const_cast<abool &>(valid)) {
+					read(t, boost::is_pointer<T>());
 					success = true;
 				}
 				return success;
@@ -166,24 +334,21 @@ template <class T, trie_key_size N> class trie
 			 * This takes care of pulling a value out of the Node in as
 			 * efficient a way as possible, and then invalidating the Node's
 			 * contents as if the value is being "removed". For pointers,
-			 * it's CAS, but for non-pointers, it's a spinlock to protect
-			 * the assignment. If there's a value to get, it's copied and
+			 * it's CAS, but for non-pointers, it's a read under the
+			 * seqlock. If there's a value to get, it's copied and
 			 * 'true' is returned. If not, then the arg is left untouched,
-			 * and 'false' is returned.
+			 * and 'false' is returned. A pointer that's removed is the
+			 * caller's, and readers may still have it, so it has to be
+			 * deleted only once they're done - with trie::retire().
 			 */
 			bool remove( T & t )
 			{
 				bool		success = false;
 				if ((bool)valid) {
 					if (boost::is_pointer<T>::value) {
-						// CAS out the value after a no-op or-ing.
-						t = value;
-						while (!__sync_bool_compare_and_swap(&value, t, NULL)) {
-							t = value;
-						}
+						t = exchange(T(), boost::is_pointer<T>());
 					} else {
-						boost::detail::spinlock::scoped_lock	lock(mutex);
-						t = value;
+						read(t, boost::is_pointer<T>());
 					}
 					success = true;
 					// make sure that we are considering this node invalid
@@ -192,6 +357,72 @@ template <class T, trie_key_size N> class trie
 				return success;
 			}
 
+			/**
+			 * These are the moves of the value itself - a pointer is
+			 * swapped in with CAS, and a plain value is copied in, and out,
+			 * a byte at a time between the seqlock's sequence reads.
+			 */
+			T exchange( const T & t, const boost::true_type & aPointer )
+			{
+				T	old = value;
+				while (!__sync_bool_compare_and_swap(&value, old, t)) {
+					old = value;
+				}
+				return old;
+			}
+
+			T exchange( const T & t, const boost::false_type & aPointer )
+			{
+				return t;
+			}
+
+			void write( const T & t, const boost::true_type & aPointer )
+			{
+				exchange(t, aPointer);
+			}
+
+			void write( const T & t, const boost::false_type & aPointer )
+			{
+				this->lockForWrite();
+				memcpy(const_cast<T *>(&value), &t, sizeof(T));
+				this->unlockForWrite();
+			}
+
+			void read( T & t, const boost::true_type & aPointer ) const
+			{
+				t = __atomic_load_n(&value, __ATOMIC_ACQUIRE);
+			}
+
+			void read( T & t, const boost::false_type & aPointer ) const
+			{
+				uint32_t	s = 0;
+				do {
+					s = this->beginRead();
+					memcpy(&t, const_cast<const T *>(&value), sizeof(T));
+				} while (!this->endRead(s));
+			}
+
+			/**
+			 * A pointer that's been replaced, or cleared, is handed to the
+			 * epoch, and it's deleted once no read_guard could have it.
+			 */
+			static void retire( T t, const boost::true_type & aPointer )
+			{
+				if (t != NULL) {
+					util::epoch::retire((void *)t, &reclaim);
+				}
+			}
+
+			static void retire( T t, const boost::false_type & aPointer )
+			{
+			}
+
+			static void reclaim( void *aPtr )
+			{
+				T	t = (T)aPtr;
+				trie_util::destroy(t);
+			}
+
 			/**
 			 * This method is just a simple debugging tool to be able
 			 * to see the value within in the Node at the time.
@@ -236,7 +467,84 @@ template <class T, trie_key_size N> class trie
 				virtual bool process( volatile Node & aNode ) = 0;
 		};
 
+		/**
+		 * This is the functor for the parallel apply() - where the trie is
+		 * split up into parts, and each part is walked on a worker. Each
+		 * part gets a reducer of its own from fork(), so the workers never
+		 * share anything while they work, and when they're all done, the
+		 * parts are handed back to the original with combine() - in the
+		 * order of the parts, which is the order of the trie - and then
+		 * deleted. So a count is just summed up, and a list of keys in an
+		 * ordered_keys trie ends up in order.
+		 */
+		class reducer
+		{
+			public:
+				virtual ~reducer() { }
+				// this makes a new, empty, reducer for one of the parts
+				virtual reducer *fork() = 0;
+				// this is called for each valid Node in the part
+				virtual bool process( volatile Node & aNode ) = 0;
+				// ...and this folds a part's results into this one
+				virtual void combine( reducer & aPart ) = 0;
+		};
+
+		/********************************************************
+		 *
+		 *              Read-Side Critical Section
+		 *
+		 ********************************************************/
+		/**
+		 * When the values are pointers, get() hands out the very pointer
+		 * in the trie, and a writer can replace it right after. So the
+		 * one it replaces isn't deleted then, but retired to the epoch -
+		 * and it's only deleted once every read_guard that was around at
+		 * the time is gone. Put one on the stack around the get() calls,
+		 * and the use of what they return:
+		 *
+		 *   {
+		 *     trie_t::read_guard	rg;
+		 *     if (m.get(key, bp)) {
+		 *       ...use bp...
+		 *     }
+		 *   }
+		 *
+		 * The guard is the epoch's, so it nests, and only the outermost
+		 * one publishes anything - and that's to this thread's own slot.
+		 * The get() itself stores nothing at all, so many guarded gets in
+		 * one read_guard cost no more than the gets.
+		 */
+		class read_guard
+		{
+			public:
+				read_guard() : _guard() { }
+				~read_guard() { }
+
+			private:
+				util::epoch::guard		_guard;
+
+				// guards are on the stack, and nowhere else
+				read_guard( const read_guard & anOther );
+				read_guard & operator=( const read_guard & anOther );
+		};
+
 	protected:
+		/**
+		 * A key is walked a byte at a time, and this is the key as it's
+		 * walked - as it is in memory, or most significant byte first, as
+		 * the trie_key_order says. A uint16_key still takes three steps -
+		 * the root, a Branch, and the Leaf - so it has a spare byte, that
+		 * is always zero.
+		 */
+		enum {
+			eKeyBytes = (N > 2 ? N : 3),
+			eNodeByte = (eKeyBytes - 1)
+		};
+
+		struct key_bytes {
+			uint8_t		bytes[eKeyBytes];
+		};
+
 		/**
 		 * The base component for the structure of the trie is called a
 		 * 'Component', and it will be sub-classed into a Branch and a
@@ -501,42 +809,51 @@ template <class T, trie_key_size N> class trie
 			{
 				volatile Node	*n = NULL;
 
-				// get the index we're working on (re-used a few times)
-				uint8_t		idx = aKey[aStep];
-				Component	*curr = __sync_or_and_fetch(&kids[idx], 0x0);
+				// get - or make - the next Branch or Leaf on the path
+				Component	*curr = getOrCreateKid(aKey[aStep], (aStep >= eLastBranch));
+
+				// now pass down to that next branch the request to fill
+				if (curr != NULL) {
+					n = curr->getOrCreateNodeForKey(aKey, (aStep + 1));
+				}
+
+				// return what we have dug out of the tree
+				return n;
+			}
+
+			/**
+			 * This method returns the child of this Branch at 'anIndex',
+			 * and if there isn't one, makes it - a Leaf if 'aLeaf' is
+			 * 'true', and a Branch if not - and CASes it into place. It's
+			 * not virtual, so the trie's unrolled walk can call it as well.
+			 */
+			Component *getOrCreateKid( uint8_t anIndex, bool aLeaf )
+			{
+				Component	*curr = __sync_or_and_fetch(&kids[anIndex], 0x0);
 				if (curr == NULL) {
 					// create a new Branch or Leaf for this part of the trie
-					bool	createBranch = true;
-					if (aStep < eLastBranch) {
-						curr = new Branch();
-					} else {
+					if (aLeaf) {
 						curr = new Leaf();
-						createBranch = false;
+					} else {
+						curr = new Branch();
 					}
 					// throw a runtime exception if we couldn't make it
 					if (curr == NULL) {
-						if (createBranch) {
-							throw std::runtime_error("[Branch::getOrCreateNodeForKey] Unable to create new Branch for the trie!");
+						if (aLeaf) {
+							throw std::runtime_error("[Branch::getOrCreateKid] Unable to create new Leaf for the trie!");
 						} else {
-							throw std::runtime_error("[Branch::getOrCreateNodeForKey] Unable to create new Leaf for the trie!");
+							throw std::runtime_error("[Branch::getOrCreateKid] Unable to create new Branch for the trie!");
 						}
 					}
 					// see if we can put this new one in the right place
-					if (!__sync_bool_compare_and_swap(&kids[idx], NULL, curr)) {
+					if (!__sync_bool_compare_and_swap(&kids[anIndex], NULL, curr)) {
 						// someone beat us to it! Delete what we just made...
 						delete curr;
 						// ...and get what is there now
-						curr = __sync_or_and_fetch(&kids[idx], 0x0);
+						curr = __sync_or_and_fetch(&kids[anIndex], 0x0);
 					}
 				}
-
-				// now pass down to that next branch the request to fill
-				if (curr != NULL) {
-					n = curr->getOrCreateNodeForKey(aKey, (aStep + 1));
-				}
-
-				// return what we have dug out of the tree
-				return n;
+				return curr;
 			}
 
 			/**
@@ -603,6 +920,147 @@ template <class T, trie_key_size N> class trie
 		};
 
 
+	public:
+		/********************************************************
+		 *
+		 *              Ordered Cursor for the Trie
+		 *
+		 ********************************************************/
+		/**
+		 * In a trie with ordered_keys, this walks the valid values in the
+		 * order of their keys - from the first, or from the first at, or
+		 * after, a given key. It holds on to the Leaf it's in, so next()
+		 * is mostly a scan of the rest of that Leaf, and only when that's
+		 * done does it go back to the root, and seek the next one - going
+		 * right past the empty subtrees, as each is just a NULL. Nothing
+		 * is deleted out from under it but by clear(), so it's fine for
+		 * the trie to be changing while it's walked - it just may, or may
+		 * not, see the changes.
+		 */
+		class cursor
+		{
+			public:
+				/**
+				 * These constructors put the cursor on the first valid value
+				 * in the trie, or on the first at, or after, the key.
+				 */
+				cursor( trie & aTrie ) :
+					_trie(&aTrie),
+					_leaf(NULL),
+					_node(NULL),
+					_key()
+				{
+					static_assert(O == ordered_keys, "a cursor needs a trie with ordered_keys");
+					_node = _trie->seek(_key.bytes, _leaf);
+				}
+
+				cursor( trie & aTrie, uint64_t aKey ) :
+					_trie(&aTrie),
+					_leaf(NULL),
+					_node(NULL),
+					_key(encode(aKey))
+				{
+					static_assert(O == ordered_keys, "a cursor needs a trie with ordered_keys");
+					_node = _trie->seek(_key.bytes, _leaf);
+				}
+
+				cursor( trie & aTrie, const uint8_t aKey[] ) :
+					_trie(&aTrie),
+					_leaf(NULL),
+					_node(NULL),
+					_key()
+				{
+					static_assert(O == ordered_keys, "a cursor needs a trie with ordered_keys");
+					memcpy(_key.bytes, aKey, N);
+					_node = _trie->seek(_key.bytes, _leaf);
+				}
+
+				virtual ~cursor()
+				{
+				}
+
+				/**
+				 * This method returns 'true' if the cursor is on a value,
+				 * and 'false' once it's gone past the last one.
+				 */
+				bool valid() const
+				{
+					return (_node != NULL);
+				}
+
+				/**
+				 * These methods return the key of the value the cursor is
+				 * on - as a number, which for a uint128_key is just the low
+				 * 64 bits, and as the bytes, most significant first.
+				 */
+				uint64_t key() const
+				{
+					return decode(_key.bytes);
+				}
+
+				const uint8_t *bytes() const
+				{
+					return _key.bytes;
+				}
+
+				/**
+				 * This method returns the Node the cursor is on - just as
+				 * a functor would get it - and it's only good when valid().
+				 */
+				volatile Node & node()
+				{
+					return *_node;
+				}
+
+				/**
+				 * This method copies the value the cursor is on into 'aValue'
+				 * and returns 'true' - or 'false' if it's been removed since
+				 * the cursor got to it.
+				 */
+				bool value( T & aValue )
+				{
+					return ((_node != NULL) && const_cast<Node *>(_node)->copy(aValue));
+				}
+
+				/**
+				 * This method moves the cursor on to the next valid value,
+				 * and returns 'true' if there is one.
+				 */
+				bool next()
+				{
+					if (_node == NULL) {
+						return false;
+					}
+					// the rest of this Leaf is right here, so look there first
+					for (uint16_t i = _key.bytes[eNodeByte] + 1; i < 256; ++i) {
+						if ((bool)const_cast<Node &>(_leaf->nodes[i]).valid) {
+							_key.bytes[eNodeByte] = (uint8_t)i;
+							_node = &(_leaf->nodes[i]);
+							return true;
+						}
+					}
+					// ...then move the key on to the start of the next Leaf
+					int16_t		b = eNodeByte - 1;
+					for (; (b >= 0) && (++_key.bytes[b] == 0); --b) {
+					}
+					if (b < 0) {
+						_node = NULL;
+						return false;
+					}
+					_key.bytes[eNodeByte] = 0;
+					_node = _trie->seek(_key.bytes, _leaf);
+					return (_node != NULL);
+				}
+
+			private:
+				// this is the trie, and where we are in it
+				trie				*_trie;
+				Leaf				*_leaf;
+				volatile Node		*_node;
+				key_bytes			_key;
+		};
+
+
 	public:
 		/********************************************************
 		 *
@@ -614,7 +1072,8 @@ template <class T, trie_key_size N> class trie
 		 * with NO publishers, but ready to take on as many as you need.
 		 */
 		trie() :
-			_roots()
+			_roots(),
+			_image(NULL)
 		{
 		}
 
@@ -624,8 +1083,9 @@ template <class T, trie_key_size N> class trie
 		 * class to make sure that we don't have too many things running
 		 * around.
 		 */
-		trie( const trie<T,N> & anOther ) :
-			_roots()
+		trie( const trie<T,N,M,O> & anOther ) :
+			_roots(),
+			_image(NULL)
 		{
 			// let the '=' operator do all the heavy lifting
 			*this = anOther;
@@ -649,7 +1109,7 @@ template <class T, trie_key_size N> class trie
 		 * make sure that we do this right by always having an equals
 		 * operator on all classes.
 		 */
-		trie<T,N> & operator=( const trie<T,N> & anOther )
+		trie<T,N,M,O> & operator=( const trie<T,N,M,O> & anOther )
 		{
 			/**
 			 * Make sure that we don't do this to ourselves...
@@ -683,6 +1143,7 @@ template <class T, trie_key_size N> class trie
 		 */
 		bool put( const T & aValue )
 		{
+			writable("put");
 			bool			success = false;
 			volatile Node	*n = getOrCreateNodeForKey(key_value(aValue));
 			if (n != NULL) {
@@ -704,6 +1165,7 @@ template <class T, trie_key_size N> class trie
 		 */
 		bool upsert( const T & aValue )
 		{
+			writable("upsert");
 			bool			update = false;
 			volatile Node	*n = getOrCreateNodeForKey(key_value(aValue));
 			if (n != NULL) {
@@ -719,22 +1181,31 @@ template <class T, trie_key_size N> class trie
 		 * key in the trie. If it is successful, a copy will be made,
 		 * and placed in the 'aValue' argument and a 'true' returned.
 		 * If not, then 'aValue' will be unchanged, and a 'false' will
-		 * be returned.
+		 * be returned. A pointer that's returned is good for as long
+		 * as there's a read_guard around the get(), and its use. If the
+		 * trie is mapped from an image, it's copied out of the image.
 		 */
 		bool get( uint16_t aKey, T & aValue )
 		{
-			return get((uint8_t *)&aKey, aValue);
+			return get(encode(aKey).bytes, aValue);
 		}
 		bool get( uint32_t aKey, T & aValue )
 		{
-			return get((uint8_t *)&aKey, aValue);
+			return get(encode(aKey).bytes, aValue);
 		}
 		bool get( uint64_t aKey, T & aValue )
 		{
-			return get((uint8_t *)&aKey, aValue);
+			return get(encode(aKey).bytes, aValue);
 		}
 		bool get( const uint8_t aKey[], T & aValue )
 		{
+			if (_image != NULL) {
+				const uint8_t	*v = findInImage(aKey);
+				if (v != NULL) {
+					memcpy((void *)&aValue, v, sizeof(T));
+				}
+				return (v != NULL);
+			}
 			bool			success = false;
 			volatile Node	*n = getNodeForKey(aKey);
 			if (n != NULL) {
@@ -756,18 +1227,19 @@ template <class T, trie_key_size N> class trie
 		 */
 		bool remove( uint16_t aKey, T & aValue )
 		{
-			return remove((uint8_t *)&aKey, aValue);
+			return remove(encode(aKey).bytes, aValue);
 		}
 		bool remove( uint32_t aKey, T & aValue )
 		{
-			return remove((uint8_t *)&aKey, aValue);
+			return remove(encode(aKey).bytes, aValue);
 		}
 		bool remove( uint64_t aKey, T & aValue )
 		{
-			return remove((uint8_t *)&aKey, aValue);
+			return remove(encode(aKey).bytes, aValue);
 		}
 		bool remove( const uint8_t aKey[], T & aValue )
 		{
+			writable("remove");
 			bool			success = false;
 			volatile Node	*n = getNodeForKey(aKey);
 			if (n != NULL) {
@@ -777,6 +1249,18 @@ template <class T, trie_key_size N> class trie
 		}
 
 
+		/**
+		 * This method hands a pointer the caller got from remove() back
+		 * to the trie to dispose of - but not until the readers that
+		 * might still have it are out of their read_guards. For a value
+		 * that's not a pointer, there's nothing to do.
+		 */
+		static void retire( const T & aValue )
+		{
+			Node::retire(aValue, boost::is_pointer<T>());
+		}
+
+
 		/**
 		 * This method will attempt to find a value for the supplied
 		 * key in the trie, and then clear it. If it is successful,
@@ -786,18 +1270,19 @@ template <class T, trie_key_size N> class trie
 		 */
 		bool clear( uint16_t aKey )
 		{
-			return clear((uint8_t *)&aKey);
+			return clear(encode(aKey).bytes);
 		}
 		bool clear( uint32_t aKey )
 		{
-			return clear((uint8_t *)&aKey);
+			return clear(encode(aKey).bytes);
 		}
 		bool clear( uint64_t aKey )
 		{
-			return clear((uint8_t *)&aKey);
+			return clear(encode(aKey).bytes);
 		}
 		bool clear( const uint8_t aKey[] )
 		{
+			writable("clear");
 			bool			success = false;
 			volatile Node	*n = getNodeForKey(aKey);
 			if (n != NULL) {
@@ -817,22 +1302,25 @@ template <class T, trie_key_size N> class trie
 		 */
 		bool exists( uint16_t aKey )
 		{
-			return exists((uint8_t *)&aKey);
+			return exists(encode(aKey).bytes);
 		}
 		bool exists( uint32_t aKey )
 		{
-			return exists((uint8_t *)&aKey);
+			return exists(encode(aKey).bytes);
 		}
 		bool exists( uint64_t aKey )
 		{
-			return exists((uint8_t *)&aKey);
+			return exists(encode(aKey).bytes);
 		}
 		bool exists( const uint8_t aKey[] )
 		{
+			if (_image != NULL) {
+				return (findInImage(aKey) != NULL);
+			}
 			bool			found = false;
 			volatile Node	*n = getNodeForKey(aKey);
 			if (n != NULL) {
-				found = n->valid;
+				found = const_cast<Node *>(n)->valid;
 			}
 			return found;
 		}
@@ -860,6 +1348,9 @@ template <class T, trie_key_size N> class trie
 		 */
 		virtual bool empty()
 		{
+			if (_image != NULL) {
+				return (header()->count == 0);
+			}
 			bool		vacant = true;
 			for (uint16_t i = 0; i < 256; ++i) {
 				if ((_roots[i] != NULL) &&
@@ -883,6 +1374,9 @@ template <class T, trie_key_size N> class trie
 		 */
 		virtual size_t size()
 		{
+			if (_image != NULL) {
+				return (size_t)header()->count;
+			}
 			size_t		sz = 0;
 			for (uint16_t i = 0; i < 256; ++i) {
 				if (_roots[i] != NULL) {
@@ -897,10 +1391,15 @@ template <class T, trie_key_size N> class trie
 		 * This method will clear out the contents of the trie - dropping
 		 * any non-pointers, and deleting any pointers that it might be
 		 * holding on to. The result is a trie that's ready to store
-		 * more, but won't leak a thing.
+		 * more, but won't leak a thing. If the trie is mapped from an
+		 * image, it's unmapped, so nothing can be reading it then.
 		 */
 		virtual void clear()
 		{
+			if (_image != NULL) {
+				delete _image;
+				_image = NULL;
+			}
 			/**
 			 * Delete any root level branches we have and the
 			 * cascade effect will take care of the rest.
@@ -928,6 +1427,9 @@ template <class T, trie_key_size N> class trie
 		 */
 		virtual bool apply( functor & aFunctor )
 		{
+			if (_image != NULL) {
+				return applyToImage(header()->root, 0, aFunctor);
+			}
 			bool		error = false;
 			for (uint16_t i = 0; i < 256; ++i) {
 				if (_roots[i] != NULL) {
@@ -943,64 +1445,333 @@ template <class T, trie_key_size N> class trie
 
 		/********************************************************
 		 *
-		 *                Utility Methods
+		 *                Ordered Access Methods
 		 *
 		 ********************************************************/
 		/**
-		 * There are a lot of times that a human-readable version of
-		 * this instance will come in handy. This is that method. It's
-		 * not necessarily meant to be something to process, but most
-		 * likely what a debugging system would want to write out for
-		 * this guy.
+		 * These methods are for a trie with ordered_keys - where the keys
+		 * are walked most significant byte first, so that apply(), and
+		 * these, see the values in the order of their keys. They walk the
+		 * Branches and Leafs, and so not a trie that's mapped from an
+		 * image - for that, apply() is still in order. This one
+		 * applies the functor to the valid values with keys in the range
+		 * [aLo, aHi), in order, and returns 'false' if it was stopped.
+		 * The end is checked on all the bytes of the key, as the key()
+		 * of a uint128_key is only the low half of it.
 		 */
-		virtual std::string toString() const
+		bool range( uint64_t aLo, uint64_t aHi, functor & aFunctor )
 		{
-			return "<trie>";
+			key_bytes	last = encode(aHi);
+			for (cursor c(*this, aLo); c.valid() && (memcmp(c.bytes(), last.bytes, N) < 0); c.next()) {
+				if (!aFunctor(c.node())) {
+					return false;
+				}
+			}
+			return true;
 		}
 
 
 		/**
-		 * This method checks to see if the two tries are equal to one
-		 * another based on the values they represent and *not* on the
-		 * actual pointers themselves. If they are equal, then this method
-		 * returns true, otherwise it returns false.
+		 * This method finds the first valid value with a key at, or after,
+		 * 'aKey', and puts its key in 'aFound', and a copy of it in
+		 * 'aValue'. If there's no such value, it returns 'false' and the
+		 * arguments are left as they were. Like the cursor's key(), for
+		 * a uint128_key 'aFound' is just the low 64 bits of the key.
 		 */
-		bool operator==( const trie<T,N> & anOther ) const
+		bool lower_bound( uint64_t aKey, uint64_t & aFound, T & aValue )
 		{
-			bool		equals = false;
-			bool		keepChecking = true;
-
-			// first, see if we are checking against ourselves...
-			if (keepChecking) {
-				if (this == & anOther) {
-					equals = true;
-					keepChecking = false;
+			for (cursor c(*this, aKey); c.valid(); c.next()) {
+				if (c.value(aValue)) {
+					aFound = c.key();
+					return true;
 				}
 			}
+			return false;
+		}
 
-			// next, check each of the branches...
-			if (keepChecking) {
-				// assume it's equal, and verify each branch
-				equals = true;
-				for (uint16_t i = 0; keepChecking && (i < 256); ++i) {
-					if (_roots[i] == NULL) {
-						if (anOther._roots[i] != NULL) {
-							equals = false;
-							keepChecking = false;
-						}
-					} else {
-						if (anOther._roots[i] == NULL) {
-							equals = false;
-							keepChecking = false;
-						} else if (*(_roots[i]) != *(anOther._roots[i])) {
-							equals = false;
-							keepChecking = false;
-						}
-					}
+
+		/**
+		 * This method applies the functor, in order, to the valid values
+		 * whose keys start with the same 'aLength' bytes - the most
+		 * significant - as 'aPrefix', and returns 'false' if it was
+		 * stopped. In a uint64_key trie, a prefix of 0x1234000000000000
+		 * and a length of 2 is all the keys from 0x1234000000000000 to
+		 * 0x1234ffffffffffff.
+		 */
+		bool prefix( uint64_t aPrefix, uint8_t aLength, functor & aFunctor )
+		{
+			key_bytes	first = encode(aPrefix);
+			if (aLength > N) {
+				aLength = N;
+			}
+			memset(&first.bytes[aLength], 0, (eKeyBytes - aLength));
+			for (cursor c(*this, first.bytes); c.valid() && (memcmp(c.bytes(), first.bytes, aLength) == 0); c.next()) {
+				if (!aFunctor(c.node())) {
+					return false;
 				}
 			}
-
-			return equals;
+			return true;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Parallel Methods
+		 *
+		 ********************************************************/
+		/**
+		 * These are the versions of size(), empty(), clear() and apply()
+		 * that split the trie up, and walk the parts on the executor's
+		 * workers. The parts are the subtrees one level below the roots -
+		 * so there's plenty of them even if all the keys share a first
+		 * byte - handed out in runs, a few runs for each worker. Each part
+		 * keeps its own results, and they are only added up once they're
+		 * all done, so there's nothing shared for the workers to fight
+		 * over. They are the same as the serial ones if the trie isn't
+		 * changing, and the same estimate if it is. A trie mapped from an
+		 * image has its count in the header, and is walked serially.
+		 */
+		template <wait_type W> size_t size( executor<W> & anExec )
+		{
+			if (_image != NULL) {
+				return size();
+			}
+			std::vector<Component **>	slots;
+			std::vector<Part>			parts;
+			fanout(anExec, ePartSize, NULL, slots, parts);
+			size_t		sz = 0;
+			for (size_t i = 0; i < parts.size(); ++i) {
+				sz += parts[i].count;
+			}
+			return sz;
+		}
+
+
+		template <wait_type W> bool empty( executor<W> & anExec )
+		{
+			if (_image != NULL) {
+				return empty();
+			}
+			std::vector<Component **>	slots;
+			std::vector<Part>			parts;
+			fanout(anExec, ePartEmpty, NULL, slots, parts);
+			for (size_t i = 0; i < parts.size(); ++i) {
+				if (parts[i].count > 0) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+
+		/**
+		 * This clears out the trie with the subtrees deleted in parallel -
+		 * and then the roots, which are empty by then. As with clear(),
+		 * nothing else can be using the trie while it's done.
+		 */
+		template <wait_type W> void clear( executor<W> & anExec )
+		{
+			std::vector<Component **>	slots;
+			std::vector<Part>			parts;
+			fanout(anExec, ePartClear, NULL, slots, parts);
+			clear();
+		}
+
+
+		/**
+		 * This method applies the reducer to all the valid values in the
+		 * trie, with each part of the trie walked by a fork() of it, and
+		 * then combine()-ed back into it. It returns 'false' if any of the
+		 * parts was stopped by its process() returning 'false' - though
+		 * the other parts will have gone on.
+		 */
+		template <wait_type W> bool apply( reducer & aReducer, executor<W> & anExec )
+		{
+			if (_image != NULL) {
+				reducing_functor	f(&aReducer);
+				return apply(f);
+			}
+			std::vector<Component **>	slots;
+			std::vector<Part>			parts;
+			fanout(anExec, ePartApply, &aReducer, slots, parts);
+			bool		finished = true;
+			for (size_t i = 0; i < parts.size(); ++i) {
+				aReducer.combine(*parts[i].part);
+				delete parts[i].part;
+				parts[i].part = NULL;
+				finished = finished && !parts[i].stopped;
+			}
+			return finished;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Image Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method writes the values in the trie to an image at
+		 * 'aPath' that map() can use in place - so a process can start
+		 * up with all the values without a put() for each. It's only for
+		 * values that aren't pointers, as they're written byte for byte.
+		 * The image is written next to 'aPath', and then renamed to it,
+		 * so a reader of 'aPath' never sees a partial one. Each value is
+		 * copied as get() would, so it's fine to save() with writers
+		 * going - it's just not one moment in time. If it can't be
+		 * written, it throws a std::runtime_error.
+		 */
+		void save( const std::string & aPath )
+		{
+			static_assert(!boost::is_pointer<T>::value, "a trie of pointers can't be saved");
+
+			std::string		tmp = aPath + ".tmp";
+			bool			written = false;
+			{
+				std::ofstream	out(tmp.c_str(), (std::ios::out | std::ios::binary | std::ios::trunc));
+				if (_image != NULL) {
+					// it's already an image, so it just goes out as it is
+					out.write((const char *)_image->data(), _image->length());
+				} else {
+					trie_util::image_header		hdr;
+					memset(&hdr, 0, sizeof(hdr));
+					uint64_t	pos = 0;
+					emit(out, pos, &hdr, sizeof(hdr));
+
+					// the root is a block like any other - but it's always there
+					uint64_t	bits[4] = { 0, 0, 0, 0 };
+					uint64_t	kids[256];
+					uint16_t	cnt = 0;
+					for (uint16_t i = 0; i < 256; ++i) {
+						Component	*c = const_cast<Branch *>(_roots[i]);
+						uint64_t	off = (c == NULL ? 0 : saveComponent(out, pos, c, 1, hdr.count));
+						if (off != 0) {
+							bits[i >> 6] |= (1ULL << (i & 0x3f));
+							kids[cnt++] = off;
+						}
+					}
+					hdr.root = emitBlock(out, pos, bits, kids, cnt, sizeof(uint64_t));
+
+					hdr.magic = trie_util::image_header::eMagic;
+					hdr.version = trie_util::image_header::eVersion;
+					hdr.keyBytes = eKeyBytes;
+					hdr.order = O;
+					hdr.valueSize = sizeof(T);
+					hdr.valueAlign = eImageAlign;
+					hdr.length = pos;
+					out.seekp(0);
+					out.write((const char *)&hdr, sizeof(hdr));
+				}
+				out.flush();
+				written = out.good();
+			}
+			if (!written || (rename(tmp.c_str(), aPath.c_str()) != 0)) {
+				unlink(tmp.c_str());
+				throw std::runtime_error("[trie::save] Unable to write the image '" + aPath + "'!");
+			}
+		}
+
+
+		/**
+		 * This method maps the image at 'aPath', written by save(), and
+		 * from then on, get(), exists(), size(), empty() and apply() are
+		 * answered right out of the mapping - so the values are there as
+		 * soon as it's mapped, and each page is read in when it's first
+		 * used. Whatever was in the trie is cleared out first. A mapped
+		 * trie is read-only - put(), upsert(), remove() and clear() of a
+		 * key throw - until clear() unmaps it. If the image can't be
+		 * mapped, or it's not for this kind of trie, it throws a
+		 * std::runtime_error, and the trie is left as it was.
+		 */
+		void map( const std::string & aPath )
+		{
+			static_assert(!boost::is_pointer<T>::value, "a trie of pointers can't be mapped");
+
+			util::mapped_file	*img = new util::mapped_file(aPath);
+			try {
+				if (img->length() < sizeof(trie_util::image_header)) {
+					throw std::runtime_error("[trie::map] The file '" + aPath + "' is too small for a trie image!");
+				}
+				((const trie_util::image_header *)img->data())->verify(eKeyBytes, O, sizeof(T),
+																		eImageAlign, img->length());
+			} catch (...) {
+				delete img;
+				throw;
+			}
+			clear();
+			_image = img;
+		}
+
+
+		/**
+		 * This method returns 'true' if the trie is mapped from an image.
+		 */
+		bool mapped() const
+		{
+			return (_image != NULL);
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * There are a lot of times that a human-readable version of
+		 * this instance will come in handy. This is that method. It's
+		 * not necessarily meant to be something to process, but most
+		 * likely what a debugging system would want to write out for
+		 * this guy.
+		 */
+		virtual std::string toString() const
+		{
+			return "<trie>";
+		}
+
+
+		/**
+		 * This method checks to see if the two tries are equal to one
+		 * another based on the values they represent and *not* on the
+		 * actual pointers themselves. If they are equal, then this method
+		 * returns true, otherwise it returns false.
+		 */
+		bool operator==( const trie<T,N,M,O> & anOther ) const
+		{
+			bool		equals = false;
+			bool		keepChecking = true;
+
+			// first, see if we are checking against ourselves...
+			if (keepChecking) {
+				if (this == & anOther) {
+					equals = true;
+					keepChecking = false;
+				}
+			}
+
+			// next, check each of the branches...
+			if (keepChecking) {
+				// assume it's equal, and verify each branch
+				equals = true;
+				for (uint16_t i = 0; keepChecking && (i < 256); ++i) {
+					if (_roots[i] == NULL) {
+						if (anOther._roots[i] != NULL) {
+							equals = false;
+							keepChecking = false;
+						}
+					} else {
+						if (anOther._roots[i] == NULL) {
+							equals = false;
+							keepChecking = false;
+						} else if (*(_roots[i]) != *(anOther._roots[i])) {
+							equals = false;
+							keepChecking = false;
+						}
+					}
+				}
+			}
+
+			return equals;
 		}
 
 
@@ -1010,7 +1781,7 @@ template <class T, trie_key_size N> class trie
 		 * actual pointers themselves. If they are not equal, then this
 		 * method returns true, otherwise it returns false.
 		 */
-		bool operator!=( const trie<T,N> & anOther ) const
+		bool operator!=( const trie<T,N,M,O> & anOther ) const
 		{
 			return !operator==(anOther);
 		}
@@ -1032,6 +1803,21 @@ template <class T, trie_key_size N> class trie
 		 * something intelligent with it.
 		 */
 		volatile Node *getNodeForKey( const uint8_t aKey[] ) {
+			// see if the root branch is there, and walk down from it
+			Component	*c = const_cast<Branch *>(_roots[aKey[0]]);
+			return (c == NULL ? NULL : path<1>::find(c, aKey));
+		}
+
+
+		/**
+		 * This method is the original walk down the tree - each level
+		 * asking the next, through the virtual getNodeForKey() of the
+		 * Component, until the Leaf returns the Node. It's the same as
+		 * getNodeForKey(), just slower, and it's here for subclasses with
+		 * Components of their own, and as the yardstick for the walk that
+		 * replaced it.
+		 */
+		volatile Node *recurseToNodeForKey( const uint8_t aKey[] ) {
 			volatile Node	*n = NULL;
 			// see if the root branch is available, and work with that
 			volatile Component	*c = _roots[aKey[0]];
@@ -1053,13 +1839,13 @@ template <class T, trie_key_size N> class trie
 		 * get to the Node requested.
 		 */
 		volatile Node *getOrCreateNodeForKey( uint16_t aKey ) {
-			return getOrCreateNodeForKey((uint8_t *)&aKey);
+			return getOrCreateNodeForKey(encode(aKey).bytes);
 		}
 		volatile Node *getOrCreateNodeForKey( uint32_t aKey ) {
-			return getOrCreateNodeForKey((uint8_t *)&aKey);
+			return getOrCreateNodeForKey(encode(aKey).bytes);
 		}
 		volatile Node *getOrCreateNodeForKey( uint64_t aKey ) {
-			return getOrCreateNodeForKey((uint8_t *)&aKey);
+			return getOrCreateNodeForKey(encode(aKey).bytes);
 		}
 		volatile Node *getOrCreateNodeForKey( const uint8_t aKey[] ) {
 			volatile Node	*n = NULL;
@@ -1082,9 +1868,9 @@ template <class T, trie_key_size N> class trie
 				}
 			}
 
-			// now pass down to that next branch the request to fill
+			// now walk down from that root, filling in what's missing
 			if (curr != NULL) {
-				n = const_cast<Branch *>(curr)->getOrCreateNodeForKey(aKey, 1);
+				n = path<1>::create(const_cast<Branch *>(curr), aKey);
 			}
 
 			// return what we have dug out of the tree
@@ -1103,14 +1889,1422 @@ template <class T, trie_key_size N> class trie
 		enum {
 			eLastBranch = (N - 2)
 		};
+
 		/**
-		 * The trie needs to start with the first byte of the 64-bit
-		 * key value being 1 of 256 root branches for the tree. This
-		 * simple array is the easiest way to ensure that we have space
-		 * for all the Branches - should we need them, but not wasting
-		 * too much space by pre-allocating them.
+		 * This is the step of the walk where the kids of the Branch are
+		 * Leafs - the step after it picks the Node in the Leaf. The root
+		 * is always a Branch, so even a uint16_key has one step through it.
 		 */
-		volatile Branch		*_roots[256];
+		enum {
+			eLeafStep = (N > 2 ? (N - 2) : 1)
+		};
+
+		/**
+		 * This is the walk down the tree, unrolled at compile-time from the
+		 * size of the key: path<S> takes step S through a Branch, and hands
+		 * the kid to path<S + 1>, until path<eLeafStep> gets to the Leaf,
+		 * and the Node in it. Every type is known, and every call static,
+		 * so the whole walk is inlined into straight-line code, with no
+		 * vtables to load. The 'D' is only there so the last step can be
+		 * a partial specialization - a full one isn't allowed in a class.
+		 */
+		template <uint16_t S, bool D = true> struct path {
+			static inline volatile Node *find( Component *aBranch, const uint8_t aKey[] )
+			{
+				Component	*kid = static_cast<Branch *>(aBranch)->kids[aKey[S]];
+				return (kid == NULL ? NULL : path<S + 1, D>::find(kid, aKey));
+			}
+
+			static inline volatile Node *create( Component *aBranch, const uint8_t aKey[] )
+			{
+				Component	*kid = static_cast<Branch *>(aBranch)->getOrCreateKid(aKey[S], false);
+				return path<S + 1, D>::create(kid, aKey);
+			}
+		};
+
+		template <bool D> struct path<eLeafStep, D> {
+			static inline volatile Node *find( Component *aBranch, const uint8_t aKey[] )
+			{
+				Component	*kid = static_cast<Branch *>(aBranch)->kids[aKey[eLeafStep]];
+				return (kid == NULL ? NULL : &(static_cast<Leaf *>(kid)->nodes[aKey[eLeafStep + 1]]));
+			}
+
+			static inline volatile Node *create( Component *aBranch, const uint8_t aKey[] )
+			{
+				Component	*kid = static_cast<Branch *>(aBranch)->getOrCreateKid(aKey[eLeafStep], true);
+				return &(static_cast<Leaf *>(kid)->nodes[aKey[eLeafStep + 1]]);
+			}
+		};
+
+		/**
+		 * This method makes the bytes of a key in the order they're to be
+		 * walked. For native_order, that's as they are in memory - on this
+		 * box, the low byte first - and for ordered_keys, it's the last N
+		 * bytes of the key, most significant first, so numeric order and
+		 * byte order are the same. Any bytes left over are zeroed.
+		 */
+		template <class K> static key_bytes encode( K aKey )
+		{
+			key_bytes	k;
+			memset(k.bytes, 0, eKeyBytes);
+			if (O == ordered_keys) {
+				for (int16_t i = (N - 1); i >= 0; --i) {
+					k.bytes[i] = (uint8_t)(aKey & 0xff);
+					aKey >>= 8;
+				}
+			} else {
+				memcpy(k.bytes, &aKey, (sizeof(K) < eKeyBytes ? sizeof(K) : eKeyBytes));
+			}
+			return k;
+		}
+
+		/**
+		 * This method turns the bytes of an ordered key back into the key -
+		 * or, for a uint128_key, the low 64 bits of it.
+		 */
+		static uint64_t decode( const uint8_t aKey[] )
+		{
+			uint64_t	key = 0;
+			for (uint16_t i = 0; i < N; ++i) {
+				key = (key << 8) | aKey[i];
+			}
+			return key;
+		}
+
+		/**
+		 * This method finds the first valid Node with a key at, or after,
+		 * the one in 'aKey', and puts its key in 'aKey', and its Leaf in
+		 * 'aLeaf'. If there's none, it returns NULL, and 'aKey' is left
+		 * as it was. Each level starts at the byte of the key only if all
+		 * the levels above it did - otherwise, it starts at zero.
+		 */
+		volatile Node *seek( uint8_t aKey[], Leaf * & aLeaf )
+		{
+			for (uint16_t i = aKey[0]; i < 256; ++i) {
+				Component	*c = const_cast<Branch *>(_roots[i]);
+				if (c != NULL) {
+					volatile Node	*n = seek(c, 1, aKey, (i == aKey[0]), aLeaf);
+					if (n != NULL) {
+						aKey[0] = (uint8_t)i;
+						return n;
+					}
+				}
+			}
+			return NULL;
+		}
+
+		volatile Node *seek( Component *aComp, uint16_t aStep, uint8_t aKey[], bool aTight, Leaf * & aLeaf )
+		{
+			uint16_t	first = (aTight ? aKey[aStep] : 0);
+			if (aStep > eLeafStep) {
+				Leaf	*leaf = static_cast<Leaf *>(aComp);
+				for (uint16_t i = first; i < 256; ++i) {
+					if ((bool)const_cast<Node &>(leaf->nodes[i]).valid) {
+						aKey[aStep] = (uint8_t)i;
+						aLeaf = leaf;
+						return &(leaf->nodes[i]);
+					}
+				}
+			} else {
+				Branch	*branch = static_cast<Branch *>(aComp);
+				for (uint16_t i = first; i < 256; ++i) {
+					Component	*kid = branch->kids[i];
+					if (kid != NULL) {
+						volatile Node	*n = seek(kid, (aStep + 1), aKey, (aTight && (i == first)), aLeaf);
+						if (n != NULL) {
+							aKey[aStep] = (uint8_t)i;
+							return n;
+						}
+					}
+				}
+			}
+			return NULL;
+		}
+
+		/**
+		 * These are the things a Part of a parallel walk can do with the
+		 * subtrees it's been given.
+		 */
+		enum {
+			ePartSize = 0,
+			ePartEmpty,
+			ePartClear,
+			ePartApply
+		};
+
+		/**
+		 * This lets a reducer be handed to a Component's apply().
+		 */
+		class reducing_functor : public functor
+		{
+			public:
+				reducing_functor( reducer *aReducer ) : _reducer(aReducer) { }
+				virtual ~reducing_functor() { }
+				virtual bool process( volatile Node & aNode ) { return _reducer->process(aNode); }
+			private:
+				reducer		*_reducer;
+		};
+
+		/**
+		 * This is one part of a parallel walk - a run of the slots, one
+		 * level below the roots, that hold a subtree. Everything it finds
+		 * is kept right here, and only looked at once it's done.
+		 */
+		struct Part : public task {
+			Component		**const *slots;
+			size_t			first;
+			size_t			last;
+			int				op;
+			reducer			*part;
+			size_t			count;
+			bool			stopped;
+
+			Part() : task(), slots(NULL), first(0), last(0), op(ePartSize),
+				part(NULL), count(0), stopped(false) { }
+
+			virtual void run()
+			{
+				size_t				cnt = 0;
+				reducing_functor	f(part);
+				for (size_t i = first; i < last; ++i) {
+					Component	*c = *slots[i];
+					if (c == NULL) {
+						continue;
+					}
+					if (op == ePartSize) {
+						cnt += c->size();
+					} else if (op == ePartEmpty) {
+						if (!c->empty()) {
+							cnt = 1;
+							break;
+						}
+					} else if (op == ePartClear) {
+						*slots[i] = NULL;
+						delete c;
+					} else if (!c->apply(f)) {
+						stopped = true;
+						break;
+					}
+				}
+				count = cnt;
+			}
+		};
+
+		/**
+		 * This method gathers up the slots below the roots that have a
+		 * subtree in them, splits them into runs - four for each worker,
+		 * so a worker with a heavy run doesn't hold up the rest - and has
+		 * the executor do 'anOp' on each run, and waits for them all. For
+		 * an apply, each Part gets a fork() of the reducer.
+		 */
+		template <wait_type W> void fanout( executor<W> & anExec, int anOp, reducer *aReducer,
+											std::vector<Component **> & aSlots, std::vector<Part> & aParts )
+		{
+			for (uint16_t i = 0; i < 256; ++i) {
+				Branch	*root = const_cast<Branch *>(_roots[i]);
+				if (root != NULL) {
+					for (uint16_t j = 0; j < 256; ++j) {
+						if (root->kids[j] != NULL) {
+							aSlots.push_back(&(root->kids[j]));
+						}
+					}
+				}
+			}
+			size_t		cnt = 4 * anExec.threads();
+			if (cnt > aSlots.size()) {
+				cnt = aSlots.size();
+			}
+			aParts.resize(cnt);
+			std::vector<task *>		tasks(cnt);
+			for (size_t p = 0; p < cnt; ++p) {
+				aParts[p].slots = (aSlots.empty() ? NULL : &aSlots[0]);
+				aParts[p].first = (aSlots.size() * p) / cnt;
+				aParts[p].last = (aSlots.size() * (p + 1)) / cnt;
+				aParts[p].op = anOp;
+				aParts[p].part = (aReducer == NULL ? NULL : aReducer->fork());
+				tasks[p] = &aParts[p];
+			}
+			if (cnt > 0) {
+				task_group		g;
+				anExec.submit(&tasks[0], cnt, &g);
+				anExec.wait(g);
+			}
+		}
+
+		/**
+		 * The blocks of an image start on this boundary, and the entries
+		 * in a block that's not full start this far in - after the places
+		 * of the entries - so that the values are as aligned as they need
+		 * to be. The low bit of the offset to a full block says it is.
+		 */
+		enum {
+			eImageAlign = (alignof(T) > 8 ? alignof(T) : 8),
+			eBlockHead = ((256 + eImageAlign - 1) / eImageAlign) * eImageAlign,
+			eFullBlock = 0x01
+		};
+
+		/**
+		 * This throws if the trie is mapped from an image, as the image
+		 * is only there to be read.
+		 */
+		void writable( const char *aMethod )
+		{
+			if (_image != NULL) {
+				throw std::runtime_error(std::string("[trie::") + aMethod + "] The trie is mapped from the image '"
+										 + _image->path() + "', and is read-only!");
+			}
+		}
+
+		/**
+		 * This is the header of the image the trie is mapped from.
+		 */
+		const trie_util::image_header *header() const
+		{
+			return (const trie_util::image_header *)_image->data();
+		}
+
+		/**
+		 * This returns where the entry for 'aByte' is in the block that
+		 * 'aRef' is the offset of, or NULL if it isn't there. It's just
+		 * an index into a full block, and a look at the entry's place in
+		 * one that's not - so there's no counting of bits. The header was
+		 * checked by map(), but nothing below the root was, so the block,
+		 * its places, and the entry are all checked against the 'aLength'
+		 * of the mapping as they're used - a corrupt image throws, rather
+		 * than reading off the end of it.
+		 */
+		static inline const uint8_t *entryInBlock( const uint8_t *aBase, uint64_t aLength, uint64_t aRef,
+												   uint8_t aByte, size_t anEntrySize )
+		{
+			uint64_t	at = (aRef & ~((uint64_t)eFullBlock));
+			if ((at < sizeof(trie_util::image_header)) || (at > aLength) || ((at % eImageAlign) != 0)) {
+				corrupt();
+			}
+			uint64_t	off = 0;
+			if ((aRef & eFullBlock) != 0) {
+				off = at + (uint64_t)aByte * anEntrySize;
+			} else {
+				if (at + eBlockHead > aLength) {
+					corrupt();
+				}
+				uint8_t		place = aBase[at + aByte];
+				if (place == 0) {
+					return NULL;
+				}
+				off = at + eBlockHead + (uint64_t)(place - 1) * anEntrySize;
+			}
+			if (off + anEntrySize > aLength) {
+				corrupt();
+			}
+			return aBase + off;
+		}
+
+		/**
+		 * This is what's thrown when the walk of an image finds an offset
+		 * that's not in it.
+		 */
+		static void corrupt()
+		{
+			throw std::runtime_error("[trie] The trie image is corrupt - it points past its end!");
+		}
+
+		/**
+		 * This walks the image, as the trie walks its Branches, a byte of
+		 * the key for each block, and returns where the value is in the
+		 * mapping - or NULL if it's not there.
+		 */
+		const uint8_t *findInImage( const uint8_t aKey[] ) const
+		{
+			const uint8_t	*base = _image->data();
+			uint64_t		len = _image->length();
+			uint64_t		ref = header()->root;
+			for (uint16_t s = 0; s < eNodeByte; ++s) {
+				const uint8_t	*e = entryInBlock(base, len, ref, aKey[s], sizeof(uint64_t));
+				if (e == NULL) {
+					return NULL;
+				}
+				ref = *((const uint64_t *)e);
+			}
+			return entryInBlock(base, len, ref, aKey[eNodeByte], sizeof(T));
+		}
+
+		/**
+		 * This applies the functor to the values in the block that 'aRef'
+		 * is the offset of, for the key byte 'aStep', and all those below
+		 * it, in order. Each value is handed over in a Node of its own,
+		 * just as the trie's are.
+		 */
+		bool applyToImage( uint64_t aRef, uint16_t aStep, functor & aFunctor )
+		{
+			const uint8_t	*base = _image->data();
+			uint64_t		len = _image->length();
+			for (uint16_t i = 0; i < 256; ++i) {
+				if (aStep == eNodeByte) {
+					const uint8_t	*e = entryInBlock(base, len, aRef, (uint8_t)i, sizeof(T));
+					if (e != NULL) {
+						T	v;
+						memcpy((void *)&v, e, sizeof(T));
+						Node	n(v);
+						if (!aFunctor(n)) {
+							return false;
+						}
+					}
+				} else {
+					const uint8_t	*e = entryInBlock(base, len, aRef, (uint8_t)i, sizeof(uint64_t));
+					if ((e != NULL) && !applyToImage(*((const uint64_t *)e), (aStep + 1), aFunctor)) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		/**
+		 * This writes out the blocks for the Component at the key byte
+		 * 'aStep' - the blocks below it first, then its own - and returns
+		 * the offset of its block, or 0 if there's no value under it, and
+		 * so no block. The values written are added to 'aCount'.
+		 */
+		uint64_t saveComponent( std::ostream & anOut, uint64_t & aPos, Component *aComp,
+								uint16_t aStep, uint64_t & aCount )
+		{
+			uint64_t	bits[4] = { 0, 0, 0, 0 };
+			uint16_t	cnt = 0;
+			if (aStep == eNodeByte) {
+				Leaf	*leaf = static_cast<Leaf *>(aComp);
+				T		vals[256];
+				for (uint16_t i = 0; i < 256; ++i) {
+					if (const_cast<Node &>(leaf->nodes[i]).copy(vals[cnt])) {
+						bits[i >> 6] |= (1ULL << (i & 0x3f));
+						++cnt;
+					}
+				}
+				aCount += cnt;
+				return (cnt == 0 ? 0 : emitBlock(anOut, aPos, bits, vals, cnt, sizeof(T)));
+			}
+			Branch		*branch = static_cast<Branch *>(aComp);
+			uint64_t	kids[256];
+			for (uint16_t i = 0; i < 256; ++i) {
+				if (branch->kids[i] != NULL) {
+					uint64_t	off = saveComponent(anOut, aPos, branch->kids[i], (aStep + 1), aCount);
+					if (off != 0) {
+						bits[i >> 6] |= (1ULL << (i & 0x3f));
+						kids[cnt++] = off;
+					}
+				}
+			}
+			return (cnt == 0 ? 0 : emitBlock(anOut, aPos, bits, kids, cnt, sizeof(uint64_t)));
+		}
+
+		/**
+		 * This writes a block - on the image's boundary - for the 'aCount'
+		 * entries of the bytes set in 'aBits', and returns the offset to
+		 * it, with the low bit set if it's full.
+		 */
+		static uint64_t emitBlock( std::ostream & anOut, uint64_t & aPos, const uint64_t aBits[],
+								   const void *anEntries, uint16_t aCount, size_t anEntrySize )
+		{
+			static const uint8_t	zeros[eImageAlign] = { 0 };
+			if ((aPos % eImageAlign) != 0) {
+				emit(anOut, aPos, zeros, (eImageAlign - (aPos % eImageAlign)));
+			}
+			uint64_t	ref = aPos;
+			if (aCount == 256) {
+				ref |= eFullBlock;
+			} else {
+				uint8_t		head[eBlockHead];
+				uint16_t	place = 0;
+				memset(head, 0, sizeof(head));
+				for (uint16_t i = 0; i < 256; ++i) {
+					if ((aBits[i >> 6] & (1ULL << (i & 0x3f))) != 0) {
+						head[i] = (uint8_t)(++place);
+					}
+				}
+				emit(anOut, aPos, head, sizeof(head));
+			}
+			emit(anOut, aPos, anEntries, (aCount * anEntrySize));
+			return ref;
+		}
+
+		static void emit( std::ostream & anOut, uint64_t & aPos, const void *aData, size_t aLength )
+		{
+			anOut.write((const char *)aData, aLength);
+			aPos += aLength;
+		}
+
+		/**
+		 * The trie needs to start with the first byte of the 64-bit
+		 * key value being 1 of 256 root branches for the tree. This
+		 * simple array is the easiest way to ensure that we have space
+		 * for all the Branches - should we need them, but not wasting
+		 * too much space by pre-allocating them.
+		 */
+		volatile Branch		*_roots[256];
+
+		/**
+		 * This is the image the trie is mapped from, if it is - and then
+		 * there's nothing in the roots.
+		 */
+		util::mapped_file	*_image;
+};
+
+
+/**
+ * This is the adaptive_trie - the same keys, and the same API, as the
+ * dense one, but where each level of the tree is only as big as it needs
+ * to be. A sparse key space - order IDs, say - has most of its levels
+ * with just one or two children, and a dense Branch for each of them is
+ * 2KB of NULLs, and a dense Leaf is 256 Nodes for the one value in it.
+ *
+ * The readers never lock - they walk down the tree in an epoch guard, so
+ * nothing they can see is deleted until they're done. A writer walks down
+ * the same way, and then locks just the node it's changing. If that node
+ * is full, or has gotten too sparse, it's copied into one of the right
+ * size, which is swapped into the parent - with the parent locked, too -
+ * and the old one is marked obsolete, and retired to the epoch. A writer
+ * that finds the node it locked is obsolete just starts over. Locks are
+ * only ever taken going up the tree, so two writers can't deadlock.
+ */
+template <class T, trie_key_size N> class trie<T, N, adaptive_trie>
+{
+	public:
+		/**
+		 * The values are in the very same Nodes as in the dense trie, and
+		 * it's the same functor, so either trie can be handed the same one.
+		 */
+		typedef typename trie<T, N, dense_trie>::Node			Node;
+		typedef typename trie<T, N, dense_trie>::functor		functor;
+		typedef typename trie<T, N, dense_trie>::read_guard		read_guard;
+
+	protected:
+		/**
+		 * These are the four kinds of node in the tree, by the number of
+		 * children they have room for.
+		 */
+		enum {
+			eNode4 = 0,
+			eNode16,
+			eNode48,
+			eNode256
+		};
+
+		/**
+		 * Every node in the tree starts with this header - the kind of node
+		 * it is, the level of the tree it's at (the byte of the key it
+		 * decodes), how many of its slots have been used, and how many of
+		 * those still have a child in them. The children of a node at the
+		 * last level are the Nodes with the values, and the rest are nodes.
+		 */
+		struct Inner {
+			uint8_t							type;
+			uint8_t							level;
+			volatile uint8_t				obsolete;
+			volatile uint8_t				used;
+			uint16_t						live;
+			boost::detail::spinlock			mutex;
+
+			Inner( uint8_t aType, uint8_t aLevel ) :
+				type(aType), level(aLevel), obsolete(0), used(0), live(0), mutex()
+			{ }
+		};
+
+		/**
+		 * The two smallest nodes are a list of the bytes, and the children
+		 * for each. New children go on the end, and a removed one leaves
+		 * its byte behind, with a NULL child, so a reader scanning the list
+		 * never sees anything move. The list is compacted when it's full,
+		 * and copied.
+		 */
+		struct Node4 : public Inner {
+			uint8_t			keys[4];
+			void			*kids[4];
+
+			Node4( uint8_t aLevel ) : Inner(eNode4, aLevel), keys(), kids() { }
+		};
+
+		struct Node16 : public Inner {
+			uint8_t			keys[16];
+			void			*kids[16];
+
+			Node16( uint8_t aLevel ) : Inner(eNode16, aLevel), keys(), kids() { }
+		};
+
+		/**
+		 * The next size up has a byte for each of the 256, with one more
+		 * than the slot of its child, or zero if it has none. Slots aren't
+		 * reused until the node is copied, so a reader with a stale index
+		 * finds a NULL, and never someone else's child.
+		 */
+		struct Node48 : public Inner {
+			uint8_t			index[256];
+			void			*kids[48];
+
+			Node48( uint8_t aLevel ) : Inner(eNode48, aLevel), index(), kids() { }
+		};
+
+		/**
+		 * ...and the biggest is just like a dense Branch.
+		 */
+		struct Node256 : public Inner {
+			void			*kids[256];
+
+			Node256( uint8_t aLevel ) : Inner(eNode256, aLevel), kids() { }
+		};
+
+	public:
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This is the default constructor that makes an empty trie - there
+		 * isn't even a root node until the first value is put in it.
+		 */
+		trie() :
+			_root(NULL),
+			_rootMutex()
+		{
+		}
+
+
+		/**
+		 * This is the standard copy constructor and needs to be in every
+		 * class to make sure that we don't have too many things running
+		 * around.
+		 */
+		trie( const trie<T, N, adaptive_trie> & anOther ) :
+			_root(NULL),
+			_rootMutex()
+		{
+			// let the '=' operator do all the heavy lifting
+			*this = anOther;
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called. No one else can be using it now, so the tree is deleted
+		 * right here, and not retired.
+		 */
+		virtual ~trie()
+		{
+			if (_root != NULL) {
+				destroy(_root, true);
+				_root = NULL;
+			}
+		}
+
+
+		/**
+		 * When we want to process the result of an equality we need to
+		 * make sure that we do this right by always having an equals
+		 * operator on all classes. Just as with the dense trie, there's
+		 * no way to copy pointer values without a shallow copy that will
+		 * leak, so this does nothing.
+		 */
+		trie<T, N, adaptive_trie> & operator=( const trie<T, N, adaptive_trie> & anOther )
+		{
+			return *this;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes the provided value, and along with the
+		 * key_value( const T & ) function, will place this value
+		 * into the trie, possibly replacing the value that may already
+		 * be there - which is disposed of by the trie.
+		 */
+		bool put( const T & aValue )
+		{
+			bool		update = false;
+			uint64_t	key = key_value(aValue);
+			return store(encode(key).bytes, aValue, update);
+		}
+
+
+		/**
+		 * This method adds the value to the trie, based on it's
+		 * key_value(), and returns 'true' if it replaced one that
+		 * was already there (an update), or 'false' if it's a new
+		 * value at that key (an insert).
+		 */
+		bool upsert( const T & aValue )
+		{
+			bool		update = false;
+			uint64_t	key = key_value(aValue);
+			store(encode(key).bytes, aValue, update);
+			return update;
+		}
+
+
+		/**
+		 * This method will attempt to find a value for the supplied
+		 * key in the trie. If it is successful, a copy will be made,
+		 * and placed in the 'aValue' argument and a 'true' returned.
+		 * If not, then 'aValue' will be unchanged, and a 'false' will
+		 * be returned. The guard in here only covers the walk - to use
+		 * a pointer that comes back, hold a read_guard around it all.
+		 */
+		bool get( uint16_t aKey, T & aValue )
+		{
+			return get(encode(aKey).bytes, aValue);
+		}
+		bool get( uint32_t aKey, T & aValue )
+		{
+			return get(encode(aKey).bytes, aValue);
+		}
+		bool get( uint64_t aKey, T & aValue )
+		{
+			return get(encode(aKey).bytes, aValue);
+		}
+		bool get( const uint8_t aKey[], T & aValue )
+		{
+			util::epoch::guard	g;
+			Node	*n = find(aKey);
+			return ((n != NULL) && n->copy(aValue));
+		}
+
+
+		/**
+		 * This method will attempt to find a value for the supplied
+		 * key in the trie, and then remove it and return it to the
+		 * caller. If it is successful, a 'true' will be returned. In
+		 * the case of a pointer value, the memory management for the
+		 * returned value will become the responsibility of the caller.
+		 */
+		bool remove( uint16_t aKey, T & aValue )
+		{
+			return remove(encode(aKey).bytes, aValue);
+		}
+		bool remove( uint32_t aKey, T & aValue )
+		{
+			return remove(encode(aKey).bytes, aValue);
+		}
+		bool remove( uint64_t aKey, T & aValue )
+		{
+			return remove(encode(aKey).bytes, aValue);
+		}
+		bool remove( const uint8_t aKey[], T & aValue )
+		{
+			return take(aKey, &aValue);
+		}
+
+
+		/**
+		 * This method disposes of a pointer from remove() the same way the
+		 * dense trie does - once all the read_guards are done with it.
+		 */
+		static void retire( const T & aValue )
+		{
+			Node::retire(aValue, boost::is_pointer<T>());
+		}
+
+
+		/**
+		 * This method will attempt to find a value for the supplied
+		 * key in the trie, and then clear it, returning 'true' if there
+		 * was one. The value is disposed of by the trie - once no reader
+		 * can still be looking at it.
+		 */
+		bool clear( uint16_t aKey )
+		{
+			return clear(encode(aKey).bytes);
+		}
+		bool clear( uint32_t aKey )
+		{
+			return clear(encode(aKey).bytes);
+		}
+		bool clear( uint64_t aKey )
+		{
+			return clear(encode(aKey).bytes);
+		}
+		bool clear( const uint8_t aKey[] )
+		{
+			return take(aKey, NULL);
+		}
+
+
+		/**
+		 * This method returns 'true' if the provided key references a
+		 * valid value 'T' in the trie at this time. Since the trie is
+		 * lockless, it may not be there right after this call.
+		 */
+		bool exists( uint16_t aKey )
+		{
+			return exists(encode(aKey).bytes);
+		}
+		bool exists( uint32_t aKey )
+		{
+			return exists(encode(aKey).bytes);
+		}
+		bool exists( uint64_t aKey )
+		{
+			return exists(encode(aKey).bytes);
+		}
+		bool exists( const uint8_t aKey[] )
+		{
+			util::epoch::guard	g;
+			Node	*n = find(aKey);
+			return ((n != NULL) && (bool)n->valid);
+		}
+
+
+		/**
+		 * This method is a convenience method fronting the exists()
+		 * method where we use the key_value() function to get the
+		 * key for the value.
+		 */
+		bool value_exists( const T & aValue )
+		{
+			return exists(key_value(aValue));
+		}
+
+
+		/**
+		 * This method will return 'true' only if there are NO valid
+		 * values stored in this trie at this time.
+		 */
+		virtual bool empty()
+		{
+			return (size() == 0);
+		}
+
+
+		/**
+		 * This method will look at the entire contents of the trie
+		 * and return the BEST ESTIMATE at the number of values it
+		 * contains - exact, if no one is changing it at the time.
+		 */
+		virtual size_t size()
+		{
+			util::epoch::guard	g;
+			Inner	*r = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+			return (r == NULL ? 0 : count(r));
+		}
+
+
+		/**
+		 * This method will clear out the contents of the trie. The whole
+		 * tree is taken off the root at once, and retired, so the readers
+		 * still in it can finish, and then it's all deleted - values and
+		 * all. A writer racing this may put its value in the old tree.
+		 */
+		virtual void clear()
+		{
+			boost::detail::spinlock::scoped_lock	lock(_rootMutex);
+			Inner	*r = _root;
+			if (r != NULL) {
+				__atomic_store_n(&_root, (Inner *)NULL, __ATOMIC_RELEASE);
+				util::epoch::retire(r, reclaimTree);
+			}
+		}
+
+
+		/********************************************************
+		 *
+		 *                Functor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method takes the functor subclass instance and applies
+		 * it's process() method to all the valid entries in the trie,
+		 * in the order of the bytes of their keys at each level, until
+		 * one returns 'false'.
+		 */
+		virtual bool apply( functor & aFunctor )
+		{
+			util::epoch::guard	g;
+			Inner	*r = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+			return ((r == NULL) || walk(r, aFunctor));
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * There are a lot of times that a human-readable version of
+		 * this instance will come in handy. This is that method.
+		 */
+		virtual std::string toString() const
+		{
+			return "<trie adaptive>";
+		}
+
+
+		/**
+		 * Comparing the contents of two of these, as they change, isn't
+		 * worth what it would cost, so - as with the queues - a trie is
+		 * only equal to itself.
+		 */
+		bool operator==( const trie<T, N, adaptive_trie> & anOther ) const
+		{
+			return (this == & anOther);
+		}
+
+
+		bool operator!=( const trie<T, N, adaptive_trie> & anOther ) const
+		{
+			return !operator==(anOther);
+		}
+
+
+	protected:
+		/********************************************************
+		 *
+		 *            Scanning/Building Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method walks down the tree for the key, and returns the
+		 * Node for it, or NULL if there isn't one. The caller has to be in
+		 * an epoch guard for as long as it uses the Node.
+		 */
+		Node *find( const uint8_t aKey[] )
+		{
+			Inner	*n = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+			for (uint16_t step = 0; (n != NULL) && (step < eLast); ++step) {
+				n = (Inner *)child(n, aKey[step]);
+			}
+			return (n == NULL ? NULL : (Node *)child(n, aKey[eLast]));
+		}
+
+
+		/**
+		 * This method puts the value in the Node for the key - making it,
+		 * and the nodes on the way to it, if it's not there - and sets
+		 * 'anUpdate' if there was a value there already.
+		 */
+		bool store( const uint8_t aKey[], const T & aValue, bool & anUpdate )
+		{
+			util::epoch::guard	g;
+			while (true) {
+				Inner	*parent = NULL;
+				Inner	*n = root();
+				bool	restart = false;
+				for (uint16_t step = 0; !restart; ++step) {
+					uint8_t		b = aKey[step];
+					void		*kid = child(n, b);
+					if ((kid == NULL) || (step == eLast)) {
+						// we have to change this node, so lock it, and check it
+						n->mutex.lock();
+						if (n->obsolete) {
+							n->mutex.unlock();
+							restart = true;
+							break;
+						}
+						kid = child(n, b);
+						if (kid == NULL) {
+							Inner	*r = room(parent, (step > 0 ? aKey[step - 1] : 0), n);
+							if (r == NULL) {
+								n->mutex.unlock();
+								restart = true;
+								break;
+							}
+							n = r;
+							if (step == eLast) {
+								add(n, b, new Node(aValue));
+								n->mutex.unlock();
+								anUpdate = false;
+								return true;
+							}
+							kid = new Node4(step + 1);
+							add(n, b, kid);
+						} else if (step == eLast) {
+							// it's there - and it can't go anywhere while we hold this
+							Node	*v = (Node *)kid;
+							anUpdate = v->valid;
+							v->assign(aValue);
+							n->mutex.unlock();
+							return true;
+						}
+						n->mutex.unlock();
+					}
+					parent = n;
+					n = (Inner *)kid;
+				}
+			}
+		}
+
+
+		/**
+		 * This method takes the Node for the key out of the tree - copying
+		 * out its value into 'aValue' if there is one to copy it to, and
+		 * leaving it to be disposed of by the trie if there isn't - and
+		 * returns 'true' if it was there.
+		 */
+		bool take( const uint8_t aKey[], T *aValue )
+		{
+			util::epoch::guard	g;
+			while (true) {
+				Inner	*parent = NULL;
+				Inner	*n = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+				for (uint16_t step = 0; (n != NULL) && (step < eLast); ++step) {
+					parent = n;
+					n = (Inner *)child(n, aKey[step]);
+				}
+				if (n == NULL) {
+					return false;
+				}
+				n->mutex.lock();
+				if (n->obsolete) {
+					n->mutex.unlock();
+					continue;
+				}
+				Node	*v = (Node *)child(n, aKey[eLast]);
+				if (v == NULL) {
+					n->mutex.unlock();
+					return false;
+				}
+				bool	success = true;
+				if (aValue != NULL) {
+					success = v->remove(*aValue);
+				}
+				drop(n, aKey[eLast]);
+				tidy(parent, aKey[eLast - 1], n);
+				util::epoch::retire(v, reclaimNode);
+				return success;
+			}
+		}
+
+
+	private:
+		/**
+		 * The last byte of the key picks the Node out of the last level of
+		 * the tree - every level before it picks a node.
+		 */
+		enum {
+			eLast = (N - 1)
+		};
+
+		/**
+		 * This method makes the N bytes of the key that are walked - as it
+		 * is in memory, with the rest zeroed if the key is narrower than
+		 * the trie's, so a uint16_t is never read past its two bytes.
+		 */
+		struct key_bytes {
+			uint8_t		bytes[N];
+		};
+
+		template <class K> static key_bytes encode( K aKey )
+		{
+			key_bytes	k;
+			memset(k.bytes, 0, N);
+			memcpy(k.bytes, &aKey, (sizeof(K) < (size_t)N ? sizeof(K) : (size_t)N));
+			return k;
+		}
+
+		/**
+		 * This method returns the root of the tree - making it, if there
+		 * isn't one yet.
+		 */
+		Inner *root()
+		{
+			Inner	*r = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+			if (r == NULL) {
+				boost::detail::spinlock::scoped_lock	lock(_rootMutex);
+				r = _root;
+				if (r == NULL) {
+					r = new Node4(0);
+					__atomic_store_n(&_root, r, __ATOMIC_RELEASE);
+				}
+			}
+			return r;
+		}
+
+		/**
+		 * This method returns the child of the node for the byte 'b', or
+		 * NULL if there isn't one. It's what the readers use, so it never
+		 * locks, and only relies on the order the writers publish things.
+		 */
+		static void *child( Inner *n, uint8_t b )
+		{
+			switch (n->type) {
+				case eNode4:
+					return scan(((Node4 *)n)->keys, ((Node4 *)n)->kids, n, b);
+				case eNode16:
+					return scan(((Node16 *)n)->keys, ((Node16 *)n)->kids, n, b);
+				case eNode48:
+				{
+					Node48	*n48 = (Node48 *)n;
+					uint8_t	s = __atomic_load_n(&n48->index[b], __ATOMIC_ACQUIRE);
+					return (s == 0 ? NULL : __atomic_load_n(&n48->kids[s - 1], __ATOMIC_ACQUIRE));
+				}
+				default:
+					return __atomic_load_n(&((Node256 *)n)->kids[b], __ATOMIC_ACQUIRE);
+			}
+		}
+
+		/**
+		 * This method looks through the used part of the list in a Node4
+		 * or Node16 for the byte, skipping the ones that have been removed.
+		 */
+		static void *scan( const uint8_t keys[], void *kids[], Inner *n, uint8_t b )
+		{
+			uint8_t		cnt = __atomic_load_n(&n->used, __ATOMIC_ACQUIRE);
+			for (uint8_t i = 0; i < cnt; ++i) {
+				if (keys[i] == b) {
+					void	*k = __atomic_load_n(&kids[i], __ATOMIC_ACQUIRE);
+					if (k != NULL) {
+						return k;
+					}
+				}
+			}
+			return NULL;
+		}
+
+		/**
+		 * This method returns the number of children the kind of node has
+		 * room for.
+		 */
+		static uint16_t capacity( uint8_t aType )
+		{
+			static const uint16_t	__caps[] = { 4, 16, 48, 256 };
+			return __caps[aType];
+		}
+
+		/**
+		 * This method returns 'true' if there are no more unused slots in
+		 * the node - even if some of the used ones have been emptied.
+		 */
+		static bool full( Inner *n )
+		{
+			return ((n->type != eNode256) && (n->used == capacity(n->type)));
+		}
+
+		/**
+		 * This method returns 'true' if the node has few enough children
+		 * to be copied into the next size down - with some slack, so a
+		 * node that's right at the edge isn't copied back and forth.
+		 */
+		static bool sparse( Inner *n )
+		{
+			switch (n->type) {
+				case eNode16:	return (n->live <= 3);
+				case eNode48:	return (n->live <= 12);
+				case eNode256:	return (n->live <= 40);
+			}
+			return false;
+		}
+
+		/**
+		 * This method adds the child for 'b' to the locked node, which has
+		 * room for it. The child is in place before it can be seen: the
+		 * count of the used slots, or the index, is set last.
+		 */
+		static void add( Inner *n, uint8_t b, void *aKid )
+		{
+			switch (n->type) {
+				case eNode4:
+				{
+					Node4	*n4 = (Node4 *)n;
+					n4->kids[n->used] = aKid;
+					n4->keys[n->used] = b;
+					__atomic_store_n(&n->used, (uint8_t)(n->used + 1), __ATOMIC_RELEASE);
+					break;
+				}
+				case eNode16:
+				{
+					Node16	*n16 = (Node16 *)n;
+					n16->kids[n->used] = aKid;
+					n16->keys[n->used] = b;
+					__atomic_store_n(&n->used, (uint8_t)(n->used + 1), __ATOMIC_RELEASE);
+					break;
+				}
+				case eNode48:
+				{
+					Node48	*n48 = (Node48 *)n;
+					n48->kids[n->used] = aKid;
+					__atomic_store_n(&n48->index[b], (uint8_t)(n->used + 1), __ATOMIC_RELEASE);
+					++n->used;
+					break;
+				}
+				default:
+					__atomic_store_n(&((Node256 *)n)->kids[b], aKid, __ATOMIC_RELEASE);
+					break;
+			}
+			++n->live;
+		}
+
+		/**
+		 * This method points the slot for 'b' in the locked node at 'aKid'
+		 * - or empties it, if that's NULL. It's how a child that's been
+		 * copied is swapped out, and how one is removed.
+		 */
+		static void set( Inner *n, uint8_t b, void *aKid )
+		{
+			void	**slot = NULL;
+			switch (n->type) {
+				case eNode4:
+				case eNode16:
+				{
+					uint8_t		*keys = (n->type == eNode4 ? ((Node4 *)n)->keys : ((Node16 *)n)->keys);
+					void		**kids = (n->type == eNode4 ? ((Node4 *)n)->kids : ((Node16 *)n)->kids);
+					for (uint8_t i = 0; i < n->used; ++i) {
+						if ((keys[i] == b) && (kids[i] != NULL)) {
+							slot = &kids[i];
+							break;
+						}
+					}
+					break;
+				}
+				case eNode48:
+				{
+					Node48	*n48 = (Node48 *)n;
+					slot = &n48->kids[n48->index[b] - 1];
+					if (aKid == NULL) {
+						__atomic_store_n(&n48->index[b], (uint8_t)0, __ATOMIC_RELEASE);
+					}
+					break;
+				}
+				default:
+					slot = &((Node256 *)n)->kids[b];
+					break;
+			}
+			__atomic_store_n(slot, aKid, __ATOMIC_RELEASE);
+		}
+
+		/**
+		 * This method removes the child for 'b' from the locked node.
+		 */
+		static void drop( Inner *n, uint8_t b )
+		{
+			set(n, b, NULL);
+			--n->live;
+		}
+
+		/**
+		 * This method fills in 'keys' and 'kids' with the children of the
+		 * node, in the order of their bytes, and returns how many there
+		 * are. The lists in the two small nodes aren't in order, so they
+		 * are sorted - there are never more than 16 of them.
+		 */
+		static uint16_t gather( Inner *n, uint8_t keys[], void *kids[] )
+		{
+			uint16_t	cnt = 0;
+			if ((n->type == eNode4) || (n->type == eNode16)) {
+				uint8_t		*k = (n->type == eNode4 ? ((Node4 *)n)->keys : ((Node16 *)n)->keys);
+				void		**c = (n->type == eNode4 ? ((Node4 *)n)->kids : ((Node16 *)n)->kids);
+				uint8_t		used = __atomic_load_n(&n->used, __ATOMIC_ACQUIRE);
+				for (uint8_t i = 0; i < used; ++i) {
+					void	*kid = __atomic_load_n(&c[i], __ATOMIC_ACQUIRE);
+					if (kid != NULL) {
+						// insert it in order
+						uint16_t	j = cnt++;
+						for (; (j > 0) && (keys[j - 1] > k[i]); --j) {
+							keys[j] = keys[j - 1];
+							kids[j] = kids[j - 1];
+						}
+						keys[j] = k[i];
+						kids[j] = kid;
+					}
+				}
+			} else {
+				for (uint16_t b = 0; b < 256; ++b) {
+					void	*kid = child(n, (uint8_t)b);
+					if (kid != NULL) {
+						keys[cnt] = (uint8_t)b;
+						kids[cnt++] = kid;
+					}
+				}
+			}
+			return cnt;
+		}
+
+		/**
+		 * This method makes a new node, at the same level as the locked
+		 * node 'n', that's the smallest that has room for 'aWant' children,
+		 * and copies them all into it - compacting away the empty slots.
+		 */
+		static Inner *resize( Inner *n, uint16_t aWant )
+		{
+			Inner	*r = NULL;
+			if (aWant <= 4) {
+				r = new Node4(n->level);
+			} else if (aWant <= 16) {
+				r = new Node16(n->level);
+			} else if (aWant <= 48) {
+				r = new Node48(n->level);
+			} else {
+				r = new Node256(n->level);
+			}
+			uint8_t		keys[256];
+			void		*kids[256];
+			uint16_t	cnt = gather(n, keys, kids);
+			for (uint16_t i = 0; i < cnt; ++i) {
+				add(r, keys[i], kids[i]);
+			}
+			return r;
+		}
+
+		/**
+		 * This method swaps the node 'n' - locked, and a child of 'aParent'
+		 * for the byte 'b', or the root - out of the tree, for 'aNew'. The
+		 * parent is locked while it's done, and if it's been replaced, or
+		 * 'n' isn't its child any longer, nothing's done, and 'false' is
+		 * returned. Otherwise, 'n' is unlocked, and retired.
+		 */
+		bool replace( Inner *aParent, uint8_t b, Inner *n, Inner *aNew )
+		{
+			boost::detail::spinlock		&pm = (aParent == NULL ? _rootMutex : aParent->mutex);
+			pm.lock();
+			bool	ok = (aParent == NULL ? (_root == n) :
+							(!aParent->obsolete && (child(aParent, b) == n)));
+			if (ok) {
+				if (aParent == NULL) {
+					__atomic_store_n(&_root, aNew, __ATOMIC_RELEASE);
+				} else {
+					set(aParent, b, aNew);
+				}
+				n->obsolete = 1;
+			}
+			pm.unlock();
+			if (ok) {
+				n->mutex.unlock();
+				util::epoch::retire(n, reclaimInner);
+			}
+			return ok;
+		}
+
+		/**
+		 * This method returns the locked node 'n' if it has room for one
+		 * more child, and if it doesn't, a locked copy of it that does -
+		 * swapped into the tree in its place. If that can't be done, as
+		 * the parent has changed, it returns NULL, and 'n' is still locked.
+		 */
+		Inner *room( Inner *aParent, uint8_t b, Inner *n )
+		{
+			if (!full(n)) {
+				return n;
+			}
+			Inner	*bigger = resize(n, n->live + 1);
+			bigger->mutex.lock();
+			if (!replace(aParent, b, n, bigger)) {
+				destroy(bigger, false);
+				return NULL;
+			}
+			return bigger;
+		}
+
+		/**
+		 * This method unlocks the node 'n' - after a child's been taken
+		 * out of it - but first, if it's gotten sparse, swaps it for a
+		 * smaller copy. If the parent has changed, it's left as it is.
+		 */
+		void tidy( Inner *aParent, uint8_t b, Inner *n )
+		{
+			if (sparse(n)) {
+				Inner	*smaller = resize(n, n->live);
+				if (replace(aParent, b, n, smaller)) {
+					return;
+				}
+				destroy(smaller, false);
+			}
+			n->mutex.unlock();
+		}
+
+		/**
+		 * This method counts the valid values under the node.
+		 */
+		static size_t count( Inner *n )
+		{
+			size_t		sz = 0;
+			uint8_t		keys[256];
+			void		*kids[256];
+			uint16_t	cnt = gather(n, keys, kids);
+			for (uint16_t i = 0; i < cnt; ++i) {
+				if (n->level == eLast) {
+					sz += (((Node *)kids[i])->valid ? 1 : 0);
+				} else {
+					sz += count((Inner *)kids[i]);
+				}
+			}
+			return sz;
+		}
+
+		/**
+		 * This method applies the functor to the valid values under the
+		 * node, in order, and returns 'false' if it was told to stop.
+		 */
+		static bool walk( Inner *n, functor & aFunctor )
+		{
+			uint8_t		keys[256];
+			void		*kids[256];
+			uint16_t	cnt = gather(n, keys, kids);
+			for (uint16_t i = 0; i < cnt; ++i) {
+				if (n->level == eLast) {
+					volatile Node	&v = *((volatile Node *)kids[i]);
+					if ((bool)const_cast<Node &>(v).valid && !aFunctor(v)) {
+						return false;
+					}
+				} else if (!walk((Inner *)kids[i], aFunctor)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/**
+		 * This method deletes the node - and if 'aDeep' is 'true', all its
+		 * children, and their values, first.
+		 */
+		static void destroy( Inner *n, bool aDeep )
+		{
+			if (aDeep) {
+				uint8_t		keys[256];
+				void		*kids[256];
+				uint16_t	cnt = gather(n, keys, kids);
+				for (uint16_t i = 0; i < cnt; ++i) {
+					if (n->level == eLast) {
+						delete (Node *)kids[i];
+					} else {
+						destroy((Inner *)kids[i], true);
+					}
+				}
+			}
+			switch (n->type) {
+				case eNode4:	delete (Node4 *)n;		break;
+				case eNode16:	delete (Node16 *)n;		break;
+				case eNode48:	delete (Node48 *)n;		break;
+				default:		delete (Node256 *)n;	break;
+			}
+		}
+
+		/**
+		 * These are the reclaimers handed to the epoch with what's retired
+		 * - a Node that's been taken out, a node that's been copied, and a
+		 * whole tree that's been cleared.
+		 */
+		static void reclaimNode( void *aPtr )
+		{
+			delete (Node *)aPtr;
+		}
+
+		static void reclaimInner( void *aPtr )
+		{
+			destroy((Inner *)aPtr, false);
+		}
+
+		static void reclaimTree( void *aPtr )
+		{
+			destroy((Inner *)aPtr, true);
+		}
+
+		/**
+		 * This is the root of the tree, and the lock a writer takes to
+		 * make it, or swap it for a copy - as if it were the root's parent.
+		 */
+		Inner						*_root;
+		boost::detail::spinlock		_rootMutex;
 };
 
 
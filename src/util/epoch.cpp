@@ -0,0 +1,214 @@
+/**
+ * epoch.cpp - this file implements the epoch-based reclamation domain for
+ *             the lock-free containers in DKit. The records of the threads
+ *             are kept on a list that only ever grows - a thread that exits
+ *             leaves its record for the next one - so the threads that try
+ *             to move the epoch on can walk it without any locking at all.
+ */
+
+//	System Headers
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "util/epoch.h"
+
+//	Forward Declarations
+
+//	Private Constants
+
+//	Private Datatypes
+
+//	Private Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the data for the domain - the global epoch, the list of all the
+ * records, and the record for this thread, if it has one.
+ */
+volatile uint64_t			epoch::_global = 0;
+epoch::Record *volatile		epoch::_records = NULL;
+__thread epoch::Record		*epoch::_mine = NULL;
+
+
+/**
+ * This is the thread-local that lets go of the thread's record when the
+ * thread exits. It's made the first time the thread attaches, and its
+ * destructor is the only reason it's here.
+ */
+struct epoch_release
+{
+	~epoch_release()
+	{
+		epoch::detach();
+	}
+};
+
+
+/*******************************************************************
+ *
+ *                        Accessor Methods
+ *
+ *******************************************************************/
+/**
+ * This method returns the number of pointers this thread has retired that
+ * have yet to be reclaimed.
+ */
+size_t epoch::pending()
+{
+	size_t		retval = 0;
+	if (_mine != NULL) {
+		for (uint32_t b = 0; b < eBags; ++b) {
+			retval += _mine->bags[b].items.size();
+		}
+	}
+	return retval;
+}
+
+
+/*******************************************************************
+ *
+ *                         Utility Methods
+ *
+ *******************************************************************/
+/**
+ * This method puts the pointer in the bag for the current epoch - first
+ * reclaiming what's in it, if it's from an older one, as that's at least
+ * three epochs back, and so safe. Then, every so often, it tries to move
+ * the epoch on and reclaim the rest.
+ */
+void epoch::retire( void *aPtr, reclaimer_t aReclaimer )
+{
+	Record		*me = _mine;
+	if (me == NULL) {
+		me = attach();
+	}
+	uint64_t	e = current();
+	Bag			&bag = me->bags[e % eBags];
+	if (bag.epoch != e) {
+		for (size_t i = 0; i < bag.items.size(); ++i) {
+			(*bag.items[i].second)(bag.items[i].first);
+		}
+		bag.items.clear();
+		bag.epoch = e;
+	}
+	bag.items.push_back(std::make_pair(aPtr, aReclaimer));
+	if (++me->retires >= eCollectEvery) {
+		me->retires = 0;
+		collect();
+	}
+}
+
+
+/**
+ * This method walks all the records, and if every one in a guard is in the
+ * current epoch, moves it on by one. If someone beats us to it, that's
+ * just as good.
+ */
+bool epoch::advance()
+{
+	uint64_t	e = current();
+	__sync_synchronize();
+	for (Record *r = __atomic_load_n(&_records, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		uint64_t	s = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+		if (((s & 0x01) != 0) && ((s >> 1) != e)) {
+			return false;
+		}
+	}
+	return (__sync_bool_compare_and_swap(&_global, e, e + 1) || (current() != e));
+}
+
+
+/**
+ * This method tries to move the epoch on, and then reclaims what it can
+ * from this thread's record, and from any record left behind by a thread
+ * that's exited - taking it for just long enough to do so.
+ */
+size_t epoch::collect()
+{
+	size_t		retval = 0;
+	advance();
+	uint64_t	e = current();
+	if (_mine != NULL) {
+		retval += drain(_mine, e);
+	}
+	for (Record *r = __atomic_load_n(&_records, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		if ((__atomic_load_n(&r->owned, __ATOMIC_RELAXED) == 0) && __sync_bool_compare_and_swap(&r->owned, 0, 1)) {
+			retval += drain(r, e);
+			__sync_lock_release(&r->owned);
+		}
+	}
+	return retval;
+}
+
+
+/**
+ * This method finds this thread a record - one left by a thread that's
+ * exited, if there is one, or a new one added to the head of the list. It
+ * also makes the thread-local that will give it back.
+ */
+epoch::Record *epoch::attach()
+{
+	static thread_local epoch_release	releaser;
+	(void)releaser;
+
+	Record	*me = NULL;
+	for (Record *r = __atomic_load_n(&_records, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		if ((__atomic_load_n(&r->owned, __ATOMIC_RELAXED) == 0) && __sync_bool_compare_and_swap(&r->owned, 0, 1)) {
+			me = r;
+			break;
+		}
+	}
+	if (me == NULL) {
+		me = new Record();
+		Record	*head = _records;
+		do {
+			head = _records;
+			me->next = head;
+		} while (!__sync_bool_compare_and_swap(&_records, head, me));
+	}
+	_mine = me;
+	return me;
+}
+
+
+/**
+ * This method gives back the thread's record when it exits. What it had
+ * yet to reclaim stays with it, for the next owner, or the next collect().
+ */
+void epoch::detach()
+{
+	Record	*me = _mine;
+	if (me != NULL) {
+		_mine = NULL;
+		me->nesting = 0;
+		me->retires = 0;
+		__atomic_store_n(&me->state, (uint64_t)0, __ATOMIC_RELEASE);
+		__sync_lock_release(&me->owned);
+	}
+}
+
+
+/**
+ * This method reclaims every bag in the record that's from at least two
+ * epochs back - no thread in a guard can still be looking at those.
+ */
+size_t epoch::drain( Record *aRecord, uint64_t anEpoch )
+{
+	size_t		retval = 0;
+	for (uint32_t b = 0; b < eBags; ++b) {
+		Bag		&bag = aRecord->bags[b];
+		if (!bag.items.empty() && (bag.epoch + 2 <= anEpoch)) {
+			for (size_t i = 0; i < bag.items.size(); ++i) {
+				(*bag.items[i].second)(bag.items[i].first);
+			}
+			retval += bag.items.size();
+			bag.items.clear();
+		}
+	}
+	return retval;
+}
+}		// end of namespace util
+}		// end of namespace dkit
@@ -0,0 +1,222 @@
+/**
+ * epoch.h - this file defines the epoch-based reclamation domain for the
+ *           lock-free containers in DKit. When a node is taken out of a
+ *           linked container, another thread may still be looking at it,
+ *           so it can't be deleted right away. Instead, it's retired, and
+ *           held on the retiring thread's list until every thread that
+ *           could have seen it has left its critical section. The domain
+ *           knows this by the global epoch: a thread records the epoch when
+ *           it enters a guard, and the epoch only moves on when all the
+ *           threads in a guard have seen the current one. Once the epoch
+ *           has moved twice past the one a node was retired in, no one can
+ *           be looking at it, and it's handed to its reclaimer.
+ */
+#ifndef __DKIT_UTIL_EPOCH_H
+#define __DKIT_UTIL_EPOCH_H
+
+//	System Headers
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "util/padding.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the main class definition - the domain is process-wide, so it's
+ * all static. The only thing a user makes is a guard - on the stack, around
+ * the code that reads the nodes of a lock-free container.
+ */
+class epoch
+{
+	public:
+		/**
+		 * This is the function that's handed a retired pointer when it's
+		 * safe to do so. It can delete it, or put it on a free list.
+		 */
+		typedef void (*reclaimer_t)( void *aPtr );
+
+		/**
+		 * This is the critical section - while a guard is alive on this
+		 * thread, nothing retired after it was made will be reclaimed.
+		 * Guards nest, and only the outermost one does any work.
+		 */
+		class guard
+		{
+			public:
+				guard()
+				{
+					epoch::enter();
+				}
+
+				~guard()
+				{
+					epoch::exit();
+				}
+
+			private:
+				// guards are on the stack, and nowhere else
+				guard( const guard & anOther );
+				guard & operator=( const guard & anOther );
+		};
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the global epoch as it is right now.
+		 */
+		static uint64_t current()
+		{
+			return __atomic_load_n(&_global, __ATOMIC_ACQUIRE);
+		}
+
+
+		/**
+		 * This method returns the number of pointers this thread has
+		 * retired that have yet to be reclaimed.
+		 */
+		static size_t pending();
+
+
+		/*******************************************************************
+		 *
+		 *                         Utility Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method hands the pointer - already unlinked, so no new
+		 * reader can find it - to the domain. It'll be passed to the
+		 * reclaimer once no thread can still be looking at it. Every so
+		 * many retires, this thread tries to move the epoch on, and
+		 * reclaims what it can - so the cost is spread out.
+		 */
+		static void retire( void *aPtr, reclaimer_t aReclaimer );
+
+
+		/**
+		 * This method tries to move the global epoch on by one, and returns
+		 * 'true' if it did - or if someone else did it for us. It can only
+		 * move if every thread in a guard has seen the current epoch.
+		 */
+		static bool advance();
+
+
+		/**
+		 * This method tries to move the epoch on, and then reclaims all
+		 * that's safe - this thread's retired pointers, and those left by
+		 * threads that have exited. It returns the number reclaimed.
+		 */
+		static size_t collect();
+
+	private:
+		/**
+		 * These are the constants for the domain - how many retires go by
+		 * before a thread tries to collect, and the number of lists each
+		 * thread keeps - one for each epoch that can't yet be reclaimed.
+		 */
+		enum {
+			eCollectEvery = 64,
+			eBags = 3
+		};
+
+		/**
+		 * Each thread has one of these records - the 'state' is what the
+		 * other threads look at: the epoch it entered in, shifted up one,
+		 * with the low bit set while it's in a guard. The rest is only for
+		 * the thread that owns it. When a thread exits, its record is
+		 * left on the list for the next thread to take, along with what
+		 * it had yet to reclaim.
+		 */
+		struct Bag {
+			uint64_t									epoch;
+			std::vector< std::pair<void *, reclaimer_t> >	items;
+
+			Bag() : epoch(0), items() { }
+		};
+
+		struct Record {
+			volatile uint64_t	state;
+			char				_pad0[cache_line_size - sizeof(uint64_t)];
+			volatile uint32_t	owned;
+			uint32_t			nesting;
+			uint32_t			retires;
+			Record				*next;
+			Bag					bags[eBags];
+
+			Record() : state(0), owned(1), nesting(0), retires(0), next(NULL) { }
+		};
+
+		/**
+		 * These are the entering and leaving of a guard. The outermost
+		 * one publishes the epoch it's in - with a full barrier so that
+		 * no read of a node can come before it - and the last one out
+		 * clears it.
+		 */
+		static void enter()
+		{
+			Record	*me = _mine;
+			if (me == NULL) {
+				me = attach();
+			}
+			if (me->nesting++ == 0) {
+				__atomic_store_n(&me->state, (current() << 1) | 0x01, __ATOMIC_RELAXED);
+				__sync_synchronize();
+			}
+		}
+
+		static void exit()
+		{
+			Record	*me = _mine;
+			if (--me->nesting == 0) {
+				__atomic_store_n(&me->state, (uint64_t)0, __ATOMIC_RELEASE);
+			}
+		}
+
+		/**
+		 * These are the methods that find this thread its record - a free
+		 * one on the list, or a new one - and give it back when the thread
+		 * exits. They're in the library, with the data for the domain.
+		 */
+		static Record *attach();
+		static void detach();
+
+		/**
+		 * This method reclaims the items in the bags of the record that
+		 * are from an epoch at least two behind the global one, and returns
+		 * how many there were.
+		 */
+		static size_t drain( Record *aRecord, uint64_t anEpoch );
+
+		/**
+		 * ...and this is the data for the domain, and the thread's record
+		 * - that's read in every guard, so it's in the initial-exec TLS
+		 * model, as the library is linked in, and never dlopen()-ed.
+		 */
+		static volatile uint64_t	_global;
+		static Record *volatile		_records;
+		static __thread Record		*_mine __attribute__((tls_model("initial-exec")));
+
+		// the thread's record is let go by the destructor of one of these
+		friend struct epoch_release;
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_EPOCH_H
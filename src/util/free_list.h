@@ -0,0 +1,286 @@
+/**
+ * free_list.h - this file defines the free lists for the nodes of the linked
+ *               containers in DKit. Each thread has its own list of blocks,
+ *               big enough for an N, that it takes from and gives back to
+ *               without any atomics at all. When a thread has too many, it
+ *               hands a batch of them to the depot, and when it has none,
+ *               it takes a batch from there - so the consumer that reclaims
+ *               the nodes and the producer that needs them can share them,
+ *               with one lock for every batch, and not one malloc per node.
+ */
+#ifndef __DKIT_UTIL_FREE_LIST_H
+#define __DKIT_UTIL_FREE_LIST_H
+
+//	System Headers
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <sched.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the main class definition - it's all static, and there's one
+ * set of lists, and one depot, for each type of node.
+ */
+template <class N> class free_list
+{
+	public:
+		/**
+		 * These are the sizes of the lists - the most blocks a thread
+		 * holds on to, the number handed to, or taken from, the depot at
+		 * once, and the most batches the depot will hold before the rest
+		 * go back to the heap.
+		 */
+		enum {
+			eLocalMax = 1024,
+			eBatch = 256,
+			eDepotMax = 64
+		};
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns a block that's big enough, and aligned well
+		 * enough, for an N - from this thread's list, from the depot, or,
+		 * if all else fails, from the heap. The N isn't constructed - that's
+		 * up to the caller, with a placement new.
+		 */
+		static void *get()
+		{
+			if ((_local == NULL) && !_gone) {
+				refill();
+			}
+			Block	*b = _local;
+			if (b != NULL) {
+				_local = b->next;
+				--_count;
+				return b;
+			}
+			return allocate();
+		}
+
+
+		/**
+		 * This method gives back a block from get() - the N in it has
+		 * already been destroyed. It's got the signature of a reclaimer
+		 * so it can be handed right to util::epoch::retire().
+		 */
+		static void put( void *aBlock )
+		{
+			if (_gone) {
+				// the thread is going away - don't hold on to anything
+				free(aBlock);
+				return;
+			}
+			if (!_attached) {
+				attach();
+			}
+			Block	*b = (Block *)aBlock;
+			b->next = _local;
+			_local = b;
+			if (++_count >= eLocalMax) {
+				spill();
+			}
+		}
+
+
+		/**
+		 * This method returns the number of blocks that have ever come
+		 * from the heap for an N - a way to see that they're being reused.
+		 */
+		static size_t allocations()
+		{
+			return __atomic_load_n(&_allocations, __ATOMIC_RELAXED);
+		}
+
+	private:
+		/**
+		 * A block, when it's free, is just a link to the next one - and
+		 * the first in a batch in the depot links to the next batch.
+		 */
+		struct Block {
+			Block	*next;
+			Block	*batch;
+		};
+		static_assert(sizeof(N) >= sizeof(Block), "free_list needs a node at least two pointers big");
+
+		/**
+		 * This is the thread-local whose destructor hands this thread's
+		 * blocks to the depot when the thread exits.
+		 */
+		struct Release {
+			~Release()
+			{
+				free_list<N>::flush();
+			}
+		};
+
+		/**
+		 * This method is the first put() on the thread - making sure the
+		 * blocks it collects are given up when the thread is done.
+		 */
+		static void attach()
+		{
+			static thread_local Release		releaser;
+			(void)releaser;
+			_attached = true;
+		}
+
+		/**
+		 * This method gets a new block from the heap, aligned for an N.
+		 */
+		static void *allocate()
+		{
+			void	*b = NULL;
+			size_t	align = (alignof(N) > sizeof(void *) ? alignof(N) : sizeof(void *));
+			if (posix_memalign(&b, align, sizeof(N)) != 0) {
+				throw std::bad_alloc();
+			}
+			__sync_fetch_and_add(&_allocations, 1);
+			return b;
+		}
+
+		/**
+		 * These methods take and give back the depot's spin-lock. It's
+		 * only held long enough to link or unlink a batch.
+		 */
+		static void lock()
+		{
+			while (__sync_lock_test_and_set(&_lock, 1) != 0) {
+				sched_yield();
+			}
+		}
+
+		static void unlock()
+		{
+			__sync_lock_release(&_lock);
+		}
+
+		/**
+		 * This method takes a batch from the depot, if there is one, as
+		 * this thread's list.
+		 */
+		static void refill()
+		{
+			if (__atomic_load_n(&_depot, __ATOMIC_RELAXED) == NULL) {
+				return;
+			}
+			if (!_attached) {
+				attach();
+			}
+			lock();
+			Block	*b = _depot;
+			if (b != NULL) {
+				__atomic_store_n(&_depot, b->batch, __ATOMIC_RELAXED);
+				--_batches;
+			}
+			unlock();
+			if (b != NULL) {
+				_local = b;
+				_count = 0;
+				for (Block *n = b; n != NULL; n = n->next) {
+					++_count;
+				}
+			}
+		}
+
+		/**
+		 * This method hands a batch of this thread's blocks to the depot -
+		 * or, if the depot is full, back to the heap.
+		 */
+		static void spill()
+		{
+			Block	*first = _local;
+			Block	*last = first;
+			for (uint32_t i = 1; i < eBatch; ++i) {
+				last = last->next;
+			}
+			_local = last->next;
+			_count -= eBatch;
+			last->next = NULL;
+			give(first);
+		}
+
+		/**
+		 * This method hands all of this thread's blocks to the depot as it
+		 * exits, and makes sure any that come later go to the heap.
+		 */
+		static void flush()
+		{
+			_gone = true;
+			if (_local != NULL) {
+				give(_local);
+				_local = NULL;
+				_count = 0;
+			}
+		}
+
+		/**
+		 * This method puts a chain of blocks in the depot, or frees them
+		 * if the depot already has all it will hold.
+		 */
+		static void give( Block *aChain )
+		{
+			lock();
+			bool	kept = (_batches < eDepotMax);
+			if (kept) {
+				aChain->batch = _depot;
+				__atomic_store_n(&_depot, aChain, __ATOMIC_RELAXED);
+				++_batches;
+			}
+			unlock();
+			if (!kept) {
+				while (aChain != NULL) {
+					Block	*n = aChain->next;
+					free(aChain);
+					aChain = n;
+				}
+			}
+		}
+
+		// this is the thread's list of blocks
+		static __thread Block		*_local;
+		static __thread uint32_t	_count;
+		static __thread bool		_attached;
+		static __thread bool		_gone;
+		// ...and this is the depot, shared by all threads
+		static Block *volatile		_depot;
+		static volatile uint32_t	_batches;
+		static volatile int			_lock;
+		static volatile size_t		_allocations;
+};
+
+
+/**
+ * These are the static data for each type of node.
+ */
+template <class N> __thread typename free_list<N>::Block *free_list<N>::_local = NULL;
+template <class N> __thread uint32_t free_list<N>::_count = 0;
+template <class N> __thread bool free_list<N>::_attached = false;
+template <class N> __thread bool free_list<N>::_gone = false;
+template <class N> typename free_list<N>::Block *volatile free_list<N>::_depot = NULL;
+template <class N> volatile uint32_t free_list<N>::_batches = 0;
+template <class N> volatile int free_list<N>::_lock = 0;
+template <class N> volatile size_t free_list<N>::_allocations = 0;
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_FREE_LIST_H
@@ -0,0 +1,152 @@
+/**
+ * mapped_file.h - this file defines a plain file mmap()-ed into memory for
+ *                 reading - an image that was written out earlier, and is
+ *                 to be used right where it lies, rather than read in and
+ *                 rebuilt. The mapping is private, so if a page of it is
+ *                 ever written to, that page is copied for this process,
+ *                 and the file itself is never changed.
+ *
+ *                 Nothing is read from the file when it's mapped - each
+ *                 page comes in the first time it's touched - so mapping a
+ *                 big image takes no longer than mapping a small one.
+ */
+#ifndef __DKIT_UTIL_MAPPED_FILE_H
+#define __DKIT_UTIL_MAPPED_FILE_H
+
+//	System Headers
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <string>
+
+//	Third-Party Headers
+
+//	Other Headers
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the main class definition.
+ */
+class mapped_file
+{
+	public:
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This constructor maps all of the file at 'aPath'. If it can't
+		 * be opened, or it's empty, or it can't be mapped, it throws a
+		 * std::runtime_error.
+		 */
+		mapped_file( const std::string & aPath ) :
+			_path(aPath),
+			_data(NULL),
+			_length(0)
+		{
+			int		fd = open(_path.c_str(), O_RDONLY);
+			if (fd < 0) {
+				throw std::runtime_error("[mapped_file] Unable to open the file '" + _path + "'!");
+			}
+
+			const char		*problem = NULL;
+			struct stat		st;
+			if (fstat(fd, &st) != 0) {
+				problem = "[mapped_file] Unable to size up the file '";
+			} else if (st.st_size <= 0) {
+				problem = "[mapped_file] There's nothing in the file '";
+			} else {
+				_length = (size_t)st.st_size;
+				void	*p = mmap(NULL, _length, (PROT_READ | PROT_WRITE), MAP_PRIVATE, fd, 0);
+				if (p == MAP_FAILED) {
+					problem = "[mapped_file] Unable to map the file '";
+				} else {
+					_data = (uint8_t *)p;
+				}
+			}
+			// the mapping holds its own reference, so the descriptor can go
+			close(fd);
+			if (problem != NULL) {
+				throw std::runtime_error(problem + _path + "'!");
+			}
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called. It unmaps the file - and with it, any private copies of
+		 * the pages.
+		 */
+		virtual ~mapped_file()
+		{
+			if (_data != NULL) {
+				munmap(_data, _length);
+				_data = NULL;
+			}
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns the start of the mapping - it's page-aligned,
+		 * and wherever the kernel put it, so what's in the file has to be
+		 * addressed by offsets from here.
+		 */
+		uint8_t *data() const
+		{
+			return _data;
+		}
+
+
+		/**
+		 * This method returns the number of bytes mapped - all of the file.
+		 */
+		size_t length() const
+		{
+			return _length;
+		}
+
+
+		/**
+		 * This method returns the path of the file that's mapped.
+		 */
+		const std::string & path() const
+		{
+			return _path;
+		}
+
+	private:
+		// there's just the one mapping of the file for each of these
+		mapped_file( const mapped_file & anOther );
+		mapped_file & operator=( const mapped_file & anOther );
+
+		/**
+		 * These are the file, and where it's mapped.
+		 */
+		std::string		_path;
+		uint8_t			*_data;
+		size_t			_length;
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_MAPPED_FILE_H
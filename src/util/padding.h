@@ -0,0 +1,39 @@
+/**
+ * padding.h - this file defines the simple constants that the containers in
+ *             DKit use to keep the data touched by different threads on
+ *             different cache lines. When a producer and a consumer write
+ *             to the same cache line, even if it's to different variables,
+ *             the line has to bounce between the cores on every write, and
+ *             that's often the single most expensive thing a queue does.
+ */
+#ifndef __DKIT_UTIL_PADDING_H
+#define __DKIT_UTIL_PADDING_H
+
+//	System Headers
+#include <stddef.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+
+//	Forward Declarations
+
+//	Public Constants
+namespace dkit {
+namespace util {
+/**
+ * This is the size of the cache line on all the x86_64 machines we target,
+ * and is a safe value on the others. It's the unit of sharing between the
+ * cores, and so the unit we pad out to.
+ */
+enum {
+	cache_line_size = 64
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+#endif		// __DKIT_UTIL_PADDING_H
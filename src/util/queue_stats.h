@@ -0,0 +1,342 @@
+/**
+ * queue_stats.h - this file defines the instrumentation that the bounded
+ *                 FIFOs in DKit can carry - picked at compile-time as their
+ *                 last template parameter, S. The default, no_stats, has
+ *                 nothing in it, and every hook is an empty inline method,
+ *                 so it costs nothing at all. With queue_stats, the queue
+ *                 keeps the high-water mark of its size, counts the pushes
+ *                 that found it full and the pops that found it empty, and
+ *                 times how long a sample of the elements sat in it - from
+ *                 the push to the pop - in a histogram of powers of two nsec.
+ *
+ *                 The producers' counters and the consumers' counters are on
+ *                 their own cache lines, so neither side ever writes a line
+ *                 the other is writing. The successful pushes and pops don't
+ *                 count anything - they only look at the high-water mark, and
+ *                 every 2^R-th slot of the ring is timed. The queue says what
+ *                 kind it is, and a side with just the one thread - both of
+ *                 them, for an spsc ring - counts with a plain load and store,
+ *                 as there's no one to lose an update to. Only a side with
+ *                 many threads needs the locked add, and the high-water mark
+ *                 a CAS - and then only when it goes up. The producer puts
+ *                 the time it's pushed in a table, by slot, before it's
+ *                 published, and the consumer takes it out before the slot
+ *                 is handed back, so the element itself carries the stamp.
+ */
+#ifndef __DKIT_UTIL_QUEUE_STATS_H
+#define __DKIT_UTIL_QUEUE_STATS_H
+
+//	System Headers
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "queue_type.h"
+#include "util/padding.h"
+#include "util/timer.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the stats policy for a queue that doesn't want any - and it's
+ * the default for all of them. It's empty, and so is every hook.
+ */
+class no_stats
+{
+	public:
+		enum {
+			eEnabled = 0
+		};
+
+		no_stats( size_t aSlots = 0, queue_type aType = mp_mc ) { }
+
+		/**
+		 * These are the hooks the queue calls - a push into 'aSlot' that
+		 * leaves 'aSize' in the queue, a pop from 'aSlot', and the push
+		 * and the pop that couldn't.
+		 */
+		void pushed( size_t aSlot, size_t aSize ) { }
+		void push_failed() { }
+		void popped( size_t aSlot ) { }
+		void pop_empty() { }
+};
+
+
+/**
+ * This is the stats policy that does the counting, and times one in every
+ * 2^R slots of the ring - one in 64 by default.
+ */
+template <uint8_t R = 6> class queue_stats
+{
+	public:
+		enum {
+			eEnabled = 1,
+			eBuckets = 64
+		};
+
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the constructor that the queue calls with the number of
+		 * slots in its ring, so that there's a place for each timed one, and
+		 * the kind of queue it is, so each side knows if it's on its own.
+		 */
+		queue_stats( size_t aSlots, queue_type aType = mp_mc ) :
+			_highWater(0),
+			_pushFails(0),
+			_oneProducer((aType == sp_sc) || (aType == sp_mc)),
+			_popEmpties(0),
+			_samples(0),
+			_oneConsumer((aType == sp_sc) || (aType == mp_sc)),
+			_slots(aSlots),
+			_stamps(NULL)
+		{
+			init();
+		}
+
+
+		/**
+		 * This is the standard copy constructor - but the counts are for
+		 * the queue they're in, so a copy of the queue starts them over.
+		 */
+		queue_stats( const queue_stats<R> & anOther ) :
+			_highWater(0),
+			_pushFails(0),
+			_oneProducer(anOther._oneProducer),
+			_popEmpties(0),
+			_samples(0),
+			_oneConsumer(anOther._oneConsumer),
+			_slots(anOther._slots),
+			_stamps(NULL)
+		{
+			init();
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called.
+		 */
+		virtual ~queue_stats()
+		{
+			delete [] _stamps;
+			_stamps = NULL;
+		}
+
+
+		/**
+		 * Just like the copy constructor, assigning one queue to another
+		 * doesn't bring the counts along.
+		 */
+		queue_stats & operator=( const queue_stats<R> & anOther )
+		{
+			return *this;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * This method returns the most that's ever been in the queue -
+		 * right after a push.
+		 */
+		size_t high_water() const
+		{
+			return __atomic_load_n(&_highWater, __ATOMIC_RELAXED);
+		}
+
+
+		/**
+		 * These methods return the number of pushes that found the queue
+		 * full, and the number of pops that found it empty.
+		 */
+		uint64_t push_failures() const
+		{
+			return __atomic_load_n(&_pushFails, __ATOMIC_RELAXED);
+		}
+
+
+		uint64_t pop_empties() const
+		{
+			return __atomic_load_n(&_popEmpties, __ATOMIC_RELAXED);
+		}
+
+
+		/**
+		 * This method returns the number of elements that have been timed
+		 * from their push to their pop.
+		 */
+		uint64_t samples() const
+		{
+			return __atomic_load_n(&_samples, __ATOMIC_RELAXED);
+		}
+
+
+		/**
+		 * This method returns the number of the timed elements that were
+		 * in the queue for 2^b to 2^(b+1) nsec - the first bucket has
+		 * those under 2 nsec, as well.
+		 */
+		uint64_t bucket( uint32_t b ) const
+		{
+			return (b < eBuckets ? __atomic_load_n(&_latency[b], __ATOMIC_RELAXED) : 0);
+		}
+
+
+		/**
+		 * This method returns the time, in nsec, that the fraction 'aPct'
+		 * - 0.5 for the median, 0.99 for the 99th percentile - of the timed
+		 * elements were in the queue for no longer than. It's the top of
+		 * the bucket it falls in, so it's good to within a factor of two.
+		 */
+		uint64_t percentile( double aPct ) const
+		{
+			uint64_t	total = 0;
+			for (uint32_t b = 0; b < eBuckets; ++b) {
+				total += bucket(b);
+			}
+			uint64_t	want = (uint64_t)(aPct * total);
+			uint64_t	seen = 0;
+			for (uint32_t b = 0; b < eBuckets; ++b) {
+				seen += bucket(b);
+				if ((seen > 0) && (seen >= want)) {
+					return (b < eBuckets - 1 ? (((uint64_t)2) << b) - 1 : ~((uint64_t)0));
+				}
+			}
+			return 0;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                          Queue Hooks
+		 *
+		 *******************************************************************/
+		/**
+		 * This is called by a producer when it's put an element in 'aSlot'
+		 * - and before it's published - leaving 'aSize' in the queue. The
+		 * high-water mark is only written when it goes up, and if there's
+		 * more than one producer, that's a CAS.
+		 */
+		void pushed( size_t aSlot, size_t aSize )
+		{
+			size_t	hw = __atomic_load_n(&_highWater, __ATOMIC_RELAXED);
+			if (aSize > hw) {
+				if (_oneProducer) {
+					__atomic_store_n(&_highWater, aSize, __ATOMIC_RELAXED);
+				} else {
+					while ((aSize > hw) &&
+						   !__atomic_compare_exchange_n(&_highWater, &hw, aSize, true,
+									__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+						// hw has been reloaded - try again if we're still higher
+					}
+				}
+			}
+			if ((aSlot & eSampleMask) == 0) {
+				__atomic_store_n(&_stamps[aSlot >> R], timer::nsecStamp(), __ATOMIC_RELAXED);
+			}
+		}
+
+
+		/**
+		 * This is called by a producer when the queue is full.
+		 */
+		void push_failed()
+		{
+			bump(_pushFails, _oneProducer);
+		}
+
+
+		/**
+		 * This is called by a consumer when it's taken the element out of
+		 * 'aSlot' - and before the slot is handed back to the producers.
+		 */
+		void popped( size_t aSlot )
+		{
+			if ((aSlot & eSampleMask) == 0) {
+				uint64_t	ns = timer::nsecStamp() - __atomic_load_n(&_stamps[aSlot >> R], __ATOMIC_RELAXED);
+				uint32_t	b = 63 - __builtin_clzll(ns | 1);
+				bump(_latency[b], _oneConsumer);
+				bump(_samples, _oneConsumer);
+			}
+		}
+
+
+		/**
+		 * This is called by a consumer when the queue is empty.
+		 */
+		void pop_empty()
+		{
+			bump(_popEmpties, _oneConsumer);
+		}
+
+	private:
+		enum {
+			eSampleMask = ((1 << R) - 1)
+		};
+
+		/**
+		 * This method adds one to a count that only its side writes. When
+		 * that's just the one thread, the readers only need to see a whole
+		 * value, so there's no need for the lock on the add.
+		 */
+		static void bump( uint64_t & aCount, bool isAlone )
+		{
+			if (isAlone) {
+				__atomic_store_n(&aCount, (__atomic_load_n(&aCount, __ATOMIC_RELAXED) + 1), __ATOMIC_RELAXED);
+			} else {
+				__atomic_fetch_add(&aCount, 1, __ATOMIC_RELAXED);
+			}
+		}
+
+		/**
+		 * This method makes the table of stamps - one for each timed slot
+		 * - and clears the histogram.
+		 */
+		void init()
+		{
+			size_t	cnt = (_slots >> R) + 1;
+			_stamps = new uint64_t[cnt];
+			memset(_stamps, 0, cnt * sizeof(uint64_t));
+			memset(_latency, 0, sizeof(_latency));
+		}
+
+		/**
+		 * The producers' counts are on one cache line, the consumers' on
+		 * the next few, and the table of stamps - written by one side, and
+		 * read by the other, like the slots of the ring - is off on its own.
+		 */
+		size_t				_highWater;
+		uint64_t			_pushFails;
+		bool				_oneProducer;
+		char				_pad0[util::cache_line_size - sizeof(size_t) - sizeof(uint64_t) - sizeof(bool)];
+		uint64_t			_popEmpties;
+		uint64_t			_samples;
+		bool				_oneConsumer;
+		uint64_t			_latency[eBuckets];
+		size_t				_slots;
+		uint64_t			*_stamps;
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_QUEUE_STATS_H
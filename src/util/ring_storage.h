@@ -0,0 +1,201 @@
+/**
+ * ring_storage.h - this file defines a simple block of memory for the ring
+ *                  buffers in DKit that need to be sized at run-time. The
+ *                  block is mmap()-ed out of line, optionally on huge pages
+ *                  (MAP_HUGETLB, or transparent huge pages if those aren't
+ *                  reserved on the box), and is pre-faulted when it's made
+ *                  so that the first pass through the ring doesn't take a
+ *                  page fault on every new page. The memory is returned to
+ *                  the OS when the block is destroyed.
+ */
+#ifndef __DKIT_UTIL_RING_STORAGE_H
+#define __DKIT_UTIL_RING_STORAGE_H
+
+//	System Headers
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <stdexcept>
+
+//	Third-Party Headers
+
+//	Other Headers
+
+//	Forward Declarations
+
+//	Public Constants
+/**
+ * Not every platform calls the anonymous mapping the same thing, so make
+ * sure that we have the one we use.
+ */
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the main class definition.
+ */
+class ring_storage
+{
+	public:
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This constructor maps at least 'aBytes' of memory, and if asked
+		 * for, tries to put it on huge pages. First, we try for explicitly
+		 * reserved huge pages, and if there aren't any, we fall back to a
+		 * regular mapping and advise the kernel that we'd like transparent
+		 * huge pages for it. Either way, every page is touched before we
+		 * return, so the faults are all taken here, and not on the hot path.
+		 */
+		ring_storage( size_t aBytes, bool useHugePages = false ) :
+			_data(NULL),
+			_length(0),
+			_huge(false)
+		{
+			// round the request up to a whole number of pages
+			size_t	page = (size_t)sysconf(_SC_PAGESIZE);
+			_length = ((aBytes + page - 1) / page) * page;
+			if (_length == 0) {
+				_length = page;
+			}
+
+			#ifdef MAP_HUGETLB
+			if (useHugePages) {
+				// huge page mappings have to be a whole number of them
+				size_t	len = ((_length + eHugePage - 1) / eHugePage) * eHugePage;
+				void	*p = mmap(NULL, len, (PROT_READ | PROT_WRITE),
+								  (MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB), -1, 0);
+				if (p != MAP_FAILED) {
+					_data = p;
+					_length = len;
+					_huge = true;
+				}
+			}
+			#endif
+			// if we don't have the memory yet, get it the regular way
+			if (_data == NULL) {
+				void	*p = mmap(NULL, _length, (PROT_READ | PROT_WRITE),
+								  (MAP_PRIVATE | MAP_ANONYMOUS), -1, 0);
+				if (p == MAP_FAILED) {
+					throw std::runtime_error("[ring_storage] Unable to map the memory for the ring!");
+				}
+				_data = p;
+				#ifdef MADV_HUGEPAGE
+				if (useHugePages && (madvise(_data, _length, MADV_HUGEPAGE) == 0)) {
+					_huge = true;
+				}
+				#endif
+			}
+
+			// pre-fault every page by writing to it now
+			memset(_data, 0, _length);
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called. It hands the memory back to the OS.
+		 */
+		virtual ~ring_storage()
+		{
+			if (_data != NULL) {
+				munmap(_data, _length);
+				_data = NULL;
+			}
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns the start of the block of memory. It's
+		 * page-aligned, which is more than enough for any T we'll hold.
+		 */
+		void *data() const
+		{
+			return _data;
+		}
+
+
+		/**
+		 * This method returns the number of bytes actually mapped - which
+		 * will be at least what was asked for, rounded up to the page size.
+		 */
+		size_t length() const
+		{
+			return _length;
+		}
+
+
+		/**
+		 * This method returns 'true' if the block is on huge pages - either
+		 * reserved ones, or the kernel agreed to try for transparent ones.
+		 */
+		bool isHuge() const
+		{
+			return _huge;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * The rings that use this storage all mask their indexes, so they
+		 * need a power of two for their size. This method rounds up the
+		 * requested capacity to the next power of two - with a minimum of
+		 * two so that there's always room for at least one element.
+		 */
+		static size_t powerOfTwo( size_t aCapacity )
+		{
+			size_t	sz = 2;
+			while (sz < aCapacity) {
+				sz <<= 1;
+			}
+			return sz;
+		}
+
+
+	private:
+		/**
+		 * There's no sense in copying these blocks - the rings that use
+		 * them copy their elements, and not the memory itself.
+		 */
+		ring_storage( const ring_storage & anOther );
+		ring_storage & operator=( const ring_storage & anOther );
+
+		/**
+		 * This is the size of the huge pages we ask for with MAP_HUGETLB.
+		 */
+		enum {
+			eHugePage = (2 * 1024 * 1024)
+		};
+
+		// this is the mapped memory, and how much of it there is
+		void		*_data;
+		size_t		_length;
+		// ...and if it's on huge pages
+		bool		_huge;
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_RING_STORAGE_H
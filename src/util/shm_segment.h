@@ -0,0 +1,292 @@
+/**
+ * shm_segment.h - this file defines a named block of POSIX shared memory -
+ *                 shm_open() and mmap() - that more than one process can map
+ *                 at the same time, for the queues that go between processes.
+ *                 The first process makes it, and sizes it, and the others
+ *                 attach to it by name. It's mapped wherever each process's
+ *                 kernel likes, so anything put in it has to be addressed by
+ *                 offsets, and not pointers.
+ *
+ *                 The process that made the segment removes its name when
+ *                 it's done with it, but the memory stays around until the
+ *                 last process has unmapped it.
+ */
+#ifndef __DKIT_UTIL_SHM_SEGMENT_H
+#define __DKIT_UTIL_SHM_SEGMENT_H
+
+//	System Headers
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <string>
+
+//	Third-Party Headers
+
+//	Other Headers
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * We need to have a simple enum for the ways a process can get to a named
+ * segment - make it, and fail if it's there already, attach to one that
+ * someone else has made, or make it if no one has, and attach if they have.
+ */
+enum shm_mode {
+	shm_create = 0,
+	shm_attach,
+	shm_create_or_attach,
+};
+
+
+/**
+ * This is the header at the very start of a segment that holds one of
+ * the shared queues - so that a process attaching to it can tell that it
+ * holds what it thinks it does, laid out the way it expects. The one that
+ * makes it fills in the rest first, and sets the magic number last, with
+ * a release store, so no one sees a half-made queue.
+ */
+struct shm_header {
+	enum {
+		eMagic = 0x444b5351,		// 'DKSQ'
+		eVersion = 1
+	};
+
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	kind;
+	uint32_t	elemSize;
+	uint64_t	capacity;
+
+	/**
+	 * This method fills in the header for a queue of 'aKind', with
+	 * 'aCapacity' elements of 'anElemSize' bytes, and then publishes it.
+	 */
+	void publish( uint32_t aKind, uint32_t anElemSize, uint64_t aCapacity )
+	{
+		version = eVersion;
+		kind = aKind;
+		elemSize = anElemSize;
+		capacity = aCapacity;
+		__atomic_store_n(&magic, (uint32_t)eMagic, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * This method checks that the header is for the queue the caller
+	 * has in mind, and throws a std::runtime_error that says what's
+	 * wrong if it isn't.
+	 */
+	void verify( uint32_t aKind, uint32_t anElemSize, uint64_t aCapacity ) const
+	{
+		if (__atomic_load_n(&magic, __ATOMIC_ACQUIRE) != (uint32_t)eMagic) {
+			throw std::runtime_error("[shm_header] The segment doesn't hold an initialized queue!");
+		}
+		if (version != eVersion) {
+			throw std::runtime_error("[shm_header] The queue in the segment is another version!");
+		}
+		if (kind != aKind) {
+			throw std::runtime_error("[shm_header] The queue in the segment is another kind!");
+		}
+		if ((elemSize != anElemSize) || (capacity != aCapacity)) {
+			throw std::runtime_error("[shm_header] The queue in the segment is another size!");
+		}
+	}
+};
+
+
+/**
+ * This is the main class definition.
+ */
+class shm_segment
+{
+	public:
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This constructor gets to the segment named 'aName' - a leading
+		 * '/' is added if it's not there - as 'aMode' says. When it's
+		 * made here, it's sized to 'aBytes', and zero-filled. When it's
+		 * attached to, it's mapped at whatever size it is, and that has
+		 * to be at least 'aBytes'. If it can't be done, it throws a
+		 * std::runtime_error.
+		 */
+		shm_segment( const std::string & aName, size_t aBytes, shm_mode aMode = shm_create_or_attach ) :
+			_name(aName),
+			_data(NULL),
+			_length(0),
+			_created(false)
+		{
+			if ((_name.size() == 0) || (_name[0] != '/')) {
+				_name.insert(0, "/");
+			}
+
+			int		fd = -1;
+			if (aMode != shm_attach) {
+				fd = shm_open(_name.c_str(), (O_RDWR | O_CREAT | O_EXCL), 0600);
+				if (fd >= 0) {
+					_created = true;
+				} else if ((errno != EEXIST) || (aMode == shm_create)) {
+					throw std::runtime_error("[shm_segment] Unable to create the segment '" + _name + "'!");
+				}
+			}
+			if (fd < 0) {
+				fd = shm_open(_name.c_str(), O_RDWR, 0);
+				if (fd < 0) {
+					throw std::runtime_error("[shm_segment] Unable to attach to the segment '" + _name + "'!");
+				}
+			}
+
+			// size it if it's ours, or see how big it is if it's not
+			const char	*problem = NULL;
+			if (_created) {
+				_length = aBytes;
+				if (ftruncate(fd, (off_t)_length) != 0) {
+					problem = "[shm_segment] Unable to size the segment '";
+				}
+			} else {
+				struct stat		st;
+				if (fstat(fd, &st) != 0) {
+					problem = "[shm_segment] Unable to size up the segment '";
+				} else if ((st.st_size <= 0) || ((size_t)st.st_size < aBytes)) {
+					problem = "[shm_segment] Not enough room in the segment '";
+				} else {
+					_length = (size_t)st.st_size;
+				}
+			}
+			if (problem == NULL) {
+				void	*p = mmap(NULL, _length, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+				if (p == MAP_FAILED) {
+					problem = "[shm_segment] Unable to map the segment '";
+				} else {
+					_data = p;
+				}
+			}
+			// the mapping holds its own reference, so the descriptor can go
+			close(fd);
+			if (problem != NULL) {
+				if (_created) {
+					shm_unlink(_name.c_str());
+				}
+				throw std::runtime_error(problem + _name + "'!");
+			}
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called. It unmaps the segment, and if it was made here, removes
+		 * its name so that no one else can attach to it.
+		 */
+		virtual ~shm_segment()
+		{
+			if (_data != NULL) {
+				munmap(_data, _length);
+				_data = NULL;
+			}
+			if (_created) {
+				shm_unlink(_name.c_str());
+			}
+		}
+
+
+		/********************************************************
+		 *
+		 *                Accessor Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method returns the start of the segment, as it's mapped in
+		 * this process. It's page-aligned, but it's not at the same address
+		 * in any other process.
+		 */
+		void *data() const
+		{
+			return _data;
+		}
+
+
+		/**
+		 * This method returns the number of bytes in the segment.
+		 */
+		size_t length() const
+		{
+			return _length;
+		}
+
+
+		/**
+		 * This method returns the name of the segment - with its leading
+		 * '/' - that the other processes use to attach to it.
+		 */
+		const std::string & name() const
+		{
+			return _name;
+		}
+
+
+		/**
+		 * This method returns 'true' if the segment was made by this one,
+		 * and so it's up to us to set up what's in it.
+		 */
+		bool created() const
+		{
+			return _created;
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * When a process that made a segment dies without cleaning up, its
+		 * name is left behind, and this method removes it. It returns 'true'
+		 * if there was one to remove.
+		 */
+		static bool remove( const std::string & aName )
+		{
+			std::string		name(aName);
+			if ((name.size() == 0) || (name[0] != '/')) {
+				name.insert(0, "/");
+			}
+			return (shm_unlink(name.c_str()) == 0);
+		}
+
+
+	private:
+		/**
+		 * There's no sense in copying these - each one is a mapping of the
+		 * segment into this process, and another process makes its own.
+		 */
+		shm_segment( const shm_segment & anOther );
+		shm_segment & operator=( const shm_segment & anOther );
+
+		// this is the name of the segment, and where it is in this process
+		std::string		_name;
+		void			*_data;
+		size_t			_length;
+		// ...and if we made it
+		bool			_created;
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_SHM_SEGMENT_H
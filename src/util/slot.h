@@ -0,0 +1,181 @@
+/**
+ * slot.h - this file defines a simple, uninitialized, slot of storage for
+ *          a single T, and a few helpers for copying T's. The queues in DKit
+ *          use the slots so that a T is only constructed when it's pushed
+ *          onto the queue - and in place, if it's emplace()-ed - and it's
+ *          destroyed when it's popped. This means that T doesn't need a
+ *          default constructor, and it can be move-only.
+ *
+ *          Because the FIFO<T> methods are virtual, the copying forms of
+ *          push() and peek() are compiled for every T, and so they use the
+ *          copy helpers here, which throw a std::logic_error at run-time
+ *          if T can't be copied, rather than not compiling at all.
+ */
+#ifndef __DKIT_UTIL_SLOT_H
+#define __DKIT_UTIL_SLOT_H
+
+//	System Headers
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+//	Third-Party Headers
+
+//	Other Headers
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the copy helper for the slot - if T can be copied, it builds a
+ * copy in the raw storage, but if it can't, it throws a std::logic_error.
+ */
+template <class T> void copy_into( void *aPlace, const T & aValue, std::true_type )
+{
+	new (aPlace) T(aValue);
+}
+
+
+template <class T> void copy_into( void *aPlace, const T & aValue, std::false_type )
+{
+	throw std::logic_error("[util::copy_into] Unable to copy a move-only type!");
+}
+
+
+template <class T> void copy_into( void *aPlace, const T & aValue )
+{
+	copy_into(aPlace, aValue, typename std::is_copy_constructible<T>::type());
+}
+
+
+/**
+ * This is the main class definition. It's nothing more than properly
+ * aligned storage for a T, and the methods to build and destroy one in it.
+ * The slot doesn't know if it holds a T or not - that's up to the queue.
+ */
+template <class T> class slot
+{
+	public:
+		/**
+		 * This method constructs a T in the slot with the arguments given.
+		 * There had better not be a T in the slot already.
+		 */
+		template <class... Args> void construct( Args &&... args )
+		{
+			new (raw()) T(std::forward<Args>(args)...);
+		}
+
+
+		/**
+		 * This form of construct() makes a copy of the argument in the
+		 * slot - if T can be copied. If it can't, it throws. Because it's
+		 * not a template, it's picked over the one above for a const T&.
+		 */
+		void construct( const T & aValue )
+		{
+			copy_into(raw(), aValue);
+		}
+
+
+		/**
+		 * This method default-initializes a T in the slot - which, for a
+		 * plain struct, does nothing at all - and returns it, so that the
+		 * caller can fill it in right where it sits.
+		 */
+		T *construct_default()
+		{
+			return new (raw()) T;
+		}
+
+
+		/**
+		 * This method destroys the T in the slot. There had better be one.
+		 */
+		void destroy()
+		{
+			ref().~T();
+		}
+
+
+		/**
+		 * These methods return the T in the slot. There had better be one.
+		 */
+		T & ref()
+		{
+			return *reinterpret_cast<T *>(_bytes);
+		}
+
+
+		const T & ref() const
+		{
+			return *reinterpret_cast<const T *>(_bytes);
+		}
+
+
+		/**
+		 * This method returns the raw storage of the slot.
+		 */
+		void *raw()
+		{
+			return (void *)_bytes;
+		}
+
+
+	private:
+		// this is the storage - aligned for a T, but not a T
+		alignas(T) unsigned char	_bytes[sizeof(T)];
+};
+
+
+/**
+ * These are the copy helpers. If T can be copied, they do just that, but
+ * if it can't, they throw a std::logic_error. The first is for assigning
+ * a copy to an existing T, and the second returns a copy.
+ */
+template <class T> void copy_assign( T & aDest, const T & aValue, std::true_type )
+{
+	aDest = aValue;
+}
+
+
+template <class T> void copy_assign( T & aDest, const T & aValue, std::false_type )
+{
+	throw std::logic_error("[util::copy_assign] Unable to copy a move-only type!");
+}
+
+
+template <class T> void copy_assign( T & aDest, const T & aValue )
+{
+	copy_assign(aDest, aValue, typename std::is_copy_assignable<T>::type());
+}
+
+
+template <class T> T copy_of( const T & aValue, std::true_type )
+{
+	return T(aValue);
+}
+
+
+template <class T> T copy_of( const T & aValue, std::false_type )
+{
+	throw std::logic_error("[util::copy_of] Unable to copy a move-only type!");
+}
+
+
+template <class T> T copy_of( const T & aValue )
+{
+	return copy_of(aValue, typename std::is_copy_constructible<T>::type());
+}
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_SLOT_H
@@ -110,6 +110,28 @@ class timer
 		}
 
 
+		/**
+		 * When the intervals are shorter than a usec - like the time an
+		 * element sits in a queue - this is a RELATIVE timestamp in nsec.
+		 * It's on a monotonic clock, so it never steps back, but it's only
+		 * good for comparing with another of these.
+		 */
+		static inline uint64_t nsecStamp()
+		{
+			#ifdef __MACH__
+				static mach_timebase_info_data_t	__timebase;
+				if (__timebase.denom == 0) {
+					(void) mach_timebase_info(&__timebase);
+				}
+				return (mach_absolute_time() * __timebase.numer)/__timebase.denom;
+			#else
+				timespec	ts;
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				return ((uint64_t)ts.tv_sec * 1000000000LL + (uint64_t)ts.tv_nsec);
+			#endif
+		}
+
+
 		/**
 		 * This method takes a timestamp as usec since Epoch and formats
 		 * it into a nice, human-readable timestamp: '2012-02-12 11:34:15'
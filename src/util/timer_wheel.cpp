@@ -0,0 +1,252 @@
+/**
+ * timer_wheel.cpp - this file implements the hierarchical timing wheel for
+ *                   DKit. It's laid out like the classic one in the Linux
+ *                   kernel: each slot is a doubly-linked list of events, so
+ *                   putting one in, or taking one out, is just a few pointer
+ *                   moves, and the upper wheels are cascaded down into the
+ *                   lower ones as the first wheel comes around.
+ */
+
+//	System Headers
+#include <string.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "util/timer_wheel.h"
+
+//	Forward Declarations
+
+//	Private Constants
+
+//	Private Datatypes
+
+//	Private Data Constants
+
+
+namespace dkit {
+namespace util {
+/*******************************************************************
+ *
+ *                     Constructors/Destructor
+ *
+ *******************************************************************/
+/**
+ * This is the constructor that makes a wheel with ticks of 'aTickUSec',
+ * starting at 'aStart' - by default, right now.
+ */
+timer_wheel::timer_wheel( uint64_t aTickUSec, uint64_t aStart ) :
+	_tickUSec(aTickUSec > 0 ? aTickUSec : 1),
+	_start(aStart),
+	_now(0),
+	_pending(0),
+	_overflow(NULL),
+	_posted()
+{
+	memset(_wheels, 0, sizeof(_wheels));
+	memset(_counts, 0, sizeof(_counts));
+}
+
+
+/**
+ * This is the standard destructor and needs to be virtual to make sure
+ * that if we subclass off this the right destructor will be called. The
+ * events are the caller's, so all we do is unlink them.
+ */
+timer_wheel::~timer_wheel()
+{
+	for (uint32_t l = 0; l < eLevels; ++l) {
+		for (uint32_t s = 0; s < eSlots; ++s) {
+			while (_wheels[l][s] != NULL) {
+				unlink(_wheels[l][s]);
+			}
+		}
+	}
+	while (_overflow != NULL) {
+		unlink(_overflow);
+	}
+}
+
+
+/*******************************************************************
+ *
+ *                    Wheel Thread Methods
+ *
+ *******************************************************************/
+/**
+ * This method puts the event in the wheel to fire at the time 'aWhen' -
+ * rounded up to the next tick, and never on the tick the wheel is at. If
+ * it's already in the wheel, it's moved.
+ */
+void timer_wheel::schedule_at( event *anEvent, uint64_t aWhen )
+{
+	if (anEvent->scheduled()) {
+		unlink(anEvent);
+	}
+	uint64_t	tick = 0;
+	if (aWhen > _start) {
+		tick = (aWhen - _start + _tickUSec - 1) / _tickUSec;
+	}
+	anEvent->_tick = (tick > _now ? tick : _now + 1);
+	place(anEvent);
+}
+
+
+/**
+ * This method takes the event out of the wheel, and returns 'true' if it
+ * was there.
+ */
+bool timer_wheel::cancel( event *anEvent )
+{
+	if (!anEvent->scheduled()) {
+		return false;
+	}
+	unlink(anEvent);
+	return true;
+}
+
+
+/**
+ * This method takes in the posted events, and then moves the wheel on to
+ * the tick for 'aNow', firing the events as it goes. When the lower wheels
+ * are empty, nothing can fire until the next slot of the lowest one that
+ * isn't, so we jump to the tick just before that.
+ */
+size_t timer_wheel::advance( uint64_t aNow )
+{
+	size_t		retval = 0;
+	Posting		p;
+	while (_posted.pop(p)) {
+		schedule_at(p.what, p.when);
+	}
+
+	uint64_t	target = (aNow > _start ? (aNow - _start) / _tickUSec : 0);
+	while (_now < target) {
+		if (_pending == 0) {
+			_now = target;
+			break;
+		}
+		uint32_t	low = 0;
+		while (_counts[low] == 0) {
+			++low;
+		}
+		if (low > 0) {
+			uint64_t	last = _now | ((((uint64_t)1) << (eBits * low)) - 1);
+			if (last >= target) {
+				_now = target;
+				break;
+			}
+			_now = last;
+		}
+		// move to the next tick, and cascade what's coming due
+		++_now;
+		if ((_now & eMask) == 0) {
+			uint32_t	l = 1;
+			for (; l < eLevels; ++l) {
+				uint32_t	idx = (uint32_t)((_now >> (eBits * l)) & eMask);
+				cascade(&_wheels[l][idx]);
+				if (idx != 0) {
+					break;
+				}
+			}
+			if (l == eLevels) {
+				// the top wheel has come around - look at the overflow
+				cascade(&_overflow);
+			}
+		}
+		retval += expire();
+	}
+	return retval;
+}
+
+
+/*******************************************************************
+ *
+ *                        Private Methods
+ *
+ *******************************************************************/
+/**
+ * This method links the event into the slot of the lowest wheel that
+ * spans its tick - or the overflow list, if none of them do. The tick is
+ * never before the one the wheel is at.
+ */
+void timer_wheel::place( event *anEvent )
+{
+	uint64_t	delta = anEvent->_tick - _now;
+	uint32_t	l = 0;
+	while ((l < eLevels) && (delta >= (((uint64_t)1) << (eBits * (l + 1))))) {
+		++l;
+	}
+	event	**list = &_overflow;
+	if (l < eLevels) {
+		list = &_wheels[l][(anEvent->_tick >> (eBits * l)) & eMask];
+	}
+	anEvent->_level = l;
+	anEvent->_next = *list;
+	if (*list != NULL) {
+		(*list)->_pprev = &anEvent->_next;
+	}
+	anEvent->_pprev = list;
+	*list = anEvent;
+	++_counts[l];
+	++_pending;
+}
+
+
+/**
+ * This method unlinks the event from whatever list it's in.
+ */
+void timer_wheel::unlink( event *anEvent )
+{
+	*anEvent->_pprev = anEvent->_next;
+	if (anEvent->_next != NULL) {
+		anEvent->_next->_pprev = anEvent->_pprev;
+	}
+	anEvent->_next = NULL;
+	anEvent->_pprev = NULL;
+	--_counts[anEvent->_level];
+	--_pending;
+}
+
+
+/**
+ * This method places everything in the list again, for where the wheel
+ * is now. The list is taken off its head first, so that nothing that
+ * lands back in the same list - in the overflow - is looked at twice.
+ */
+void timer_wheel::cascade( event **aList )
+{
+	event	*e = *aList;
+	*aList = NULL;
+	while (e != NULL) {
+		event	*next = e->_next;
+		--_counts[e->_level];
+		--_pending;
+		place(e);
+		e = next;
+	}
+}
+
+
+/**
+ * This method fires everything in the first wheel's slot for this tick.
+ * Each event is unlinked before it fires, so that it can schedule itself
+ * again, or cancel any of the others still waiting to fire on this tick.
+ * Nothing scheduled now can land back in this slot - it would be 256
+ * ticks out, and that's in the next wheel up.
+ */
+size_t timer_wheel::expire()
+{
+	size_t		retval = 0;
+	event		**slot = &_wheels[0][_now & eMask];
+	uint64_t	when = now();
+	while (*slot != NULL) {
+		event	*e = *slot;
+		unlink(e);
+		e->fire(when);
+		++retval;
+	}
+	return retval;
+}
+}		// end of namespace util
+}		// end of namespace dkit
@@ -0,0 +1,271 @@
+/**
+ * timer_wheel.h - this file defines a hierarchical timing wheel for DKit -
+ *                 a way to have a great many timers pending, and to fire
+ *                 them as their time comes, with a constant cost to add one,
+ *                 cancel one, or move the clock on by a tick - no matter how
+ *                 many there are. Time is in ticks of a fixed number of usec
+ *                 on the util::timer's usecStamp() clock.
+ *
+ *                 There are four wheels of 256 slots. The first has a slot
+ *                 for each of the next 256 ticks, the second a slot for each
+ *                 of the next 256 runs of 256 ticks, and so on. A timer goes
+ *                 in the wheel that spans its time, and as the clock gets to
+ *                 each slot in an upper wheel, the timers in it are moved down
+ *                 to where they now belong - so each one is moved, at most,
+ *                 three times. Those more than 2^32 ticks out wait in a list
+ *                 that's looked at each time the top wheel comes around.
+ *
+ *                 All the work is done on the one thread that owns the wheel
+ *                 and calls advance() - that's where the timers fire. Other
+ *                 threads post() their timers to an MPSC queue, and they're
+ *                 put in the wheel at the start of the next advance().
+ */
+#ifndef __DKIT_UTIL_TIMER_WHEEL_H
+#define __DKIT_UTIL_TIMER_WHEEL_H
+
+//	System Headers
+#include <stddef.h>
+#include <stdint.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "mpsc/LinkedFIFO.h"
+#include "util/timer.h"
+
+//	Forward Declarations
+
+//	Public Constants
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the main class definition.
+ */
+class timer_wheel
+{
+	public:
+		/**
+		 * This is the base class for a timer - subclass it and implement
+		 * fire(). The wheel doesn't own it, and it links it in place, so
+		 * it has to stay alive while it's scheduled. It can be scheduled
+		 * again - even from its own fire() - and scheduling one that's
+		 * already pending just moves it.
+		 */
+		class event
+		{
+			public:
+				event() : _next(NULL), _pprev(NULL), _tick(0), _level(0) { }
+				virtual ~event() { }
+
+				/**
+				 * This is called on the wheel's thread when the time comes.
+				 * 'aNow' is the time the wheel was advanced to.
+				 */
+				virtual void fire( uint64_t aNow ) = 0;
+
+				/**
+				 * This method returns 'true' if the event is in the wheel.
+				 */
+				bool scheduled() const
+				{
+					return (_pprev != NULL);
+				}
+
+			private:
+				// this is the link in the slot's list, the tick it's due,
+				// and the wheel it's in - or the overflow list
+				event		*_next;
+				event		**_pprev;
+				uint64_t	_tick;
+				uint32_t	_level;
+
+				friend class timer_wheel;
+		};
+
+		/*******************************************************************
+		 *
+		 *                     Constructors/Destructor
+		 *
+		 *******************************************************************/
+		/**
+		 * This is the constructor that makes a wheel with ticks of
+		 * 'aTickUSec', starting at 'aStart' - by default, right now.
+		 */
+		timer_wheel( uint64_t aTickUSec = 1000, uint64_t aStart = timer::usecStamp() );
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called. Any events still in the wheel are just unlinked.
+		 */
+		virtual ~timer_wheel();
+
+
+		/*******************************************************************
+		 *
+		 *                        Accessor Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * These methods return the length of a tick, and the time - on
+		 * the usecStamp() clock - that the wheel has been advanced to.
+		 */
+		uint64_t tickUSec() const
+		{
+			return _tickUSec;
+		}
+
+
+		uint64_t now() const
+		{
+			return (_start + _now * _tickUSec);
+		}
+
+
+		/**
+		 * This method returns the number of events in the wheel - not
+		 * counting those posted, and not yet taken in by advance().
+		 */
+		size_t pending() const
+		{
+			return _pending;
+		}
+
+
+		/*******************************************************************
+		 *
+		 *                    Wheel Thread Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * These methods put the event in the wheel to fire 'aDelayUSec'
+		 * from the time the wheel is at, or at the time 'aWhen'. It never
+		 * fires early - it's rounded up to the next tick - and if its time
+		 * has passed, it fires on the next tick. They are ONLY to be called
+		 * on the wheel's thread.
+		 */
+		void schedule( event *anEvent, uint64_t aDelayUSec )
+		{
+			schedule_at(anEvent, now() + aDelayUSec);
+		}
+
+
+		void schedule_at( event *anEvent, uint64_t aWhen );
+
+
+		/**
+		 * This method takes the event out of the wheel, and returns 'true'
+		 * if it was there. One that's been posted, and not yet taken in by
+		 * advance(), isn't in the wheel. It's ONLY to be called on the
+		 * wheel's thread.
+		 */
+		bool cancel( event *anEvent );
+
+
+		/**
+		 * This method takes in the events that have been posted, and then
+		 * moves the wheel on, a tick at a time, up to 'aNow', firing the
+		 * events as their time comes. Runs of ticks where there's nothing
+		 * in the lower wheels are skipped right over. It returns the number
+		 * fired. It's
+		 * ONLY to be called on the wheel's thread - and it's the one that
+		 * owns the wheel that calls it.
+		 */
+		size_t advance( uint64_t aNow = timer::usecStamp() );
+
+
+		/*******************************************************************
+		 *
+		 *                     Any Thread Methods
+		 *
+		 *******************************************************************/
+		/**
+		 * These methods are for the threads other than the wheel's. The
+		 * event is queued, and put in the wheel at the next advance(), as
+		 * if schedule_at() were called then. The event can't be touched
+		 * by this thread again until it's fired.
+		 */
+		void post( event *anEvent, uint64_t aDelayUSec )
+		{
+			post_at(anEvent, timer::usecStamp() + aDelayUSec);
+		}
+
+
+		void post_at( event *anEvent, uint64_t aWhen )
+		{
+			_posted.push(Posting(anEvent, aWhen));
+		}
+
+	private:
+		/**
+		 * These are the sizes of the wheels - four of them, of 256 slots.
+		 */
+		enum {
+			eBits = 8,
+			eSlots = (1 << eBits),
+			eMask = (eSlots - 1),
+			eLevels = 4
+		};
+
+		/**
+		 * This is what's on the queue for an event posted by another
+		 * thread - the event, and when it's to fire.
+		 */
+		struct Posting {
+			event		*what;
+			uint64_t	when;
+
+			Posting() : what(NULL), when(0) { }
+			Posting( event *anEvent, uint64_t aWhen ) : what(anEvent), when(aWhen) { }
+		};
+
+		/**
+		 * These methods link the event into the list it belongs in for
+		 * its tick, and unlink it from whatever list it's on.
+		 */
+		void place( event *anEvent );
+		void unlink( event *anEvent );
+
+		/**
+		 * This method takes everything out of the list and places it again
+		 * - moving it down a wheel, or two - as the clock gets to it.
+		 */
+		void cascade( event **aList );
+
+		/**
+		 * This method fires everything in the first wheel's slot for the
+		 * tick the wheel is at, and returns how many there were.
+		 */
+		size_t expire();
+
+		/**
+		 * There's no sense in copying these - the events point into it.
+		 */
+		timer_wheel( const timer_wheel & anOther );
+		timer_wheel & operator=( const timer_wheel & anOther );
+
+		// this is the size of a tick, and the time of tick 0
+		uint64_t					_tickUSec;
+		uint64_t					_start;
+		// ...this is the tick the wheel has been advanced to
+		uint64_t					_now;
+		size_t						_pending;
+		// ...these are the wheels, and the list of those past them, with
+		// the count of what's in each - the overflow list is the last
+		event						*_wheels[eLevels][eSlots];
+		event						*_overflow;
+		size_t						_counts[eLevels + 1];
+		// ...and this is where the other threads post their events
+		mpsc::LinkedFIFO<Posting>	_posted;
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_TIMER_WHEEL_H
@@ -0,0 +1,239 @@
+/**
+ * waiter.h - this file defines the ways a thread can wait on a queue that
+ *            it can't use right now - a consumer on an empty queue, or a
+ *            producer on a full one. The wait_type picks the strategy: just
+ *            spin with the CPU's 'pause', spin a while and then yield the
+ *            CPU, or spin a while and then park on a futex until the other
+ *            side wakes us. The other side only makes the system call to
+ *            wake us when there's someone parked, so the cost of parking is
+ *            only paid when it's needed.
+ */
+#ifndef __DKIT_UTIL_WAITER_H
+#define __DKIT_UTIL_WAITER_H
+
+//	System Headers
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "util/timer.h"
+
+//	Forward Declarations
+
+//	Public Constants
+/**
+ * We need to have a simple enum for the different ways that a thread can
+ * wait on a queue. The spin_wait burns a core for the lowest latency, the
+ * yield_wait is nicer to the other threads on the box, and the park_wait
+ * sleeps cheaply in the kernel until it's woken up.
+ */
+#ifndef __DKIT_WAIT_TYPE
+#define __DKIT_WAIT_TYPE
+namespace dkit {
+enum wait_type {
+	spin_wait = 0,
+	yield_wait,
+	park_wait,
+};
+}		// end of namespace dkit
+#endif	// __DKIT_WAIT_TYPE
+
+//	Public Datatypes
+
+//	Public Data Constants
+
+
+namespace dkit {
+namespace util {
+/**
+ * This is the main class definition. One of these is used for each of the
+ * two things a thread can wait for on a queue - something to pop, or room
+ * to push - and the thread that makes that happen calls wake() on it.
+ */
+template <wait_type W> class waiter
+{
+	public:
+		/********************************************************
+		 *
+		 *                Constructors/Destructor
+		 *
+		 ********************************************************/
+		/**
+		 * This is the default constructor that makes a waiter with no
+		 * one waiting on it.
+		 */
+		waiter() :
+			_epoch(0),
+			_waiters(0)
+		{
+		}
+
+
+		/**
+		 * This is the standard destructor and needs to be virtual to make
+		 * sure that if we subclass off this the right destructor will be
+		 * called.
+		 */
+		virtual ~waiter()
+		{
+		}
+
+
+		/********************************************************
+		 *
+		 *                Waiting Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This method is called by a thread that just tried to use the
+		 * queue and couldn't. For the first 'eSpins' times, it just does
+		 * a 'pause' - and the spin_wait never does anything else. After
+		 * that, this returns 'false' to say it's time to yield, or park,
+		 * as the strategy dictates.
+		 */
+		bool spin( uint32_t & aSpins )
+		{
+			if ((W == spin_wait) || (aSpins < eSpins)) {
+				++aSpins;
+				pause();
+				return true;
+			}
+			return false;
+		}
+
+
+		/**
+		 * This method gives up the CPU for the yield_wait strategy, and
+		 * for the park_wait strategy on a platform with no futexes.
+		 */
+		void yield()
+		{
+			sched_yield();
+		}
+
+
+		/**
+		 * Parking is a three-step dance so that a wake() can't be lost.
+		 * First, the thread enlists as a waiter and gets the current epoch.
+		 * Then it tries the queue one more time - because a producer
+		 * may have pushed before it saw us enlist. Only then does it park,
+		 * and if the epoch has moved on, the kernel won't put us to sleep.
+		 * Finally, it delists, regardless of how the park ended.
+		 */
+		int32_t enlist()
+		{
+			__atomic_add_fetch(&_waiters, 1, __ATOMIC_SEQ_CST);
+			return __atomic_load_n(&_epoch, __ATOMIC_SEQ_CST);
+		}
+
+
+		void delist()
+		{
+			__atomic_sub_fetch(&_waiters, 1, __ATOMIC_SEQ_CST);
+		}
+
+
+		/**
+		 * This method parks the calling thread until the epoch moves
+		 * past 'anEpoch', or the deadline - in usec on the timer's
+		 * usecStamp() clock - passes. A deadline of 0 means forever.
+		 * There are spurious wake-ups, so the caller needs to look at
+		 * the queue again in any case.
+		 */
+		void park( int32_t anEpoch, uint64_t aDeadline )
+		{
+			#ifdef __linux__
+			timespec	ts;
+			timespec	*tsp = NULL;
+			if (aDeadline != 0) {
+				uint64_t	now = timer::usecStamp();
+				uint64_t	left = (aDeadline > now ? aDeadline - now : 0);
+				ts.tv_sec = left / 1000000LL;
+				ts.tv_nsec = (left % 1000000LL) * 1000LL;
+				tsp = &ts;
+			}
+			syscall(SYS_futex, &_epoch, FUTEX_WAIT_PRIVATE, anEpoch, tsp, NULL, 0);
+			#else
+			// without a futex, the best we can do is a very short nap
+			if (__atomic_load_n(&_epoch, __ATOMIC_ACQUIRE) == anEpoch) {
+				usleep(50);
+			}
+			#endif
+		}
+
+
+		/**
+		 * This method is called by the thread that just made it possible
+		 * for a waiter to go on. It's only the park_wait strategy that
+		 * needs to do anything, and then only if there's a thread parked.
+		 * The fence makes sure that the push, or pop, that's just been
+		 * done is seen before we look for waiters - and that pairs with
+		 * the enlist() of the waiter, and its last look at the queue.
+		 */
+		void wake()
+		{
+			if (W == park_wait) {
+				__atomic_thread_fence(__ATOMIC_SEQ_CST);
+				if (__atomic_load_n(&_waiters, __ATOMIC_RELAXED) > 0) {
+					__atomic_add_fetch(&_epoch, 1, __ATOMIC_SEQ_CST);
+					#ifdef __linux__
+					syscall(SYS_futex, &_epoch, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+					#endif
+				}
+			}
+		}
+
+
+		/********************************************************
+		 *
+		 *                Utility Methods
+		 *
+		 ********************************************************/
+		/**
+		 * This is the CPU's hint that we're in a spin-wait loop - it saves
+		 * power, and keeps us from flooding the memory bus with reads.
+		 */
+		static inline void pause()
+		{
+			#if defined(__i386__) || defined(__x86_64__)
+			__builtin_ia32_pause();
+			#elif defined(__aarch64__)
+			__asm__ __volatile__ ("yield");
+			#endif
+		}
+
+
+	private:
+		/**
+		 * There's no sense in copying these - the threads waiting on one
+		 * have no interest in a copy.
+		 */
+		waiter( const waiter<W> & anOther );
+		waiter & operator=( const waiter<W> & anOther );
+
+		/**
+		 * This is how many times we spin before we yield, or park.
+		 */
+		enum {
+			eSpins = 100
+		};
+
+		// this is the futex word the parked threads sleep on
+		volatile int32_t	_epoch;
+		// ...and this is how many of them there are right now
+		volatile int32_t	_waiters;
+};
+}		// end of namespace util
+}		// end of namespace dkit
+
+#endif		// __DKIT_UTIL_WAITER_H
@@ -0,0 +1,426 @@
+/**
+ * This is the tests for the adaptive trie - that it does all the dense
+ * trie does, that its nodes grow through all four sizes and shrink back
+ * as the children come and go, that readers never miss a value that's
+ * there while a writer is changing the nodes around them, and then what
+ * it saves in memory on sparse keys, against the dense one.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <stdlib.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "trie.h"
+#include "util/timer.h"
+
+
+class blob {
+	public:
+		blob() : _when(0) { }
+		blob(uint64_t aWhen) : _when(aWhen) { }
+		virtual ~blob() { }
+		void setValue(uint64_t aValue) { _when = aValue; }
+		uint64_t getValue() const { return _when; }
+	private:
+		uint64_t		_when;
+};
+
+uint64_t key_value( const blob *aValue )
+{
+	return (*aValue).getValue();
+}
+
+typedef dkit::trie<blob *, dkit::uint64_key, dkit::adaptive_trie>	adaptive_t;
+typedef dkit::trie<blob *, dkit::uint64_key>						dense_t;
+typedef dkit::trie<blob *, dkit::uint128_key, dkit::adaptive_trie>	wide_t;
+
+/**
+ * The functor is the same for both kinds of trie - so this counts either.
+ */
+class counter : public dense_t::functor
+{
+	public:
+		counter() : _cnt(0) { }
+		virtual ~counter() { }
+		virtual bool process( volatile dense_t::Node & aNode )
+		{
+			++_cnt;
+			return true;
+		}
+		uint64_t getCount() { return _cnt; }
+	private:
+		uint64_t	_cnt;
+};
+
+
+/**
+ * This returns the bytes the heap has handed out right now - both the
+ * small blocks and the big, mapped, ones.
+ */
+size_t heap_in_use()
+{
+	struct mallinfo2	mi = mallinfo2();
+	return (mi.uordblks + mi.hblkhd);
+}
+
+
+/**
+ * This reclaims all that's been retired to the epoch, so that what's
+ * freed later on doesn't throw off the measuring of the heap. The
+ * pending() count is only this thread's, and the threads of the tests
+ * before may have left some behind, so it moves the epoch on enough
+ * times for all of it to be safe, whatever pending() says.
+ */
+void settle()
+{
+	for (uint32_t i = 0; i < 10; ++i) {
+		dkit::util::epoch::collect();
+	}
+}
+
+
+/**
+ * This is a 64-bit random number - spread over all the bytes of the key.
+ */
+uint64_t random_key()
+{
+	return (((uint64_t)random() << 33) ^ ((uint64_t)random() << 11) ^ (uint64_t)random());
+}
+
+
+/**
+ * This puts 'aCount' keys into the trie - 'aBase' plus each of them times
+ * 'aStride' - and checks that they are all there, and that a key between
+ * them isn't. Then it takes them out, one by one, checking that the rest
+ * are still there as it goes - which shrinks the node back down.
+ */
+bool grow_and_shrink( uint64_t aBase, uint64_t aStride, uint16_t aCount, const std::string & aName )
+{
+	bool		error = false;
+	adaptive_t	m;
+	for (uint16_t i = 0; i < aCount; ++i) {
+		m.put(new blob(aBase + i * aStride));
+	}
+	if (m.size() != aCount) {
+		error = true;
+		std::cout << "ERROR - " << aName << " has " << m.size() << " values, not " << aCount << "!" << std::endl;
+	}
+	blob	*bp = NULL;
+	for (uint16_t i = 0; !error && (i < aCount); ++i) {
+		if (!m.get(aBase + i * aStride, bp) || (bp->getValue() != aBase + i * aStride)) {
+			error = true;
+			std::cout << "ERROR - " << aName << " lost key " << (aBase + i * aStride) << "!" << std::endl;
+		}
+	}
+	if (!error && (aStride > 1) && m.exists(aBase + 1)) {
+		error = true;
+		std::cout << "ERROR - " << aName << " has a key that was never put!" << std::endl;
+	}
+	for (uint16_t i = 0; !error && (i < aCount); ++i) {
+		if (!m.remove(aBase + i * aStride, bp)) {
+			error = true;
+			std::cout << "ERROR - " << aName << " couldn't remove key " << (aBase + i * aStride) << "!" << std::endl;
+			break;
+		}
+		delete bp;
+		// every so often, make sure the rest made it through the shrink
+		if ((i % 8) == 0) {
+			for (uint16_t j = i + 1; j < aCount; ++j) {
+				if (!m.exists(aBase + j * aStride)) {
+					error = true;
+					std::cout << "ERROR - " << aName << " lost key " << (aBase + j * aStride)
+							  << " after removing " << (i + 1) << "!" << std::endl;
+					break;
+				}
+			}
+		}
+	}
+	if (!error && !m.empty()) {
+		error = true;
+		std::cout << "ERROR - " << aName << " isn't empty after removing them all!" << std::endl;
+	}
+	if (!error) {
+		std::cout << "Passed - " << aName << " grew to " << aCount << " and shrank back" << std::endl;
+	}
+	return !error;
+}
+
+
+/**
+ * These are the threads for the concurrent test - the readers keep
+ * looking for the keys that are always there, while the writer puts,
+ * and takes out, keys next to them, so the nodes they are reading are
+ * being copied, and swapped, the whole time.
+ */
+static volatile bool	__done = false;
+static volatile bool	__missed = false;
+
+void reader( adaptive_t *aTrie, uint64_t aCount, uint64_t *aReads )
+{
+	uint64_t	reads = 0;
+	blob		*bp = NULL;
+	while (!__done) {
+		for (uint64_t k = 0; k < aCount; ++k) {
+			uint64_t	key = k * 4;
+			if (!aTrie->get(key, bp) || (bp->getValue() != key)) {
+				__missed = true;
+			}
+			++reads;
+		}
+	}
+	*aReads = reads;
+}
+
+void writer( adaptive_t *aTrie, uint64_t aCount, uint32_t aPasses )
+{
+	blob	*bp = NULL;
+	for (uint32_t p = 0; p < aPasses; ++p) {
+		for (uint64_t k = 0; k < aCount; ++k) {
+			aTrie->put(new blob(k * 4 + 1));
+			aTrie->put(new blob(k * 4 + 2));
+		}
+		for (uint64_t k = 0; k < aCount; ++k) {
+			if (aTrie->remove(k * 4 + 1, bp)) {
+				delete bp;
+			}
+			aTrie->clear(k * 4 + 2);
+		}
+	}
+	__done = true;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, the same things the dense trie does
+	 */
+	if (!error) {
+		std::cout << "=== Testing the adaptive trie API ===" << std::endl;
+		adaptive_t	m;
+		uint64_t	cnt = 65535;
+		for (uint64_t i = 0; i < cnt; ++i) {
+			m.put(new blob(i));
+		}
+		if (m.size() != cnt) {
+			error = true;
+			std::cout << "ERROR - the trie has " << m.size() << " values, and it should have " << cnt << "!" << std::endl;
+		}
+		blob	*bp = NULL;
+		for (uint64_t i = 0; !error && (i < cnt); ++i) {
+			if (!m.get(i, bp) || (bp->getValue() != i)) {
+				error = true;
+				std::cout << "ERROR - failed to get key=" << i << "!" << std::endl;
+			}
+		}
+		if (!error) {
+			if (m.upsert(new blob(10)) && !m.upsert(new blob(cnt)) && (m.size() == cnt + 1)) {
+				std::cout << "Passed - upsert tells an update from an insert" << std::endl;
+			} else {
+				error = true;
+				std::cout << "ERROR - upsert got an update and an insert wrong!" << std::endl;
+			}
+		}
+		if (!error) {
+			counter		c;
+			m.apply(c);
+			if (c.getCount() == cnt + 1) {
+				std::cout << "Passed - apply() saw all " << c.getCount() << " values" << std::endl;
+			} else {
+				error = true;
+				std::cout << "ERROR - apply() saw " << c.getCount() << " values, not " << (cnt + 1) << "!" << std::endl;
+			}
+		}
+		if (!error) {
+			bool	ok = true;
+			for (uint64_t i = 0; i < cnt; i += 2) {
+				if (m.remove(i, bp)) {
+					ok = ok && (bp->getValue() == i);
+					delete bp;
+				} else {
+					ok = false;
+				}
+			}
+			ok = ok && !m.exists((uint64_t)0) && m.exists((uint64_t)1) && !m.remove((uint64_t)0, bp);
+			ok = ok && m.clear((uint64_t)1) && !m.exists((uint64_t)1) && !m.clear((uint64_t)1);
+			ok = ok && (m.size() == cnt / 2);
+			if (ok) {
+				std::cout << "Passed - remove() and clear(key) took out what they should" << std::endl;
+			} else {
+				error = true;
+				std::cout << "ERROR - the trie has " << m.size() << " values after removing, not " << (cnt / 2) << "!" << std::endl;
+			}
+		}
+		if (!error) {
+			m.clear();
+			if (m.empty() && !m.exists((uint64_t)3)) {
+				m.put(new blob(3));
+				if (m.exists((uint64_t)3) && (m.size() == 1)) {
+					std::cout << "Passed - clear() emptied the trie, and it's still usable" << std::endl;
+				} else {
+					error = true;
+					std::cout << "ERROR - the trie wasn't usable after clear()!" << std::endl;
+				}
+			} else {
+				error = true;
+				std::cout << "ERROR - clear() didn't empty the trie!" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * A key narrower than the trie's is the same key, zero-extended -
+	 * whichever width it's looked up with, and in a uint128_key trie,
+	 * where even the uint64_t from key_value() is the narrow one.
+	 */
+	if (!error) {
+		std::cout << "=== Testing keys narrower than the trie's ===" << std::endl;
+		adaptive_t	m;
+		wide_t		w;
+		uint64_t	cnt = 1000;
+		for (uint64_t i = 0; i < cnt; ++i) {
+			m.put(new blob(i * 61));
+			w.put(new blob(i * 61));
+		}
+		blob	*bp = NULL;
+		bool	ok = (m.size() == cnt) && (w.size() == cnt);
+		for (uint64_t i = 0; ok && (i < cnt); ++i) {
+			uint16_t	k16 = (uint16_t)(i * 61);
+			uint32_t	k32 = (uint32_t)(i * 61);
+			ok = m.get(k16, bp) && (bp->getValue() == i * 61) && m.exists(k16) &&
+				 m.get(k32, bp) && (bp->getValue() == i * 61) && m.exists(k32) &&
+				 w.get(k16, bp) && (bp->getValue() == i * 61) && w.exists(k32) &&
+				 w.get(i * 61, bp) && (bp->getValue() == i * 61) &&
+				 !m.exists((uint16_t)(i * 61 + 1)) && !w.exists((uint32_t)(i * 61 + 1));
+		}
+		if (ok) {
+			ok = m.remove((uint16_t)61, bp) && (bp->getValue() == 61) && !m.exists((uint64_t)61) &&
+				 m.clear((uint32_t)122) && !m.exists((uint64_t)122) &&
+				 w.clear((uint16_t)183) && !w.exists((uint64_t)183) && (m.size() == cnt - 2);
+			delete bp;
+		}
+		if (ok) {
+			std::cout << "Passed - the uint16_t, uint32_t and uint64_t keys found the same values" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - a narrow key didn't find the value that's there!" << std::endl;
+		}
+	}
+
+	/**
+	 * Next, make one node go through all the sizes - first at the last
+	 * level, where the children are the values, and then at the top,
+	 * where they're nodes. The first byte of the key in memory picks the
+	 * child of the root, so on this box, that's the low byte.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the growing and shrinking of nodes ===" << std::endl;
+		error = !grow_and_shrink(0x1234567800000000ULL, (1ULL << 56), 256, "the leaf-level node") || error;
+		error = !grow_and_shrink(0x7700, 1, 256, "the root node") || error;
+		error = !grow_and_shrink(0x55, (1ULL << 24), 40, "a mid-level node") || error;
+	}
+
+	/**
+	 * Then hammer it - readers after the keys that stay, and a writer
+	 * adding, and taking out, the ones around them.
+	 */
+	if (!error) {
+		std::cout << "=== Testing readers with a writer changing the nodes ===" << std::endl;
+		adaptive_t	m;
+		uint64_t	cnt = 4096;
+		for (uint64_t k = 0; k < cnt; ++k) {
+			m.put(new blob(k * 4));
+		}
+		uint64_t			reads[2] = { 0, 0 };
+		boost::thread		r1(reader, &m, cnt, &reads[0]);
+		boost::thread		r2(reader, &m, cnt, &reads[1]);
+		boost::thread		w(writer, &m, cnt, 20);
+		w.join();
+		r1.join();
+		r2.join();
+		if (__missed) {
+			error = true;
+			std::cout << "ERROR - a reader missed a value that was always there!" << std::endl;
+		} else if (m.size() != cnt) {
+			error = true;
+			std::cout << "ERROR - the trie has " << m.size() << " values after the writer, not " << cnt << "!" << std::endl;
+		} else {
+			std::cout << "Passed - " << (reads[0] + reads[1]) << " reads never missed, while the writer churned" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, what it costs in memory, and time, on sparse keys
+	 */
+	if (!error) {
+		std::cout << "=== Comparing the dense and adaptive tries on sparse keys ===" << std::endl;
+		uint32_t				cnt = 2000;
+		std::vector<uint64_t>	keys;
+		srandom(42);
+		for (uint32_t i = 0; i < cnt; ++i) {
+			keys.push_back(random_key());
+		}
+
+		settle();
+		size_t		base = heap_in_use();
+		dense_t		*d = new dense_t();
+		for (uint32_t i = 0; i < cnt; ++i) {
+			d->put(new blob(keys[i]));
+		}
+		size_t		denseBytes = heap_in_use() - base;
+
+		settle();
+		base = heap_in_use();
+		adaptive_t	*a = new adaptive_t();
+		for (uint32_t i = 0; i < cnt; ++i) {
+			a->put(new blob(keys[i]));
+		}
+		settle();
+		size_t		adaptiveBytes = heap_in_use() - base;
+
+		blob		*bp = NULL;
+		uint32_t	passes = 50;
+		uint64_t	denseTime = dkit::util::timer::usecStamp();
+		for (uint32_t p = 0; p < passes; ++p) {
+			for (uint32_t i = 0; i < cnt; ++i) {
+				d->get(keys[i], bp);
+			}
+		}
+		denseTime = dkit::util::timer::usecStamp() - denseTime;
+		uint64_t	adaptiveTime = dkit::util::timer::usecStamp();
+		for (uint32_t p = 0; p < passes; ++p) {
+			for (uint32_t i = 0; i < cnt; ++i) {
+				if (!a->get(keys[i], bp) || (bp->getValue() != keys[i])) {
+					error = true;
+				}
+			}
+		}
+		adaptiveTime = dkit::util::timer::usecStamp() - adaptiveTime;
+
+		std::cout << "dense trie: " << (denseBytes / cnt) << " bytes/key, "
+				  << (1000.0 * denseTime / (passes * cnt)) << " nsec/get" << std::endl;
+		std::cout << "adaptive trie: " << (adaptiveBytes / cnt) << " bytes/key, "
+				  << (1000.0 * adaptiveTime / (passes * cnt)) << " nsec/get" << std::endl;
+		if (error) {
+			std::cout << "ERROR - the adaptive trie lost a random key!" << std::endl;
+		} else if (adaptiveBytes * 10 > denseBytes) {
+			error = true;
+			std::cout << "ERROR - the adaptive trie isn't a tenth the size of the dense one!" << std::endl;
+		} else {
+			std::cout << "Passed - the adaptive trie is " << (denseBytes / adaptiveBytes)
+					  << "x smaller on sparse keys" << std::endl;
+		}
+		delete d;
+		delete a;
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
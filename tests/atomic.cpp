@@ -6,9 +6,50 @@
 #include <string>
 
 //	Third-Party Headers
+#include <boost/thread.hpp>
 
 //	Other Headers
 #include "atomic.h"
+#include "util/timer.h"
+
+/**
+ * This is a thread that bumps the counter it's given 'count' times - and
+ * takes one back every fourth time, so the cells don't all just go up.
+ */
+template <class C> struct Bumper {
+	C			*counter;
+	int64_t		count;
+
+	void operator()()
+	{
+		for (int64_t i = 0; i < count; ++i) {
+			++(*counter);
+			if ((i & 0x03) == 0) {
+				--(*counter);
+			}
+		}
+	}
+};
+
+
+/**
+ * This runs four Bumpers on the counter at once, and returns the time,
+ * in usec, that it took.
+ */
+template <class C> uint64_t hammer( C & aCounter, int64_t aCount )
+{
+	Bumper<C>	b;
+	b.counter = &aCounter;
+	b.count = aCount;
+	uint64_t	start = dkit::util::timer::usecStamp();
+	boost::thread_group	thrs;
+	for (int i = 0; i < 4; ++i) {
+		thrs.create_thread(b);
+	}
+	thrs.join_all();
+	return (dkit::util::timer::usecStamp() - start);
+}
+
 
 int main(int argc, char *argv[]) {
 	bool	error = false;
@@ -152,6 +193,41 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	/**
+	 * Check the sharded counter - the simple operations on one thread,
+	 * and then four threads at once against an aint64_t.
+	 */
+	acounter	c = 10;
+	if (!error) {
+		++c;
+		c += 5;
+		--c;
+		c -= 3;
+		acounter	d = c;
+		if ((c.getValue() != 12) || (d != 12)) {
+			error = true;
+			std::cout << "ERROR - the acounter is " << c << " and its copy " << d << " - not 12!" << std::endl;
+		} else {
+			std::cout << "Passed - the acounter can be incremented, decremented and copied" << std::endl;
+		}
+	}
+	if (!error) {
+		const int64_t	cnt = 2000000;
+		const int64_t	want = 4 * (cnt - (cnt + 3) / 4);
+		c = 0;
+		aint64_t		a = 0;
+		uint64_t		sharded = hammer(c, cnt);
+		uint64_t		single = hammer(a, cnt);
+		if ((c != want) || (a != want)) {
+			error = true;
+			std::cout << "ERROR - four threads left the acounter at " << c << ", and the aint64_t at "
+					  << a << " - not " << want << "!" << std::endl;
+		} else {
+			std::cout << "Passed - four threads counted to " << want << " in " << single
+					  << " usec on an aint64_t, and " << sharded << " usec on an acounter" << std::endl;
+		}
+	}
+
 	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
 	return (error ? 1 : 0);
 }
@@ -0,0 +1,130 @@
+/**
+ * This is the tests for the BlockingFIFO - each of the wait strategies on
+ * an SPSC CircularFIFO, with the timeouts of pop_wait() and push_wait(),
+ * and a producer and consumer that only ever wait on the queue.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "BlockingFIFO.h"
+#include "spsc/CircularFIFO.h"
+#include "util/timer.h"
+
+
+/**
+ * This is the producer for the threaded test - it just pushes 'count'
+ * values with push_wait(), and never fails - it'll wait forever.
+ */
+template <class Q> struct Feeder {
+	Q			*queue;
+	int32_t		count;
+
+	Feeder( Q *aQueue, int32_t aCount ) : queue(aQueue), count(aCount) { }
+	void operator()()
+	{
+		for (int32_t i = 0; i < count; ++i) {
+			queue->push_wait(i);
+		}
+	}
+};
+
+
+/**
+ * This runs the tests for one wait strategy, W, and returns 'true' if
+ * they all passed.
+ */
+template <dkit::wait_type W> bool exercise( const std::string & aName )
+{
+	bool	error = false;
+
+	typedef dkit::spsc::CircularFIFO<int32_t, 4>	ring_t;
+	typedef dkit::BlockingFIFO<int32_t, W>			queue_t;
+	ring_t		ring;
+	queue_t		q(&ring);
+
+	std::cout << "=== Testing the BlockingFIFO with " << aName << " ===" << std::endl;
+	// an empty queue needs to time out - and not too early
+	if (!error) {
+		int32_t		v = 0;
+		uint64_t	goTime = dkit::util::timer::usecStamp();
+		bool		got = q.pop_wait(v, 20000);
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		if (got || (goTime < 20000)) {
+			error = true;
+			std::cout << "ERROR - pop_wait() on an empty queue returned in " << goTime << " usec" << std::endl;
+		} else {
+			std::cout << "Passed - pop_wait() on an empty queue timed out in " << goTime << " usec" << std::endl;
+		}
+	}
+
+	// ...and a full one needs to do the same
+	if (!error) {
+		int32_t		lim = 0;
+		while (q.push_wait(lim, 0)) {
+			++lim;
+		}
+		uint64_t	goTime = dkit::util::timer::usecStamp();
+		bool		put = q.push_wait(lim, 20000);
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		if (put || (goTime < 20000)) {
+			error = true;
+			std::cout << "ERROR - push_wait() on a full queue returned in " << goTime << " usec" << std::endl;
+		} else {
+			std::cout << "Passed - push_wait() on a full queue of " << lim << " timed out in " << goTime << " usec" << std::endl;
+		}
+		q.clear();
+	}
+
+	/**
+	 * Now a producer and consumer that only wait on the queue. If there's
+	 * only one CPU, the spin_wait will burn whole time slices waiting on
+	 * a thread that can't run, so it's not much of a test.
+	 */
+	if (!error && (W == dkit::spin_wait) && (boost::thread::hardware_concurrency() < 2)) {
+		std::cout << "Skipped - spin_wait with two threads needs two CPUs" << std::endl;
+	} else if (!error) {
+		int32_t			cnt = 100000;
+		Feeder<queue_t>	src(&q, cnt);
+		uint64_t		goTime = dkit::util::timer::usecStamp();
+		boost::thread	thr(boost::ref(src));
+		int32_t			v = 0;
+		for (int32_t i = 0; i < cnt; ++i) {
+			if (!q.pop_wait(v, 5000000) || (v != i)) {
+				error = true;
+				std::cout << "ERROR - could not pop the value " << i << std::endl;
+				break;
+			}
+		}
+		thr.join();
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		if (!error) {
+			std::cout << "Passed - waited through " << cnt << " values in "
+					  << (goTime * 1000.0)/cnt << " ns/op" << std::endl;
+		}
+	}
+
+	return !error;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	if (!error) {
+		error = !exercise<dkit::spin_wait>("spin_wait");
+	}
+	if (!error) {
+		error = !exercise<dkit::yield_wait>("yield_wait");
+	}
+	if (!error) {
+		error = !exercise<dkit::park_wait>("park_wait");
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -0,0 +1,443 @@
+/**
+ * This is the tests for the broadcast ring - that every sink sees every
+ * item, in order, that a slow sink doesn't hold up the fast ones, and that
+ * the items sent as pointers are copied into the ring, so the sender can
+ * reuse what it sent as soon as send() returns.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <sched.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "broadcast.h"
+#include "io/datagram.h"
+#include "util/timer.h"
+
+
+/**
+ * This is a sink that checks it's getting the items in order - 1, 2, 3...
+ * and keeps count of them. If it's told to, it'll hold on the first item
+ * until it's let go - so we can have a slow sink.
+ */
+class Counter :
+	public dkit::sink<int64_t>
+{
+	public:
+		volatile int64_t	count;
+		volatile bool		ordered;
+		volatile bool		hold;
+
+		Counter() : dkit::sink<int64_t>(), count(0), ordered(true), hold(false) { }
+
+		virtual bool recv( const int64_t anItem )
+		{
+			while (hold) {
+				sched_yield();
+			}
+			if (anItem != count + 1) {
+				ordered = false;
+			}
+			count = anItem;
+			return true;
+		}
+};
+
+
+/**
+ * This is an item that gives up the CPU as it's copied into the ring -
+ * after the producer has checked for room, and before it publishes - so
+ * that's when a sink is most likely to be added. The sink that's added
+ * while the ring is busy starts with whatever item is next, and from there
+ * it has to see every one, in order. It's slow, too, so the producer gets
+ * the chance to lap it.
+ */
+struct Tick {
+	int64_t		seq;
+
+	Tick() : seq(0) { }
+	Tick & operator=( const Tick & anOther )
+	{
+		sched_yield();
+		seq = anOther.seq;
+		return *this;
+	}
+};
+
+class Follower :
+	public dkit::sink<Tick *>
+{
+	public:
+		volatile int64_t	first;
+		volatile int64_t	count;
+		volatile bool		ordered;
+
+		Follower() : dkit::sink<Tick *>(), first(0), count(0), ordered(true) { }
+
+		virtual bool recv( Tick * const anItem )
+		{
+			for (uint32_t i = 0; i < 4; ++i) {
+				sched_yield();
+			}
+			if (first == 0) {
+				first = anItem->seq;
+			} else if (anItem->seq != count + 1) {
+				ordered = false;
+			}
+			count = anItem->seq;
+			return true;
+		}
+};
+
+
+/**
+ * This is the producer for the ring that has no sinks when it starts - it
+ * publishes 1, 2, 3... until it's told to stop.
+ */
+static volatile bool	__stop = false;
+
+static void pump( dkit::broadcast<Tick *, 1> *aRing )
+{
+	Tick	t;
+	for (t.seq = 1; !__stop; ++t.seq) {
+		aRing->recv(&t);
+	}
+}
+
+
+/**
+ * This is a sink that's had enough after 'aLimit' items, and removes
+ * itself from the ring - right from its own recv().
+ */
+class Quitter :
+	public dkit::sink<int64_t>
+{
+	public:
+		volatile int64_t				count;
+		volatile bool					removed;
+		int64_t							limit;
+		dkit::broadcast<int64_t, 6>		*ring;
+
+		Quitter( int64_t aLimit ) : dkit::sink<int64_t>(), count(0), removed(false), limit(aLimit), ring(NULL) { }
+
+		virtual bool recv( const int64_t anItem )
+		{
+			count = anItem;
+			if (anItem == limit) {
+				removed = ring->removeFromListeners(this);
+			}
+			return true;
+		}
+};
+
+
+/**
+ * This is a value that's sent as a pointer, and the sink that checks that
+ * what it gets is what was sent - even though the sender reuses the one
+ * value it has for every send().
+ */
+struct Quote {
+	int64_t		seq;
+	int64_t		price;
+
+	Quote() : seq(0), price(0) { }
+};
+
+class QuoteCheck :
+	public dkit::sink<Quote *>
+{
+	public:
+		volatile int64_t	count;
+		volatile bool		ok;
+
+		QuoteCheck() : dkit::sink<Quote *>(), count(0), ok(true) { }
+
+		virtual bool recv( Quote * const anItem )
+		{
+			if ((anItem->seq != count + 1) || (anItem->price != 2 * anItem->seq)) {
+				ok = false;
+			}
+			count = anItem->seq;
+			return true;
+		}
+};
+
+
+/**
+ * This is a sink of datagrams that counts them, and the NULLs it's handed.
+ */
+class DatagramCount :
+	public dkit::sink<dkit::io::datagram *>
+{
+	public:
+		volatile int64_t	count;
+		volatile int64_t	nulls;
+
+		DatagramCount() : dkit::sink<dkit::io::datagram *>(), count(0), nulls(0) { }
+
+		virtual bool recv( dkit::io::datagram * const anItem )
+		{
+			if (anItem == NULL) {
+				++nulls;
+			}
+			++count;
+			return true;
+		}
+};
+
+
+/**
+ * This waits for all the counters to get to 'aCount', and returns 'true'
+ * if they all got there in order.
+ */
+static bool waitFor( Counter *aSinks[], uint32_t aNum, int64_t aCount )
+{
+	bool	ok = true;
+	for (uint32_t i = 0; i < aNum; ++i) {
+		while (aSinks[i]->count < aCount) {
+			sched_yield();
+		}
+		ok = ok && aSinks[i]->ordered;
+	}
+	return ok;
+}
+
+
+/**
+ * This sends 'aCount' items through the ring to three sinks, and checks
+ * that they all see them all, in order - and prints the time per item.
+ */
+template <dkit::wait_type W> bool fanOut( const std::string & aName, int64_t aCount )
+{
+	bool	error = false;
+
+	if ((W == dkit::spin_wait) && (boost::thread::hardware_concurrency() < 4)) {
+		std::cout << "Skipped - spin_wait with four threads needs four CPUs" << std::endl;
+		return true;
+	}
+	// the sinks have to outlive the ring - and its threads
+	Counter		a, b, c;
+	dkit::broadcast<int64_t, 10, W>	ring;
+	Counter		*all[] = { &a, &b, &c };
+	for (uint32_t i = 0; i < 3; ++i) {
+		ring.addToListeners(all[i]);
+	}
+	// send through the source<T> facade
+	dkit::source<int64_t>	*src = &ring;
+	uint64_t	goTime = dkit::util::timer::usecStamp();
+	for (int64_t i = 1; i <= aCount; ++i) {
+		src->send(i);
+	}
+	if (!waitFor(all, 3, aCount)) {
+		error = true;
+		std::cout << "ERROR - the " << aName << " sinks didn't see every item in order" << std::endl;
+	}
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	if (!error) {
+		std::cout << "Passed - " << aName << " - 3 sinks each saw " << aCount << " items in order, "
+				  << ((goTime * 1000.0)/aCount) << " ns/item" << std::endl;
+	}
+	return !error;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, every sink needs to see every item - in order - with each
+	 * of the ways to wait.
+	 */
+	if (!error) {
+		std::cout << "=== Testing three sinks on the ring ===" << std::endl;
+		error = !fanOut<dkit::spin_wait>("spin_wait", 200000) ||
+				!fanOut<dkit::yield_wait>("yield_wait", 1000000) ||
+				!fanOut<dkit::park_wait>("park_wait", 1000000);
+	}
+
+	/**
+	 * Next, a sink that's stuck on its first item can't hold up a fast
+	 * one - or the producer - until the producer is a ring ahead of it.
+	 */
+	if (!error) {
+		std::cout << "=== Testing a slow sink ===" << std::endl;
+		Counter		fast, slow;
+		dkit::broadcast<int64_t, 6>		ring;
+		slow.hold = true;
+		ring.addToListeners(&fast);
+		ring.addToListeners(&slow);
+		int64_t		cnt = ring.capacity();
+		for (int64_t i = 1; i <= cnt; ++i) {
+			ring.recv(i);
+		}
+		Counter		*quick[] = { &fast };
+		if (!waitFor(quick, 1, cnt) || (slow.count != 0)) {
+			error = true;
+			std::cout << "ERROR - the fast sink didn't get a ring's worth of items past the slow one" << std::endl;
+		} else {
+			std::cout << "Passed - the fast sink got " << fast.count << " items while the slow one was stuck" << std::endl;
+		}
+		// let the slow one go, and it needs to catch up, in order
+		slow.hold = false;
+		for (int64_t i = cnt + 1; i <= 10 * cnt; ++i) {
+			ring.recv(i);
+		}
+		Counter		*both[] = { &fast, &slow };
+		if (!error && !waitFor(both, 2, 10 * cnt)) {
+			error = true;
+			std::cout << "ERROR - the slow sink didn't catch up in order" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - the slow sink caught up, and saw all " << slow.count << " items" << std::endl;
+		}
+		// ...and a removed sink no longer holds up the producer
+		if (!error) {
+			ring.removeFromListeners(&slow);
+			for (int64_t i = 10 * cnt + 1; i <= 20 * cnt; ++i) {
+				ring.recv(i);
+			}
+			if (!waitFor(quick, 1, 20 * cnt) || (slow.count != 10 * cnt)) {
+				error = true;
+				std::cout << "ERROR - the fast sink didn't get everything after the slow one was removed" << std::endl;
+			} else {
+				std::cout << "Passed - removed the slow sink, and the fast one got all " << fast.count << " items" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * A sink added to a ring that the producer is busy publishing into,
+	 * with no other sinks, mustn't have its items written over before it
+	 * gets to them.
+	 */
+	if (!error) {
+		std::cout << "=== Testing a sink added while publishing ===" << std::endl;
+		dkit::broadcast<Tick *, 1>		ring;
+		boost::thread	producer(pump, &ring);
+		for (uint32_t pass = 0; !error && (pass < 500); ++pass) {
+			Follower	late;
+			// ...landing at a different point of the producer's loop each time
+			for (uint32_t i = 0; i < (pass % 3); ++i) {
+				sched_yield();
+			}
+			ring.addToListeners(&late);
+			while ((late.first == 0) || (late.count < late.first + 100)) {
+				sched_yield();
+			}
+			ring.removeFromListeners(&late);
+			if (!late.ordered) {
+				error = true;
+				std::cout << "ERROR - a sink added while publishing missed items, starting at " << late.first << std::endl;
+			}
+		}
+		__stop = true;
+		producer.join();
+		if (!error) {
+			std::cout << "Passed - 500 sinks added to a busy ring each saw every item from where they started" << std::endl;
+		}
+	}
+
+	/**
+	 * A sink that removes itself, from its own thread, gets nothing after
+	 * that, and doesn't hold up the producer, or the sinks that stay.
+	 */
+	if (!error) {
+		std::cout << "=== Testing a sink that removes itself ===" << std::endl;
+		Counter		stay;
+		Quitter		quit(100);
+		dkit::broadcast<int64_t, 6>		ring;
+		quit.ring = &ring;
+		ring.addToListeners(&stay);
+		ring.addToListeners(&quit);
+		int64_t		cnt = 20 * ring.capacity();
+		for (int64_t i = 1; i <= cnt; ++i) {
+			ring.recv(i);
+		}
+		Counter		*kept[] = { &stay };
+		if (!waitFor(kept, 1, cnt) || !quit.removed || (quit.count != 100)) {
+			error = true;
+			std::cout << "ERROR - the sink that removed itself got " << quit.count << " items, not 100" << std::endl;
+		} else {
+			std::cout << "Passed - the sink removed itself after 100 items, and the other got all " << stay.count << std::endl;
+		}
+		// ...and it can be added back, once it's gone
+		if (!error) {
+			quit.limit = cnt + 50;
+			while (!ring.addToListeners(&quit)) {
+				sched_yield();
+			}
+			for (int64_t i = cnt + 1; i <= 2 * cnt; ++i) {
+				ring.recv(i);
+			}
+			if (!waitFor(kept, 1, 2 * cnt) || (quit.count != cnt + 50)) {
+				error = true;
+				std::cout << "ERROR - the sink added back got " << quit.count << " items, not " << (cnt + 50) << std::endl;
+			} else {
+				std::cout << "Passed - the sink was added back, and removed itself again" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * Finally, send one Quote over and over - changing it each time - and
+	 * each sink needs to see each value as it was when it was sent.
+	 */
+	if (!error) {
+		std::cout << "=== Testing items sent as pointers ===" << std::endl;
+		QuoteCheck	a, b;
+		dkit::broadcast<Quote *, 4>	ring;
+		ring.addToListeners(&a);
+		ring.addToListeners(&b);
+		Quote		q;
+		int64_t		cnt = 100000;
+		for (int64_t i = 1; i <= cnt; ++i) {
+			q.seq = i;
+			q.price = 2 * i;
+			ring.send(&q);
+			// scribble on it - the sinks mustn't see this
+			q.seq = -1;
+			q.price = -1;
+		}
+		while ((a.count < cnt) || (b.count < cnt)) {
+			sched_yield();
+		}
+		if (!a.ok || !b.ok) {
+			error = true;
+			std::cout << "ERROR - the sinks saw a Quote that was changed after it was sent" << std::endl;
+		} else {
+			std::cout << "Passed - 2 sinks saw " << cnt << " Quotes as they were sent" << std::endl;
+		}
+	}
+
+	/**
+	 * A NULL datagram has nothing to put in the ring, so it's turned away
+	 * - the sinks mustn't get the slot's old datagram over again.
+	 */
+	if (!error) {
+		std::cout << "=== Testing a NULL datagram ===" << std::endl;
+		DatagramCount	a;
+		dkit::broadcast<dkit::io::datagram *, 4>	ring;
+		ring.addToListeners(&a);
+		dkit::io::datagram	dg;
+		bool		sent = ring.send(&dg);
+		bool		nullSent = ring.send(NULL);
+		bool		sentAgain = ring.send(&dg);
+		while (a.count < 2) {
+			sched_yield();
+		}
+		// ...give it the chance to see any more than it should
+		for (uint32_t i = 0; i < 100; ++i) {
+			sched_yield();
+		}
+		if (!sent || nullSent || !sentAgain || (ring.published() != 2) || (a.count != 2) || (a.nulls != 0)) {
+			error = true;
+			std::cout << "ERROR - a NULL datagram was published, or the sink got " << a.count << " of 2" << std::endl;
+		} else {
+			std::cout << "Passed - the NULL datagram was turned away, and the sink got just the 2 real ones" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
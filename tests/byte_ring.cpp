@@ -0,0 +1,286 @@
+/**
+ * This is the tests for the SPSC and MPSC ByteRings - that records of all
+ * sizes come out just as they went in, that the padding at the end of the
+ * ring is skipped, that a record can be committed shorter than it was
+ * reserved, and how fast the records stream from one thread to another.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <sched.h>
+#include <string.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "spsc/ByteRing.h"
+#include "mpsc/ByteRing.h"
+#include "util/timer.h"
+
+
+/**
+ * Each record is a 'who' and a 'seq', and then the bytes of the seq, over
+ * and over, to a length that changes from one record to the next.
+ */
+static size_t lengthOf( int64_t aSeq )
+{
+	return 16 + (size_t)((aSeq * 37) % 300);
+}
+
+static void fill( char *aRecord, int64_t aWho, int64_t aSeq, size_t aLength )
+{
+	memcpy(aRecord, &aWho, 8);
+	memcpy(aRecord + 8, &aSeq, 8);
+	for (size_t i = 16; i < aLength; ++i) {
+		aRecord[i] = (char)(aSeq + i);
+	}
+}
+
+static bool check( const char *aRecord, size_t aLength, int64_t & aWho, int64_t & aSeq )
+{
+	memcpy(&aWho, aRecord, 8);
+	memcpy(&aSeq, aRecord + 8, 8);
+	if (aLength != lengthOf(aSeq)) {
+		return false;
+	}
+	for (size_t i = 16; i < aLength; ++i) {
+		if (aRecord[i] != (char)(aSeq + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+ * This is a producer that writes 'count' records right into the ring -
+ * reserving the most it could need, and committing what it used.
+ */
+template <class R> struct Writer {
+	R			*ring;
+	int64_t		who;
+	int64_t		count;
+
+	void operator()()
+	{
+		for (int64_t i = 1; i <= count; ++i) {
+			size_t	len = lengthOf(i);
+			char	*p = NULL;
+			while ((p = (char *)ring->try_reserve(316)) == NULL) {
+				sched_yield();
+			}
+			fill(p, who, i, len);
+			commit(ring, p, len);
+		}
+	}
+
+	static void commit( dkit::spsc::ByteRing<16> *aRing, char *aRecord, size_t aLength )
+	{
+		aRing->commit(aLength);
+	}
+
+	static void commit( dkit::mpsc::ByteRing<16> *aRing, char *aRecord, size_t aLength )
+	{
+		aRing->commit(aRecord, aLength);
+	}
+};
+
+
+/**
+ * This reads 'aCount' records from each of the 'aWriters' producers, in
+ * place, and checks that each producer's are all there, in order, and whole.
+ */
+template <class R> bool stream( R *aRing, uint32_t aWriters, int64_t aCount, uint64_t & aTime, uint64_t & aBytes )
+{
+	Writer<R>		w[4];
+	boost::thread	*threads[4];
+	int64_t			next[4] = { 1, 1, 1, 1 };
+	bool			ok = true;
+	aBytes = 0;
+	aTime = dkit::util::timer::usecStamp();
+	for (uint32_t i = 0; i < aWriters; ++i) {
+		w[i].ring = aRing;
+		w[i].who = i;
+		w[i].count = aCount;
+		threads[i] = new boost::thread(w[i]);
+	}
+	for (int64_t n = 0; n < aCount * aWriters; ++n) {
+		size_t		len = 0;
+		const char	*p = NULL;
+		while ((p = (const char *)aRing->try_front(len)) == NULL) {
+			sched_yield();
+		}
+		int64_t		who = 0;
+		int64_t		seq = 0;
+		if (!check(p, len, who, seq) || (who < 0) || (who >= (int64_t)aWriters) || (seq != next[who]++)) {
+			ok = false;
+		}
+		aBytes += len;
+		aRing->release();
+	}
+	for (uint32_t i = 0; i < aWriters; ++i) {
+		threads[i]->join();
+		delete threads[i];
+	}
+	aTime = dkit::util::timer::usecStamp() - aTime;
+	return (ok && aRing->empty());
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, on one thread, fill the ring with records of all sizes, well
+	 * past the end of the ring, and read them back.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the SPSC ByteRing on one thread ===" << std::endl;
+		dkit::spsc::ByteRing<10>	r;
+		char		buff[600];
+		int64_t		pushed = 0;
+		int64_t		popped = 0;
+		for (int32_t lap = 0; !error && (lap < 50); ++lap) {
+			while (true) {
+				size_t	len = lengthOf(pushed + 1);
+				fill(buff, 0, pushed + 1, len);
+				if (!r.push(buff, len)) {
+					break;
+				}
+				++pushed;
+			}
+			ssize_t		len = 0;
+			while ((len = r.pop(buff, sizeof(buff))) >= 0) {
+				int64_t		who = 0;
+				int64_t		seq = 0;
+				if (!check(buff, (size_t)len, who, seq) || (seq != ++popped)) {
+					error = true;
+					std::cout << "ERROR - record " << popped << " didn't come back as it was sent" << std::endl;
+					break;
+				}
+			}
+		}
+		if (!error && ((pushed != popped) || !r.empty())) {
+			error = true;
+			std::cout << "ERROR - pushed " << pushed << " records, but popped " << popped << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - " << pushed << " records, around the ring 50 times, came back whole" << std::endl;
+		}
+		// a record has to fit in half the ring
+		if (!error && ((r.try_reserve(r.max_record() + 1) != NULL) || (r.try_reserve(r.max_record()) == NULL))) {
+			error = true;
+			std::cout << "ERROR - try_reserve() didn't hold the line at " << r.max_record() << " bytes" << std::endl;
+		} else if (!error) {
+			// ...and one can be committed shorter than it was reserved
+			char	*p = (char *)r.try_reserve(r.max_record());
+			strcpy(p, "short");
+			r.commit(6);
+			size_t	len = 0;
+			const char	*f = (const char *)r.try_front(len);
+			if ((f == NULL) || (len != 6) || (strcmp(f, "short") != 0) || (r.size() != 16)) {
+				error = true;
+				std::cout << "ERROR - the short commit didn't give a 6-byte record" << std::endl;
+			} else {
+				r.release();
+				std::cout << "Passed - refused " << (r.max_record() + 1) << " bytes, and committed 6 of "
+						  << r.max_record() << " reserved" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * Next, the MPSC ring - reserve two, commit them backwards, and the
+	 * consumer can't see either until the first is done. Then the same
+	 * laps around the ring as above.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the MPSC ByteRing on one thread ===" << std::endl;
+		dkit::mpsc::ByteRing<10>	r;
+		char		*a = (char *)r.try_reserve(100);
+		char		*b = (char *)r.try_reserve(100);
+		size_t		len = 0;
+		strcpy(a, "first");
+		strcpy(b, "second");
+		r.commit(b, 7);
+		if (r.try_front(len) != NULL) {
+			error = true;
+			std::cout << "ERROR - try_front() saw past a reservation that isn't committed" << std::endl;
+		} else {
+			r.commit(a, 6);
+			const char	*f = (const char *)r.try_front(len);
+			bool		ok = ((f != NULL) && (len == 6) && (strcmp(f, "first") == 0));
+			r.release();
+			f = (const char *)r.try_front(len);
+			ok = ok && (f != NULL) && (len == 7) && (strcmp(f, "second") == 0);
+			r.release();
+			if (!ok || !r.empty() || (r.try_front(len) != NULL)) {
+				error = true;
+				std::cout << "ERROR - the short, backwards, commits didn't come out in order" << std::endl;
+			} else {
+				std::cout << "Passed - committed two short records backwards, and read them in order" << std::endl;
+			}
+		}
+		char		buff[600];
+		int64_t		pushed = 0;
+		int64_t		popped = 0;
+		for (int32_t lap = 0; !error && (lap < 50); ++lap) {
+			while (true) {
+				size_t	l = lengthOf(pushed + 1);
+				fill(buff, 0, pushed + 1, l);
+				if (!r.push(buff, l)) {
+					break;
+				}
+				++pushed;
+			}
+			ssize_t		l = 0;
+			while ((l = r.pop(buff, sizeof(buff))) >= 0) {
+				int64_t		who = 0;
+				int64_t		seq = 0;
+				if (!check(buff, (size_t)l, who, seq) || (seq != ++popped)) {
+					error = true;
+					std::cout << "ERROR - record " << popped << " didn't come back as it was sent" << std::endl;
+					break;
+				}
+			}
+		}
+		if (!error && ((pushed != popped) || !r.empty())) {
+			error = true;
+			std::cout << "ERROR - pushed " << pushed << " records, but popped " << popped << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - " << pushed << " records, around the ring 50 times, came back whole" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, stream records from one thread to another - and for the
+	 * MPSC ring, from four - reading them in place.
+	 */
+	if (!error) {
+		std::cout << "=== Streaming records between threads ===" << std::endl;
+		int64_t		cnt = 1000000;
+		uint64_t	t = 0;
+		uint64_t	bytes = 0;
+		dkit::spsc::ByteRing<16>	*s = new dkit::spsc::ByteRing<16>();
+		if (!stream(s, 1, cnt, t, bytes)) {
+			error = true;
+			std::cout << "ERROR - the SPSC ring lost, reordered, or tore a record" << std::endl;
+		} else {
+			std::cout << "Passed - SPSC " << cnt << " records, " << ((t * 1000.0)/cnt) << " ns/rec, "
+					  << (bytes/(double)t) << " MB/s" << std::endl;
+		}
+		delete s;
+		dkit::mpsc::ByteRing<16>	*m = new dkit::mpsc::ByteRing<16>();
+		if (!error && !stream(m, 4, cnt/4, t, bytes)) {
+			error = true;
+			std::cout << "ERROR - the MPSC ring lost, reordered, or tore a record" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - MPSC 4 x " << (cnt/4) << " records, " << ((t * 1000.0)/cnt) << " ns/rec, "
+					  << (bytes/(double)t) << " MB/s" << std::endl;
+		}
+		delete m;
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
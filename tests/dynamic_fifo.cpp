@@ -0,0 +1,134 @@
+/**
+ * This is the tests for the run-time sized DynamicCircularFIFOs - one for
+ * each of the SPSC, MPSC and SPMC flavors.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "spsc/DynamicCircularFIFO.h"
+#include "mpsc/DynamicCircularFIFO.h"
+#include "spmc/DynamicCircularFIFO.h"
+#include "util/timer.h"
+
+
+/**
+ * This runs the basic push/pop tests on a queue of type Q - made with the
+ * capacity given at run-time - and returns 'true' if everything worked.
+ */
+template <class Q> bool exercise( const std::string & aName, size_t aCapacity, bool useHugePages )
+{
+	bool	error = false;
+
+	Q		q(aCapacity, useHugePages);
+	std::cout << "=== Testing " << aName << " with capacity " << aCapacity
+			  << " ===" << std::endl;
+	// the capacity needs to be rounded up to the next power of two
+	if (!error) {
+		size_t	want = dkit::util::ring_storage::powerOfTwo(aCapacity);
+		if (q.capacity() != want) {
+			error = true;
+			std::cout << "ERROR - asked for " << aCapacity << " and got "
+					  << q.capacity() << " and not " << want << std::endl;
+		} else {
+			std::cout << "Passed - capacity is " << q.capacity()
+					  << (q.isOnHugePages() ? " (on huge pages)" : "") << std::endl;
+		}
+	}
+
+	// run enough values through the queue to wrap it a few times
+	if (!error) {
+		uint64_t	goTime = dkit::util::timer::usecStamp();
+		int32_t		batch = (int32_t)(q.capacity() / 2);
+		int32_t		trips = 4 * (int32_t)(q.capacity() / batch) + 1;
+		for (int32_t cycle = 0; !error && (cycle < trips); ++cycle) {
+			for (int32_t i = 0; i < batch; ++i) {
+				if (!q.push(i)) {
+					error = true;
+					std::cout << "ERROR - could not push the value " << i << std::endl;
+					break;
+				}
+			}
+			if (!error && (q.size() != (size_t)batch)) {
+				error = true;
+				std::cout << "ERROR - pushed " << batch << " integers, but size() reports "
+						  << q.size() << std::endl;
+			}
+			int32_t		v = 0;
+			for (int32_t i = 0; !error && (i < batch); ++i) {
+				if (!q.pop(v) || (v != i)) {
+					error = true;
+					std::cout << "ERROR - could not pop the value " << i << std::endl;
+				}
+			}
+			if (!error && !q.empty()) {
+				error = true;
+				std::cout << "ERROR - popped all values, but the queue isn't empty!" << std::endl;
+			}
+		}
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		if (!error) {
+			std::cout << "Passed - " << trips << " trips of " << batch << " integers in "
+					  << (goTime * 1000.0)/(trips * batch) << " ns/op" << std::endl;
+		}
+	}
+
+	// a copy needs to have the same capacity and contents
+	if (!error) {
+		q.push(42);
+		Q		c(q);
+		int32_t	v = 0;
+		if ((c.capacity() != q.capacity()) || !c.pop(v) || (v != 42)) {
+			error = true;
+			std::cout << "ERROR - the copy of the queue isn't the same!" << std::endl;
+		} else {
+			std::cout << "Passed - the copy has the same capacity and contents" << std::endl;
+		}
+		q.clear();
+	}
+
+	return !error;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	typedef dkit::spsc::DynamicCircularFIFO<int32_t>	spsc_q;
+	typedef dkit::mpsc::DynamicCircularFIFO<int32_t>	mpsc_q;
+	typedef dkit::spmc::DynamicCircularFIFO<int32_t>	spmc_q;
+
+	// first, the odd sizes that get rounded up
+	if (!error) {
+		error = !exercise<spsc_q>("spsc::DynamicCircularFIFO", 1000, false) ||
+				!exercise<mpsc_q>("mpsc::DynamicCircularFIFO", 1000, false) ||
+				!exercise<spmc_q>("spmc::DynamicCircularFIFO", 1000, false);
+	}
+
+	// next, the big ones - on huge pages if the box has them to give
+	if (!error) {
+		error = !exercise<spsc_q>("spsc::DynamicCircularFIFO", (1 << 20), true) ||
+				!exercise<mpsc_q>("mpsc::DynamicCircularFIFO", (1 << 20), true) ||
+				!exercise<spmc_q>("spmc::DynamicCircularFIFO", (1 << 20), true);
+	}
+
+	// finally, queues of different sizes can't be assigned to one another
+	if (!error) {
+		std::cout << "=== Testing assignment of different capacities ===" << std::endl;
+		spsc_q		a(16);
+		spsc_q		b(32);
+		try {
+			a = b;
+			error = true;
+			std::cout << "ERROR - assigned queues of different capacities!" << std::endl;
+		} catch (std::runtime_error & e) {
+			std::cout << "Passed - assignment was refused" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -0,0 +1,248 @@
+/**
+ * This is the tests for the epoch-based reclamation domain, the free lists
+ * of nodes, and the SPMC LinkedFIFO that uses them both with a number of
+ * consumers all popping at once.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "util/epoch.h"
+#include "util/free_list.h"
+#include "spmc/LinkedFIFO.h"
+
+
+/**
+ * This is the reclaimer for the domain tests - it just counts them.
+ */
+static volatile size_t	reclaimed = 0;
+static void tally( void *aPtr )
+{
+	__sync_fetch_and_add(&reclaimed, 1);
+}
+
+
+/**
+ * This is a thread that sits in a guard until it's told to leave - so we
+ * can see that nothing retired while it's there is reclaimed.
+ */
+struct Holder {
+	volatile bool	in;
+	volatile bool	leave;
+
+	Holder() : in(false), leave(false) { }
+	void operator()()
+	{
+		dkit::util::epoch::guard	g;
+		in = true;
+		while (!leave) {
+			sched_yield();
+		}
+	}
+};
+
+
+/**
+ * This is a thread that retires a number of pointers and exits - leaving
+ * them for the rest of the threads to reclaim.
+ */
+struct Leaver {
+	void operator()()
+	{
+		for (int32_t i = 0; i < 10; ++i) {
+			dkit::util::epoch::retire(NULL, tally);
+		}
+	}
+};
+
+
+/**
+ * This is a node for the free list tests, and a thread that gives back all
+ * the blocks it's handed, and then exits.
+ */
+struct Thing {
+	int64_t		a;
+	int64_t		b;
+};
+
+struct Giver {
+	std::vector<void *>		*blocks;
+
+	Giver( std::vector<void *> *aBlocks ) : blocks(aBlocks) { }
+	void operator()()
+	{
+		for (size_t i = 0; i < blocks->size(); ++i) {
+			dkit::util::free_list<Thing>::put((*blocks)[i]);
+		}
+	}
+};
+
+
+/**
+ * This is a consumer for the SPMC test - it pops until the producer is
+ * done and the queue is empty, and keeps the count and sum of what it got.
+ */
+struct Consumer {
+	dkit::spmc::LinkedFIFO<int64_t>	*queue;
+	volatile bool					*done;
+	int64_t							count;
+	int64_t							sum;
+
+	Consumer( dkit::spmc::LinkedFIFO<int64_t> *aQueue, volatile bool *aDone ) :
+		queue(aQueue), done(aDone), count(0), sum(0) { }
+	void operator()()
+	{
+		int64_t		v = 0;
+		uint32_t	spins = 0;
+		while (true) {
+			if (queue->pop(v)) {
+				++count;
+				sum += v;
+			} else if (*done && queue->empty()) {
+				break;
+			} else if (++spins > 100) {
+				sched_yield();
+				spins = 0;
+			}
+		}
+	}
+};
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, retire some pointers while another thread is in a guard, and
+	 * make sure none are reclaimed until it leaves.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the epoch domain ===" << std::endl;
+		Holder				h;
+		boost::thread		thr(boost::ref(h));
+		while (!h.in) {
+			sched_yield();
+		}
+		reclaimed = 0;
+		for (int32_t i = 0; i < 1000; ++i) {
+			dkit::util::epoch::retire(NULL, tally);
+		}
+		for (int32_t i = 0; i < 10; ++i) {
+			dkit::util::epoch::collect();
+		}
+		if (reclaimed != 0) {
+			error = true;
+			std::cout << "ERROR - reclaimed " << reclaimed << " pointers while a guard was held" << std::endl;
+		} else {
+			std::cout << "Passed - reclaimed nothing while another thread was in a guard" << std::endl;
+		}
+		h.leave = true;
+		thr.join();
+		for (int32_t i = 0; !error && (i < 3); ++i) {
+			dkit::util::epoch::collect();
+		}
+		if (!error) {
+			if ((reclaimed != 1000) || (dkit::util::epoch::pending() != 0)) {
+				error = true;
+				std::cout << "ERROR - reclaimed " << reclaimed << " of 1000 pointers after the guard was gone" << std::endl;
+			} else {
+				std::cout << "Passed - reclaimed all 1000 pointers once the guard was gone" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * What a thread retires before it exits needs to be reclaimed by the
+	 * threads that are still around.
+	 */
+	if (!error) {
+		reclaimed = 0;
+		Leaver			lv;
+		boost::thread	thr(lv);
+		thr.join();
+		for (int32_t i = 0; i < 3; ++i) {
+			dkit::util::epoch::collect();
+		}
+		if (reclaimed != 10) {
+			error = true;
+			std::cout << "ERROR - reclaimed " << reclaimed << " of the 10 pointers left by an exited thread" << std::endl;
+		} else {
+			std::cout << "Passed - reclaimed the 10 pointers left by an exited thread" << std::endl;
+		}
+	}
+
+	/**
+	 * The blocks a thread gives back as it exits need to get to the thread
+	 * that wants them - without going back to the heap.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the free lists ===" << std::endl;
+		typedef dkit::util::free_list<Thing>	list_t;
+		std::vector<void *>		blocks;
+		for (int32_t i = 0; i < 1000; ++i) {
+			blocks.push_back(list_t::get());
+		}
+		size_t			made = list_t::allocations();
+		Giver			gv(&blocks);
+		boost::thread	thr(gv);
+		thr.join();
+		for (int32_t i = 0; i < 1000; ++i) {
+			blocks[i] = list_t::get();
+		}
+		if (list_t::allocations() != made) {
+			error = true;
+			std::cout << "ERROR - went to the heap for " << (list_t::allocations() - made)
+					  << " blocks that were given back" << std::endl;
+		} else {
+			std::cout << "Passed - reused 1000 blocks given back by another thread" << std::endl;
+		}
+		for (int32_t i = 0; i < 1000; ++i) {
+			list_t::put(blocks[i]);
+		}
+	}
+
+	/**
+	 * Finally, one producer and four consumers on the SPMC LinkedFIFO -
+	 * every value needs to be popped once, and only once.
+	 */
+	if (!error) {
+		std::cout << "=== Testing four consumers on the SP/MC LinkedFIFO ===" << std::endl;
+		dkit::spmc::LinkedFIFO<int64_t>	q;
+		volatile bool			done = false;
+		std::vector<Consumer>	dest(4, Consumer(&q, &done));
+		boost::thread_group		thrs;
+		for (uint32_t i = 0; i < 4; ++i) {
+			thrs.create_thread(boost::ref(dest[i]));
+		}
+		int64_t		cnt = 500000;
+		for (int64_t i = 1; i <= cnt; ++i) {
+			q.push(i);
+		}
+		done = true;
+		thrs.join_all();
+		int64_t		total = 0;
+		int64_t		sum = 0;
+		for (uint32_t i = 0; i < 4; ++i) {
+			total += dest[i].count;
+			sum += dest[i].sum;
+		}
+		if ((total != cnt) || (sum != (cnt * (cnt + 1))/2)) {
+			error = true;
+			std::cout << "ERROR - popped " << total << " values, summing to " << sum
+					  << " - but pushed " << cnt << std::endl;
+		} else {
+			std::cout << "Passed - popped " << total << " values (" << dest[0].count << "+"
+					  << dest[1].count << "+" << dest[2].count << "+" << dest[3].count
+					  << "), each once, with four consumers" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
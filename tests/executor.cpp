@@ -0,0 +1,262 @@
+/**
+ * This is the tests for the work-stealing deque and the executor built on
+ * it - that the owner and the thieves never get the same element, that a
+ * batch of tasks all run, and a fork-join benchmark: the usual recursive
+ * Fibonacci, forking two tasks at each level down to a cutoff, against
+ * the same thing done serially.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "executor.h"
+#include "spmc/WorkStealingDeque.h"
+#include "util/timer.h"
+
+
+/**
+ * This is a thief on the deque - it steals until it's told to stop, and
+ * keeps the count, and sum, of what it got.
+ */
+struct Thief {
+	dkit::spmc::WorkStealingDeque<intptr_t, 4>	*deque;
+	volatile bool		*stop;
+	int64_t				count;
+	int64_t				sum;
+
+	Thief() : deque(NULL), stop(NULL), count(0), sum(0) { }
+	void operator()()
+	{
+		intptr_t	v = 0;
+		while (true) {
+			if (deque->steal(v)) {
+				++count;
+				sum += v;
+			} else if (*stop && deque->empty()) {
+				break;
+			} else {
+				sched_yield();
+			}
+		}
+	}
+};
+
+
+/**
+ * This is the task for the batch test - it just counts that it ran.
+ */
+static volatile int64_t	ran = 0;
+
+class Tick :
+	public dkit::task
+{
+	public:
+		virtual void run()
+		{
+			__sync_fetch_and_add(&ran, 1);
+		}
+};
+
+
+/**
+ * This is the fork-join task - below the cutoff it's done serially, and
+ * above it, it forks the two halves as tasks and joins on them.
+ */
+static int64_t fib( int32_t n )
+{
+	return (n < 2 ? n : fib(n - 1) + fib(n - 2));
+}
+
+template <dkit::wait_type W> class Fib :
+	public dkit::task
+{
+	public:
+		Fib( dkit::executor<W> *anExec, int32_t n, int32_t aCutoff ) :
+			exec(anExec), n(n), cutoff(aCutoff), result(0) { }
+
+		virtual void run()
+		{
+			if (n < cutoff) {
+				result = fib(n);
+			} else {
+				Fib<W>				a(exec, n - 1, cutoff);
+				Fib<W>				b(exec, n - 2, cutoff);
+				dkit::task			*kids[] = { &a, &b };
+				dkit::task_group	g;
+				exec->submit(kids, 2, &g);
+				exec->wait(g);
+				result = a.result + b.result;
+			}
+		}
+
+		dkit::executor<W>	*exec;
+		int32_t				n;
+		int32_t				cutoff;
+		int64_t				result;
+};
+
+
+/**
+ * This runs the fork-join Fibonacci on an executor with 'aThreads' workers
+ * and prints the time against the serial one.
+ */
+template <dkit::wait_type W> bool forkJoin( const std::string & aName, uint32_t aThreads,
+											int32_t n, uint64_t aSerial, int64_t anAnswer )
+{
+	if ((W == dkit::spin_wait) && (boost::thread::hardware_concurrency() < aThreads + 1)) {
+		std::cout << "Skipped - " << aName << " with " << aThreads << " spinning workers needs "
+				  << (aThreads + 1) << " CPUs" << std::endl;
+		return true;
+	}
+	dkit::executor<W>	exec(aThreads);
+	Fib<W>				root(&exec, n, 16);
+	dkit::task_group	g;
+	uint64_t	goTime = dkit::util::timer::usecStamp();
+	exec.submit(&root, &g);
+	exec.wait(g);
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	if (root.result != anAnswer) {
+		std::cout << "ERROR - " << aName << " with " << aThreads << " workers got fib(" << n
+				  << ") = " << root.result << ", not " << anAnswer << std::endl;
+		return false;
+	}
+	std::cout << "Passed - " << aName << " with " << aThreads << " workers: " << goTime
+			  << " usec (serial " << aSerial << " usec), " << exec.executed() << " tasks, "
+			  << exec.steals() << " stolen" << std::endl;
+	return true;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, the deque on its own - the owner sees a stack, and a thief
+	 * sees a queue, and it grows as it needs to.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the WorkStealingDeque on one thread ===" << std::endl;
+		dkit::spmc::WorkStealingDeque<intptr_t, 2>	d;
+		for (intptr_t i = 1; i <= 10; ++i) {
+			d.push(i);
+		}
+		intptr_t	v = 0;
+		if ((d.size() != 10) || (d.capacity() < 10)) {
+			error = true;
+			std::cout << "ERROR - the deque didn't grow to hold 10 elements" << std::endl;
+		} else if (!d.steal(v) || (v != 1) || !d.pop(v) || (v != 10)) {
+			error = true;
+			std::cout << "ERROR - the owner didn't pop the newest, or the thief didn't steal the oldest" << std::endl;
+		} else {
+			intptr_t	more[] = { 11, 12, 13 };
+			d.push(more, 3);
+			int64_t		sum = 0;
+			while (d.pop(v)) {
+				sum += v;
+			}
+			if ((sum != (2+3+4+5+6+7+8+9+11+12+13)) || !d.empty() || d.steal(v)) {
+				error = true;
+				std::cout << "ERROR - the batch push, or popping it all, didn't work" << std::endl;
+			} else {
+				std::cout << "Passed - the owner pops the newest, a thief steals the oldest, and it grew to "
+						  << d.capacity() << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * Next, the owner pushes, and pops some, while three thieves steal -
+	 * and every value has to come out exactly once.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the WorkStealingDeque with three thieves ===" << std::endl;
+		dkit::spmc::WorkStealingDeque<intptr_t, 4>	d;
+		volatile bool	stop = false;
+		Thief			thieves[3];
+		boost::thread	*threads[3];
+		for (uint32_t i = 0; i < 3; ++i) {
+			thieves[i].deque = &d;
+			thieves[i].stop = &stop;
+			threads[i] = new boost::thread(boost::ref(thieves[i]));
+		}
+		int64_t		cnt = 1000000;
+		int64_t		popped = 0;
+		int64_t		sum = 0;
+		intptr_t	v = 0;
+		for (intptr_t i = 1; i <= cnt; ++i) {
+			d.push(i);
+			if (((i % 3) == 0) && d.pop(v)) {
+				++popped;
+				sum += v;
+			}
+		}
+		while (d.pop(v)) {
+			++popped;
+			sum += v;
+		}
+		stop = true;
+		int64_t		stolen = 0;
+		for (uint32_t i = 0; i < 3; ++i) {
+			threads[i]->join();
+			delete threads[i];
+			stolen += thieves[i].count;
+			sum += thieves[i].sum;
+		}
+		if ((popped + stolen != cnt) || (sum != cnt * (cnt + 1) / 2)) {
+			error = true;
+			std::cout << "ERROR - " << (popped + stolen) << " values came out of " << cnt
+					  << " - some were lost, or taken twice" << std::endl;
+		} else {
+			std::cout << "Passed - " << cnt << " values came out once each - "
+					  << popped << " popped, " << stolen << " stolen" << std::endl;
+		}
+	}
+
+	/**
+	 * Then a batch of tasks submitted from outside the executor, in one
+	 * call, all need to run before the wait() returns.
+	 */
+	if (!error) {
+		std::cout << "=== Testing a batch of tasks ===" << std::endl;
+		dkit::executor<dkit::park_wait>	exec(4);
+		std::vector<Tick>				ticks(10000);
+		std::vector<dkit::task *>		batch;
+		for (size_t i = 0; i < ticks.size(); ++i) {
+			batch.push_back(&ticks[i]);
+		}
+		dkit::task_group	g;
+		exec.submit(&batch[0], batch.size(), &g);
+		exec.wait(g);
+		if ((ran != (int64_t)ticks.size()) || (g.pending() != 0)) {
+			error = true;
+			std::cout << "ERROR - only " << ran << " of the " << ticks.size() << " tasks ran" << std::endl;
+		} else {
+			std::cout << "Passed - all " << ran << " tasks in the batch ran" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, the fork-join benchmark, with each way to wait.
+	 */
+	if (!error) {
+		std::cout << "=== Timing fork-join fib(32) ===" << std::endl;
+		int32_t		n = 32;
+		uint64_t	serial = dkit::util::timer::usecStamp();
+		int64_t		answer = fib(n);
+		serial = dkit::util::timer::usecStamp() - serial;
+		error = !forkJoin<dkit::spin_wait>("spin_wait", 2, n, serial, answer) ||
+				!forkJoin<dkit::yield_wait>("yield_wait", 1, n, serial, answer) ||
+				!forkJoin<dkit::yield_wait>("yield_wait", 4, n, serial, answer) ||
+				!forkJoin<dkit::park_wait>("park_wait", 1, n, serial, answer) ||
+				!forkJoin<dkit::park_wait>("park_wait", 4, n, serial, answer);
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
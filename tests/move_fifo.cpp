@@ -0,0 +1,290 @@
+/**
+ * This is the tests for the move semantics of the FIFO queues - a move-only
+ * value, a value with no default constructor that's emplace()-ed, and a
+ * value that counts its instances, so that we know every one is destroyed
+ * when it's popped, cleared, or the queue goes away.
+ */
+//	System Headers
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "spsc/CircularFIFO.h"
+#include "spsc/CachedCircularFIFO.h"
+#include "spsc/DynamicCircularFIFO.h"
+#include "mpsc/CircularFIFO.h"
+#include "mpsc/DynamicCircularFIFO.h"
+#include "mpsc/LinkedFIFO.h"
+#include "mpsc/SegmentedFIFO.h"
+#include "spmc/CircularFIFO.h"
+#include "spmc/DynamicCircularFIFO.h"
+#include "spmc/LinkedFIFO.h"
+#include "mpmc/CircularFIFO.h"
+
+
+/**
+ * This is the move-only value - it can only be moved into, and out of,
+ * the queues.
+ */
+typedef std::unique_ptr<int32_t>	owned_t;
+
+
+/**
+ * This is a value with no default constructor, so it can only be put
+ * on a queue by copying, moving, or emplace()-ing it.
+ */
+struct Quote {
+	std::string		symbol;
+	int32_t			price;
+
+	Quote( const std::string & aSymbol, int32_t aPrice ) : symbol(aSymbol), price(aPrice) { }
+};
+
+
+/**
+ * This is a value that keeps a count of how many of them are alive, so
+ * we can see that the queues destroy what they hold.
+ */
+struct Counted {
+	static int32_t	live;
+	int32_t			id;
+
+	explicit Counted( int32_t anId ) : id(anId) { ++live; }
+	Counted( const Counted & anOther ) : id(anOther.id) { ++live; }
+	Counted( Counted && anOther ) : id(anOther.id) { ++live; }
+	Counted & operator=( const Counted & anOther ) { id = anOther.id; return *this; }
+	Counted & operator=( Counted && anOther ) { id = anOther.id; return *this; }
+	~Counted() { --live; }
+};
+int32_t		Counted::live = 0;
+
+
+/**
+ * This moves, and emplaces, move-only values through the queue, and then
+ * makes sure that the copying methods throw, rather than crash.
+ */
+template <class Q> bool moveOnly( Q & aQueue )
+{
+	bool	error = false;
+
+	// move some in, and emplace some more - alternating
+	for (int32_t i = 0; !error && (i < 6); ++i) {
+		bool	ok = false;
+		if ((i % 2) == 0) {
+			owned_t		p(new int32_t(i));
+			ok = aQueue.push(std::move(p)) && (p.get() == NULL);
+		} else {
+			ok = aQueue.emplace(new int32_t(i));
+		}
+		if (!ok) {
+			error = true;
+			std::cout << "ERROR - could not move in the value " << i << std::endl;
+		}
+	}
+	// a copy of a move-only value needs to throw a logic_error
+	if (!error) {
+		bool	threw = false;
+		try {
+			owned_t		p(new int32_t(99));
+			aQueue.push((const owned_t &)p);
+		} catch (std::logic_error & le) {
+			threw = true;
+		}
+		try {
+			aQueue.peek();
+			threw = false;
+		} catch (std::logic_error & le) {
+		}
+		if (!threw) {
+			error = true;
+			std::cout << "ERROR - copying a move-only value did not throw a logic_error" << std::endl;
+		}
+	}
+	// now get them back out - in order, with both forms of pop()
+	for (int32_t i = 0; !error && (i < 6); ++i) {
+		owned_t		p;
+		if ((i % 2) == 0) {
+			if (!aQueue.pop(p)) {
+				p.reset();
+			}
+		} else {
+			p = aQueue.pop();
+		}
+		if (!p || (*p != i)) {
+			error = true;
+			std::cout << "ERROR - could not move out the value " << i << std::endl;
+		}
+	}
+	if (!error && !aQueue.empty()) {
+		error = true;
+		std::cout << "ERROR - the queue isn't empty at the end" << std::endl;
+	}
+
+	return !error;
+}
+
+
+/**
+ * This emplaces a value with no default constructor, and then peeks and
+ * pops it - which needs no default constructor either.
+ */
+template <class Q> bool noDefault( Q & aQueue )
+{
+	bool	error = false;
+
+	if (!aQueue.emplace("AAPL", 150) || !aQueue.push(Quote("IBM", 120))) {
+		error = true;
+		std::cout << "ERROR - could not emplace a Quote" << std::endl;
+	}
+	if (!error) {
+		Quote	top = aQueue.peek();
+		Quote	first = aQueue.pop();
+		Quote	second("", 0);
+		if ((top.symbol != "AAPL") || (first.symbol != "AAPL") || (first.price != 150) ||
+			!aQueue.pop(second) || (second.symbol != "IBM") || (second.price != 120)) {
+			error = true;
+			std::cout << "ERROR - the Quotes did not come out as they went in" << std::endl;
+		}
+	}
+
+	return !error;
+}
+
+
+/**
+ * This makes sure that the queue doesn't hold any T's it doesn't have to
+ * - none to start, none after a pop(), and none after a clear().
+ */
+template <class Q> bool lifetimes( Q & aQueue )
+{
+	bool	error = false;
+
+	if (Counted::live != 0) {
+		error = true;
+		std::cout << "ERROR - an empty queue holds " << Counted::live << " values" << std::endl;
+	}
+	for (int32_t i = 0; !error && (i < 5); ++i) {
+		aQueue.emplace(i);
+	}
+	if (!error) {
+		Counted		c(0);
+		aQueue.pop(c);
+		if (Counted::live != 5) {
+			error = true;
+			std::cout << "ERROR - after a pop() there are " << Counted::live << " values, not 5" << std::endl;
+		}
+	}
+	if (!error) {
+		aQueue.clear();
+		if (Counted::live != 0) {
+			error = true;
+			std::cout << "ERROR - after a clear() there are " << Counted::live << " values" << std::endl;
+		}
+	}
+	// leave a few on the queue for the destructor to clean up
+	for (int32_t i = 0; !error && (i < 3); ++i) {
+		aQueue.push(Counted(i));
+	}
+
+	return !error;
+}
+
+
+/**
+ * This runs all the tests on one kind of queue, where M, D and C are the
+ * queue of move-only values, no-default values and counted values.
+ */
+template <class M, class D, class C> bool exercise( const std::string & aName, M & aMoveOnly, D & aNoDefault, C *aCounted )
+{
+	bool	error = false;
+
+	if (!error && !moveOnly(aMoveOnly)) {
+		error = true;
+	}
+	if (!error && !noDefault(aNoDefault)) {
+		error = true;
+	}
+	if (!error && !lifetimes(*aCounted)) {
+		error = true;
+	}
+	// ...and the destructor needs to clean up what was left
+	delete aCounted;
+	if (!error && (Counted::live != 0)) {
+		error = true;
+		std::cout << "ERROR - the destructor left " << Counted::live << " values" << std::endl;
+	}
+	Counted::live = 0;
+
+	if (!error) {
+		std::cout << "Passed - " << aName << " moves, emplaces, and destroys its values" << std::endl;
+	}
+	return !error;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	if (!error) {
+		dkit::spsc::CircularFIFO<owned_t, 4>	m;
+		dkit::spsc::CircularFIFO<Quote, 4>		d;
+		error = !exercise("spsc::CircularFIFO", m, d, new dkit::spsc::CircularFIFO<Counted, 4>());
+	}
+	if (!error) {
+		dkit::spsc::CachedCircularFIFO<owned_t, 4>	m;
+		dkit::spsc::CachedCircularFIFO<Quote, 4>	d;
+		error = !exercise("spsc::CachedCircularFIFO", m, d, new dkit::spsc::CachedCircularFIFO<Counted, 4>());
+	}
+	if (!error) {
+		dkit::spsc::DynamicCircularFIFO<owned_t>	m(16);
+		dkit::spsc::DynamicCircularFIFO<Quote>		d(16);
+		error = !exercise("spsc::DynamicCircularFIFO", m, d, new dkit::spsc::DynamicCircularFIFO<Counted>(16));
+	}
+	if (!error) {
+		dkit::mpsc::CircularFIFO<owned_t, 4>	m;
+		dkit::mpsc::CircularFIFO<Quote, 4>		d;
+		error = !exercise("mpsc::CircularFIFO", m, d, new dkit::mpsc::CircularFIFO<Counted, 4>());
+	}
+	if (!error) {
+		dkit::mpsc::DynamicCircularFIFO<owned_t>	m(16);
+		dkit::mpsc::DynamicCircularFIFO<Quote>		d(16);
+		error = !exercise("mpsc::DynamicCircularFIFO", m, d, new dkit::mpsc::DynamicCircularFIFO<Counted>(16));
+	}
+	if (!error) {
+		dkit::mpsc::LinkedFIFO<owned_t>		m;
+		dkit::mpsc::LinkedFIFO<Quote>		d;
+		error = !exercise("mpsc::LinkedFIFO", m, d, new dkit::mpsc::LinkedFIFO<Counted>());
+	}
+	if (!error) {
+		dkit::mpsc::SegmentedFIFO<owned_t, 2>	m;
+		dkit::mpsc::SegmentedFIFO<Quote, 2>		d;
+		error = !exercise("mpsc::SegmentedFIFO", m, d, new dkit::mpsc::SegmentedFIFO<Counted, 2>());
+	}
+	if (!error) {
+		dkit::spmc::CircularFIFO<owned_t, 4>	m;
+		dkit::spmc::CircularFIFO<Quote, 4>		d;
+		error = !exercise("spmc::CircularFIFO", m, d, new dkit::spmc::CircularFIFO<Counted, 4>());
+	}
+	if (!error) {
+		dkit::spmc::DynamicCircularFIFO<owned_t>	m(16);
+		dkit::spmc::DynamicCircularFIFO<Quote>		d(16);
+		error = !exercise("spmc::DynamicCircularFIFO", m, d, new dkit::spmc::DynamicCircularFIFO<Counted>(16));
+	}
+	if (!error) {
+		dkit::spmc::LinkedFIFO<owned_t>		m;
+		dkit::spmc::LinkedFIFO<Quote>		d;
+		error = !exercise("spmc::LinkedFIFO", m, d, new dkit::spmc::LinkedFIFO<Counted>());
+	}
+	if (!error) {
+		dkit::mpmc::CircularFIFO<owned_t, 4>	m;
+		dkit::mpmc::CircularFIFO<Quote, 4>		d;
+		error = !exercise("mpmc::CircularFIFO", m, d, new dkit::mpmc::CircularFIFO<Counted, 4>());
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
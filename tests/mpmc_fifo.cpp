@@ -0,0 +1,414 @@
+/**
+ * This is the tests for the MPMC CircularFIFO
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "mpmc/CircularFIFO.h"
+#include "util/timer.h"
+#include "hammer.h"
+#include "drain.h"
+
+
+/**
+ * When a producer finds the queue full, or a consumer finds it empty, it's
+ * going to spin a bit and then yield the CPU - so that the contention test
+ * finishes in a reasonable time even when the threads have to share a core.
+ */
+static inline void backoff( uint32_t & aSpins )
+{
+	if (++aSpins > 100) {
+		sched_yield();
+		aSpins = 0;
+	}
+}
+
+
+/**
+ * This is a producer for the contention test - like the Hammer, but it
+ * waits for room in the queue rather than giving up when it's full.
+ */
+struct Pusher {
+	dkit::FIFO<int32_t>	*queue;
+	int32_t				count;
+
+	Pusher( dkit::FIFO<int32_t> *aQueue, int32_t aCount ) : queue(aQueue), count(aCount) { }
+	void operator()()
+	{
+		uint32_t	spins = 0;
+		for (int32_t i = 0; i < count; ++i) {
+			while (!queue->push(i)) {
+				backoff(spins);
+			}
+		}
+	}
+};
+
+
+/**
+ * This is a consumer for the contention test - like the Drain, but it
+ * stops when all the consumers, together, have popped 'total' values, and
+ * it keeps a sum of what it popped so that we can check nothing was lost,
+ * or popped twice.
+ */
+struct Popper {
+	dkit::FIFO<int32_t>	*queue;
+	volatile int64_t	*popped;
+	int64_t				total;
+	int64_t				sum;
+
+	Popper( dkit::FIFO<int32_t> *aQueue, volatile int64_t *aPopped, int64_t aTotal ) :
+		queue(aQueue), popped(aPopped), total(aTotal), sum(0) { }
+	void operator()()
+	{
+		int32_t		v = 0;
+		uint32_t	spins = 0;
+		while (__sync_or_and_fetch(popped, 0) < total) {
+			if (queue->pop(v)) {
+				sum += v;
+				__sync_add_and_fetch(popped, 1);
+			} else {
+				backoff(spins);
+			}
+		}
+	}
+};
+
+
+/**
+ * These are the threads for the peek() test - the values are strings too
+ * long to be kept in the string itself, so each one is on the heap, and a
+ * consumer that pops one frees it. The producer makes them, the consumers
+ * pop them, taking a break now and then, and the peeker looks at whatever's at the head, over and over,
+ * and checks it's all there.
+ */
+typedef dkit::mpmc::CircularFIFO<std::string, 6>	strings_t;
+
+static std::string make_string( int32_t aValue )
+{
+	return std::string(48, (char)('a' + (aValue % 26))) + std::to_string(aValue);
+}
+
+static bool whole_string( const std::string & aValue )
+{
+	size_t	digits = aValue.find_first_of("0123456789");
+	return ((digits == 48) && (aValue == make_string(std::stoi(aValue.substr(digits)))));
+}
+
+static volatile bool	__peekDone = false;
+
+struct StringPusher {
+	strings_t	*queue;
+	int32_t		count;
+
+	StringPusher( strings_t *aQueue, int32_t aCount ) : queue(aQueue), count(aCount) { }
+	void operator()()
+	{
+		uint32_t	spins = 0;
+		for (int32_t i = 0; i < count; ++i) {
+			while (!queue->push(make_string(i))) {
+				backoff(spins);
+			}
+		}
+	}
+};
+
+struct StringPopper {
+	strings_t			*queue;
+	volatile int64_t	*popped;
+	int64_t				total;
+	int64_t				sum;
+
+	StringPopper( strings_t *aQueue, volatile int64_t *aPopped, int64_t aTotal ) :
+		queue(aQueue), popped(aPopped), total(aTotal), sum(0) { }
+	void operator()()
+	{
+		std::string		v;
+		uint32_t		spins = 0;
+		while (__sync_or_and_fetch(popped, 0) < total) {
+			if (queue->pop(v)) {
+				sum += std::stoi(v.substr(48));
+				__sync_add_and_fetch(popped, 1);
+				// ...a little work, so the queue has something to peek at
+				if ((sum % 4) == 0) {
+					sched_yield();
+				}
+			} else {
+				backoff(spins);
+			}
+		}
+	}
+};
+
+struct StringPeeker {
+	strings_t	*queue;
+	int64_t		peeks;
+	bool		whole;
+
+	StringPeeker( strings_t *aQueue ) : queue(aQueue), peeks(0), whole(true) { }
+	void operator()()
+	{
+		std::string		v;
+		for (uint32_t i = 1; !__peekDone; ++i) {
+			if (queue->peek(v)) {
+				whole = whole && whole_string(v);
+				++peeks;
+			}
+			if ((i % 64) == 0) {
+				sched_yield();
+			}
+		}
+	}
+};
+
+
+/**
+ * This runs 'aProds' producers, each pushing 'aCount' values, against
+ * 'aCons' consumers on the one queue, and returns the ns/op for the run,
+ * or a negative value if the values popped don't match those pushed.
+ */
+double contend( dkit::FIFO<int32_t> *aQueue, uint32_t aProds, uint32_t aCons, int32_t aCount )
+{
+	volatile int64_t	popped = 0;
+	int64_t				total = (int64_t)aProds * aCount;
+	std::vector<Popper>	dest(aCons, Popper(aQueue, &popped, total));
+	boost::thread_group	thrs;
+	// get the starting time and start the consumers, then producers
+	uint64_t	goTime = dkit::util::timer::usecStamp();
+	for (uint32_t i = 0; i < aCons; ++i) {
+		thrs.create_thread(boost::ref(dest[i]));
+	}
+	for (uint32_t i = 0; i < aProds; ++i) {
+		thrs.create_thread(Pusher(aQueue, aCount));
+	}
+	thrs.join_all();
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	// every producer pushed 0..aCount-1, so that's what the sum should be
+	int64_t		sum = 0;
+	for (uint32_t i = 0; i < aCons; ++i) {
+		sum += dest[i].sum;
+	}
+	int64_t		want = (int64_t)aProds * ((int64_t)aCount * (aCount - 1) / 2);
+	return ((sum == want) ? (goTime * 1000.0)/total : -1.0);
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	// make a circular FIFO of 4096 int32_t values - max
+	dkit::mpmc::CircularFIFO<int32_t, 12>	q;
+	// put 500 values on the queue - and check the size
+	if (!error) {
+		std::cout << "=== Testing speed and correctness of CircularFIFO ===" << std::endl;
+
+		// get the starting time
+		uint64_t	goTime = dkit::util::timer::usecStamp();
+
+		// do this often enough to rotate through the size of the values
+		int32_t		trips = 100000;
+		for (int32_t cycle = 0; cycle < trips; ++cycle) {
+			// put 500 values on the queue - and check the size
+			for (int32_t i = 0; i < 500; ++i) {
+				if (!q.push(i)) {
+					error = true;
+					std::cout << "ERROR - could not push the value " << i << std::endl;
+					break;
+				}
+			}
+			// now check the size
+			if (!error) {
+				if (q.size() != 500) {
+					error = true;
+					std::cout << "ERROR - pushed 500 integers, but size() reports only " << q.size() << std::endl;
+				} else {
+					if (cycle == 0) {
+						std::cout << "Passed - pushed on 500 integers" << std::endl;
+					}
+				}
+			}
+			// pop off 500 integers and it should be empty
+			if (!error) {
+				int32_t		v = 0;
+				for (int32_t i = 0; i < 500; ++i) {
+					if (!q.pop(v) || (v != i)) {
+						error = true;
+						std::cout << "ERROR - could not pop the value " << i << std::endl;
+						break;
+					}
+				}
+			}
+			// now check the size
+			if (!error) {
+				if (!q.empty()) {
+					error = true;
+					std::cout << "ERROR - popped 500 integers, but size() reports " << q.size() << std::endl;
+				} else {
+					if (cycle == 0) {
+						std::cout << "Passed - popped all 500 integers" << std::endl;
+					}
+				}
+			}
+			// now make sure we can't pop() anything
+			if (!error) {
+				int32_t		v = 0;
+				if (!q.pop(v)) {
+					if (cycle == 0) {
+						std::cout << "Passed - unable to pop from an empty queue" << std::endl;
+					}
+				} else {
+					error = true;
+					std::cout << "ERROR - popped " << v << " from an empty queue - shouldn't be possible" << std::endl;
+				}
+			}
+			if (error) {
+				break;
+			}
+		}
+
+		// get the elapsed time
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		std::cout << "Passed - did " << (trips * 500) << " push/pop pairs in " << (goTime/1000.0) << "ms = " << ((goTime * 1000.0)/(trips * 500.0)) << "ns/op" << std::endl;
+	}
+
+	// check on what happens when the queue is full
+	if (!error) {
+		// make sure it's all cleared out for this test
+		q.clear();
+
+		std::cout << "=== Testing a full CircularFIFO ===" << std::endl;
+
+		// push values starting at 0 up until we can't push any more
+		int32_t		v = 0;
+		int32_t		lim = 0;
+		while (q.push(lim)) {
+			++lim;
+		}
+		if ((size_t)lim != q.capacity()) {
+			error = true;
+			std::cout << "ERROR - failed on pushing " << lim << " and not " << q.capacity() << std::endl;
+		} else {
+			std::cout << "Passed - filled all " << lim << " slots" << std::endl;
+		}
+		for (int32_t i = 0; !error && (i < lim); ++i) {
+			if (!q.pop(v) || (v != i)) {
+				error = true;
+				std::cout << "ERROR - could not pop the value " << i << std::endl;
+			}
+		}
+		if (!error) {
+			std::cout << "Passed - after filling, still able to recover all values" << std::endl;
+		}
+	}
+
+	/**
+	 * Make a set of Hammers and a set of Drains and test threading
+	 */
+	if (!error) {
+		Hammer	*src[] = { NULL, NULL, NULL, NULL };
+		Drain	*dest[] = { NULL, NULL, NULL, NULL };
+		for (uint32_t i = 0; i < 4; ++i) {
+			src[i] = new Hammer(i, &q, 1000);
+			dest[i] = new Drain(i, &q);
+		}
+		// now start the drains then the hammers
+		for (uint32_t i = 0; i < 4; ++i) {
+			dest[i]->start();
+		}
+		for (uint32_t i = 0; i < 4; ++i) {
+			src[i]->start();
+		}
+		// now let's wait for the hammers to be done
+		for (uint32_t i = 0; i < 4; ++i) {
+			while (!src[i]->isDone()) {
+				usleep(250000);
+			}
+		}
+		// now tell the drains to stop when the queue is empty
+		for (uint32_t i = 0; i < 4; ++i) {
+			dest[i]->stopOnEmpty();
+		}
+		// wait for all the drains to be done and tally up the counts
+		uint32_t	cnt[] = { 0, 0, 0, 0 };
+		uint32_t	total = 0;
+		for (uint32_t i = 0; i < 4; ++i) {
+			while (!dest[i]->isDone()) {
+				usleep(250000);
+			}
+			cnt[i] = dest[i]->getCount();
+			total += cnt[i];
+		}
+		// now let's see what we have
+		if (total == 4000) {
+			std::cout << "Passed - popped " << total << " integers (" << cnt[0] << "+" << cnt[1] << "+" << cnt[2] << "+" << cnt[3] << "), with four hammer and four drain threads" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - popped " << total << " integers (" << cnt[0] << "+" << cnt[1] << "+" << cnt[2] << "+" << cnt[3] << "), with four hammer and four drain threads - but should have popped 4000" << std::endl;
+		}
+		// finally, clean things up
+		for (uint32_t i = 0; i < 4; ++i) {
+			delete src[i];
+			delete dest[i];
+		}
+	}
+
+	/**
+	 * Scale up the producers and consumers and see how the queue holds up
+	 */
+	if (!error) {
+		std::cout << "=== Contention of 1..4 producers and 1..4 consumers ===" << std::endl;
+		dkit::mpmc::CircularFIFO<int32_t, 10>	cq;
+		for (uint32_t p = 1; !error && (p <= 4); p *= 2) {
+			for (uint32_t c = 1; !error && (c <= 4); c *= 2) {
+				double	ns = contend(&cq, p, c, 100000 / p);
+				if (ns < 0.0) {
+					error = true;
+					std::cout << "ERROR - " << p << " producers, " << c << " consumers lost or duplicated values!" << std::endl;
+				} else {
+					std::cout << "Passed - " << p << " producers, " << c << " consumers = " << ns << " ns/op" << std::endl;
+				}
+			}
+		}
+	}
+
+	/**
+	 * A peek() at a value that isn't trivially copyable has to see it
+	 * whole, even with other consumers popping - and freeing - the values
+	 */
+	if (!error) {
+		std::cout << "=== Testing peek() with two consumers popping strings ===" << std::endl;
+		strings_t			sq;
+		int32_t				cnt = 200000;
+		volatile int64_t	popped = 0;
+		StringPopper		c1(&sq, &popped, cnt);
+		StringPopper		c2(&sq, &popped, cnt);
+		StringPeeker		look(&sq);
+		boost::thread_group	thrs;
+		thrs.create_thread(boost::ref(c1));
+		thrs.create_thread(boost::ref(c2));
+		boost::thread		peeker(boost::ref(look));
+		thrs.create_thread(StringPusher(&sq, cnt));
+		thrs.join_all();
+		__peekDone = true;
+		peeker.join();
+		if ((c1.sum + c2.sum) != ((int64_t)cnt * (cnt - 1) / 2)) {
+			error = true;
+			std::cout << "ERROR - the consumers lost, or duplicated, strings while they were peeked at!" << std::endl;
+		} else if (!look.whole) {
+			error = true;
+			std::cout << "ERROR - peek() saw a string that wasn't whole!" << std::endl;
+		} else {
+			std::cout << "Passed - " << look.peeks << " peeks, all whole, while " << cnt << " strings were popped" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
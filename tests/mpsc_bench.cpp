@@ -0,0 +1,122 @@
+/**
+ * This is the producer-scaling benchmark of the MPSC CircularFIFO - from 1
+ * to 16 producers push onto a small ring that's kept nearly full, as the
+ * single consumer can't keep up, so that the producers are always fighting
+ * over the last few free slots.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "mpsc/CircularFIFO.h"
+#include "util/timer.h"
+
+
+/**
+ * When a producer finds the queue full, or the consumer finds it empty,
+ * it's going to spin a bit and then yield the CPU - so that these tests
+ * finish in a reasonable time even when the threads have to share a core.
+ */
+static inline void backoff( uint32_t & aSpins )
+{
+	if (++aSpins > 100) {
+		sched_yield();
+		aSpins = 0;
+	}
+}
+
+
+/**
+ * This is a producer for the benchmark - it pushes 'count' values onto
+ * the queue, and when the queue is full, it waits for room and tries the
+ * same value again. It also counts how many times it found it full.
+ */
+template <class Q> struct Producer {
+	Q			*queue;
+	int32_t		count;
+	uint64_t	fulls;
+
+	Producer( Q *aQueue, int32_t aCount ) : queue(aQueue), count(aCount), fulls(0) { }
+	void operator()()
+	{
+		uint32_t	spins = 0;
+		for (int32_t i = 0; i < count; ++i) {
+			while (!queue->push(i)) {
+				++fulls;
+				backoff(spins);
+			}
+		}
+	}
+};
+
+
+/**
+ * This runs 'aProds' producers, together pushing 'aTotal' values, onto
+ * one queue of type Q, and pops them all off in this thread. It returns
+ * the ns/op for the run, or a negative value if the sum of the popped
+ * values doesn't match what was pushed.
+ */
+template <class Q> double scale( uint32_t aProds, int32_t aTotal, uint64_t & aFulls )
+{
+	Q					*q = new Q();
+	int32_t				cnt = aTotal / aProds;
+	std::vector< Producer<Q> >	src(aProds, Producer<Q>(q, cnt));
+	boost::thread_group	thrs;
+	// get the starting time and start the producers
+	uint64_t	goTime = dkit::util::timer::usecStamp();
+	for (uint32_t i = 0; i < aProds; ++i) {
+		thrs.create_thread(boost::ref(src[i]));
+	}
+	// ...and be the one consumer
+	int64_t		sum = 0;
+	int32_t		v = 0;
+	uint32_t	spins = 0;
+	for (int64_t i = 0; i < (int64_t)aProds * cnt; ++i) {
+		while (!q->pop(v)) {
+			backoff(spins);
+		}
+		sum += v;
+	}
+	thrs.join_all();
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	delete q;
+	// tally up the fulls, and check the sum of 0..cnt-1 for each producer
+	aFulls = 0;
+	for (uint32_t i = 0; i < aProds; ++i) {
+		aFulls += src[i].fulls;
+	}
+	int64_t		want = (int64_t)aProds * ((int64_t)cnt * (cnt - 1) / 2);
+	return ((sum == want) ? (goTime * 1000.0)/((int64_t)aProds * cnt) : -1.0);
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	// a small ring - 64 slots - that the producers will keep full
+	typedef dkit::mpsc::CircularFIFO<int32_t, 6>	mpsc_q;
+
+	if (!error) {
+		std::cout << "=== Scaling 1..16 producers on a nearly full CircularFIFO ===" << std::endl;
+		for (uint32_t p = 1; !error && (p <= 16); p *= 2) {
+			uint64_t	fulls = 0;
+			double		ns = scale<mpsc_q>(p, 1000000, fulls);
+			if (ns < 0.0) {
+				error = true;
+				std::cout << "ERROR - with " << p << " producers values were lost or duplicated!" << std::endl;
+			} else {
+				std::cout << "Passed - " << p << " producers = " << ns << " ns/op ("
+						  << fulls << " pushes found it full)" << std::endl;
+			}
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -114,6 +114,64 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	/**
+	 * Reserve two slots, and commit the second first - the consumer can't
+	 * see it until the first is committed, too, and then sees them in order.
+	 */
+	if (!error) {
+		q.clear();
+		std::cout << "=== Testing in-place try_reserve/commit and try_front/release ===" << std::endl;
+		int32_t		*a = q.try_reserve();
+		int32_t		*b = q.try_reserve();
+		*a = 1;
+		*b = 2;
+		q.commit(b);
+		if (q.try_front() != NULL) {
+			error = true;
+			std::cout << "ERROR - try_front() saw past a reservation that isn't committed" << std::endl;
+		} else {
+			q.commit(a);
+			const int32_t	*f = q.try_front();
+			if ((f == NULL) || (*f != 1)) {
+				error = true;
+				std::cout << "ERROR - try_front() didn't see the first committed value" << std::endl;
+			} else {
+				q.release();
+				f = q.try_front();
+				if ((f == NULL) || (*f != 2)) {
+					error = true;
+					std::cout << "ERROR - try_front() didn't see the second committed value" << std::endl;
+				} else {
+					q.release();
+					std::cout << "Passed - committed out of order, and read back in order, in place" << std::endl;
+				}
+			}
+		}
+		// ...and the reservations have to respect a full queue
+		int32_t		cnt = 0;
+		int32_t		*p = NULL;
+		while (!error && ((p = q.try_reserve()) != NULL)) {
+			*p = cnt++;
+			q.commit(p);
+		}
+		if (!error && (cnt != (int32_t)q.capacity())) {
+			error = true;
+			std::cout << "ERROR - try_reserve() gave out " << cnt << " slots, but the queue holds " << q.capacity() << std::endl;
+		} else if (!error) {
+			int32_t		v = 0;
+			for (int32_t i = 0; i < cnt; ++i) {
+				if (!q.pop(v) || (v != i)) {
+					error = true;
+					std::cout << "ERROR - could not pop the reserved value " << i << std::endl;
+					break;
+				}
+			}
+			if (!error) {
+				std::cout << "Passed - reserved all " << cnt << " slots, and popped them in order" << std::endl;
+			}
+		}
+	}
+
 	/**
 	 * Make a set of Hammers and a Drain and test threading
 	 */
@@ -0,0 +1,290 @@
+/**
+ * This is the tests for the trie with ordered_keys - that apply() sees
+ * the values in the order of their keys, and that range(), lower_bound(),
+ * prefix() and the cursor find just what a std::set of the same keys
+ * says they should, in the same order - even with values removed, and
+ * for the smaller key sizes, and the 128-bit one.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <set>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "trie.h"
+#include "util/timer.h"
+
+
+class blob {
+	public:
+		blob() : _when(0) { }
+		blob(uint64_t aWhen) : _when(aWhen) { }
+		virtual ~blob() { }
+		uint64_t getValue() const { return _when; }
+	private:
+		uint64_t		_when;
+};
+
+uint64_t key_value( const blob *aValue )
+{
+	return (*aValue).getValue();
+}
+
+typedef dkit::trie<blob *, dkit::uint64_key, dkit::dense_trie, dkit::ordered_keys>	ordered_t;
+typedef dkit::trie<blob *, dkit::uint32_key, dkit::dense_trie, dkit::ordered_keys>	ordered32_t;
+typedef dkit::trie<blob *, dkit::uint128_key, dkit::dense_trie, dkit::ordered_keys>	ordered128_t;
+
+
+/**
+ * The key_value() is only 64 bits, so to get a key with any of the high
+ * 8 bytes set into a uint128_key trie, this puts it in by its bytes.
+ */
+class wide_trie : public ordered128_t
+{
+	public:
+		void put( const uint8_t aKey[], blob *aValue )
+		{
+			const_cast<ordered128_t::Node *>(getOrCreateNodeForKey(aKey))->assign(aValue);
+		}
+};
+
+
+/**
+ * This functor just keeps the keys of the values it's handed, in order.
+ */
+template <class TRIE> class collector : public TRIE::functor
+{
+	public:
+		collector( size_t aLimit = 0 ) : _keys(), _limit(aLimit) { }
+		virtual ~collector() { }
+		virtual bool process( volatile typename TRIE::Node & aNode )
+		{
+			_keys.push_back(((blob *)aNode.value)->getValue());
+			return ((_limit == 0) || (_keys.size() < _limit));
+		}
+		const std::vector<uint64_t> & keys() const { return _keys; }
+	private:
+		std::vector<uint64_t>	_keys;
+		size_t					_limit;
+};
+
+
+/**
+ * This returns 'true' if the keys the functor saw are just the ones in
+ * the set from 'aFirst' up to, but not including, 'aLast'.
+ */
+bool same( const std::vector<uint64_t> & aSeen, std::set<uint64_t>::const_iterator aFirst,
+		   std::set<uint64_t>::const_iterator aLast )
+{
+	size_t		i = 0;
+	for (; aFirst != aLast; ++aFirst, ++i) {
+		if ((i >= aSeen.size()) || (aSeen[i] != *aFirst)) {
+			return false;
+		}
+	}
+	return (i == aSeen.size());
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * Fill one with some packed runs of keys, and some scattered ones,
+	 * and keep the same keys in a std::set to check it against.
+	 */
+	ordered_t			m;
+	std::set<uint64_t>	keys;
+	srandom(42);
+	for (uint64_t i = 0; i < 20000; ++i) {
+		uint64_t	k = 0x0102030400000000ULL + i * 3;
+		m.put(new blob(k));
+		keys.insert(k);
+	}
+	for (uint32_t i = 0; i < 2000; ++i) {
+		uint64_t	k = (((uint64_t)random() << 33) ^ ((uint64_t)random() << 11) ^ (uint64_t)random());
+		if (keys.insert(k).second) {
+			m.put(new blob(k));
+		}
+	}
+	blob	*bp = NULL;
+	for (std::set<uint64_t>::const_iterator it = keys.begin(); !error && (it != keys.end()); ++it) {
+		if (!m.get(*it, bp) || (bp->getValue() != *it)) {
+			error = true;
+			std::cout << "ERROR - couldn't get key " << *it << " from the ordered trie!" << std::endl;
+		}
+	}
+
+	if (!error) {
+		std::cout << "=== Testing apply() and the cursor in key order ===" << std::endl;
+		collector<ordered_t>	c;
+		m.apply(c);
+		if (same(c.keys(), keys.begin(), keys.end())) {
+			std::cout << "Passed - apply() saw all " << c.keys().size() << " values in key order" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - apply() didn't see the values in key order!" << std::endl;
+		}
+	}
+	if (!error) {
+		std::vector<uint64_t>	seen;
+		uint64_t	goTime = dkit::util::timer::usecStamp();
+		for (ordered_t::cursor c(m); c.valid(); c.next()) {
+			seen.push_back(c.key());
+		}
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		if (same(seen, keys.begin(), keys.end())) {
+			std::cout << "Passed - the cursor walked all " << seen.size() << " keys in order at "
+					  << (1000.0 * goTime / seen.size()) << " nsec/key" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the cursor didn't walk the keys in order!" << std::endl;
+		}
+	}
+
+	/**
+	 * Then the range(), lower_bound() and prefix() on a bunch of random
+	 * bounds - the set has the answers
+	 */
+	if (!error) {
+		std::cout << "=== Testing range(), lower_bound() and prefix() ===" << std::endl;
+		for (uint32_t i = 0; !error && (i < 500); ++i) {
+			uint64_t	lo = 0x0102030400000000ULL + (random() % 70000);
+			uint64_t	hi = lo + (random() % 500);
+			if ((i % 5) == 0) {
+				lo = (((uint64_t)random() << 33) ^ (uint64_t)random());
+				hi = lo + (((uint64_t)random() << 30));
+				if (hi < lo) {
+					hi = 0xffffffffffffffffULL;
+				}
+			}
+			collector<ordered_t>	c;
+			m.range(lo, hi, c);
+			if (!same(c.keys(), keys.lower_bound(lo), keys.lower_bound(hi))) {
+				error = true;
+				std::cout << "ERROR - range(" << lo << ", " << hi << ") saw " << c.keys().size() << " keys!" << std::endl;
+			}
+			uint64_t	found = 0;
+			std::set<uint64_t>::const_iterator	it = keys.lower_bound(lo);
+			bool		hit = m.lower_bound(lo, found, bp);
+			if ((hit != (it != keys.end())) || (hit && ((found != *it) || (bp->getValue() != *it)))) {
+				error = true;
+				std::cout << "ERROR - lower_bound(" << lo << ") found " << found << "!" << std::endl;
+			}
+		}
+		if (!error) {
+			std::cout << "Passed - 500 random ranges and lower bounds matched a std::set" << std::endl;
+		}
+	}
+	if (!error) {
+		collector<ordered_t>	c;
+		m.prefix(0x0102030400000000ULL, 6, c);
+		collector<ordered_t>	c2;
+		m.prefix(0x0102030400000000ULL, 7, c2);
+		collector<ordered_t>	c3(10);
+		bool					stopped = !m.prefix(0x0102030400000000ULL, 4, c3);
+		if (same(c.keys(), keys.lower_bound(0x0102030400000000ULL), keys.lower_bound(0x0102030400010000ULL)) &&
+			same(c2.keys(), keys.lower_bound(0x0102030400000000ULL), keys.lower_bound(0x0102030400000100ULL)) &&
+			!c.keys().empty() && !c2.keys().empty() && stopped && (c3.keys().size() == 10)) {
+			std::cout << "Passed - prefix() saw " << c.keys().size() << " and " << c2.keys().size()
+					  << " keys, and stopped when told" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - prefix() didn't see the right keys!" << std::endl;
+		}
+	}
+
+	/**
+	 * Take out every other one of the packed keys, and the cursor, and
+	 * range(), have to skip right over them
+	 */
+	if (!error) {
+		std::cout << "=== Testing the cursor with values removed ===" << std::endl;
+		for (uint64_t i = 0; i < 20000; i += 2) {
+			uint64_t	k = 0x0102030400000000ULL + i * 3;
+			if (m.remove(k, bp)) {
+				delete bp;
+			}
+			keys.erase(k);
+		}
+		std::vector<uint64_t>	seen;
+		for (ordered_t::cursor c(m, 0x0102030400000000ULL); c.valid() && (seen.size() < 5000); c.next()) {
+			seen.push_back(c.key());
+		}
+		std::set<uint64_t>::const_iterator	first = keys.lower_bound(0x0102030400000000ULL);
+		std::set<uint64_t>::const_iterator	last = first;
+		for (uint32_t i = 0; (i < 5000) && (last != keys.end()); ++i) {
+			++last;
+		}
+		collector<ordered_t>	c;
+		m.range(0, 0xffffffffffffffffULL, c);
+		if (same(seen, first, last) && (c.keys().size() + 1 >= keys.size())) {
+			std::cout << "Passed - the cursor skipped the " << (20000 / 2) << " removed values" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the cursor didn't skip the removed values!" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, a smaller key size - it's the last four bytes of the key
+	 * that count, most significant first
+	 */
+	if (!error) {
+		std::cout << "=== Testing a uint32_key ordered trie ===" << std::endl;
+		ordered32_t		s;
+		for (uint64_t k = 0; k < 1000; ++k) {
+			s.put(new blob(0xfffffff0 - k * 0x10001));
+		}
+		collector<ordered32_t>	c;
+		s.apply(c);
+		bool	ordered = (c.keys().size() == 1000);
+		for (size_t i = 1; ordered && (i < c.keys().size()); ++i) {
+			ordered = (c.keys()[i - 1] < c.keys()[i]);
+		}
+		uint64_t	found = 0;
+		if (ordered && s.lower_bound((uint32_t)0x10000, found, bp) && (found == 0xfffffff0 - 999 * 0x10001)) {
+			std::cout << "Passed - the uint32_key trie is in key order" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the uint32_key trie isn't in key order!" << std::endl;
+		}
+	}
+
+	/**
+	 * In a uint128_key trie, the end of a range() is on all 16 bytes of
+	 * the key - a key past 2^64 whose low half is in the range isn't.
+	 */
+	if (!error) {
+		std::cout << "=== Testing range() on a uint128_key ordered trie ===" << std::endl;
+		wide_trie		w;
+		uint8_t			key[16];
+		for (uint64_t k = 0; k < 100; ++k) {
+			memset(key, 0, sizeof(key));
+			key[15] = (uint8_t)k;
+			w.put(key, new blob(k));
+			key[7] = 1;
+			w.put(key, new blob(0x100 + k));
+		}
+		collector<ordered128_t>	c;
+		w.range(10, 200, c);
+		std::set<uint64_t>	want;
+		for (uint64_t k = 10; k < 100; ++k) {
+			want.insert(k);
+		}
+		if (same(c.keys(), want.begin(), want.end())) {
+			std::cout << "Passed - range() stopped at the end on all the bytes of the key" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - range(10, 200) saw " << c.keys().size() << " keys, and not 90!" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -0,0 +1,247 @@
+/**
+ * This is the tests for the parallel size(), empty(), clear() and apply()
+ * on the dense trie - that they get just what the serial ones do, that a
+ * reducer's parts come back in the order of the trie, and then how long
+ * a full walk takes serially, and on the executor.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "trie.h"
+#include "executor.h"
+#include "util/timer.h"
+
+
+class blob {
+	public:
+		blob() : _when(0) { }
+		blob(uint64_t aWhen) : _when(aWhen) { }
+		virtual ~blob() { }
+		uint64_t getValue() const { return _when; }
+	private:
+		uint64_t		_when;
+};
+
+uint64_t key_value( const blob *aValue )
+{
+	return (*aValue).getValue();
+}
+
+typedef dkit::trie<blob *, dkit::uint64_key, dkit::dense_trie, dkit::ordered_keys>	ordered_t;
+typedef dkit::trie<blob *, dkit::uint64_key>										native_t;
+
+
+/**
+ * This is the key for the i-th value - runs of 256 in a row, so each run
+ * fills a Leaf, with the runs spread out over the first two bytes.
+ */
+uint64_t key_for( uint64_t i )
+{
+	return (((i >> 8) << 44) | (i & 0xff));
+}
+
+
+/**
+ * This reducer counts the values, and adds up their keys - the kind of
+ * thing a snapshot does - and each part just has its own totals.
+ */
+template <class TRIE> class summer : public TRIE::reducer
+{
+	public:
+		summer() : count(0), total(0) { }
+		virtual ~summer() { }
+		virtual typename TRIE::reducer *fork() { return new summer<TRIE>(); }
+		virtual bool process( volatile typename TRIE::Node & aNode )
+		{
+			++count;
+			total += ((blob *)aNode.value)->getValue();
+			return true;
+		}
+		virtual void combine( typename TRIE::reducer & aPart )
+		{
+			summer<TRIE>	&p = static_cast<summer<TRIE> &>(aPart);
+			count += p.count;
+			total += p.total;
+		}
+		uint64_t	count;
+		uint64_t	total;
+};
+
+
+/**
+ * This reducer keeps the keys, in the order it sees them, and combining
+ * them just tacks a part's on the end - so in an ordered trie, they have
+ * to come out in order.
+ */
+class lister : public ordered_t::reducer
+{
+	public:
+		lister() : keys() { }
+		virtual ~lister() { }
+		virtual ordered_t::reducer *fork() { return new lister(); }
+		virtual bool process( volatile ordered_t::Node & aNode )
+		{
+			keys.push_back(((blob *)aNode.value)->getValue());
+			return true;
+		}
+		virtual void combine( ordered_t::reducer & aPart )
+		{
+			lister	&p = static_cast<lister &>(aPart);
+			keys.insert(keys.end(), p.keys.begin(), p.keys.end());
+		}
+		std::vector<uint64_t>	keys;
+};
+
+
+/**
+ * ...and the serial one, as a functor, to check against.
+ */
+template <class TRIE> class serial_summer : public TRIE::functor
+{
+	public:
+		serial_summer() : count(0), total(0) { }
+		virtual ~serial_summer() { }
+		virtual bool process( volatile typename TRIE::Node & aNode )
+		{
+			++count;
+			total += ((blob *)aNode.value)->getValue();
+			return true;
+		}
+		uint64_t	count;
+		uint64_t	total;
+};
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	dkit::executor<>	exec(4);
+
+	/**
+	 * First, a trie with a million keys - spread over sixteen roots, and
+	 * some 3900 subtrees below them
+	 */
+	ordered_t	m;
+	uint64_t	cnt = 1000000;
+	for (uint64_t i = 0; i < cnt; ++i) {
+		m.put(new blob(key_for(i)));
+	}
+
+	if (!error) {
+		std::cout << "=== Testing the parallel size() and empty() ===" << std::endl;
+		size_t		sz = m.size(exec);
+		if ((sz == cnt) && (sz == m.size()) && !m.empty(exec)) {
+			std::cout << "Passed - the parallel size() is " << sz << ", and it's not empty()" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the parallel size() was " << sz << ", not " << cnt << "!" << std::endl;
+		}
+	}
+
+	if (!error) {
+		std::cout << "=== Testing the parallel apply() with reducers ===" << std::endl;
+		summer<ordered_t>			s;
+		serial_summer<ordered_t>	ss;
+		m.apply(s, exec);
+		m.apply(ss);
+		if ((s.count == cnt) && (s.count == ss.count) && (s.total == ss.total)) {
+			std::cout << "Passed - the reducer saw " << s.count << " values, and the same total" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the reducer saw " << s.count << " values, not " << ss.count << "!" << std::endl;
+		}
+	}
+	if (!error) {
+		lister		l;
+		m.apply(l, exec);
+		bool		ordered = (l.keys.size() == cnt);
+		for (size_t i = 0; ordered && (i < l.keys.size()); ++i) {
+			ordered = (l.keys[i] == key_for(i));
+		}
+		if (ordered) {
+			std::cout << "Passed - the parts combined back in key order" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the parts didn't combine back in key order!" << std::endl;
+		}
+	}
+
+	/**
+	 * A native-order trie with a few scattered keys - where there are
+	 * fewer subtrees than parts would like
+	 */
+	if (!error) {
+		native_t	n;
+		summer<native_t>	s;
+		if (!n.empty(exec) || (n.size(exec) != 0) || !n.apply(s, exec) || (s.count != 0)) {
+			error = true;
+			std::cout << "ERROR - the empty trie wasn't empty in parallel!" << std::endl;
+		}
+		srandom(42);
+		uint64_t	expect = 0;
+		for (uint32_t i = 0; i < 5; ++i) {
+			uint64_t	k = (((uint64_t)random() << 33) ^ (uint64_t)random());
+			n.put(new blob(k));
+			expect += k;
+		}
+		n.apply(s, exec);
+		if (!error && (s.count == 5) && (s.total == expect) && (n.size(exec) == 5)) {
+			std::cout << "Passed - a sparse trie with just 5 subtrees reduced right" << std::endl;
+		} else if (!error) {
+			error = true;
+			std::cout << "ERROR - the sparse trie reduced " << s.count << " values, not 5!" << std::endl;
+		}
+	}
+
+	/**
+	 * Then time the full walks both ways - on a box with one core, don't
+	 * look for a speed-up
+	 */
+	if (!error) {
+		std::cout << "=== Timing serial and parallel walks on " << boost::thread::hardware_concurrency()
+				  << " core(s) ===" << std::endl;
+		uint64_t	serialTime = dkit::util::timer::usecStamp();
+		size_t		sz = m.size();
+		serial_summer<ordered_t>	ss;
+		m.apply(ss);
+		serialTime = dkit::util::timer::usecStamp() - serialTime;
+		uint64_t	parallelTime = dkit::util::timer::usecStamp();
+		sz += m.size(exec);
+		summer<ordered_t>		s;
+		m.apply(s, exec);
+		parallelTime = dkit::util::timer::usecStamp() - parallelTime;
+		std::cout << "size() and apply() of " << cnt << " values - serial " << (serialTime / 1000.0)
+				  << " msec, parallel on " << exec.threads() << " workers " << (parallelTime / 1000.0)
+				  << " msec" << std::endl;
+		if (sz != 2 * cnt) {
+			error = true;
+			std::cout << "ERROR - the timed walks didn't see all the values!" << std::endl;
+		}
+	}
+
+	if (!error) {
+		std::cout << "=== Testing the parallel clear() ===" << std::endl;
+		m.clear(exec);
+		if (m.empty() && m.empty(exec) && (m.size() == 0)) {
+			m.put(new blob(key_for(7)));
+			if (m.exists(key_for(7)) && (m.size(exec) == 1)) {
+				std::cout << "Passed - the parallel clear() emptied it, and it's still usable" << std::endl;
+			} else {
+				error = true;
+				std::cout << "ERROR - the trie wasn't usable after the parallel clear()!" << std::endl;
+			}
+		} else {
+			error = true;
+			std::cout << "ERROR - the parallel clear() didn't empty the trie!" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
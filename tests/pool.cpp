@@ -11,6 +11,51 @@
 #include "pool.h"
 #include "util/timer.h"
 
+
+/**
+ * This cycles a value through the pool 'aCount' times, and returns the
+ * time it took in ns per next() and recycle() pair. It works the same
+ * no matter how the pool holds its queue.
+ */
+template <class P> double cycle( P & aPool, uint32_t aCount )
+{
+	uint64_t	goTime = dkit::util::timer::usecStamp();
+	for (uint32_t i = 0; i < aCount; ++i) {
+		aPool.recycle(aPool.next());
+	}
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	return (goTime * 1000.0)/aCount;
+}
+
+
+/**
+ * This fills a pool of 2^5 past its capacity, and makes sure that it holds
+ * on to no more than that, and gives them back in the order recycled.
+ */
+template <class P> bool fill( P & aPool, const std::string & aName )
+{
+	bool			error = false;
+	std::string		*inUse[40];
+	for (uint8_t i = 0; i < 40; ++i) {
+		inUse[i] = aPool.next();
+	}
+	for (uint8_t i = 0; i < 40; ++i) {
+		aPool.recycle(inUse[i]);
+	}
+	size_t		cap = 32;
+	if ((aPool.size() < 31) || (aPool.size() > cap)) {
+		error = true;
+		std::cout << "ERROR - the " << aName << " pool holds " << aPool.size() << " of " << cap << std::endl;
+	} else if (aPool.next() != inUse[0]) {
+		error = true;
+		std::cout << "ERROR - the " << aName << " pool didn't give back the first one recycled" << std::endl;
+	} else {
+		std::cout << "Passed - the " << aName << " pool holds " << aPool.size() << " of " << cap << std::endl;
+	}
+	return !error;
+}
+
+
 int main(int argc, char *argv[]) {
 	bool	error = false;
 
@@ -94,6 +139,31 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	// each queue type, and the virtual dispatch, need to work the same
+	if (!error) {
+		std::cout << "=== Checking the Queue Policies ===" << std::endl;
+		dkit::pool<std::string *, 5, dkit::mp_sc>		mpsc;
+		dkit::pool<std::string *, 5, dkit::sp_mc>		spmc;
+		dkit::pool<std::string *, 5, dkit::mp_mc>		mpmc;
+		dkit::pool<std::string *, 5, dkit::sp_sc, dkit::virtual_dispatch>	virt;
+		error = !fill(mpsc, "mp_sc") || !fill(spmc, "sp_mc") ||
+				!fill(mpmc, "mp_mc") || !fill(virt, "virtual sp_sc");
+	}
+
+	// ...and the embedded ring should be no slower than the virtual one
+	if (!error) {
+		std::cout << "=== Timing next()/recycle() ===" << std::endl;
+		dkit::pool<int64_t, 10, dkit::sp_sc>							direct;
+		dkit::pool<int64_t, 10, dkit::sp_sc, dkit::virtual_dispatch>	virt;
+		uint32_t	cnt = 5000000;
+		cycle(direct, cnt);
+		cycle(virt, cnt);
+		double		directTime = cycle(direct, cnt);
+		double		virtTime = cycle(virt, cnt);
+		std::cout << "Passed - static dispatch " << directTime << " ns/op, virtual dispatch "
+				  << virtTime << " ns/op" << std::endl;
+	}
+
 	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
 	return (error ? 1 : 0);
 }
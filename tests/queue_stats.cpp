@@ -0,0 +1,228 @@
+/**
+ * This is the tests for the queue instrumentation - that each of the
+ * CircularFIFOs, and the Dynamic and Cached rings, made with
+ * util::queue_stats, keeps its high-water mark, counts the pushes that
+ * found it full and the pops that found it empty, and times a sample of
+ * the elements going through it. Then, what it costs
+ * to have it on, against the same queue without it.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "spsc/CircularFIFO.h"
+#include "mpsc/CircularFIFO.h"
+#include "spmc/CircularFIFO.h"
+#include "mpmc/CircularFIFO.h"
+#include "spsc/DynamicCircularFIFO.h"
+#include "mpsc/DynamicCircularFIFO.h"
+#include "spmc/DynamicCircularFIFO.h"
+#include "spsc/CachedCircularFIFO.h"
+#include "util/queue_stats.h"
+#include "util/timer.h"
+
+
+typedef dkit::util::queue_stats<>	stats_t;
+
+
+/**
+ * This fills the queue on one thread until a push fails, and tries once
+ * more, empties half of it, fills it until a push fails again, and then
+ * empties it until a pop fails, and tries twice more. The high-water mark
+ * has to be how much it holds, and there have to be three of each failure.
+ */
+template <class Q> bool fill_and_drain( Q & aQueue, const std::string & aName )
+{
+	bool		error = false;
+	int64_t		n = 0;
+	while (aQueue.push(n)) {
+		++n;
+	}
+	size_t		held = (size_t)n;
+	aQueue.push(n);
+	int64_t		v = 0;
+	for (size_t i = 0; i < held / 2; ++i) {
+		aQueue.pop(v);
+	}
+	while (aQueue.push(n)) {
+		++n;
+	}
+	while (aQueue.pop(v)) {
+	}
+	aQueue.pop(v);
+	aQueue.pop(v);
+	const stats_t	&s = aQueue.stats();
+	if ((s.high_water() != held) || (s.push_failures() != 3) || (s.pop_empties() != 3)) {
+		error = true;
+		std::cout << "ERROR - " << aName << " high-water " << s.high_water() << " (not " << held
+				  << "), " << s.push_failures() << " failed pushes, and " << s.pop_empties()
+				  << " empty pops" << std::endl;
+	} else if (s.samples() == 0) {
+		error = true;
+		std::cout << "ERROR - " << aName << " timed none of the " << n << " elements" << std::endl;
+	} else {
+		std::cout << "Passed - " << aName << " high-water " << s.high_water() << ", "
+				  << s.push_failures() << " failed pushes, " << s.pop_empties() << " empty pops, "
+				  << s.samples() << " of " << n << " timed" << std::endl;
+	}
+	return !error;
+}
+
+
+/**
+ * This is a producer that pushes 'count' values into the queue, waiting
+ * when it's full.
+ */
+template <class Q> struct Feeder {
+	Q			*queue;
+	int64_t		count;
+
+	void operator()()
+	{
+		for (int64_t i = 1; i <= count; ++i) {
+			while (!queue->push(i)) {
+				sched_yield();
+			}
+		}
+	}
+};
+
+
+/**
+ * This streams 'aCount' values through the queue, from one thread to this
+ * one, and returns the time it took - and 'false' if they didn't all come
+ * through, in order.
+ */
+template <class Q> bool stream( Q & aQueue, int64_t aCount, uint64_t & aTime )
+{
+	Feeder<Q>	f;
+	f.queue = &aQueue;
+	f.count = aCount;
+	bool		ok = true;
+	aTime = dkit::util::timer::usecStamp();
+	boost::thread	thr(f);
+	int64_t		v = 0;
+	for (int64_t i = 1; i <= aCount; ++i) {
+		while (!aQueue.pop(v)) {
+			sched_yield();
+		}
+		if (v != i) {
+			ok = false;
+		}
+	}
+	thr.join();
+	aTime = dkit::util::timer::usecStamp() - aTime;
+	return ok;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, fill and drain each of the queues on one thread.
+	 */
+	if (!error) {
+		std::cout << "=== Testing queue_stats on one thread ===" << std::endl;
+		dkit::spsc::CircularFIFO<int64_t, 8, stats_t>	spsc;
+		dkit::mpsc::CircularFIFO<int64_t, 8, stats_t>	mpsc;
+		dkit::spmc::CircularFIFO<int64_t, 8, stats_t>	spmc;
+		dkit::mpmc::CircularFIFO<int64_t, 8, stats_t>	mpmc;
+		error = !fill_and_drain(spsc, "SPSC") || !fill_and_drain(mpsc, "MPSC") ||
+				!fill_and_drain(spmc, "SPMC") || !fill_and_drain(mpmc, "MPMC");
+	}
+
+	/**
+	 * The run-time sized rings, and the cached one, have to count the
+	 * very same way.
+	 */
+	if (!error) {
+		std::cout << "=== Testing queue_stats on the Dynamic and Cached rings ===" << std::endl;
+		dkit::spsc::DynamicCircularFIFO<int64_t, stats_t>	spsc(256);
+		dkit::mpsc::DynamicCircularFIFO<int64_t, stats_t>	mpsc(256);
+		dkit::spmc::DynamicCircularFIFO<int64_t, stats_t>	spmc(256);
+		dkit::spsc::CachedCircularFIFO<int64_t, 8, stats_t>	cached;
+		error = !fill_and_drain(spsc, "Dynamic SPSC") || !fill_and_drain(mpsc, "Dynamic MPSC") ||
+				!fill_and_drain(spmc, "Dynamic SPMC") || !fill_and_drain(cached, "Cached SPSC");
+	}
+
+	/**
+	 * Next, the in-place and batch methods have to be counted, too.
+	 */
+	if (!error) {
+		std::cout << "=== Testing queue_stats on the in-place and batch methods ===" << std::endl;
+		dkit::spsc::CircularFIFO<int64_t, 4, stats_t>	q;
+		int64_t		batch[20];
+		for (int64_t i = 0; i < 20; ++i) {
+			batch[i] = i;
+		}
+		size_t		cnt = q.push_n(batch, 10);
+		int64_t		*p = q.try_reserve();
+		*p = 10;
+		q.commit();
+		cnt += 1 + q.push_n(batch, 20);
+		bool		full = (q.try_reserve() == NULL);
+		size_t		out = q.pop_n(batch, 20);
+		bool		empty = (q.try_front() == NULL) && (q.pop_n(batch, 20) == 0);
+		const stats_t	&s = q.stats();
+		if (!full || !empty || (cnt != 15) || (out != 15) || (s.high_water() != 15) ||
+			(s.push_failures() != 2) || (s.pop_empties() != 2)) {
+			error = true;
+			std::cout << "ERROR - in-place and batch: high-water " << s.high_water() << ", "
+					  << s.push_failures() << " failed pushes, " << s.pop_empties()
+					  << " empty pops" << std::endl;
+		} else {
+			std::cout << "Passed - in-place and batch: high-water " << s.high_water() << ", "
+					  << s.push_failures() << " failed pushes, " << s.pop_empties()
+					  << " empty pops" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, stream values from one thread to another through the SPSC
+	 * and MPSC queues, with and without the stats, and see what it costs,
+	 * and how long the elements sat in the queue.
+	 */
+	if (!error) {
+		std::cout << "=== Timing queue_stats between threads ===" << std::endl;
+		int64_t		cnt = 2000000;
+		uint64_t	plain = 0;
+		uint64_t	timed = 0;
+		dkit::spsc::CircularFIFO<int64_t, 10>			*a = new dkit::spsc::CircularFIFO<int64_t, 10>();
+		dkit::spsc::CircularFIFO<int64_t, 10, stats_t>	*b = new dkit::spsc::CircularFIFO<int64_t, 10, stats_t>();
+		if (!stream(*a, cnt, plain) || !stream(*b, cnt, timed)) {
+			error = true;
+			std::cout << "ERROR - the SPSC queue lost, or reordered, the values" << std::endl;
+		} else {
+			const stats_t	&s = b->stats();
+			std::cout << "Passed - SPSC " << ((plain * 1000.0)/cnt) << " ns/op plain, "
+					  << ((timed * 1000.0)/cnt) << " ns/op with stats - high-water "
+					  << s.high_water() << ", " << s.samples() << " timed, median <= "
+					  << s.percentile(0.5) << " ns, 99% <= " << s.percentile(0.99) << " ns" << std::endl;
+		}
+		delete a;
+		delete b;
+		dkit::mpsc::CircularFIFO<int64_t, 10>			*c = new dkit::mpsc::CircularFIFO<int64_t, 10>();
+		dkit::mpsc::CircularFIFO<int64_t, 10, stats_t>	*d = new dkit::mpsc::CircularFIFO<int64_t, 10, stats_t>();
+		if (!error && (!stream(*c, cnt, plain) || !stream(*d, cnt, timed))) {
+			error = true;
+			std::cout << "ERROR - the MPSC queue lost, or reordered, the values" << std::endl;
+		} else if (!error) {
+			const stats_t	&s = d->stats();
+			std::cout << "Passed - MPSC " << ((plain * 1000.0)/cnt) << " ns/op plain, "
+					  << ((timed * 1000.0)/cnt) << " ns/op with stats - high-water "
+					  << s.high_water() << ", " << s.samples() << " timed, median <= "
+					  << s.percentile(0.5) << " ns, 99% <= " << s.percentile(0.99) << " ns" << std::endl;
+		}
+		delete c;
+		delete d;
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
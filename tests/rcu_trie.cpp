@@ -0,0 +1,262 @@
+/**
+ * This is the tests for the pointer values in the trie, and the read_guard
+ * that keeps them around - that a value a reader got in a read_guard isn't
+ * deleted out from under it when a writer replaces it, that it is deleted
+ * once the guard is gone, and that readers on a last-value cache of heap
+ * objects never see one that's been deleted while a writer churns them.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "trie.h"
+#include "util/epoch.h"
+#include "util/timer.h"
+
+
+/**
+ * This is the heap object in the cache. It's marked dead when it's
+ * deleted, and its memory is never really freed - so a reader that has
+ * one after it's been deleted finds it marked, and not reused.
+ */
+static volatile uint64_t	__live = 0;
+
+class blob {
+	public:
+		blob( uint64_t aKey, uint64_t aCount ) : _key(aKey), _count(aCount), _alive(true)
+		{
+			__sync_add_and_fetch(&__live, 1);
+		}
+		virtual ~blob()
+		{
+			_alive = false;
+			__sync_sub_and_fetch(&__live, 1);
+		}
+		static void *operator new( size_t aSize ) { return malloc(aSize); }
+		static void operator delete( void *aPtr ) { }
+		uint64_t getKey() const { return _key; }
+		uint64_t getCount() const { return _count; }
+		bool alive() const { return _alive; }
+	private:
+		uint64_t			_key;
+		uint64_t			_count;
+		volatile bool		_alive;
+};
+
+uint64_t key_value( const blob *aValue )
+{
+	return (*aValue).getKey();
+}
+
+typedef dkit::trie<blob *, dkit::uint64_key>	cache_t;
+
+
+/**
+ * The keys count up in the high byte, so they all land in one Leaf.
+ */
+uint64_t key_for( uint64_t i )
+{
+	return (i << 56);
+}
+
+/**
+ * This collects the epoch a few times over, so that all that's been
+ * retired, and can be reclaimed, is.
+ */
+void settle()
+{
+	for (uint32_t i = 0; i < 4; ++i) {
+		dkit::util::epoch::collect();
+	}
+}
+
+
+/**
+ * These are the threads for the concurrent test - the readers get each
+ * value, let the writer in, and then look at it again, all in a guard.
+ * The writer replaces every value, over and over.
+ */
+static volatile bool	__done = false;
+static volatile bool	__dead = false;
+
+void reader( cache_t *aTrie, uint32_t aCount, uint64_t *aReads )
+{
+	uint64_t	reads = 0;
+	blob		*bp = NULL;
+	while (!__done) {
+		for (uint32_t i = 0; i < aCount; ++i) {
+			cache_t::read_guard		rg;
+			if (!aTrie->get(key_for(i), bp) || !bp->alive()) {
+				__dead = true;
+			}
+			if ((i % 16) == 0) {
+				boost::this_thread::yield();
+			}
+			if (!bp->alive() || (bp->getKey() != key_for(i))) {
+				__dead = true;
+			}
+			++reads;
+		}
+	}
+	*aReads = reads;
+}
+
+void writer( cache_t *aTrie, uint32_t aCount, uint32_t aPasses )
+{
+	for (uint32_t p = 1; p <= aPasses; ++p) {
+		for (uint32_t i = 0; i < aCount; ++i) {
+			aTrie->put(new blob(key_for(i), p));
+		}
+		boost::this_thread::yield();
+	}
+	__done = true;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, one thread - a value it's got in a guard has to outlive
+	 * being replaced, cleared, and even collected, until the guard goes
+	 */
+	if (!error) {
+		std::cout << "=== Testing a value held in a read_guard ===" << std::endl;
+		cache_t		m;
+		blob		*held = NULL;
+		blob		*cleared = NULL;
+		m.put(new blob(key_for(1), 1));
+		m.put(new blob(key_for(2), 1));
+		{
+			cache_t::read_guard		rg;
+			m.get(key_for(1), held);
+			m.get(key_for(2), cleared);
+			m.put(new blob(key_for(1), 2));
+			m.clear(key_for(2));
+			settle();
+			if (!held->alive() || !cleared->alive() || (held->getCount() != 1)) {
+				error = true;
+				std::cout << "ERROR - a value was deleted while it was in a read_guard!" << std::endl;
+			}
+		}
+		settle();
+		if (!error && (held->alive() || cleared->alive())) {
+			error = true;
+			std::cout << "ERROR - the values weren't deleted after the read_guard was gone!" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - the replaced, and cleared, values lasted as long as the guard" << std::endl;
+		}
+	}
+	if (!error) {
+		cache_t		m;
+		blob		*bp = NULL;
+		m.put(new blob(key_for(3), 1));
+		settle();
+		uint64_t	before = __live;
+		{
+			cache_t::read_guard		rg;
+			m.remove(key_for(3), bp);
+			cache_t::retire(bp);
+			settle();
+			if (!bp->alive()) {
+				error = true;
+				std::cout << "ERROR - a removed value was deleted in a read_guard!" << std::endl;
+			}
+		}
+		settle();
+		if (!error && (bp->alive() || (__live != before - 1))) {
+			error = true;
+			std::cout << "ERROR - a retired value wasn't deleted!" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - a removed value handed to retire() lasted as long as the guard" << std::endl;
+		}
+	}
+
+	/**
+	 * Then the readers against a writer replacing every value they read
+	 */
+	if (!error) {
+		std::cout << "=== Testing readers against a writer replacing the values ===" << std::endl;
+		settle();
+		uint64_t	before = __live;
+		uint32_t	cnt = 64;
+		{
+			cache_t		m;
+			for (uint32_t i = 0; i < cnt; ++i) {
+				m.put(new blob(key_for(i), 0));
+			}
+			uint64_t			reads[2] = { 0, 0 };
+			boost::thread		r1(reader, &m, cnt, &reads[0]);
+			boost::thread		r2(reader, &m, cnt, &reads[1]);
+			boost::thread		w(writer, &m, cnt, 5000);
+			w.join();
+			r1.join();
+			r2.join();
+			settle();
+			if (__dead) {
+				error = true;
+				std::cout << "ERROR - a reader saw a value after it was deleted!" << std::endl;
+			} else if (__live != before + cnt) {
+				error = true;
+				std::cout << "ERROR - there are " << (__live - before) << " values left, not " << cnt << "!" << std::endl;
+			} else {
+				std::cout << "Passed - " << (reads[0] + reads[1]) << " guarded reads, and none saw a deleted value" << std::endl;
+			}
+		}
+		settle();
+		if (!error && (__live != before)) {
+			error = true;
+			std::cout << "ERROR - the trie left " << (__live - before) << " values behind!" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, what a guard costs - one around each get(), and one
+	 * around a whole pass of them
+	 */
+	if (!error) {
+		std::cout << "=== Timing guarded reads ===" << std::endl;
+		cache_t		m;
+		uint32_t	cnt = 64;
+		for (uint32_t i = 0; i < cnt; ++i) {
+			m.put(new blob(key_for(i), i));
+		}
+		uint32_t	passes = 100000;
+		uint64_t	sum = 0;
+		blob		*bp = NULL;
+		uint64_t	eachTime = dkit::util::timer::usecStamp();
+		for (uint32_t p = 0; p < passes; ++p) {
+			for (uint32_t i = 0; i < cnt; ++i) {
+				cache_t::read_guard		rg;
+				m.get(key_for(i), bp);
+				sum += bp->getCount();
+			}
+		}
+		eachTime = dkit::util::timer::usecStamp() - eachTime;
+		uint64_t	batchTime = dkit::util::timer::usecStamp();
+		for (uint32_t p = 0; p < passes; ++p) {
+			cache_t::read_guard		rg;
+			for (uint32_t i = 0; i < cnt; ++i) {
+				m.get(key_for(i), bp);
+				sum += bp->getCount();
+			}
+		}
+		batchTime = dkit::util::timer::usecStamp() - batchTime;
+		if (sum == 2 * (uint64_t)passes * (cnt * (cnt - 1) / 2)) {
+			std::cout << "Passed - a guard per get() " << (1000.0 * eachTime / ((uint64_t)passes * cnt))
+					  << " nsec/get, a guard per pass " << (1000.0 * batchTime / ((uint64_t)passes * cnt))
+					  << " nsec/get" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the reads added up to " << sum << "!" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
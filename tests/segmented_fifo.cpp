@@ -0,0 +1,178 @@
+/**
+ * This is the tests for the MPSC SegmentedFIFO - the order of the values
+ * through many segments, the order of each producer's values when there
+ * are several of them, and the speed against the MPSC LinkedFIFO.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "mpsc/SegmentedFIFO.h"
+#include "mpsc/LinkedFIFO.h"
+#include "util/timer.h"
+
+
+/**
+ * This is a producer for the threaded test - it pushes 'count' values,
+ * each tagged with its 'id' in the high bits, so the consumer can check
+ * that each producer's values come out in the order they went in.
+ */
+template <class Q> struct Tagger {
+	Q			*queue;
+	int64_t		id;
+	int64_t		count;
+
+	Tagger( Q *aQueue, int64_t anId, int64_t aCount ) : queue(aQueue), id(anId), count(aCount) { }
+	void operator()()
+	{
+		for (int64_t i = 0; i < count; ++i) {
+			queue->push((id << 32) | i);
+		}
+	}
+};
+
+
+/**
+ * This times 'aCount' push/pop pairs, in batches of 500, on the queue and
+ * returns the ns/op.
+ */
+template <class Q> double timing( Q & aQueue, int32_t aCount )
+{
+	uint64_t	goTime = dkit::util::timer::usecStamp();
+	int64_t		v = 0;
+	for (int32_t cycle = 0; cycle < (aCount / 500); ++cycle) {
+		for (int32_t i = 0; i < 500; ++i) {
+			aQueue.push(i);
+		}
+		for (int32_t i = 0; i < 500; ++i) {
+			aQueue.pop(v);
+		}
+	}
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	return (goTime * 1000.0)/aCount;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, push enough through a queue with small segments to go
+	 * through a lot of them - and the cache - checking order and size.
+	 */
+	if (!error) {
+		std::cout << "=== Testing order through the segments ===" << std::endl;
+		dkit::mpsc::SegmentedFIFO<int64_t, 4>	q;
+		for (int32_t cycle = 0; !error && (cycle < 100); ++cycle) {
+			for (int64_t i = 0; i < 500; ++i) {
+				q.push(i);
+			}
+			if (q.size() != 500) {
+				error = true;
+				std::cout << "ERROR - pushed 500 values, but size() reports " << q.size() << std::endl;
+			}
+			int64_t		v = 0;
+			for (int64_t i = 0; !error && (i < 500); ++i) {
+				if (!q.pop(v) || (v != i)) {
+					error = true;
+					std::cout << "ERROR - could not pop the value " << i << std::endl;
+				}
+			}
+			if (!error && (!q.empty() || q.pop(v))) {
+				error = true;
+				std::cout << "ERROR - popped all 500 values, but the queue isn't empty" << std::endl;
+			}
+		}
+		if (!error) {
+			std::cout << "Passed - pushed and popped 50000 values through segments of "
+					  << q.segmentSize() << std::endl;
+		}
+		// a copy needs to have all the same values, and leave the original
+		if (!error) {
+			for (int64_t i = 0; i < 40; ++i) {
+				q.push(i);
+			}
+			dkit::mpsc::SegmentedFIFO<int64_t, 4>	dup(q);
+			int64_t		v = 0;
+			for (int64_t i = 0; !error && (i < 40); ++i) {
+				if (!dup.pop(v) || (v != i)) {
+					error = true;
+					std::cout << "ERROR - the copy did not have the value " << i << std::endl;
+				}
+			}
+			if (!error && (q.size() != 40)) {
+				error = true;
+				std::cout << "ERROR - the copy changed the original" << std::endl;
+			} else if (!error) {
+				std::cout << "Passed - copied a queue of 40 values" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * Now four producers at once, with segments small enough that they
+	 * are all fighting over the move to the next one.
+	 */
+	if (!error) {
+		std::cout << "=== Testing four producers ===" << std::endl;
+		typedef dkit::mpsc::SegmentedFIFO<int64_t, 6>	queue_t;
+		queue_t					q;
+		int64_t					cnt = 50000;
+		std::vector< Tagger<queue_t> >	src;
+		for (int64_t i = 0; i < 4; ++i) {
+			src.push_back(Tagger<queue_t>(&q, i, cnt));
+		}
+		boost::thread_group		thrs;
+		for (uint32_t i = 0; i < 4; ++i) {
+			thrs.create_thread(boost::ref(src[i]));
+		}
+		// ...and be the one consumer, checking each producer's order
+		int64_t		next[] = { 0, 0, 0, 0 };
+		int64_t		v = 0;
+		uint32_t	spins = 0;
+		for (int64_t got = 0; !error && (got < 4 * cnt); ) {
+			if (q.pop(v)) {
+				int64_t		id = (v >> 32);
+				if ((id < 0) || (id > 3) || ((v & 0xffffffffLL) != next[id])) {
+					error = true;
+					std::cout << "ERROR - popped " << (v & 0xffffffffLL) << " from producer "
+							  << id << " out of order" << std::endl;
+				} else {
+					++next[id];
+					++got;
+				}
+			} else if (++spins > 100) {
+				sched_yield();
+				spins = 0;
+			}
+		}
+		thrs.join_all();
+		if (!error) {
+			std::cout << "Passed - popped " << (4 * cnt) << " values from four producers, in order" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, let's see how it stacks up to the LinkedFIFO, that has to
+	 * go to the heap for each value.
+	 */
+	if (!error) {
+		std::cout << "=== Timing against the LinkedFIFO ===" << std::endl;
+		dkit::mpsc::SegmentedFIFO<int64_t>	seg;
+		dkit::mpsc::LinkedFIFO<int64_t>		lnk;
+		int32_t		cnt = 2000000;
+		double		segTime = timing(seg, cnt);
+		double		lnkTime = timing(lnk, cnt);
+		std::cout << "Passed - SegmentedFIFO " << segTime << " ns/op, LinkedFIFO "
+				  << lnkTime << " ns/op" << std::endl;
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
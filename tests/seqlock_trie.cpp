@@ -0,0 +1,211 @@
+/**
+ * This is the tests for the trie with values that aren't pointers - that
+ * a trivially copyable struct goes in, and comes out, whole, that the
+ * readers never see a value half-written while a writer is updating the
+ * same hot keys as fast as it can, and that the Nodes no longer carry a
+ * lock word.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "trie.h"
+#include "util/timer.h"
+
+
+/**
+ * This is a last-value - every field is made from the same count, so a
+ * reader can tell if it got parts of two different updates.
+ */
+struct quote {
+	uint32_t	symbol;
+	uint32_t	count;
+	uint64_t	bid;
+	uint64_t	ask;
+	uint64_t	check;
+};
+
+uint64_t key_value( const quote & aValue )
+{
+	return aValue.symbol;
+}
+
+typedef dkit::trie<quote, dkit::uint32_key>		quotes_t;
+
+/**
+ * This makes the 'aCount'-th quote for the symbol, and checks that one is
+ * all of a piece.
+ */
+quote make_quote( uint32_t aSymbol, uint32_t aCount )
+{
+	quote	q;
+	q.symbol = aSymbol;
+	q.count = aCount;
+	q.bid = (uint64_t)aCount * 3;
+	q.ask = q.bid + 1;
+	q.check = ~((uint64_t)aSymbol ^ aCount);
+	return q;
+}
+
+bool whole( const quote & aQuote )
+{
+	return ((aQuote.bid == (uint64_t)aQuote.count * 3) && (aQuote.ask == aQuote.bid + 1) &&
+			(aQuote.check == ~((uint64_t)aQuote.symbol ^ aQuote.count)));
+}
+
+/**
+ * The symbols count up in the high byte, so they all land in one Leaf -
+ * the hot spot of a last-value cache.
+ */
+uint32_t symbol_for( uint32_t i )
+{
+	return (i << 24);
+}
+
+
+/**
+ * These are the threads for the concurrent test - the readers read the
+ * hot symbols over and over, and the one writer updates them all, over
+ * and over, until it's done.
+ */
+static volatile bool	__done = false;
+static volatile bool	__torn = false;
+
+void reader( quotes_t *aTrie, uint32_t aCount, uint64_t *aReads )
+{
+	uint64_t	reads = 0;
+	quote		q;
+	while (!__done) {
+		for (uint32_t i = 0; i < aCount; ++i) {
+			if (!aTrie->get(symbol_for(i), q) || (q.symbol != symbol_for(i)) || !whole(q)) {
+				__torn = true;
+			}
+			++reads;
+		}
+	}
+	*aReads = reads;
+}
+
+void writer( quotes_t *aTrie, uint32_t aCount, uint32_t aPasses )
+{
+	for (uint32_t p = 1; p <= aPasses; ++p) {
+		for (uint32_t i = 0; i < aCount; ++i) {
+			aTrie->put(make_quote(symbol_for(i), p));
+		}
+	}
+	__done = true;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, the simple things - in, out, upsert and remove
+	 */
+	if (!error) {
+		std::cout << "=== Testing a trie of trivially copyable values ===" << std::endl;
+		quotes_t	m;
+		quote		q;
+		m.put(make_quote(symbol_for(1), 10));
+		bool	added = m.upsert(make_quote(symbol_for(2), 20));
+		bool	updated = m.upsert(make_quote(symbol_for(1), 11));
+		if (added || !updated) {
+			error = true;
+			std::cout << "ERROR - upsert() didn't tell an add from an update!" << std::endl;
+		} else if (!m.get(symbol_for(1), q) || (q.count != 11) || !whole(q)) {
+			error = true;
+			std::cout << "ERROR - couldn't get the updated quote back!" << std::endl;
+		} else if (!m.remove(symbol_for(2), q) || (q.count != 20) || m.get(symbol_for(2), q)) {
+			error = true;
+			std::cout << "ERROR - couldn't remove the quote!" << std::endl;
+		} else if (m.size() != 1) {
+			error = true;
+			std::cout << "ERROR - the trie has " << m.size() << " quotes, not 1!" << std::endl;
+		} else {
+			std::cout << "Passed - the quotes went in, and came out, whole" << std::endl;
+		}
+	}
+
+	/**
+	 * The Node of a pointer is just the value and its flag, and the Node
+	 * of anything else adds only the sequence
+	 */
+	if (!error) {
+		size_t	ptr = sizeof(dkit::trie<quote *, dkit::uint32_key>::Node);
+		size_t	val = sizeof(quotes_t::Node);
+		if ((ptr == sizeof(quote *) + sizeof(abool)) && (val <= sizeof(quote) + sizeof(abool) + sizeof(uint64_t))) {
+			std::cout << "Passed - a pointer Node is " << ptr << " bytes, and a quote Node is " << val << " bytes" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the Nodes are " << ptr << " and " << val << " bytes!" << std::endl;
+		}
+	}
+
+	/**
+	 * Then the readers against a writer on the same hot symbols - none of
+	 * them can ever see a quote that's part one update, and part another.
+	 */
+	if (!error) {
+		std::cout << "=== Testing readers against a writer on hot symbols ===" << std::endl;
+		quotes_t	m;
+		uint32_t	cnt = 64;
+		for (uint32_t i = 0; i < cnt; ++i) {
+			m.put(make_quote(symbol_for(i), 0));
+		}
+		uint64_t			reads[2] = { 0, 0 };
+		boost::thread		r1(reader, &m, cnt, &reads[0]);
+		boost::thread		r2(reader, &m, cnt, &reads[1]);
+		boost::thread		w(writer, &m, cnt, 20000);
+		w.join();
+		r1.join();
+		r2.join();
+		quote	q;
+		if (__torn) {
+			error = true;
+			std::cout << "ERROR - a reader saw a torn quote!" << std::endl;
+		} else if (!m.get(symbol_for(cnt - 1), q) || (q.count != 20000)) {
+			error = true;
+			std::cout << "ERROR - the last update isn't there!" << std::endl;
+		} else {
+			std::cout << "Passed - " << (reads[0] + reads[1]) << " reads, and not one torn quote" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, how long a read takes with no writer around
+	 */
+	if (!error) {
+		std::cout << "=== Timing uncontended reads ===" << std::endl;
+		quotes_t	m;
+		uint32_t	cnt = 64;
+		for (uint32_t i = 0; i < cnt; ++i) {
+			m.put(make_quote(symbol_for(i), i));
+		}
+		uint64_t	sum = 0;
+		uint32_t	passes = 100000;
+		quote		q;
+		uint64_t	goTime = dkit::util::timer::usecStamp();
+		for (uint32_t p = 0; p < passes; ++p) {
+			for (uint32_t i = 0; i < cnt; ++i) {
+				m.get(symbol_for(i), q);
+				sum += q.count;
+			}
+		}
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		if (sum == (uint64_t)passes * (cnt * (cnt - 1) / 2)) {
+			std::cout << "Passed - " << (1000.0 * goTime / ((uint64_t)passes * cnt)) << " nsec/get" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the reads added up to " << sum << "!" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -0,0 +1,348 @@
+/**
+ * This is the tests for the shared-memory SPSC and MPSC queues - that a
+ * queue made in a segment can be attached to by name, at another address,
+ * that the header keeps out the ones that don't match, and that they work
+ * between processes. Then, the round-trip time between two processes over
+ * a pair of them, against the same ping-pong over a loopback TCP socket.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "spsc/SharedFIFO.h"
+#include "mpsc/SharedFIFO.h"
+#include "util/shm_segment.h"
+#include "util/timer.h"
+
+using namespace dkit::util;
+
+/**
+ * These are the names of the segments - removed first, in case an earlier
+ * run died and left them behind.
+ */
+static const char	*__names[] = { "dkit_shm_spsc", "dkit_shm_mpsc", "dkit_shm_ping",
+								   "dkit_shm_pong", "dkit_shm_many", NULL };
+
+
+/**
+ * This fills the queue through one handle, and empties it through the
+ * other - a separate mapping of the same segment - and checks that it all
+ * comes out in order, and that it holds what it says it can.
+ */
+template <class Q> bool fill_and_drain( Q & aIn, Q & aOut, const std::string & aName )
+{
+	bool		error = false;
+	int64_t		n = 0;
+	while (aIn.push(n)) {
+		++n;
+	}
+	if (((size_t)n != aIn.capacity()) || (aOut.size() != aIn.capacity())) {
+		error = true;
+		std::cout << "ERROR - " << aName << " took " << n << " elements, and the other mapping saw "
+				  << aOut.size() << " - not " << aIn.capacity() << std::endl;
+	}
+	int64_t		v = 0;
+	for (int64_t i = 0; !error && (i < n); ++i) {
+		if (!aOut.pop(v) || (v != i)) {
+			error = true;
+			std::cout << "ERROR - " << aName << " popped " << v << " when it should have been "
+					  << i << std::endl;
+		}
+	}
+	if (!error && (aOut.pop(v) || !aIn.empty())) {
+		error = true;
+		std::cout << "ERROR - " << aName << " isn't empty after it's drained" << std::endl;
+	}
+	if (!error) {
+		std::cout << "Passed - " << aName << " filled with " << n
+				  << " and drained at another address" << std::endl;
+	}
+	return !error;
+}
+
+
+/**
+ * This returns 'true' if making the queue 'Q' on 'aName' with 'aMode'
+ * throws - which is what it should do.
+ */
+template <class Q> bool refused( const std::string & aName, shm_mode aMode )
+{
+	try {
+		Q	q(aName, aMode);
+	} catch (std::runtime_error & re) {
+		return true;
+	}
+	return false;
+}
+
+
+/**
+ * This is the forked process on the other end of the ping-pong: it attaches
+ * to the two queues by name and sends back each value it gets, until it
+ * gets a zero.
+ */
+static void echo_shm()
+{
+	dkit::spsc::SharedFIFO<int64_t, 10>	ping("dkit_shm_ping", shm_attach);
+	dkit::spsc::SharedFIFO<int64_t, 10>	pong("dkit_shm_pong", shm_attach);
+	int64_t		v = 0;
+	do {
+		while (!ping.pop(v)) {
+			sched_yield();
+		}
+		while (!pong.push(v)) {
+			sched_yield();
+		}
+	} while (v != 0);
+}
+
+
+/**
+ * This is the TCP version of the same - it reads each 8-byte value off the
+ * socket, and writes it right back, until it gets a zero.
+ */
+static void echo_tcp( int aSocket )
+{
+	int64_t		v = 0;
+	do {
+		if (recv(aSocket, &v, sizeof(v), MSG_WAITALL) != sizeof(v)) {
+			break;
+		}
+		if (send(aSocket, &v, sizeof(v), 0) != sizeof(v)) {
+			break;
+		}
+	} while (v != 0);
+}
+
+
+/**
+ * This makes a connected pair of loopback TCP sockets - with Nagle off, as
+ * anyone timing a request and its reply would have it.
+ */
+static bool tcp_pair( int & aClient, int & aServer )
+{
+	int			lsn = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in	addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t	len = sizeof(addr);
+	if ((lsn < 0) || (bind(lsn, (sockaddr *)&addr, sizeof(addr)) != 0) ||
+		(listen(lsn, 1) != 0) || (getsockname(lsn, (sockaddr *)&addr, &len) != 0)) {
+		return false;
+	}
+	aClient = socket(AF_INET, SOCK_STREAM, 0);
+	if ((aClient < 0) || (connect(aClient, (sockaddr *)&addr, sizeof(addr)) != 0)) {
+		close(lsn);
+		return false;
+	}
+	aServer = accept(lsn, NULL, NULL);
+	close(lsn);
+	int			one = 1;
+	setsockopt(aClient, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	setsockopt(aServer, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return (aServer >= 0);
+}
+
+
+/**
+ * This waits for the forked child, and returns 'true' if it exited cleanly.
+ */
+static bool reap( pid_t aChild )
+{
+	int		status = 0;
+	while ((waitpid(aChild, &status, 0) < 0) && (errno == EINTR)) {
+	}
+	return (WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	for (uint32_t i = 0; __names[i] != NULL; ++i) {
+		shm_segment::remove(__names[i]);
+	}
+
+	/**
+	 * First, make each queue, attach to it again by name, and move the
+	 * elements from one mapping to the other.
+	 */
+	if (!error) {
+		std::cout << "=== Testing SharedFIFO create and attach ===" << std::endl;
+		dkit::spsc::SharedFIFO<int64_t, 4>	a("dkit_shm_spsc", shm_create);
+		dkit::spsc::SharedFIFO<int64_t, 4>	b("dkit_shm_spsc", shm_attach);
+		if (a.segment()->data() == b.segment()->data()) {
+			error = true;
+			std::cout << "ERROR - both SPSC handles have the segment at the same address" << std::endl;
+		} else {
+			error = !fill_and_drain(a, b, "SPSC");
+		}
+		dkit::mpsc::SharedFIFO<int64_t, 4>	c("dkit_shm_mpsc", shm_create);
+		dkit::mpsc::SharedFIFO<int64_t, 4>	d("dkit_shm_mpsc");
+		if (!error && d.segment()->created()) {
+			error = true;
+			std::cout << "ERROR - the MPSC queue was made twice" << std::endl;
+		} else if (!error) {
+			error = !fill_and_drain(c, d, "MPSC");
+		}
+	}
+
+	/**
+	 * Next, the segments that don't hold what's expected - or aren't there,
+	 * or are there already - have to be refused.
+	 */
+	if (!error) {
+		std::cout << "=== Testing SharedFIFO header checks ===" << std::endl;
+		dkit::spsc::SharedFIFO<int64_t, 4>	a("dkit_shm_spsc", shm_create);
+		if (!refused< dkit::spsc::SharedFIFO<int64_t, 4> >("dkit_shm_spsc", shm_create)) {
+			error = true;
+			std::cout << "ERROR - made a segment that was already there" << std::endl;
+		} else if (!refused< dkit::spsc::SharedFIFO<int64_t, 4> >("dkit_shm_missing", shm_attach)) {
+			error = true;
+			std::cout << "ERROR - attached to a segment that isn't there" << std::endl;
+		} else if (!refused< dkit::spsc::SharedFIFO<int64_t, 3> >("dkit_shm_spsc", shm_attach)) {
+			error = true;
+			std::cout << "ERROR - attached with the wrong number of elements" << std::endl;
+		} else if (!refused< dkit::spsc::SharedFIFO<int32_t, 4> >("dkit_shm_spsc", shm_attach)) {
+			error = true;
+			std::cout << "ERROR - attached with the wrong size of element" << std::endl;
+		} else if (!refused< dkit::mpsc::SharedFIFO<int64_t, 4> >("dkit_shm_spsc", shm_attach)) {
+			error = true;
+			std::cout << "ERROR - attached an MPSC queue to an SPSC one" << std::endl;
+		} else {
+			std::cout << "Passed - refused a duplicate, a missing segment, and three mismatches" << std::endl;
+		}
+	}
+
+	/**
+	 * Now, two producer processes into one MPSC queue, and each of their
+	 * values have to come out in the order they were pushed.
+	 */
+	if (!error) {
+		std::cout << "=== Testing SharedFIFO between processes ===" << std::endl;
+		const int64_t	cnt = 200000;
+		dkit::mpsc::SharedFIFO<int64_t, 8>	q("dkit_shm_many", shm_create);
+		pid_t	kids[2];
+		for (int64_t p = 0; p < 2; ++p) {
+			kids[p] = fork();
+			if (kids[p] == 0) {
+				dkit::mpsc::SharedFIFO<int64_t, 8>	mine("dkit_shm_many", shm_attach);
+				for (int64_t i = 1; i <= cnt; ++i) {
+					while (!mine.push((p << 32) | i)) {
+						sched_yield();
+					}
+				}
+				_exit(0);
+			}
+		}
+		int64_t		last[2] = { 0, 0 };
+		int64_t		v = 0;
+		for (int64_t i = 0; i < 2 * cnt; ++i) {
+			while (!q.pop(v)) {
+				sched_yield();
+			}
+			int64_t		p = (v >> 32);
+			if ((p < 0) || (p > 1) || ((v & 0xffffffff) != last[p] + 1)) {
+				error = true;
+				std::cout << "ERROR - popped " << v << " out of order" << std::endl;
+				break;
+			}
+			last[p] = (v & 0xffffffff);
+		}
+		if (!reap(kids[0]) || !reap(kids[1])) {
+			error = true;
+			std::cout << "ERROR - the producer processes didn't exit cleanly" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - " << (2 * cnt) << " values from two processes, each in order" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, the round trip to another process and back - a value goes
+	 * over one SPSC queue, and comes back on another - and then the same
+	 * over a loopback TCP socket.
+	 */
+	if (!error) {
+		std::cout << "=== Timing the round trip between processes ===" << std::endl;
+		const int64_t	cnt = 100000;
+		dkit::spsc::SharedFIFO<int64_t, 10>	ping("dkit_shm_ping", shm_create);
+		dkit::spsc::SharedFIFO<int64_t, 10>	pong("dkit_shm_pong", shm_create);
+		pid_t	kid = fork();
+		if (kid == 0) {
+			echo_shm();
+			_exit(0);
+		}
+		int64_t		v = 0;
+		uint64_t	shm = timer::usecStamp();
+		for (int64_t i = 1; i <= cnt; ++i) {
+			while (!ping.push(i)) {
+				sched_yield();
+			}
+			while (!pong.pop(v)) {
+				sched_yield();
+			}
+			if (v != i) {
+				error = true;
+			}
+		}
+		shm = timer::usecStamp() - shm;
+		ping.push(0);
+		if (!reap(kid) || error) {
+			error = true;
+			std::cout << "ERROR - the shared-memory echo didn't send back what it got" << std::endl;
+		}
+
+		int			client = -1;
+		int			server = -1;
+		uint64_t	tcp = 0;
+		if (!error && !tcp_pair(client, server)) {
+			error = true;
+			std::cout << "ERROR - unable to connect a pair of loopback TCP sockets" << std::endl;
+		} else if (!error) {
+			kid = fork();
+			if (kid == 0) {
+				close(client);
+				echo_tcp(server);
+				_exit(0);
+			}
+			close(server);
+			tcp = timer::usecStamp();
+			for (int64_t i = 1; i <= cnt; ++i) {
+				if ((send(client, &i, sizeof(i), 0) != sizeof(i)) ||
+					(recv(client, &v, sizeof(v), MSG_WAITALL) != sizeof(v)) || (v != i)) {
+					error = true;
+					break;
+				}
+			}
+			tcp = timer::usecStamp() - tcp;
+			v = 0;
+			send(client, &v, sizeof(v), 0);
+			close(client);
+			if (!reap(kid) || error) {
+				error = true;
+				std::cout << "ERROR - the TCP echo didn't send back what it got" << std::endl;
+			}
+		}
+		if (!error) {
+			std::cout << "Passed - round trip " << ((shm * 1000.0)/cnt) << " ns over shared memory, "
+					  << ((tcp * 1000.0)/cnt) << " ns over loopback TCP" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
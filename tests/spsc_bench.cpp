@@ -0,0 +1,184 @@
+/**
+ * This is the two-thread benchmark of the SPSC CircularFIFO and the
+ * SPSC CachedCircularFIFO - a streaming test where one thread pushes as
+ * fast as it can and the other pops, and a ping-pong test where a value
+ * goes over and back between the two threads on a pair of queues.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "spsc/CircularFIFO.h"
+#include "spsc/CachedCircularFIFO.h"
+#include "util/timer.h"
+
+
+/**
+ * When one side finds the queue full, or empty, it's going to spin a bit
+ * and then yield the CPU - so that these tests finish in a reasonable time
+ * even when the two threads have to share a core.
+ */
+static inline void backoff( uint32_t & aSpins )
+{
+	if (++aSpins > 1000) {
+		sched_yield();
+		aSpins = 0;
+	}
+}
+
+
+/**
+ * This is the consumer side of the streaming test - it pops 'count'
+ * values off the queue, spinning when it's empty, and makes sure that
+ * they arrive in the order they were sent.
+ */
+template <class Q> struct Streamer {
+	Q			*queue;
+	int32_t		count;
+	bool		ok;
+
+	Streamer( Q *aQueue, int32_t aCount ) : queue(aQueue), count(aCount), ok(true) { }
+	void operator()()
+	{
+		int32_t		v = 0;
+		uint32_t	spins = 0;
+		for (int32_t i = 0; i < count; ++i) {
+			while (!queue->pop(v)) {
+				backoff(spins);
+			}
+			if (v != i) {
+				ok = false;
+			}
+		}
+	}
+};
+
+
+/**
+ * This is the far end of the ping-pong test - it pops each value off
+ * the 'ping' queue and pushes it right back on the 'pong' queue.
+ */
+template <class Q> struct Echo {
+	Q			*ping;
+	Q			*pong;
+	int32_t		count;
+
+	Echo( Q *aPing, Q *aPong, int32_t aCount ) : ping(aPing), pong(aPong), count(aCount) { }
+	void operator()()
+	{
+		int32_t		v = 0;
+		uint32_t	spins = 0;
+		for (int32_t i = 0; i < count; ++i) {
+			while (!ping->pop(v)) {
+				backoff(spins);
+			}
+			while (!pong->push(v)) {
+				backoff(spins);
+			}
+		}
+	}
+};
+
+
+/**
+ * This runs the streaming test on a queue of type Q and returns the
+ * ns/op for the run, or a negative value if the data was corrupted.
+ */
+template <class Q> double stream( int32_t aCount )
+{
+	Q				*q = new Q();
+	Streamer<Q>		dest(q, aCount);
+	// get the starting time and start the consumer
+	uint64_t		goTime = dkit::util::timer::usecStamp();
+	boost::thread	thr(boost::ref(dest));
+	uint32_t		spins = 0;
+	for (int32_t i = 0; i < aCount; ++i) {
+		while (!q->push(i)) {
+			backoff(spins);
+		}
+	}
+	thr.join();
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	delete q;
+	return (dest.ok ? (goTime * 1000.0)/aCount : -1.0);
+}
+
+
+/**
+ * This runs the ping-pong test on a pair of queues of type Q and returns
+ * the ns per round-trip, or a negative value if the data was corrupted.
+ */
+template <class Q> double pingpong( int32_t aCount )
+{
+	Q				*ping = new Q();
+	Q				*pong = new Q();
+	Echo<Q>			echo(ping, pong, aCount);
+	bool			ok = true;
+	// get the starting time and start the far end
+	uint64_t		goTime = dkit::util::timer::usecStamp();
+	boost::thread	thr(boost::ref(echo));
+	int32_t			v = 0;
+	uint32_t		spins = 0;
+	for (int32_t i = 0; i < aCount; ++i) {
+		while (!ping->push(i)) {
+			backoff(spins);
+		}
+		while (!pong->pop(v)) {
+			backoff(spins);
+		}
+		if (v != i) {
+			ok = false;
+		}
+	}
+	thr.join();
+	goTime = dkit::util::timer::usecStamp() - goTime;
+	delete ping;
+	delete pong;
+	return (ok ? (goTime * 1000.0)/aCount : -1.0);
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	typedef dkit::spsc::CircularFIFO<int32_t, 10>		plain_q;
+	typedef dkit::spsc::CachedCircularFIFO<int32_t, 10>	cached_q;
+
+	// first, the streaming of lots of values from one thread to another
+	if (!error) {
+		std::cout << "=== Streaming 10M integers between two threads ===" << std::endl;
+		int32_t		cnt = 10000000;
+		double		plain = stream<plain_q>(cnt);
+		double		cached = stream<cached_q>(cnt);
+		if ((plain < 0.0) || (cached < 0.0)) {
+			error = true;
+			std::cout << "ERROR - the values arrived out of order!" << std::endl;
+		} else {
+			std::cout << "Passed - CircularFIFO       = " << plain << " ns/op" << std::endl;
+			std::cout << "Passed - CachedCircularFIFO = " << cached << " ns/op" << std::endl;
+		}
+	}
+
+	// next, the latency of a value going over and back
+	if (!error) {
+		std::cout << "=== Ping-pong of 100K integers between two threads ===" << std::endl;
+		int32_t		cnt = 100000;
+		double		plain = pingpong<plain_q>(cnt);
+		double		cached = pingpong<cached_q>(cnt);
+		if ((plain < 0.0) || (cached < 0.0)) {
+			error = true;
+			std::cout << "ERROR - the values came back out of order!" << std::endl;
+		} else {
+			std::cout << "Passed - CircularFIFO       = " << plain << " ns/round-trip" << std::endl;
+			std::cout << "Passed - CachedCircularFIFO = " << cached << " ns/round-trip" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -5,12 +5,145 @@
 #include <iostream>
 #include <string>
 
+#include <sched.h>
+#include <string.h>
+
 //	Third-Party Headers
+#include <boost/thread.hpp>
 
 //	Other Headers
 #include "spsc/CircularFIFO.h"
 #include "util/timer.h"
 
+/**
+ * This is a simple functor for consume_all() that checks that the values
+ * it sees are the sequence 0, 1, 2, ... and notes if one is out of place.
+ */
+struct Checker {
+	int32_t		next;
+	bool		ok;
+
+	Checker() : next(0), ok(true) { }
+	void operator()( const int32_t & aValue )
+	{
+		if (aValue != next++) {
+			ok = false;
+		}
+	}
+};
+
+
+/**
+ * This is a record about the size of an order book update - to see what
+ * the in-place writes and reads save over copying it in, and out again.
+ */
+struct Update {
+	int64_t		seq;
+	int64_t		levels[23];
+	int64_t		check;
+};
+
+
+/**
+ * This keeps a count of how many of them are alive, so that a slot that's
+ * reserved, and then cancelled, can be seen to have been cleaned up.
+ */
+struct Tracked {
+	static int32_t	live;
+	int32_t			value;
+
+	Tracked() : value(0) { ++live; }
+	Tracked( const Tracked & anOther ) : value(anOther.value) { ++live; }
+	~Tracked() { --live; }
+	Tracked & operator=( const Tracked & anOther ) { value = anOther.value; return *this; }
+};
+int32_t	Tracked::live = 0;
+
+
+/**
+ * This is a producer thread that sends 'count' Updates on the queue - built
+ * in the ring with try_reserve() and commit(), or built on the stack and
+ * copied in with push().
+ */
+struct Feeder {
+	dkit::spsc::CircularFIFO<Update, 10>	*q;
+	int64_t		count;
+	bool		inPlace;
+
+	void operator()()
+	{
+		Update	u;
+		for (int64_t i = 1; i <= count; ++i) {
+			if (inPlace) {
+				Update	*p = NULL;
+				while ((p = q->try_reserve()) == NULL) {
+					sched_yield();
+				}
+				fill(*p, i);
+				q->commit();
+			} else {
+				fill(u, i);
+				while (!q->push(u)) {
+					sched_yield();
+				}
+			}
+		}
+	}
+
+	static void fill( Update & anUpdate, int64_t aSeq )
+	{
+		anUpdate.seq = aSeq;
+		anUpdate.check = aSeq;
+		for (int32_t l = 0; l < 23; ++l) {
+			anUpdate.levels[l] = aSeq + l;
+			anUpdate.check += anUpdate.levels[l];
+		}
+	}
+};
+
+
+/**
+ * This runs a Feeder against this thread reading the Updates - in place, or
+ * popped out - and returns 'true' if every one was there, in order, and whole.
+ */
+static bool feed( bool inPlace, int64_t aCount, uint64_t & aTime )
+{
+	dkit::spsc::CircularFIFO<Update, 10>	*q = new dkit::spsc::CircularFIFO<Update, 10>();
+	Feeder		f = { q, aCount, inPlace };
+	bool		ok = true;
+	Update		u;
+	aTime = dkit::util::timer::usecStamp();
+	boost::thread	producer(f);
+	for (int64_t i = 1; i <= aCount; ++i) {
+		const Update	*p = NULL;
+		if (inPlace) {
+			while ((p = q->try_front()) == NULL) {
+				sched_yield();
+			}
+		} else {
+			while (!q->pop(u)) {
+				sched_yield();
+			}
+			p = &u;
+		}
+		int64_t		sum = p->seq;
+		for (int32_t l = 0; l < 23; ++l) {
+			sum += p->levels[l];
+		}
+		if ((p->seq != i) || (p->check != sum)) {
+			ok = false;
+		}
+		if (inPlace) {
+			q->release();
+		}
+	}
+	producer.join();
+	aTime = dkit::util::timer::usecStamp() - aTime;
+	delete q;
+	return ok;
+}
+
+
 int main(int argc, char *argv[]) {
 	bool	error = false;
 
@@ -74,6 +207,169 @@ int main(int argc, char *argv[]) {
 		std::cout << "Passed - did " << (trips * 500) << " push/pop pairs in " << (goTime/1000.0) << "ms = " << ((goTime * 1000.0)/(trips * 500.0)) << "ns/op" << std::endl;
 	}
 
+	// now let's see how the batch methods do as we vary the batch size
+	if (!error) {
+		std::cout << "=== Testing speed and correctness of batch push_n/pop_n ===" << std::endl;
+
+		int32_t		in[500];
+		int32_t		out[500];
+		for (int32_t i = 0; i < 500; ++i) {
+			in[i] = i;
+		}
+		size_t		sizes[] = { 1, 4, 16, 64, 250, 500 };
+		for (size_t s = 0; !error && (s < sizeof(sizes)/sizeof(size_t)); ++s) {
+			size_t		batch = sizes[s];
+			// get the starting time
+			uint64_t	goTime = dkit::util::timer::usecStamp();
+
+			// move 500 values through the queue in batches of 'batch'
+			int32_t		trips = 500000;
+			for (int32_t cycle = 0; !error && (cycle < trips); ++cycle) {
+				for (size_t i = 0; i < 500; i += batch) {
+					size_t	cnt = (500 - i < batch ? 500 - i : batch);
+					if (q.push_n(&in[i], cnt) != cnt) {
+						error = true;
+						std::cout << "ERROR - could not push_n " << cnt << " values at " << i << std::endl;
+						break;
+					}
+				}
+				for (size_t i = 0; !error && (i < 500); i += batch) {
+					size_t	cnt = (500 - i < batch ? 500 - i : batch);
+					if (q.pop_n(&out[i], cnt) != cnt) {
+						error = true;
+						std::cout << "ERROR - could not pop_n " << cnt << " values at " << i << std::endl;
+					}
+				}
+				if (!error && (cycle == 0)) {
+					for (int32_t i = 0; i < 500; ++i) {
+						if (out[i] != i) {
+							error = true;
+							std::cout << "ERROR - popped " << out[i] << " but expected " << i << std::endl;
+							break;
+						}
+					}
+				}
+			}
+
+			// get the elapsed time
+			goTime = dkit::util::timer::usecStamp() - goTime;
+			if (!error) {
+				std::cout << "Passed - batch of " << batch << " did " << (trips * 500) << " push/pop pairs in " << (goTime/1000.0) << "ms = " << ((goTime * 1000.0)/(trips * 500.0)) << "ns/op" << std::endl;
+			}
+		}
+	}
+
+	// make sure the batches are honest about a full queue
+	if (!error) {
+		int32_t		big[2048];
+		for (int32_t i = 0; i < 2048; ++i) {
+			big[i] = i;
+		}
+		size_t		cnt = q.push_n(big, 2048);
+		if (cnt == q.capacity() - 1) {
+			std::cout << "Passed - push_n() stopped at " << cnt << " values on a full queue" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - push_n() placed " << cnt << " values, but should have placed " << (q.capacity() - 1) << std::endl;
+		}
+		// now consume them all and check the order
+		Checker		chk;
+		if (!error && ((q.consume_all(chk) != cnt) || !chk.ok || !q.empty())) {
+			error = true;
+			std::cout << "ERROR - consume_all() did not cleanly consume the " << cnt << " values" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - consume_all() consumed all " << cnt << " values in order" << std::endl;
+		}
+	}
+
+	/**
+	 * Build the records right in the ring, and read them there, and make
+	 * sure the reservations respect a full, and an empty, queue.
+	 */
+	if (!error) {
+		std::cout << "=== Testing in-place try_reserve/commit and try_front/release ===" << std::endl;
+		dkit::spsc::CircularFIFO<Update, 2>		small;
+		int32_t		cnt = 0;
+		Update		*p = NULL;
+		while ((p = small.try_reserve()) != NULL) {
+			Feeder::fill(*p, ++cnt);
+			small.commit();
+		}
+		if ((cnt != (int32_t)small.capacity() - 1) || (small.size() != (size_t)cnt)) {
+			error = true;
+			std::cout << "ERROR - try_reserve() gave out " << cnt << " slots, but should have given " << (small.capacity() - 1) << std::endl;
+		} else {
+			const Update	*f = NULL;
+			for (int32_t i = 1; !error && (i <= cnt); ++i) {
+				if (((f = small.try_front()) == NULL) || (f->seq != i)) {
+					error = true;
+					std::cout << "ERROR - try_front() didn't see the record " << i << std::endl;
+				} else {
+					small.release();
+				}
+			}
+			if (!error && (small.try_front() != NULL)) {
+				error = true;
+				std::cout << "ERROR - try_front() found a record on an empty queue" << std::endl;
+			} else if (!error) {
+				std::cout << "Passed - reserved " << cnt << " records on a full queue, and read them back in place" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * Asking for a reservation again, before the commit(), has to get the
+	 * same slot - with nothing new built in it - and cancel() has to clean
+	 * it up without the consumer ever seeing it.
+	 */
+	if (!error) {
+		std::cout << "=== Testing a repeated try_reserve() and cancel() ===" << std::endl;
+		{
+			dkit::spsc::CircularFIFO<Tracked, 2>	q;
+			Tracked		*a = q.try_reserve();
+			a->value = 7;
+			Tracked		*b = q.try_reserve();
+			int32_t		kept = b->value;
+			int32_t		reserved = Tracked::live;
+			q.cancel();
+			int32_t		cancelled = Tracked::live;
+			Tracked		*c = q.try_reserve();
+			c->value = 9;
+			q.commit();
+			Tracked		v;
+			if ((a != b) || (kept != 7) || (reserved != 1) || (cancelled != 0)) {
+				error = true;
+				std::cout << "ERROR - the second try_reserve() didn't get the same slot, or cancel() didn't drop it" << std::endl;
+			} else if (!q.pop(v) || (v.value != 9) || !q.empty()) {
+				error = true;
+				std::cout << "ERROR - the cancelled slot was seen by the consumer" << std::endl;
+			}
+			// ...and one left reserved has to go with the queue
+			q.try_reserve();
+		}
+		if (!error && (Tracked::live != 0)) {
+			error = true;
+			std::cout << "ERROR - " << Tracked::live << " reserved elements were left behind" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - a repeated try_reserve() got the same slot, and cancel() dropped it" << std::endl;
+		}
+	}
+
+	// ...and then time it against copying the records in, and out
+	if (!error) {
+		int64_t		cnt = 1000000;
+		uint64_t	copied = 0;
+		uint64_t	inPlace = 0;
+		if (!feed(false, cnt, copied) || !feed(true, cnt, inPlace)) {
+			error = true;
+			std::cout << "ERROR - a record was lost, out of order, or torn, between the threads" << std::endl;
+		} else {
+			std::cout << "Passed - " << cnt << " " << sizeof(Update) << "-byte records: push/pop "
+					  << ((copied * 1000.0)/cnt) << " ns/rec, in-place " << ((inPlace * 1000.0)/cnt)
+					  << " ns/rec" << std::endl;
+		}
+	}
+
 	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
 	return (error ? 1 : 0);
 }
@@ -0,0 +1,324 @@
+/**
+ * This is the tests for the timer wheel - that a timer fires on the very
+ * tick it's due, from the first wheel out past the last one, that they
+ * can be cancelled, and rescheduled as they fire, that other threads can
+ * post them, and what it costs to have a million of them in the wheel.
+ * The wheel is run on a made-up clock, starting at zero, with 1 msec ticks,
+ * so that it's the same every time.
+ */
+//	System Headers
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <sched.h>
+
+//	Third-Party Headers
+#include <boost/thread.hpp>
+
+//	Other Headers
+#include "util/timer_wheel.h"
+#include "util/timer.h"
+
+
+/**
+ * This is a timer that just remembers when it fired, and how many times.
+ */
+struct Marker : public dkit::util::timer_wheel::event
+{
+	uint64_t	firedAt;
+	uint32_t	fires;
+
+	Marker() : firedAt(0), fires(0) { }
+
+	virtual void fire( uint64_t aNow )
+	{
+		firedAt = aNow;
+		++fires;
+	}
+};
+
+
+/**
+ * This is a timer that puts itself back in the wheel each time it fires.
+ */
+struct Heartbeat : public dkit::util::timer_wheel::event
+{
+	dkit::util::timer_wheel		*wheel;
+	uint64_t					period;
+	uint32_t					beats;
+
+	virtual void fire( uint64_t aNow )
+	{
+		++beats;
+		wheel->schedule(this, period);
+	}
+};
+
+
+/**
+ * This is a thread that posts its markers to the wheel, each at its own
+ * time, on the made-up clock.
+ */
+struct Poster {
+	dkit::util::timer_wheel		*wheel;
+	Marker						*markers;
+	uint64_t					*whens;
+	size_t						count;
+
+	void operator()()
+	{
+		for (size_t i = 0; i < count; ++i) {
+			wheel->post_at(&markers[i], whens[i]);
+			if ((i % 1000) == 0) {
+				sched_yield();
+			}
+		}
+	}
+};
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, schedule timers in each of the wheels, and past them, and
+	 * make sure that each fires on the tick it's due - not one before.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the timer_wheel fires on time ===" << std::endl;
+		dkit::util::timer_wheel		w(1000, 0);
+		uint64_t	delays[] = { 1, 999, 1000, 1001, 255500, 256000, 256001,
+								 70000000, 16777217000ULL, 4294967296000ULL + 100000,
+								 4294967296000ULL * 3 + 7 };
+		size_t		cnt = sizeof(delays)/sizeof(uint64_t);
+		Marker		m[sizeof(delays)/sizeof(uint64_t)];
+		std::vector<uint64_t>	due;
+		// move the clock on a ways first
+		w.advance(12345);
+		for (size_t i = 0; i < cnt; ++i) {
+			w.schedule(&m[i], delays[i]);
+			due.push_back(((w.now() + delays[i] + 999) / 1000) * 1000);
+		}
+		std::vector<uint64_t>	order(due);
+		std::sort(order.begin(), order.end());
+		order.erase(std::unique(order.begin(), order.end()), order.end());
+		for (size_t i = 0; !error && (i < order.size()); ++i) {
+			w.advance(order[i] - 1);
+			for (size_t j = 0; j < cnt; ++j) {
+				if ((m[j].fires != 0) && (due[j] >= order[i])) {
+					error = true;
+					std::cout << "ERROR - the timer due at " << due[j] << " fired at " << m[j].firedAt << std::endl;
+				}
+			}
+			w.advance(order[i]);
+		}
+		for (size_t j = 0; !error && (j < cnt); ++j) {
+			if ((m[j].fires != 1) || (m[j].firedAt != due[j])) {
+				error = true;
+				std::cout << "ERROR - the timer due at " << due[j] << " fired " << m[j].fires
+						  << " times, last at " << m[j].firedAt << std::endl;
+			}
+		}
+		if (!error && (w.pending() != 0)) {
+			error = true;
+			std::cout << "ERROR - there are still " << w.pending() << " timers in the wheel" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - " << cnt << " timers, out to " << (order.back() / 1000)
+					  << " ticks, each fired on its tick" << std::endl;
+		}
+	}
+
+	/**
+	 * Next, put in a bunch, cancel every other one, and move a few, and
+	 * check that only the right ones fire - and when.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the timer_wheel cancel and reschedule ===" << std::endl;
+		dkit::util::timer_wheel		w(1000, 0);
+		size_t					cnt = 10000;
+		std::vector<Marker>		m(cnt);
+		std::vector<uint64_t>	due(cnt);
+		srand(42);
+		for (size_t i = 0; i < cnt; ++i) {
+			due[i] = 1000 * (1 + (rand() % 100000));
+			w.schedule_at(&m[i], due[i]);
+		}
+		size_t		cancelled = 0;
+		for (size_t i = 0; i < cnt; i += 2) {
+			cancelled += (w.cancel(&m[i]) ? 1 : 0);
+		}
+		for (size_t i = 1; i < cnt; i += 10) {
+			due[i] = 1000 * (1 + (rand() % 300000));
+			w.schedule_at(&m[i], due[i]);
+		}
+		if ((cancelled != cnt/2) || w.cancel(&m[0]) || (w.pending() != cnt/2)) {
+			error = true;
+			std::cout << "ERROR - cancelled " << cancelled << " of " << (cnt/2)
+					  << ", and " << w.pending() << " are left" << std::endl;
+		}
+		size_t		fired = 0;
+		for (uint64_t t = 0; t <= 300000000; t += 77777) {
+			fired += w.advance(t);
+		}
+		fired += w.advance(300000000);
+		for (size_t i = 0; !error && (i < cnt); ++i) {
+			bool	ok = ((i % 2) == 0 ? (m[i].fires == 0) : ((m[i].fires == 1) && (m[i].firedAt == due[i])));
+			if (!ok) {
+				error = true;
+				std::cout << "ERROR - timer " << i << " fired " << m[i].fires << " times, at "
+						  << m[i].firedAt << " and not " << due[i] << std::endl;
+			}
+		}
+		if (!error && ((fired != cnt/2) || (w.pending() != 0))) {
+			error = true;
+			std::cout << "ERROR - " << fired << " fired, and " << w.pending() << " are left" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - cancelled " << cancelled << ", moved " << (cnt/10)
+					  << ", and the other " << fired << " fired on their ticks" << std::endl;
+		}
+	}
+
+	/**
+	 * Next, a timer that schedules itself again as it fires.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the timer_wheel heartbeat ===" << std::endl;
+		dkit::util::timer_wheel		w(1000, 0);
+		Heartbeat	hb;
+		hb.wheel = &w;
+		hb.period = 10000;
+		hb.beats = 0;
+		w.schedule(&hb, hb.period);
+		for (uint64_t t = 0; t <= 1000000; t += 3000) {
+			w.advance(t);
+		}
+		w.advance(1000000);
+		if ((hb.beats != 100) || !hb.scheduled()) {
+			error = true;
+			std::cout << "ERROR - the 10 msec heartbeat beat " << hb.beats << " times in 1 sec" << std::endl;
+		} else {
+			std::cout << "Passed - the 10 msec heartbeat beat " << hb.beats << " times in 1 sec" << std::endl;
+		}
+		w.cancel(&hb);
+	}
+
+	/**
+	 * Next, have four threads post timers while the wheel's thread moves
+	 * the clock on - and they all have to fire, once.
+	 */
+	if (!error) {
+		std::cout << "=== Testing the timer_wheel posted from 4 threads ===" << std::endl;
+		dkit::util::timer_wheel		w(1000, 0);
+		size_t					per = 25000;
+		std::vector<Marker>		m(4 * per);
+		std::vector<uint64_t>	whens(4 * per);
+		for (size_t i = 0; i < whens.size(); ++i) {
+			whens[i] = 1000 * (i % 5000) + 500;
+		}
+		Poster					p[4];
+		boost::thread			*threads[4];
+		for (uint32_t i = 0; i < 4; ++i) {
+			p[i].wheel = &w;
+			p[i].markers = &m[i * per];
+			p[i].whens = &whens[i * per];
+			p[i].count = per;
+			threads[i] = new boost::thread(p[i]);
+		}
+		size_t		fired = 0;
+		uint64_t	t = 0;
+		while (fired < m.size()) {
+			fired += w.advance(t);
+			t += 1000;
+			sched_yield();
+			if (t > 100000000000ULL) {
+				break;
+			}
+		}
+		for (uint32_t i = 0; i < 4; ++i) {
+			threads[i]->join();
+			delete threads[i];
+		}
+		for (size_t i = 0; !error && (i < m.size()); ++i) {
+			if (m[i].fires != 1) {
+				error = true;
+				std::cout << "ERROR - posted timer " << i << " fired " << m[i].fires << " times" << std::endl;
+			}
+		}
+		if (!error && ((fired != m.size()) || (w.pending() != 0))) {
+			error = true;
+			std::cout << "ERROR - " << fired << " of " << m.size() << " posted timers fired" << std::endl;
+		} else if (!error) {
+			std::cout << "Passed - " << fired << " timers posted from 4 threads all fired once" << std::endl;
+		}
+	}
+
+	/**
+	 * Finally, put a million timers in the wheel, spread over a million
+	 * ticks, and see what it costs to put them in, take them out, and to
+	 * move the clock on a tick at a time - and then the same ticks with
+	 * just a thousand in the wheel.
+	 */
+	if (!error) {
+		std::cout << "=== Timing the timer_wheel with 1M timers ===" << std::endl;
+		size_t		cnt = 1000000;
+		uint64_t	ticks = 65536;
+		std::vector<Marker>		m(cnt);
+		std::vector<uint64_t>	due(cnt);
+		srand(7);
+		for (size_t i = 0; i < cnt; ++i) {
+			due[i] = 1000 * (1 + ((((uint64_t)rand() << 16) ^ rand()) % (1 << 20)));
+		}
+		dkit::util::timer_wheel		*w = new dkit::util::timer_wheel(1000, 0);
+		uint64_t	ins = dkit::util::timer::usecStamp();
+		for (size_t i = 0; i < cnt; ++i) {
+			w->schedule_at(&m[i], due[i]);
+		}
+		ins = dkit::util::timer::usecStamp() - ins;
+		uint64_t	can = dkit::util::timer::usecStamp();
+		for (size_t i = 0; i < cnt; ++i) {
+			w->cancel(&m[i]);
+		}
+		can = dkit::util::timer::usecStamp() - can;
+		for (size_t i = 0; i < cnt; ++i) {
+			w->schedule_at(&m[i], due[i]);
+		}
+		size_t		expect = 0;
+		for (size_t i = 0; i < cnt; ++i) {
+			expect += (due[i] <= 1000 * ticks ? 1 : 0);
+		}
+		size_t		fired = 0;
+		uint64_t	big = dkit::util::timer::usecStamp();
+		for (uint64_t t = 1; t <= ticks; ++t) {
+			fired += w->advance(1000 * t);
+		}
+		big = dkit::util::timer::usecStamp() - big;
+		if ((fired != expect) || (w->pending() != cnt - expect)) {
+			error = true;
+			std::cout << "ERROR - " << fired << " of the " << expect << " timers due fired" << std::endl;
+		}
+		delete w;
+
+		// now the same ticks with just a thousand of them
+		w = new dkit::util::timer_wheel(1000, 0);
+		for (size_t i = 0; i < 1000; ++i) {
+			w->schedule_at(&m[i], due[i]);
+		}
+		uint64_t	small = dkit::util::timer::usecStamp();
+		for (uint64_t t = 1; t <= ticks; ++t) {
+			w->advance(1000 * t);
+		}
+		small = dkit::util::timer::usecStamp() - small;
+		delete w;
+		if (!error) {
+			std::cout << "Passed - " << cnt << " timers: insert " << ((ins * 1000.0)/cnt)
+					  << " ns, cancel " << ((can * 1000.0)/cnt) << " ns" << std::endl;
+			std::cout << "Passed - " << ticks << " ticks: " << ((big * 1000.0)/ticks)
+					  << " ns/tick with 1M pending (" << fired << " fired), "
+					  << ((small * 1000.0)/ticks) << " ns/tick with 1000" << std::endl;
+		}
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -0,0 +1,152 @@
+/**
+ * This is the benchmark of the lookup in the dense trie - the unrolled,
+ * non-virtual, walk that get() uses against the original recursion
+ * through each Component's virtual getNodeForKey(). It's run on packed
+ * keys in order, the same keys in a random order, and sparse random
+ * 64-bit keys - and the two walks have to find the very same Nodes.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "trie.h"
+#include "util/timer.h"
+
+
+class blob {
+	public:
+		blob() : _when(0) { }
+		blob(uint64_t aWhen) : _when(aWhen) { }
+		virtual ~blob() { }
+		uint64_t getValue() const { return _when; }
+	private:
+		uint64_t		_when;
+};
+
+uint64_t key_value( const blob *aValue )
+{
+	return (*aValue).getValue();
+}
+
+
+/**
+ * This is the trie, opened up so that we can call each of the walks.
+ */
+class probe : public dkit::trie<blob *, dkit::uint64_key>
+{
+	public:
+		volatile Node *unrolled( uint64_t aKey )
+		{
+			return getNodeForKey((uint8_t *)&aKey);
+		}
+
+		volatile Node *recursive( uint64_t aKey )
+		{
+			return recurseToNodeForKey((uint8_t *)&aKey);
+		}
+};
+
+
+/**
+ * This looks up all the keys, 'aPasses' times, with each of the walks,
+ * and prints the nsec per lookup for each. It returns 'false' if any key
+ * isn't found, or if the two walks don't find the same Node for it.
+ */
+bool compare( probe & aTrie, const std::vector<uint64_t> & aKeys, uint32_t aPasses, const std::string & aName )
+{
+	bool		error = false;
+	size_t		cnt = aKeys.size();
+	for (size_t i = 0; i < cnt; ++i) {
+		volatile probe::Node	*n = aTrie.unrolled(aKeys[i]);
+		if ((n == NULL) || (n != aTrie.recursive(aKeys[i]))) {
+			error = true;
+			std::cout << "ERROR - the walks didn't agree on key " << aKeys[i] << "!" << std::endl;
+			break;
+		}
+	}
+
+	uintptr_t	sum = 0;
+	uint64_t	unrolledTime = dkit::util::timer::usecStamp();
+	for (uint32_t p = 0; p < aPasses; ++p) {
+		for (size_t i = 0; i < cnt; ++i) {
+			sum += (uintptr_t)aTrie.unrolled(aKeys[i]);
+		}
+	}
+	unrolledTime = dkit::util::timer::usecStamp() - unrolledTime;
+
+	uint64_t	recursiveTime = dkit::util::timer::usecStamp();
+	for (uint32_t p = 0; p < aPasses; ++p) {
+		for (size_t i = 0; i < cnt; ++i) {
+			sum -= (uintptr_t)aTrie.recursive(aKeys[i]);
+		}
+	}
+	recursiveTime = dkit::util::timer::usecStamp() - recursiveTime;
+
+	if (!error && (sum != 0)) {
+		error = true;
+		std::cout << "ERROR - the walks found different Nodes!" << std::endl;
+	}
+	if (!error) {
+		double	u = 1000.0 * unrolledTime / (aPasses * cnt);
+		double	r = 1000.0 * recursiveTime / (aPasses * cnt);
+		std::cout << "Passed - " << aName << ": unrolled " << u << " nsec/get, recursive "
+				  << r << " nsec/get (" << (r / u) << "x)" << std::endl;
+	}
+	return !error;
+}
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	/**
+	 * First, a million packed keys - looked up in order, and then in a
+	 * random order, where most every lookup misses the cache. The trie
+	 * picks the root with the first byte of the key in memory - the low
+	 * byte, on this box - so to fill up the Leafs, and not make a path
+	 * for each key, it's the high bytes that count up.
+	 */
+	if (!error) {
+		std::cout << "=== Timing lookups of packed keys ===" << std::endl;
+		probe		m;
+		uint64_t	cnt = 1000000;
+		std::vector<uint64_t>	keys;
+		uint64_t	goTime = dkit::util::timer::usecStamp();
+		for (uint64_t i = 0; i < cnt; ++i) {
+			m.put(new blob(i << 40));
+			keys.push_back(i << 40);
+		}
+		goTime = dkit::util::timer::usecStamp() - goTime;
+		std::cout << "inserted " << cnt << " keys at " << (1000.0 * goTime / cnt) << " nsec/put" << std::endl;
+		error = !compare(m, keys, 10, "packed keys, in order") || error;
+		srandom(42);
+		std::random_shuffle(keys.begin(), keys.end());
+		error = !compare(m, keys, 10, "packed keys, shuffled") || error;
+	}
+
+	/**
+	 * Then sparse random keys - where each one has a path of its own
+	 */
+	if (!error) {
+		std::cout << "=== Timing lookups of sparse random keys ===" << std::endl;
+		probe		m;
+		uint64_t	cnt = 4000;
+		std::vector<uint64_t>	keys;
+		srandom(42);
+		for (uint64_t i = 0; i < cnt; ++i) {
+			uint64_t	k = (((uint64_t)random() << 33) ^ ((uint64_t)random() << 11) ^ (uint64_t)random());
+			m.put(new blob(k));
+			keys.push_back(k);
+		}
+		error = !compare(m, keys, 250, "sparse random keys") || error;
+	}
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}
@@ -0,0 +1,364 @@
+/**
+ * This is the tests for the saved images of the trie - that a trie mapped
+ * from what save() wrote has every value, in the same order, and nothing
+ * else, that it's read-only until it's cleared, that an image for the
+ * wrong kind of trie is turned away, and that a corrupt one throws, rather
+ * than crashing, when it's used. Then it's the benchmark of starting
+ * up with a million values - put() for each, against mapping the image -
+ * and of lookups in the trie, and in the mapping.
+ */
+//	System Headers
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//	Third-Party Headers
+
+//	Other Headers
+#include "trie.h"
+#include "util/timer.h"
+
+
+/**
+ * This is the reference data for an instrument - all plain data, so the
+ * trie can hold it by value, and save it.
+ */
+struct instrument {
+	uint64_t	id;
+	uint32_t	lotSize;
+	uint32_t	tickSize;
+	char		symbol[16];
+};
+
+uint64_t key_value( const instrument & aValue )
+{
+	return aValue.id;
+}
+
+typedef dkit::trie<instrument, dkit::uint64_key, dkit::dense_trie, dkit::ordered_keys>	ref_t;
+typedef dkit::trie<instrument, dkit::uint32_key, dkit::dense_trie, dkit::ordered_keys>	small_t;
+
+
+/**
+ * This makes the instrument with the id, and checks that one is right.
+ */
+instrument make_instrument( uint64_t anId )
+{
+	instrument	i;
+	memset(&i, 0, sizeof(i));
+	i.id = anId;
+	i.lotSize = (uint32_t)(anId % 1000) + 1;
+	i.tickSize = (uint32_t)(anId % 7) + 1;
+	snprintf(i.symbol, sizeof(i.symbol), "S%llu", (unsigned long long)anId);
+	return i;
+}
+
+bool right( const instrument & anInst, uint64_t anId )
+{
+	instrument	i = make_instrument(anId);
+	return (memcmp(&anInst, &i, sizeof(i)) == 0);
+}
+
+/**
+ * The ids are in runs, spread out over the key space, so that there's
+ * more than one path through the image.
+ */
+uint64_t id_for( uint64_t i )
+{
+	return (((i / 50000) << 36) | (i % 50000));
+}
+
+
+/**
+ * This writes 'aLength' bytes over the file at 'anOffset' - to corrupt an
+ * image that's been saved.
+ */
+void patch( const char *aPath, uint64_t anOffset, const void *aData, size_t aLength )
+{
+	FILE	*fp = fopen(aPath, "r+b");
+	if (fp != NULL) {
+		fseek(fp, (long)anOffset, SEEK_SET);
+		fwrite(aData, 1, aLength, fp);
+		fclose(fp);
+	}
+}
+
+
+/**
+ * This functor keeps the ids it's handed, in order.
+ */
+class collector : public ref_t::functor
+{
+	public:
+		collector() : ids() { }
+		virtual ~collector() { }
+		virtual bool process( volatile ref_t::Node & aNode )
+		{
+			instrument	i;
+			const_cast<ref_t::Node &>(aNode).copy(i);
+			ids.push_back(i.id);
+			return true;
+		}
+		std::vector<uint64_t>	ids;
+};
+
+
+int main(int argc, char *argv[]) {
+	bool	error = false;
+
+	char		path[64];
+	snprintf(path, sizeof(path), "/tmp/trie_image.%d", (int)getpid());
+
+	/**
+	 * First, a small one - saved, mapped, and checked against the trie
+	 * it came from
+	 */
+	if (!error) {
+		std::cout << "=== Testing save() and map() ===" << std::endl;
+		ref_t		m;
+		for (uint64_t i = 0; i < 200000; i += 3) {
+			m.put(make_instrument(id_for(i)));
+		}
+		m.save(path);
+		ref_t		img;
+		img.map(path);
+		instrument	inst;
+		for (uint64_t i = 0; !error && (i < 200000); ++i) {
+			bool	there = img.get(id_for(i), inst);
+			if ((there != ((i % 3) == 0)) || (there && !right(inst, id_for(i))) ||
+				(img.exists(id_for(i)) != there)) {
+				error = true;
+				std::cout << "ERROR - the mapped trie got id " << id_for(i) << " wrong!" << std::endl;
+			}
+		}
+		collector	live;
+		collector	mapped;
+		m.apply(live);
+		img.apply(mapped);
+		if (!error && (img.mapped() && (img.size() == m.size()) && !img.empty() && (live.ids == mapped.ids))) {
+			std::cout << "Passed - all " << img.size() << " values are in the image, in order" << std::endl;
+		} else if (!error) {
+			error = true;
+			std::cout << "ERROR - the image has " << img.size() << " values, not " << m.size() << "!" << std::endl;
+		}
+
+		// a mapped trie can be saved as well - it's the same image
+		if (!error) {
+			std::string		again = std::string(path) + ".again";
+			img.save(again);
+			ref_t			img2;
+			img2.map(again);
+			collector		mapped2;
+			img2.apply(mapped2);
+			unlink(again.c_str());
+			if (mapped2.ids != live.ids) {
+				error = true;
+				std::cout << "ERROR - the image of the mapped trie is different!" << std::endl;
+			}
+		}
+
+		// it's read-only until it's cleared
+		if (!error) {
+			bool	thrown = false;
+			try {
+				img.put(make_instrument(7));
+			} catch (std::runtime_error & e) {
+				thrown = true;
+			}
+			img.clear();
+			img.put(make_instrument(7));
+			if (thrown && !img.mapped() && (img.size() == 1) && img.get((uint64_t)7, inst) && right(inst, 7)) {
+				std::cout << "Passed - the mapped trie was read-only, until it was cleared" << std::endl;
+			} else {
+				error = true;
+				std::cout << "ERROR - the mapped trie wasn't read-only, or clear() didn't unmap it!" << std::endl;
+			}
+		}
+	}
+
+	/**
+	 * An empty trie is an image, too, and an image of the wrong kind
+	 * of trie, or no image at all, is turned away
+	 */
+	if (!error) {
+		ref_t		m;
+		m.save(path);
+		ref_t		img;
+		img.map(path);
+		instrument	inst;
+		bool		good = img.empty() && (img.size() == 0) && !img.get((uint64_t)1, inst);
+		small_t		other;
+		bool		wrongKey = false;
+		try {
+			other.map(path);
+		} catch (std::runtime_error & e) {
+			wrongKey = true;
+		}
+		bool		missing = false;
+		try {
+			img.map(std::string(path) + ".missing");
+		} catch (std::runtime_error & e) {
+			missing = true;
+		}
+		if (good && wrongKey && missing && img.mapped()) {
+			std::cout << "Passed - an empty image mapped, and the wrong, or missing, ones didn't" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - the empty, wrong or missing images weren't handled right!" << std::endl;
+		}
+	}
+
+	/**
+	 * A corrupt image gets past map() - it only checks the header - but
+	 * an offset, or a place, in it that points past the end has to throw
+	 * when it's walked. All the ids are under 2^40, so the root block has
+	 * just the one entry, for the top byte of zero, and it's written last.
+	 */
+	if (!error) {
+		std::cout << "=== Testing corrupt images ===" << std::endl;
+		ref_t		m;
+		for (uint64_t i = 0; i < 1000; ++i) {
+			m.put(make_instrument(id_for(i)));
+		}
+		m.save(path);
+		dkit::trie_util::image_header	hdr;
+		FILE	*fp = fopen(path, "rb");
+		if ((fp == NULL) || (fread(&hdr, sizeof(hdr), 1, fp) != 1)) {
+			error = true;
+		}
+		if (fp != NULL) {
+			fclose(fp);
+		}
+		uint64_t	root = (hdr.root & ~((uint64_t)0x01));
+		instrument	inst;
+
+		// the place of a byte that's not there says it's past the end
+		uint8_t		place = 255;
+		patch(path, (root + 0xff), &place, 1);
+		bool		badPlace = false;
+		bool		goodStill = false;
+		{
+			ref_t	img;
+			img.map(path);
+			goodStill = img.get(id_for(7), inst) && right(inst, id_for(7));
+			try {
+				img.get((uint64_t)0xff00000000000000ULL, inst);
+			} catch (std::runtime_error & e) {
+				badPlace = true;
+			}
+		}
+
+		// the one offset in the root points way off the end
+		uint64_t	off = (1ULL << 40);
+		patch(path, (root + 256), &off, sizeof(off));
+		bool		badGet = false;
+		bool		badApply = false;
+		{
+			ref_t	img;
+			img.map(path);
+			try {
+				img.get(id_for(7), inst);
+			} catch (std::runtime_error & e) {
+				badGet = true;
+			}
+			collector	c;
+			try {
+				img.apply(c);
+			} catch (std::runtime_error & e) {
+				badApply = true;
+			}
+		}
+		if (!error && goodStill && badPlace && badGet && badApply) {
+			std::cout << "Passed - the corrupt places and offsets threw, and the good ones still worked" << std::endl;
+		} else {
+			error = true;
+			std::cout << "ERROR - a corrupt image didn't throw when it was walked!" << std::endl;
+		}
+	}
+
+	/**
+	 * Then the benchmark - a million instruments, built up with put()
+	 * and mapped from the image, and then lookups in a random order
+	 */
+	if (!error) {
+		std::cout << "=== Timing the start-up, and lookups, with a million values ===" << std::endl;
+		uint64_t	cnt = 1000000;
+		std::vector<uint64_t>	ids;
+		for (uint64_t i = 0; i < cnt; ++i) {
+			ids.push_back(id_for(i));
+		}
+		srandom(42);
+		std::random_shuffle(ids.begin(), ids.end());
+
+		ref_t		*live = new ref_t();
+		uint64_t	putTime = dkit::util::timer::usecStamp();
+		for (uint64_t i = 0; i < cnt; ++i) {
+			live->put(make_instrument(id_for(i)));
+		}
+		putTime = dkit::util::timer::usecStamp() - putTime;
+
+		uint64_t	saveTime = dkit::util::timer::usecStamp();
+		live->save(path);
+		saveTime = dkit::util::timer::usecStamp() - saveTime;
+		struct stat		st;
+		stat(path, &st);
+
+		ref_t		img;
+		uint64_t	mapTime = dkit::util::timer::usecStamp();
+		img.map(path);
+		mapTime = dkit::util::timer::usecStamp() - mapTime;
+
+		// the first pass pages it all in, and the next ones are the lookups
+		instrument	inst;
+		uint64_t	firstTime = dkit::util::timer::usecStamp();
+		for (uint64_t i = 0; i < cnt; ++i) {
+			if (!img.get(ids[i], inst) || (inst.id != ids[i])) {
+				error = true;
+			}
+		}
+		firstTime = dkit::util::timer::usecStamp() - firstTime;
+
+		uint32_t	passes = 3;
+		uint64_t	sum = 0;
+		uint64_t	liveTime = dkit::util::timer::usecStamp();
+		for (uint32_t p = 0; p < passes; ++p) {
+			for (uint64_t i = 0; i < cnt; ++i) {
+				live->get(ids[i], inst);
+				sum += inst.lotSize;
+			}
+		}
+		liveTime = dkit::util::timer::usecStamp() - liveTime;
+		uint64_t	imgTime = dkit::util::timer::usecStamp();
+		for (uint32_t p = 0; p < passes; ++p) {
+			for (uint64_t i = 0; i < cnt; ++i) {
+				img.get(ids[i], inst);
+				sum -= inst.lotSize;
+			}
+		}
+		imgTime = dkit::util::timer::usecStamp() - imgTime;
+		delete live;
+
+		if (error || (sum != 0)) {
+			error = true;
+			std::cout << "ERROR - the mapped trie didn't find the same values!" << std::endl;
+		} else {
+			std::cout << "Passed - start-up: put() of each " << (putTime / 1000.0) << " msec, map() "
+					  << (mapTime / 1000.0) << " msec, then a first pass of get() "
+					  << (firstTime / 1000.0) << " msec (save() took " << (saveTime / 1000.0) << " msec, for "
+					  << (st.st_size / (1024.0 * 1024.0)) << " MB)" << std::endl;
+			std::cout << "Passed - random lookups: the trie " << (1000.0 * liveTime / (passes * cnt))
+					  << " nsec/get, the image " << (1000.0 * imgTime / (passes * cnt)) << " nsec/get" << std::endl;
+		}
+	}
+
+	unlink(path);
+
+	std::cout << (error ? "FAILED!" : "SUCCESS") << std::endl;
+	return (error ? 1 : 0);
+}